@@ -30,8 +30,14 @@
 #define LOG_TAG "agm_client_wrapper"
 
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <agm/agm_api.h>
+#include <agm/shm_ring.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include "utils.h"
 
 #define AGM_OBJECT_PATH "/org/qti/agm"
@@ -40,11 +46,25 @@
 #define AGM_DBUS_CONNECTION "org.Qti.AgmService"
 #define AGM_MAX_G_OBJ_PATH 128
 
+/* a ring wait gives up after as long as a default D-Bus call would */
+#ifndef AGM_SHM_RING_TIMEOUT_MS
+#define AGM_SHM_RING_TIMEOUT_MS 25000
+#endif
+
 typedef struct {
     GDBusConnection *conn;
     GDBusProxy *proxy;
     char g_obj_path[AGM_MAX_G_OBJ_PATH];
     GHashTable *ses_hash_table;
+    /* One loop thread and one AgmEventCb subscription serve every
+       session; signal_hash_table maps a session object path to its
+       session data and, like the callback lists, is under signal_lock. */
+    GMutex signal_lock;
+    GMainContext *signal_ctx;
+    GMainLoop *signal_loop;
+    GThread *signal_thread;
+    guint signal_sub_id;
+    GHashTable *signal_hash_table;
 } agm_client_module_data;
 
 typedef struct {
@@ -52,9 +72,18 @@ typedef struct {
     GDBusProxy *proxy;
     char *obj_path;
     uint32_t session_id;
-    GThread *thread_loop;
-    GMainLoop *loop;
     GList *callbacks;
+    /* Data ring, set up by the first read or write which fixes its
+       direction. Sessions the service refuses a ring stay on D-Bus, as do
+       sessions opened with AGM_IPC_DATA_SHM=0 in the environment. */
+    GMutex ring_lock;
+    struct agm_shm_ring *ring;
+    size_t ring_map_size;
+    uint32_t ring_size;
+    uint32_t ring_dir;
+    int ring_srv_efd;
+    int ring_clt_efd;
+    gboolean ring_disabled;
 } agm_client_session_data;
 
 typedef struct {
@@ -62,15 +91,24 @@ typedef struct {
     void *client_data;
     agm_event_cb cb;
     uint32_t evt_type;
-    guint sub_id_callback_event;
 } agm_callback_data;
 
 static agm_client_module_data *mdata = NULL;
 
+/*
+ * agm serves on the system bus; AGM_DBUS_BUS=session moves client and
+ * server to the session bus, e.g. to run them as an unprivileged user.
+ */
+static GBusType get_dbus_bus_type() {
+    if (g_strcmp0(g_getenv("AGM_DBUS_BUS"), "session") == 0)
+        return G_BUS_TYPE_SESSION;
+    return G_BUS_TYPE_SYSTEM;
+}
+
 static GDBusConnection *get_dbus_connection() {
     GError *error = NULL;
     GDBusConnection *conn = NULL;
-    conn = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+    conn = g_bus_get_sync(get_dbus_bus_type(), NULL, &error);
 
     if (conn == NULL) {
         AGM_LOGE("%s: Error in getting dbus connection: %s", __func__,
@@ -138,6 +176,8 @@ static int initialize_module_data() {
                "%s", AGM_OBJECT_PATH);
 
     mdata->ses_hash_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_mutex_init(&mdata->signal_lock);
+    mdata->signal_hash_table = g_hash_table_new(g_str_hash, g_str_equal);
     return rc;
 }
 
@@ -148,7 +188,10 @@ static void on_emit_signal_callback(GDBusConnection *conn,
                                     const gchar *signal_name,
                                     GVariant *parameters,
                                     gpointer data) {
-    agm_callback_data *cb_data = (agm_callback_data *)data;
+    agm_client_session_data *ses_data;
+    agm_callback_data *cbs = NULL;
+    GList *node;
+    guint n_cbs = 0, i;
     GVariant *array_v;
     GVariantIter arg_i;
     struct agm_event_cb_params event_params;
@@ -159,6 +202,23 @@ static void on_emit_signal_callback(GDBusConnection *conn,
 
     AGM_LOGD("%s\n", __func__);
 
+    /* Take a copy of the callbacks so that they run unlocked and may
+       register or deregister callbacks themselves. */
+    g_mutex_lock(&mdata->signal_lock);
+    ses_data = (agm_client_session_data *)
+                g_hash_table_lookup(mdata->signal_hash_table, object_path);
+    if (ses_data != NULL) {
+        cbs = g_new(agm_callback_data, g_list_length(ses_data->callbacks));
+        for (node = ses_data->callbacks; node != NULL; node = node->next)
+            cbs[n_cbs++] = *(agm_callback_data *)node->data;
+    }
+    g_mutex_unlock(&mdata->signal_lock);
+
+    if (n_cbs == 0) {
+        g_free(cbs);
+        return;
+    }
+
     g_variant_iter_init(&arg_i, parameters);
     g_variant_iter_next(&arg_i, "u", &event_params.source_module_id);
     g_variant_iter_next(&arg_i, "u", &event_params.event_id);
@@ -175,98 +235,121 @@ static void on_emit_signal_callback(GDBusConnection *conn,
     event_params_l->event_id = event_params.event_id;
     event_params_l->event_payload_size = event_params.event_payload_size;
 
-    cb_data->cb(cb_data->session_id, event_params_l, cb_data->client_data);
+    for (i = 0; i < n_cbs; i++)
+        cbs[i].cb(cbs[i].session_id, event_params_l, cbs[i].client_data);
+    g_free(cbs);
 }
 
 static void free_callbacks(agm_client_session_data *ses_data) {
     GList *node;
-    agm_callback_data *cb_data;
     g_assert(mdata != NULL);
 
+    g_mutex_lock(&mdata->signal_lock);
+    if (ses_data->obj_path != NULL)
+        g_hash_table_remove(mdata->signal_hash_table, ses_data->obj_path);
+
     for (node = ses_data->callbacks; node != NULL; node = node->next) {
         if (node->data != NULL) {
-            cb_data = (agm_callback_data *)node->data;
-            g_dbus_connection_signal_unsubscribe(mdata->conn,
-                                              cb_data->sub_id_callback_event);
             free(node->data);
             node->data = NULL;
         }
     }
 
     g_list_free(ses_data->callbacks);
+    ses_data->callbacks = NULL;
+    g_mutex_unlock(&mdata->signal_lock);
 }
 
-static int subscribe_callback_event(agm_client_session_data *ses_data,
-                                    bool subscribe,
-                                    agm_callback_data *cb_data) {
-    GVariant *result;
+static gpointer signal_threadloop(gpointer cookie) {
+    AGM_LOGD("initiate main loop run for callbacks");
+    g_main_context_push_thread_default(mdata->signal_ctx);
+    g_main_loop_run(mdata->signal_loop);
+    g_main_context_pop_thread_default(mdata->signal_ctx);
+    AGM_LOGD("out of main loop\n");
+    return NULL;
+}
+
+/* Starts the client wide event loop on first use, with signal_lock held.
+   The loop lives as long as the process, like the module data. */
+static int start_signal_loop_l() {
     GError *error = NULL;
-    gint ret = 0;
-    GHashTableIter iter;
-    gpointer key, value;
-    GList *node = NULL;
-    agm_callback_data *node_data = NULL;
 
-    AGM_LOGD("%s\n", __func__);
-    g_assert(mdata != NULL);
-    g_assert(cb_data != NULL);
+    if (mdata->signal_thread != NULL)
+        return 0;
 
-    if (subscribe) {
-        cb_data->sub_id_callback_event = g_dbus_connection_signal_subscribe(
+    mdata->signal_ctx = g_main_context_new();
+    mdata->signal_loop = g_main_loop_new(mdata->signal_ctx, FALSE);
+
+    /* signals are dispatched in the context current at subscribe time */
+    g_main_context_push_thread_default(mdata->signal_ctx);
+    mdata->signal_sub_id = g_dbus_connection_signal_subscribe(
                                           mdata->conn,
                                           NULL,
                                           AGM_SESSION_IFACE,
                                           "AgmEventCb",
-                                          ses_data->obj_path,
+                                          NULL,
                                           NULL,
                                           G_DBUS_SIGNAL_FLAGS_NONE,
                                           on_emit_signal_callback,
-                                          cb_data,
+                                          NULL,
                                           NULL);
+    g_main_context_pop_thread_default(mdata->signal_ctx);
 
-        ses_data->callbacks = g_list_prepend(ses_data->callbacks, cb_data);
-    } else {
-        for (node = ses_data->callbacks; node != NULL; node = node->next) {
-            node_data = (agm_callback_data *)node->data;
-            if (node_data != NULL) {
-                if (node_data->session_id == cb_data->session_id &&
-                    node_data->evt_type == cb_data->evt_type &&
-                    node_data->sub_id_callback_event ==
-                                             cb_data->sub_id_callback_event) {
-                        g_dbus_connection_signal_unsubscribe(mdata->conn,
-                                               cb_data->sub_id_callback_event);
-                        ses_data->callbacks = g_list_remove(
-                                                           ses_data->callbacks,
-                                                           node_data);
-                        free(node_data);
-                        node_data = NULL;
-                        break;
-                }
-            }
-        }
+    mdata->signal_thread = g_thread_try_new("agm_event_loop",
+                                            signal_threadloop, NULL, &error);
+    if (mdata->signal_thread == NULL) {
+        AGM_LOGE("Could not create event loop thread, error %s\n",
+                  error->message);
+        g_error_free(error);
+        g_dbus_connection_signal_unsubscribe(mdata->conn,
+                                             mdata->signal_sub_id);
+        g_main_loop_unref(mdata->signal_loop);
+        g_main_context_unref(mdata->signal_ctx);
+        mdata->signal_loop = NULL;
+        mdata->signal_ctx = NULL;
+        return -EINVAL;
     }
-
     return 0;
 }
 
-static void *signal_threadloop(void *cookie) {
-    agm_client_session_data *ses_data = (agm_client_session_data *)cookie;
-
-    AGM_LOGD("Enter %s %p\n", __func__, ses_data);
-    if (!ses_data) {
-        AGM_LOGE("Invalid thread params");
-        goto exit;
-    }
+static int subscribe_callback_event(agm_client_session_data *ses_data,
+                                    bool subscribe,
+                                    agm_callback_data *cb_data) {
+    GList *node = NULL;
+    agm_callback_data *node_data = NULL;
+    int ret = 0;
 
-    ses_data->loop = g_main_loop_new(NULL, FALSE);
-    AGM_LOGD("initiate main loop run for callbacks");
-    g_main_loop_run(ses_data->loop);
+    AGM_LOGD("%s\n", __func__);
+    g_assert(mdata != NULL);
+    g_assert(cb_data != NULL);
 
-    AGM_LOGD("out of main loop\n");
-    g_main_loop_unref(ses_data->loop);
+    g_mutex_lock(&mdata->signal_lock);
+    if (subscribe) {
+        ret = start_signal_loop_l();
+        if (ret == 0) {
+            ses_data->callbacks = g_list_prepend(ses_data->callbacks, cb_data);
+            g_hash_table_insert(mdata->signal_hash_table, ses_data->obj_path,
+                                ses_data);
+        }
+    } else {
+        for (node = ses_data->callbacks; node != NULL; node = node->next) {
+            node_data = (agm_callback_data *)node->data;
+            if (node_data != NULL &&
+                node_data->session_id == cb_data->session_id &&
+                node_data->evt_type == cb_data->evt_type &&
+                node_data->client_data == cb_data->client_data) {
+                ses_data->callbacks = g_list_remove(ses_data->callbacks,
+                                                    node_data);
+                free(node_data);
+                break;
+            }
+        }
+        if (ses_data->callbacks == NULL)
+            g_hash_table_remove(mdata->signal_hash_table, ses_data->obj_path);
+    }
+    g_mutex_unlock(&mdata->signal_lock);
 
-exit:
-    return NULL;
+    return ret;
 }
 
 static int agm_session_deregister_cb(uint32_t session_id,
@@ -353,6 +436,7 @@ static int agm_session_deregister_cb(uint32_t session_id,
     cb_data->client_data = client_data;
     cb_data->session_id = session_id;
     cb_data->cb = NULL;
+    cb_data->evt_type = evt_type;
 
     if (subscribe_callback_event(ses_data, false, cb_data)) {
         AGM_LOGE("Unable to subscribe for callback event\n");
@@ -381,7 +465,6 @@ int agm_session_register_cb(uint32_t session_id,
     agm_client_session_data *ses_data = NULL;
     char *obj_path = NULL;
     agm_callback_data *cb_data;
-    gchar thread_name[16] = "";
     uint64_t data;
 
     AGM_LOGD("%s\n", __func__);
@@ -447,18 +530,6 @@ int agm_session_register_cb(uint32_t session_id,
         }
 
         ses_data->session_id = session_id;
-        snprintf(thread_name, sizeof(thread_name), "agm_loop_%d", session_id);
-        AGM_LOGE("create thread %s\n", thread_name);
-        ses_data->thread_loop = g_thread_try_new(thread_name, signal_threadloop,
-                                ses_data, &error);
-        if (!ses_data->thread_loop) {
-            rc = -EINVAL;
-            AGM_LOGE("Could not create thread %s, error %s\n", thread_name,
-                      error->message);
-            g_error_free(error);
-            g_free(ses_data);
-            goto exit;
-        }
         /* add session to sessions hash table */
         g_hash_table_insert(mdata->ses_hash_table,
                             GINT_TO_POINTER(ses_data->session_id),
@@ -473,9 +544,7 @@ int agm_session_register_cb(uint32_t session_id,
 
     if (subscribe_callback_event(ses_data, true, cb_data)) {
         AGM_LOGE("Unable to subscribe for callback event\n");
-        g_error_free(error);
-        g_free(ses_data);
-        g_free(cb_data);
+        free(cb_data);
         rc = -EINVAL;
     }
 
@@ -1485,15 +1554,169 @@ int agm_session_set_config(uint64_t handle,
     return 0;
 }
 
+static void client_ring_unmap(agm_client_session_data *ses_data) {
+    if (ses_data->ring == NULL)
+        return;
+
+    munmap(ses_data->ring, ses_data->ring_map_size);
+    close(ses_data->ring_srv_efd);
+    close(ses_data->ring_clt_efd);
+    ses_data->ring = NULL;
+}
+
+static int client_ring_setup(agm_client_session_data *ses_data, uint32_t dir) {
+    GVariant *result = NULL;
+    GUnixFDList *fd_list = NULL;
+    GError *error = NULL;
+    gint32 idx[3];
+    int fds[3] = {-1, -1, -1};
+    struct agm_shm_ring *ring = NULL;
+    struct stat st;
+    void *addr = NULL;
+    uint32_t size;
+    int i, rc = 0;
+
+    result = g_dbus_proxy_call_with_unix_fd_list_sync(ses_data->proxy,
+                                    "AgmSessionShmRing",
+                                    g_variant_new("(u)", dir),
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &fd_list,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGI("%s: No ring from the service: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -ENOSYS;
+    }
+
+    g_variant_get(result, "(hhh)", &idx[0], &idx[1], &idx[2]);
+    for (i = 0; i < 3; i++) {
+        if (fd_list != NULL)
+            fds[i] = g_unix_fd_list_get(fd_list, idx[i], NULL);
+        if (fds[i] < 0)
+            rc = -EINVAL;
+    }
+    if (fd_list != NULL)
+        g_object_unref(fd_list);
+    g_variant_unref(result);
+    if (rc)
+        goto exit;
+
+    if (fstat(fds[0], &st) < 0 ||
+        st.st_size <= (off_t)sizeof(struct agm_shm_ring)) {
+        rc = -EINVAL;
+        goto exit;
+    }
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fds[0], 0);
+    if (addr == MAP_FAILED) {
+        rc = -errno;
+        goto exit;
+    }
+
+    ring = (struct agm_shm_ring *)addr;
+    size = ring->size;
+    if (!size || (size & (size - 1)) ||
+        size > st.st_size - sizeof(struct agm_shm_ring) || ring->dir != dir) {
+        AGM_LOGE("%s: bad ring, size %u dir %u\n", __func__, size, ring->dir);
+        munmap(addr, st.st_size);
+        rc = -EINVAL;
+        goto exit;
+    }
+
+    ses_data->ring = ring;
+    ses_data->ring_map_size = st.st_size;
+    ses_data->ring_size = size;
+    ses_data->ring_dir = dir;
+    ses_data->ring_srv_efd = fds[1];
+    ses_data->ring_clt_efd = fds[2];
+    fds[1] = fds[2] = -1;
+
+exit:
+    /* the mapping keeps the memory, only the doorbells are needed */
+    for (i = 0; i < 3; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    return rc;
+}
+
+static int client_ring_wait(void *priv) {
+    agm_client_session_data *ses_data = (agm_client_session_data *)priv;
+    struct pollfd pfd = { ses_data->ring_clt_efd, POLLIN, 0 };
+    uint64_t val;
+    int ret;
+
+    ret = poll(&pfd, 1, AGM_SHM_RING_TIMEOUT_MS);
+    /* the call is left in flight, so the ring cannot be trusted any more */
+    if (ret == 0) {
+        AGM_LOGE("%s: no answer on the ring of session %d in %d ms\n",
+                 __func__, ses_data->session_id, AGM_SHM_RING_TIMEOUT_MS);
+        return -AGM_SHM_RING_EBROKEN;
+    }
+    if (ret < 0)
+        return errno == EINTR ? 0 : -errno;
+    if (read(ses_data->ring_clt_efd, &val, sizeof(val)) < 0 && errno != EINTR)
+        return -errno;
+    return 0;
+}
+
+/*
+ * Moves one read or write through the session ring. Returns -ENOSYS when
+ * the call has to go over D-Bus instead: no ring, a ring set up for the
+ * other direction, or more data than the ring holds. A ring that stalled
+ * or broke is given up on for the rest of the session.
+ */
+static int client_ring_transfer(agm_client_session_data *ses_data, void *buf,
+                                size_t *byte_count, uint32_t dir) {
+    int rc = -ENOSYS;
+
+    if (*byte_count > UINT32_MAX)
+        return -ENOSYS;
+
+    g_mutex_lock(&ses_data->ring_lock);
+    if (ses_data->ring == NULL && !ses_data->ring_disabled &&
+        client_ring_setup(ses_data, dir) != 0)
+        ses_data->ring_disabled = TRUE;
+    if (ses_data->ring_disabled || ses_data->ring_dir != dir)
+        goto exit;
+
+    if (dir == AGM_SHM_RING_WRITE)
+        rc = agm_shm_ring_client_write(ses_data->ring, ses_data->ring_size,
+                                       ses_data->ring_srv_efd, buf,
+                                       byte_count, client_ring_wait, ses_data);
+    else
+        rc = agm_shm_ring_client_read(ses_data->ring, ses_data->ring_size,
+                                      ses_data->ring_srv_efd, buf,
+                                      byte_count, client_ring_wait, ses_data);
+    if (rc == -AGM_SHM_RING_EBROKEN) {
+        AGM_LOGE("%s: ring failed %d, session %d goes back to D-Bus\n",
+                  __func__, rc, ses_data->session_id);
+        ses_data->ring_disabled = TRUE;
+    }
+exit:
+    g_mutex_unlock(&ses_data->ring_lock);
+    return rc;
+}
+
 int agm_session_write(uint64_t handle, void *buf, size_t *byte_count) {
     agm_client_session_data *ses_data = (agm_client_session_data *) handle;
     GVariant *result = NULL, *arr = NULL, *argument = NULL;
     GError *error = NULL;
+    int rc;
 
     g_assert(ses_data != NULL);
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    rc = client_ring_transfer(ses_data, buf, byte_count, AGM_SHM_RING_WRITE);
+    if (rc != -ENOSYS)
+        return rc;
+
     arr = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
                                     (gconstpointer)buf,
                                     *byte_count,
@@ -1529,11 +1752,16 @@ int agm_session_read(uint64_t handle, void *buf, size_t *byte_count) {
     gconstpointer value;
     gsize n_elements;
     gsize element_size = sizeof(guchar);
+    int rc;
 
     g_assert(ses_data != NULL);
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    rc = client_ring_transfer(ses_data, buf, byte_count, AGM_SHM_RING_READ);
+    if (rc != -ENOSYS)
+        return rc;
+
     argument = g_variant_new("(@u)", g_variant_new_uint32(*byte_count));
 
     result = g_dbus_proxy_call_sync(ses_data->proxy,
@@ -1566,6 +1794,114 @@ int agm_session_read(uint64_t handle, void *buf, size_t *byte_count) {
     return 0;
 }
 
+int agm_session_writev(uint64_t handle, const struct iovec *iov, int iovcnt,
+                       size_t *count) {
+    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
+    GVariant *result = NULL, *sizes = NULL, *arr = NULL;
+    GError *error = NULL;
+    uint32_t seg_sizes[AGM_SESSION_IOV_MAX];
+    guint64 written = 0;
+    size_t size = 0, offset = 0;
+    guchar *buf;
+    int i;
+
+    g_assert(ses_data != NULL);
+    g_assert(ses_data->proxy != NULL);
+    AGM_LOGD("%s\n", __func__);
+
+    if (iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+
+    for (i = 0; i < iovcnt; i++) {
+        seg_sizes[i] = (uint32_t)iov[i].iov_len;
+        size += iov[i].iov_len;
+    }
+    /*packed into one message, the service writes from it in place*/
+    buf = (guchar *)g_malloc(size ? size : 1);
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(buf + offset, iov[i].iov_base, iov[i].iov_len);
+        offset += iov[i].iov_len;
+    }
+    sizes = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, seg_sizes,
+                                      iovcnt, sizeof(uint32_t));
+    arr = g_variant_new_from_data(G_VARIANT_TYPE_BYTESTRING, buf, size,
+                                  TRUE, g_free, buf);
+
+    result = g_dbus_proxy_call_sync(ses_data->proxy,
+                                    "AgmSessionWritev",
+                                    g_variant_new("(@au@ay)", sizes, arr),
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionWritev: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
+
+    g_variant_get(result, "(t)", &written);
+    *count = (size_t)written;
+    g_variant_unref(result);
+    return 0;
+}
+
+int agm_session_readv(uint64_t handle, const struct iovec *iov, int iovcnt,
+                      size_t *count) {
+    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
+    GVariant *result = NULL, *sizes = NULL, *val_arr = NULL;
+    GError *error = NULL;
+    uint32_t seg_sizes[AGM_SESSION_IOV_MAX];
+    const guchar *value;
+    gsize n_elements, offset = 0, len;
+    int i;
+
+    g_assert(ses_data != NULL);
+    g_assert(ses_data->proxy != NULL);
+    AGM_LOGD("%s\n", __func__);
+
+    if (iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+
+    for (i = 0; i < iovcnt; i++)
+        seg_sizes[i] = (uint32_t)iov[i].iov_len;
+    sizes = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, seg_sizes,
+                                      iovcnt, sizeof(uint32_t));
+
+    result = g_dbus_proxy_call_sync(ses_data->proxy,
+                                    "AgmSessionReadv",
+                                    g_variant_new("(@au)", sizes),
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionReadv: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
+
+    val_arr = g_variant_get_child_value(result, 0);
+    value = (const guchar *)g_variant_get_fixed_array(val_arr, &n_elements,
+                                                      sizeof(guchar));
+    for (i = 0; i < iovcnt && offset < n_elements; i++) {
+        len = n_elements - offset;
+        if (len > iov[i].iov_len)
+            len = iov[i].iov_len;
+        memcpy(iov[i].iov_base, value + offset, len);
+        offset += len;
+    }
+    *count = offset;
+
+    g_variant_unref(val_arr);
+    g_variant_unref(result);
+    return 0;
+}
+
 int agm_session_resume(uint64_t handle) {
     agm_client_session_data *ses_data = (agm_client_session_data *) handle;
     GVariant *result = NULL;
@@ -1678,6 +2014,38 @@ int agm_session_start(uint64_t handle) {
     return 0;
 }
 
+int agm_session_async_op(uint64_t handle, enum agm_session_async_op op,
+                         uint64_t token) {
+    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
+    GVariant *result = NULL;
+    GError *error = NULL;
+
+    g_assert(ses_data != NULL);
+    g_assert(ses_data->proxy != NULL);
+    AGM_LOGD("%s op %d\n", __func__, op);
+
+    if (op == AGM_SESSION_OP_CLOSE)
+        return -EOPNOTSUPP;
+
+    result = g_dbus_proxy_call_sync(ses_data->proxy,
+                                    "AgmSessionAsyncOp",
+                                    g_variant_new("(ut)", (uint32_t)op, token),
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionAsyncOp: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
+
+    g_variant_unref(result);
+    return 0;
+}
+
 int agm_session_prepare(uint64_t handle) {
     agm_client_session_data *ses_data = (agm_client_session_data *) handle;
     GVariant *result = NULL;
@@ -1733,12 +2101,9 @@ int agm_session_close(uint64_t handle) {
 
     free_callbacks(ses_data);
 
-    if (ses_data->thread_loop) {
-        AGM_LOGE("Quitting loop");
-        g_main_loop_quit(ses_data->loop);
-        g_thread_join(ses_data->thread_loop);
-        ses_data->thread_loop = NULL;
-    }
+    /* the service has stopped serving the ring by now */
+    client_ring_unmap(ses_data);
+    g_mutex_clear(&ses_data->ring_lock);
 
     g_hash_table_remove(mdata->ses_hash_table,
                         GINT_TO_POINTER(ses_data->session_id));
@@ -1752,12 +2117,61 @@ int agm_session_close(uint64_t handle) {
     return 0;
 }
 
+/* Look up the client side data of a session, creating it and its proxy for
+   obj_path on first use. Returns the session handle handed to clients. */
+static int get_session_handle(uint32_t session_id, const char *obj_path,
+                              uint64_t *handle) {
+    agm_client_session_data *ses_data = NULL;
+    GError *error = NULL;
+
+    if ((ses_data = (agm_client_session_data *)g_hash_table_lookup(
+                                        mdata->ses_hash_table,
+                                        GINT_TO_POINTER(session_id))) != NULL) {
+        *handle = (uint64_t)ses_data;
+        return 0;
+    }
+
+    ses_data = (agm_client_session_data *)
+                                g_malloc0(sizeof(agm_client_session_data));
+    ses_data->obj_path = g_strdup(obj_path);
+    ses_data->conn = mdata->conn;
+    g_mutex_init(&ses_data->ring_lock);
+    ses_data->ring_disabled = g_strcmp0(g_getenv("AGM_IPC_DATA_SHM"), "0") == 0;
+
+    ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
+                            G_DBUS_PROXY_FLAGS_NONE,
+                            NULL,
+                            AGM_DBUS_CONNECTION,
+                            ses_data->obj_path,
+                            AGM_SESSION_IFACE,
+                            NULL,
+                            &error);
+
+    if (ses_data->proxy == NULL) {
+        AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
+                  error->message);
+        g_error_free(error);
+        g_mutex_clear(&ses_data->ring_lock);
+        g_free(ses_data->obj_path);
+        g_free(ses_data);
+        return -EINVAL;
+    }
+
+    ses_data->session_id = session_id;
+    /* add session to sessions hash table */
+    g_hash_table_insert(mdata->ses_hash_table,
+                        GINT_TO_POINTER(ses_data->session_id),
+                        ses_data);
+    *handle = (uint64_t)ses_data;
+    return 0;
+}
+
 int agm_session_open(uint32_t session_id, uint64_t *handle) {
     GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
-    agm_client_session_data *ses_data = NULL;
+    char *obj_path = NULL;
 
     g_assert(handle != NULL);
     AGM_LOGD("%s\n", __func__);
@@ -1781,52 +2195,91 @@ int agm_session_open(uint32_t session_id, uint64_t *handle) {
         AGM_LOGE("%s: Error invoking AgmSessionOpen: %s\n", __func__,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        goto exit;
+        return -EINVAL;
     }
 
-    if ((ses_data = (agm_client_session_data *)g_hash_table_lookup(
-                                        mdata->ses_hash_table,
-                                        GINT_TO_POINTER(session_id))) == NULL) {
-        ses_data = (agm_client_session_data *)
-                                    g_malloc0(sizeof(agm_client_session_data));
+    g_variant_get(result, "(o)", &obj_path);
+    rc = get_session_handle(session_id, obj_path, handle);
+    g_free(obj_path);
+    g_variant_unref(result);
+    return rc;
+}
 
-        g_variant_get(result, "(o)", &ses_data->obj_path);
-        ses_data->conn = mdata->conn;
-        *handle = (uint64_t)ses_data;
+int agm_session_batch(const void *ops, size_t size, uint32_t num_ops,
+                      struct agm_batch_status *status) {
+    GVariant *value_1, *value_2, *argument;
+    GVariant *result = NULL;
+    GVariant *status_v = NULL;
+    GVariantIter *path_iter = NULL;
+    GError *error = NULL;
+    const struct agm_batch_op *op = NULL;
+    gconstpointer status_data = NULL;
+    gsize status_size = 0;
+    uint32_t session_id, i;
+    char *obj_path = NULL;
+    int rc = 0;
 
-        ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
-                                G_DBUS_PROXY_FLAGS_NONE,
-                                NULL,
-                                AGM_DBUS_CONNECTION,
-                                ses_data->obj_path,
-                                AGM_SESSION_IFACE,
-                                NULL,
-                                &error);
+    g_assert(ops != NULL && status != NULL);
+    AGM_LOGD("%s\n", __func__);
 
-        if (ses_data->proxy == NULL) {
-            AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
-                      error->message);
-            rc = -EINVAL;
-            g_error_free(error);
-            goto exit;
-        }
+    if (num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS)
+        return -EINVAL;
 
-        ses_data->session_id = session_id;
-        /* add session to sessions hash table */
-        g_hash_table_insert(mdata->ses_hash_table,
-                            GINT_TO_POINTER(ses_data->session_id),
-                            ses_data);
-        g_variant_unref(result);
-        return rc;
-    } else {
-        *handle = (uint64_t)ses_data;
-        return rc;
+    for (i = 0; i < num_ops; i++) {
+        status[i].ret = -ECANCELED;
+        status[i].hndl = 0;
     }
 
-exit:
-    if (ses_data != NULL)
-        g_free(ses_data);
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    value_1 = g_variant_new_uint32(num_ops);
+    value_2 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        ops,
+                                        size,
+                                        sizeof(gchar));
+    argument = g_variant_new("(@u@ay)", value_1, value_2);
+
+    result = g_dbus_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionBatch",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionBatch: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
+
+    g_variant_get(result, "(i@aya(uo))", &rc, &status_v, &path_iter);
+    status_data = g_variant_get_fixed_array(status_v, &status_size,
+                                            sizeof(gchar));
+    if (status_size == num_ops * sizeof(struct agm_batch_status))
+        memcpy(status, status_data, status_size);
+
+    /* session handles are client side objects, swap in ours for the opens */
+    while (g_variant_iter_loop(path_iter, "(uo)", &session_id, &obj_path)) {
+        op = (const struct agm_batch_op *)ops;
+        for (i = 0; i < num_ops; i++, op = AGM_BATCH_OP_NEXT(op)) {
+            if (op->op_id != AGM_BATCH_OP_SESSION_OPEN ||
+                op->session_id != session_id || status[i].ret != 0)
+                continue;
+            status[i].ret = get_session_handle(session_id, obj_path,
+                                               &status[i].hndl);
+            if (status[i].ret && rc == 0)
+                rc = status[i].ret;
+        }
+    }
+
+    g_variant_iter_free(path_iter);
+    g_variant_unref(status_v);
+    g_variant_unref(result);
     return rc;
 }
 
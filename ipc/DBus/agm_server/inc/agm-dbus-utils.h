@@ -35,10 +35,31 @@ typedef void (*agm_dbus_receive_cb_t)(DBusConnection *conn,
                                       DBusMessage *msg,
                                       void *userdata);
 
+/* Where a method call runs. Inline methods run on the main loop in bus
+   order and may change objects and interfaces. Control and data methods run
+   on their own worker pools, so a slow control call never holds up data. */
+typedef enum {
+    AGM_DBUS_LANE_INLINE = 0,
+    AGM_DBUS_LANE_CONTROL,
+    AGM_DBUS_LANE_DATA,
+} agm_dbus_lane;
+
+/* Latency buckets of a method, from dispatch to the end of its handler.
+   Bucket 0 counts calls under 1us, bucket n calls under 2^n us and the
+   last one everything slower. */
+#define AGM_DBUS_LATENCY_BUCKETS 20
+
+typedef struct {
+    uint64_t count[AGM_DBUS_LATENCY_BUCKETS];
+} agm_dbus_method_stats;
+
 typedef struct {
     const char *method_name;
     const char *method_signature;
     agm_dbus_receive_cb_t cb_func;
+    agm_dbus_lane lane;
+    /* Filled in by agm_dbus_add_interface */
+    agm_dbus_method_stats *stats;
 } agm_dbus_method;
 
 typedef struct {
@@ -70,8 +91,18 @@ typedef struct {
 typedef struct {
     DBusConnection *conn;
     GHashTable *objects;
+    /* Workers for control and data methods */
+    GThreadPool *control_pool;
+    GThreadPool *data_pool;
+    /* Key -> interface.method Value -> agm_dbus_method_stats */
+    GHashTable *stats;
+    /* Protects the pending call counts of interfaces */
+    GMutex lock;
 } agm_dbus_connection;
 
+/* Takes back the userdata of a removed interface, see below */
+typedef void (*agm_dbus_release_cb)(void *userdata);
+
 /* Creates a new agm_dbus_connection object and returns it */
 agm_dbus_connection *agm_dbus_new_connection();
 
@@ -84,10 +115,15 @@ int agm_dbus_add_interface(agm_dbus_connection *conn,
                            agm_dbus_interface_info *interface_info,
                            void *userdata);
 
-/* Removes dbus interface from the object */
+/* Removes dbus interface from the object, from the main loop. No call
+   reaches it afterwards, but calls already queued or running on the worker
+   pools still use its userdata: the interface is freed, and release called
+   with the userdata if not NULL, on the main loop once the last of them is
+   done, right away if there is none. */
 int agm_dbus_remove_interface(agm_dbus_connection *conn,
                               const char *dbus_obj_path,
-                              const char *interface);
+                              const char *interface,
+                              agm_dbus_release_cb release);
 
 /* Sends error to dbus client */
 void agm_dbus_send_error(agm_dbus_connection *conn,
@@ -98,6 +134,11 @@ void agm_dbus_send_error(agm_dbus_connection *conn,
 /* Sends a signal to dbus client */
 void agm_dbus_send_signal(agm_dbus_connection *conn, DBusMessage *msg);
 
+/* Appends the latency histograms of all methods as a(sat), one entry of
+   interface.method and its bucket counts per method */
+void agm_dbus_append_method_stats(agm_dbus_connection *conn,
+                                  DBusMessageIter *iter);
+
 /* Sets the watch and timeout functions of a DBusConnection to integrate the
    connection. Returns 0 on success */
 int agm_setup_dbus_with_main_loop(agm_dbus_connection *conn);
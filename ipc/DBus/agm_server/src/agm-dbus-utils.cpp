@@ -32,17 +32,40 @@
 #include <stdio.h>
 #include <errno.h>
 #include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "agm-dbus-utils.h"
 #include "utils.h"
 
 #define DISPATCH_TIMEOUT  0
 
+#ifndef AGM_DBUS_CONTROL_WORKERS
+#define AGM_DBUS_CONTROL_WORKERS 4
+#endif
+
+#ifndef AGM_DBUS_DATA_WORKERS
+#define AGM_DBUS_DATA_WORKERS 4
+#endif
+
+/* Nice value of data lane workers, that of audio threads on Android */
+#ifndef AGM_DBUS_DATA_NICE
+#define AGM_DBUS_DATA_NICE (-16)
+#endif
+
 typedef struct {
     const char *name;
     GHashTable *methods; /* Key -> method_name Value -> agm_dbus_method */
     GHashTable *signals; /* Key -> method_name Value -> agm_dbus_signal */
     void *userdata;
+    /* Calls queued or running on the worker pools, under conn->lock */
+    guint pending;
+    /* Set by agm_dbus_remove_interface, under conn->lock */
+    gboolean removed;
+    agm_dbus_release_cb release;
 } agm_dbus_interface;
 
 typedef struct {
@@ -50,6 +73,78 @@ typedef struct {
     GHashTable *interfaces; /* Key -> interface name Value -> agm_dbus_interface */
 } agm_dbus_object;
 
+/* A method call handed to a worker pool */
+typedef struct {
+    DBusConnection *conn;
+    DBusMessage *msg;
+    agm_dbus_interface *interface;
+    agm_dbus_method *method;
+    gint64 start;
+} agm_dbus_call;
+
+/* Takes the stats rather than the method, which an inline close frees */
+static void agm_dbus_record_latency(agm_dbus_method_stats *stats,
+                                    gint64 start) {
+    gint64 elapsed = g_get_monotonic_time() - start;
+    guint bucket = elapsed > 0 ? g_bit_storage(elapsed) : 0;
+
+    if (stats == NULL)
+        return;
+    if (bucket >= AGM_DBUS_LATENCY_BUCKETS)
+        bucket = AGM_DBUS_LATENCY_BUCKETS - 1;
+    __atomic_fetch_add(&stats->count[bucket], 1, __ATOMIC_RELAXED);
+}
+
+void agm_free_interface(gpointer data);
+
+/* Hands a removed interface back to its owner, on the main loop */
+static void agm_dbus_release_interface(agm_dbus_interface *interface) {
+    if (interface->release != NULL)
+        interface->release(interface->userdata);
+    agm_free_interface(interface);
+}
+
+static gboolean agm_dbus_release_idle_cb(gpointer userdata) {
+    agm_dbus_release_interface((agm_dbus_interface *)userdata);
+    return FALSE;
+}
+
+static void agm_dbus_run_call(agm_dbus_call *call,
+                              agm_dbus_connection *conn) {
+    agm_dbus_interface *interface = call->interface;
+    gboolean released;
+
+    call->method->cb_func(call->conn, call->msg, interface->userdata);
+    agm_dbus_record_latency(call->method->stats, call->start);
+
+    /* the last call of a removed interface finishes its removal */
+    g_mutex_lock(&conn->lock);
+    released = --interface->pending == 0 && interface->removed;
+    g_mutex_unlock(&conn->lock);
+    if (released)
+        g_idle_add(agm_dbus_release_idle_cb, interface);
+
+    dbus_message_unref(call->msg);
+    dbus_connection_unref(call->conn);
+    free(call);
+}
+
+static void agm_dbus_control_worker(gpointer data, gpointer userdata) {
+    agm_dbus_run_call((agm_dbus_call *)data, (agm_dbus_connection *)userdata);
+}
+
+static void agm_dbus_data_worker(gpointer data, gpointer userdata) {
+    static __thread bool prio_set = false;
+
+    /* the pool is exclusive, so each of its threads is raised only once */
+    if (!prio_set) {
+        if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), AGM_DBUS_DATA_NICE))
+            AGM_LOGD("%s: Could not raise data worker priority\n", __func__);
+        prio_set = true;
+    }
+    agm_dbus_run_call((agm_dbus_call *)data, (agm_dbus_connection *)userdata);
+}
+
 static DBusHandlerResult server_message_handler(DBusConnection *connection,
                                                 DBusMessage *message,
                                                 void *userdata) {
@@ -63,6 +158,10 @@ static DBusHandlerResult server_message_handler(DBusConnection *connection,
     agm_dbus_object *object = NULL;
     agm_dbus_interface *interface = NULL;
     agm_dbus_method *method = NULL;
+    agm_dbus_call *call = NULL;
+    GThreadPool *pool = NULL;
+    agm_dbus_method_stats *stats = NULL;
+    gint64 start;
 
     if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -82,11 +181,51 @@ static DBusHandlerResult server_message_handler(DBusConnection *connection,
             if ((method = (agm_dbus_method *)
                 g_hash_table_lookup(interface->methods, dbus_method)) == NULL) {
                 return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-            } else {
-                method->cb_func(connection, message, interface->userdata);
             }
         }
     }
+
+    /* Signatures are checked once here, before any handler runs */
+    if (!dbus_message_has_signature(message, method->method_signature)) {
+        AGM_LOGE("%s: Invalid signature %s for %s\n", __func__,
+                 dbus_message_get_signature(message), dbus_method);
+        reply = dbus_message_new_error(message, DBUS_ERROR_INVALID_ARGS,
+                                       "Invalid signature");
+        dbus_connection_send(connection, reply, NULL);
+        dbus_message_unref(reply);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    if (method->lane == AGM_DBUS_LANE_CONTROL)
+        pool = conn->control_pool;
+    else if (method->lane == AGM_DBUS_LANE_DATA)
+        pool = conn->data_pool;
+
+    if (pool == NULL) {
+        stats = method->stats;
+        start = g_get_monotonic_time();
+        method->cb_func(connection, message, interface->userdata);
+        agm_dbus_record_latency(stats, start);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    call = (agm_dbus_call *)malloc(sizeof(agm_dbus_call));
+    if (call == NULL) {
+        AGM_LOGE("%s: Couldn't allocate memory for call\n", __func__);
+        return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+    call->conn = dbus_connection_ref(connection);
+    call->msg = dbus_message_ref(message);
+    call->interface = interface;
+    call->method = method;
+    call->start = g_get_monotonic_time();
+
+    g_mutex_lock(&conn->lock);
+    interface->pending++;
+    g_mutex_unlock(&conn->lock);
+
+    g_thread_pool_push(pool, call, NULL);
+    return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 static DBusObjectPathVTable vtable = {
@@ -108,14 +247,26 @@ static void agm_handle_dispatch_status(DBusConnection *conn,
     }
 }
 
+static gboolean agm_dispatch_idle_cb(gpointer userdata) {
+    DBusConnection *conn = (DBusConnection *)userdata;
+
+    if (dbus_connection_get_is_connected(conn))
+        agm_handle_dispatch_status(conn,
+                                   dbus_connection_get_dispatch_status(conn),
+                                   NULL);
+    dbus_connection_unref(conn);
+    return FALSE;
+}
+
+/* libdbus reports status changes from whichever thread touched the
+   connection, workers included, while methods must only be dispatched
+   from the main loop */
 static void dispatch_status(DBusConnection *conn,
                             DBusDispatchStatus status,
                             void *userdata)
 {
-    if (!dbus_connection_get_is_connected(conn))
-        return;
-
-    agm_handle_dispatch_status(conn, status, userdata);
+    if (status == DBUS_DISPATCH_DATA_REMAINS)
+        g_idle_add(agm_dispatch_idle_cb, dbus_connection_ref(conn));
 }
 
 static void agm_free_dbus_watch_data(void *userdata) {
@@ -347,7 +498,7 @@ int agm_setup_dbus_with_main_loop(agm_dbus_connection *conn) {
     }
 
     dbus_connection_set_dispatch_status_function(conn->conn,
-                                                 agm_handle_dispatch_status,
+                                                 dispatch_status,
                                                  conn,
                                                  NULL);
 
@@ -379,6 +530,52 @@ void agm_dbus_send_error(agm_dbus_connection *conn,
     return;
 }
 
+void agm_dbus_append_method_stats(agm_dbus_connection *conn,
+                                  DBusMessageIter *iter) {
+    DBusMessageIter array_i, struct_i, count_i;
+    GHashTableIter stats_i;
+    gpointer key, value;
+    agm_dbus_method_stats *stats;
+    dbus_uint64_t count;
+    int i;
+
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sat)", &array_i);
+    g_hash_table_iter_init(&stats_i, conn->stats);
+    while (g_hash_table_iter_next(&stats_i, &key, &value)) {
+        stats = (agm_dbus_method_stats *)value;
+        dbus_message_iter_open_container(&array_i, DBUS_TYPE_STRUCT, NULL,
+                                         &struct_i);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_STRING, &key);
+        dbus_message_iter_open_container(&struct_i, DBUS_TYPE_ARRAY, "t",
+                                         &count_i);
+        for (i = 0; i < AGM_DBUS_LATENCY_BUCKETS; i++) {
+            count = __atomic_load_n(&stats->count[i], __ATOMIC_RELAXED);
+            dbus_message_iter_append_basic(&count_i, DBUS_TYPE_UINT64, &count);
+        }
+        dbus_message_iter_close_container(&struct_i, &count_i);
+        dbus_message_iter_close_container(&array_i, &struct_i);
+    }
+    dbus_message_iter_close_container(iter, &array_i);
+}
+
+/* Histograms are kept per interface and method name, so they outlive the
+   session objects whose calls they count */
+static agm_dbus_method_stats *get_method_stats(agm_dbus_connection *conn,
+                                               const char *interface,
+                                               const char *method) {
+    agm_dbus_method_stats *stats = NULL;
+    gchar *key = g_strdup_printf("%s.%s", interface, method);
+
+    if ((stats = (agm_dbus_method_stats *)
+                            g_hash_table_lookup(conn->stats, key)) == NULL) {
+        stats = g_new0(agm_dbus_method_stats, 1);
+        g_hash_table_insert(conn->stats, key, stats);
+    } else {
+        g_free(key);
+    }
+    return stats;
+}
+
 void agm_free_signal(gpointer data) {
     agm_dbus_signal *signal = (agm_dbus_signal *)data;
 
@@ -406,11 +603,11 @@ void agm_free_interface(gpointer data) {
     if(interface == NULL)
         return;
 
-    g_hash_table_remove_all(interface->methods);
-    g_hash_table_unref(interface->methods);
-
-    g_hash_table_remove_all(interface->signals);
-    g_hash_table_unref(interface->signals);
+    /* either may be missing, see agm_dbus_add_interface */
+    if (interface->methods != NULL)
+        g_hash_table_unref(interface->methods);
+    if (interface->signals != NULL)
+        g_hash_table_unref(interface->signals);
 
     free(interface);
     interface = NULL;
@@ -431,9 +628,11 @@ void agm_free_object(gpointer data) {
 
 int agm_dbus_remove_interface(agm_dbus_connection *conn,
                               const char *dbus_obj_path,
-                              const char *interface_path) {
+                              const char *interface_path,
+                              agm_dbus_release_cb release) {
     agm_dbus_object *object = NULL;
     agm_dbus_interface *interface = NULL;
+    gboolean idle;
 
     if (conn == NULL || dbus_obj_path == NULL || interface_path == NULL)
         return -1;
@@ -443,25 +642,25 @@ int agm_dbus_remove_interface(agm_dbus_connection *conn,
         return -1;
 
     if ((interface = (agm_dbus_interface *)
-               g_hash_table_remove(object->interfaces, interface_path)) == NULL)
+               g_hash_table_lookup(object->interfaces, interface_path)) == NULL)
         return -1;
 
-    g_hash_table_remove_all(interface->methods);
-    g_hash_table_unref(interface->methods);
-
-    g_hash_table_remove_all(interface->signals);
-    g_hash_table_unref(interface->signals);
-
-    free(interface);
-    interface = NULL;
-
+    /* no call reaches the interface from here on */
+    g_hash_table_steal(object->interfaces, interface_path);
     if (g_hash_table_size(object->interfaces) == 0) {
         unregister_object(conn, object);
-        g_hash_table_remove(conn->objects, (void *)object->obj_path);
-        free(object);
-        object = NULL;
+        g_hash_table_remove(conn->objects, dbus_obj_path);
     }
 
+    /* queued calls point at the interface, its methods and userdata */
+    g_mutex_lock(&conn->lock);
+    interface->removed = TRUE;
+    interface->release = release;
+    idle = interface->pending == 0;
+    g_mutex_unlock(&conn->lock);
+    if (idle)
+        agm_dbus_release_interface(interface);
+
     return 0;
 }
 
@@ -512,6 +711,9 @@ int agm_dbus_add_interface(agm_dbus_connection *conn,
             goto interface_malloc_failed;
         }
         interface->name = interface_info->name;
+        interface->pending = 0;
+        interface->removed = FALSE;
+        interface->release = NULL;
         interface->methods = g_hash_table_new_full(g_str_hash,
                                                    g_str_equal,
                                                    NULL,
@@ -527,6 +729,9 @@ int agm_dbus_add_interface(agm_dbus_connection *conn,
              method->method_signature =
                                     interface_info->methods[i].method_signature;
              method->cb_func = interface_info->methods[i].cb_func;
+             method->lane = interface_info->methods[i].lane;
+             method->stats = get_method_stats(conn, interface_info->name,
+                                              method->method_name);
              g_hash_table_insert(interface->methods,
                                  g_strdup(method->method_name),
                                  method);
@@ -576,6 +781,9 @@ int agm_dbus_add_interface(agm_dbus_connection *conn,
                 goto interface_malloc_failed;
             }
             interface->name = interface_info->name;
+            interface->pending = 0;
+            interface->removed = FALSE;
+            interface->release = NULL;
             interface->signals = NULL;
             interface->methods = NULL;
             if (interface_info->methods != NULL) {
@@ -595,6 +803,10 @@ int agm_dbus_add_interface(agm_dbus_connection *conn,
                     method->method_signature =
                                     interface_info->methods[i].method_signature;
                     method->cb_func = interface_info->methods[i].cb_func;
+                    method->lane = interface_info->methods[i].lane;
+                    method->stats = get_method_stats(conn,
+                                                     interface_info->name,
+                                                     method->method_name);
                     g_hash_table_insert(interface->methods,
                                         g_strdup(method->method_name),
                                         method);
@@ -654,13 +866,30 @@ void agm_dbus_connection_free(agm_dbus_connection *conn) {
         return;
     }
 
+    /* let queued calls finish before the objects go away */
+    if (conn->control_pool != NULL)
+        g_thread_pool_free(conn->control_pool, FALSE, TRUE);
+    if (conn->data_pool != NULL)
+        g_thread_pool_free(conn->data_pool, FALSE, TRUE);
+
     g_hash_table_remove_all(conn->objects);
     g_hash_table_unref(conn->objects);
+    g_hash_table_unref(conn->stats);
+    g_mutex_clear(&conn->lock);
 
     free(conn);
     conn = NULL;
 }
 
+/* The system bus unless AGM_DBUS_BUS=session, as for the client */
+static DBusBusType agm_dbus_bus_type() {
+    const char *bus = getenv("AGM_DBUS_BUS");
+
+    if (bus && !strcmp(bus, "session"))
+        return DBUS_BUS_SESSION;
+    return DBUS_BUS_SYSTEM;
+}
+
 agm_dbus_connection *agm_dbus_new_connection() {
     int rc = 0;
     DBusError err;
@@ -673,8 +902,15 @@ agm_dbus_connection *agm_dbus_new_connection() {
     }
     conn->objects = NULL;
 
+    /* methods run on worker threads, which libdbus must know up front */
+    if (!dbus_threads_init_default()) {
+        AGM_LOGE("Failed to initialize dbus threads\n");
+        free(conn);
+        return NULL;
+    }
+
     dbus_error_init(&err);
-    conn->conn = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
+    conn->conn = dbus_bus_get(agm_dbus_bus_type(), &err);
 
     if (conn->conn == NULL) {
         AGM_LOGE("Failed to request name on bus: %s\n", err.message);
@@ -683,10 +919,25 @@ agm_dbus_connection *agm_dbus_new_connection() {
         return NULL;
     }
 
+    g_mutex_init(&conn->lock);
     conn->objects = g_hash_table_new_full(g_str_hash,
                                           g_str_equal,
                                           NULL,
                                           agm_free_object);
+    conn->stats = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        g_free, g_free);
+
+    /* Without a pool the lane's methods run inline, as they used to */
+    conn->control_pool = g_thread_pool_new(agm_dbus_control_worker, conn,
+                                           AGM_DBUS_CONTROL_WORKERS, TRUE,
+                                           NULL);
+    if (conn->control_pool == NULL)
+        AGM_LOGE("Failed to start control workers\n");
+    conn->data_pool = g_thread_pool_new(agm_dbus_data_worker, conn,
+                                        AGM_DBUS_DATA_WORKERS, TRUE, NULL);
+    if (conn->data_pool == NULL)
+        AGM_LOGE("Failed to start data workers\n");
+
     dbus_error_free(&err);
     return conn;
 }
@@ -33,8 +33,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <sstream>
 #include <agm/agm_api.h>
+#include <agm/shm_ring.h>
 #include "agm-dbus-utils.h"
 #include "agm_server_wrapper_dbus.h"
 
@@ -47,6 +53,24 @@
 
 using namespace std;
 
+/*
+ * Session data ring handed out by AgmSessionShmRing, so PCM can move through
+ * shared memory while D-Bus only carries control. See agm/shm_ring.h for the
+ * layout and the protocol, which are shared with the other transports.
+ */
+/* Service end of a session ring, served by its own thread */
+typedef struct {
+    uint64_t handle;
+    struct agm_shm_ring *ring;
+    size_t map_size;
+    uint32_t dir;
+    int memfd;
+    int srv_efd;
+    int clt_efd;
+    pthread_t thread;
+    bool stop;
+} agm_session_ring;
+
 /* Module Level data */
 typedef struct {
     /* Dbus path where agm module listens for connections */
@@ -68,6 +92,11 @@ typedef struct {
     /* List which maintains all the callbacks associated with a session id.
        Used to de-register callbacks when client dies abruptly */
     GList *callbacks;
+    /* Data ring, if the client asked for one */
+    agm_session_ring *ring;
+    /* AgmSessionClose call answered once the session is released */
+    DBusConnection *close_conn;
+    DBusMessage *close_msg;
 } agm_session_data;
 
 typedef struct {
@@ -100,6 +129,8 @@ enum AgmModuleMethods {
     AgmSessionGetParams,
     AgmGetBufferTimestamp,
     AgmSessionOpen,
+    AgmSessionBatch,
+    AgmGetMethodStats,
     AgmDbusModuleMethodMax
 };
 
@@ -116,6 +147,10 @@ enum AgmSessionMethods {
     AgmSessionEos,
     AgmSessionGetTime,
     AgmGetHwProcessedBufCount,
+    AgmSessionAsyncOp,
+    AgmSessionWritev,
+    AgmSessionReadv,
+    AgmSessionShmRing,
     AgmDbusSessionMethodMax
 };
 
@@ -223,48 +258,116 @@ static void ipc_agm_session_register_cb(DBusConnection *conn,
 static void ipc_agm_session_deregister_cb(DBusConnection *conn,
                                           DBusMessage *msg,
                                           void *userdata);
+static void ipc_agm_session_batch(DBusConnection *conn,
+                                  DBusMessage *msg,
+                                  void *userdata);
+static void ipc_agm_session_async_op(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata);
+static void ipc_agm_session_writev(DBusConnection *conn,
+                                   DBusMessage *msg,
+                                   void *userdata);
+static void ipc_agm_session_readv(DBusConnection *conn,
+                                  DBusMessage *msg,
+                                  void *userdata);
+static void ipc_agm_session_shm_ring(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata);
+static void ipc_agm_get_method_stats(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata);
 
+/*
+ * Methods that open or close sessions or change their callbacks or ring
+ * run inline on the main loop, as they change the session tables. Data
+ * path methods get their own lane so control calls never queue ahead.
+ */
 static agm_dbus_method agm_dbus_module_methods[AgmDbusModuleMethodMax] = {
-    {"AgmAifSetMediaConfig", "u(uui)", ipc_agm_audio_intf_set_media_config},
-    {"AgmAifSetMetadata", "uuay", ipc_agm_audio_intf_set_metadata},
+    {"AgmAifSetMediaConfig", "u(uui)", ipc_agm_audio_intf_set_media_config,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmAifSetMetadata", "uuay", ipc_agm_audio_intf_set_metadata,
+        AGM_DBUS_LANE_CONTROL},
     {"AgmSessionAifSetMetadata", "uuuay",
-                                      ipc_agm_session_audio_inf_set_metadata},
-    {"AgmSessionSetMetadata", "uuay", ipc_agm_session_set_metadata},
-    {"AgmSessionSetLoopback", "uub", ipc_agm_session_set_loopback},
-    {"AgmSetParamsWithTag", "uu(uua(uu))", ipc_agm_set_params_with_tag},
-    {"AgmGetAifInfoListSize", "", ipc_agm_get_aif_info_list_size},
-    {"AgmGetAifInfoList", "u", ipc_agm_get_aif_info_list},
-    {"AgmSessionSetParams", "uuay", ipc_agm_session_set_params},
+        ipc_agm_session_audio_inf_set_metadata,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionSetMetadata", "uuay", ipc_agm_session_set_metadata,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionSetLoopback", "uub", ipc_agm_session_set_loopback,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSetParamsWithTag", "uu(uua(uu))", ipc_agm_set_params_with_tag,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmGetAifInfoListSize", "", ipc_agm_get_aif_info_list_size,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmGetAifInfoList", "u", ipc_agm_get_aif_info_list,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionSetParams", "uuay", ipc_agm_session_set_params,
+        AGM_DBUS_LANE_CONTROL},
     {"AgmSessionRegisterForEvents", "u(uuuyay)",
-                                         ipc_agm_session_register_for_events},
-    {"AgmSessionRegisterCb", "uut", ipc_agm_session_register_cb},
-    {"AgmSessionDeRegisterCb", "uut", ipc_agm_session_deregister_cb},
-    {"AgmSessionSetEcRef", "uub", ipc_agm_session_set_ec_ref},
-    {"AgmSessionAifConnect", "uub", ipc_agm_session_audio_inf_connect},
+        ipc_agm_session_register_for_events,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionRegisterCb", "uut", ipc_agm_session_register_cb,
+        AGM_DBUS_LANE_INLINE},
+    {"AgmSessionDeRegisterCb", "uut", ipc_agm_session_deregister_cb,
+        AGM_DBUS_LANE_INLINE},
+    {"AgmSessionSetEcRef", "uub", ipc_agm_session_set_ec_ref,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionAifConnect", "uub", ipc_agm_session_audio_inf_connect,
+        AGM_DBUS_LANE_CONTROL},
     {"AgmSessionAifGetTagModuleInfo", "uuu",
-                                     ipc_agm_session_aif_get_tag_module_info},
+        ipc_agm_session_aif_get_tag_module_info,
+        AGM_DBUS_LANE_CONTROL},
     {"AgmSessionAifGetTagModuleInfoSize", "uuu",
-                                  ipc_agm_session_aif_get_tag_module_info_size},
-    {"AgmSessionAifSetParams", "uuuay", ipc_agm_session_aif_set_params},
-    {"AgmSessionAifSetCal", "uuuay", ipc_agm_session_aif_set_cal},
-    {"AgmSessionGetParams", "uuay", ipc_agm_session_get_params},
-    {"AgmGetBufferTimestamp", "u", ipc_agm_get_buffer_timestamp},
-    {"AgmSessionOpen", "u", ipc_agm_session_open}
+        ipc_agm_session_aif_get_tag_module_info_size,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionAifSetParams", "uuuay", ipc_agm_session_aif_set_params,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionAifSetCal", "uuuay", ipc_agm_session_aif_set_cal,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionGetParams", "uuay", ipc_agm_session_get_params,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmGetBufferTimestamp", "u", ipc_agm_get_buffer_timestamp,
+        AGM_DBUS_LANE_DATA},
+    {"AgmSessionOpen", "u", ipc_agm_session_open,
+        AGM_DBUS_LANE_INLINE},
+    {"AgmSessionBatch", "uay", ipc_agm_session_batch,
+        AGM_DBUS_LANE_INLINE},
+    {"AgmGetMethodStats", "", ipc_agm_get_method_stats,
+        AGM_DBUS_LANE_INLINE}
 };
 
 static agm_dbus_method agm_dbus_session_methods[AgmDbusSessionMethodMax] = {
-    {"AgmSessionClose", "", ipc_agm_session_close},
-    {"AgmSessionPrepare", "", ipc_agm_session_prepare},
-    {"AgmSessionStart", "", ipc_agm_session_start},
-    {"AgmSessionStop", "", ipc_agm_session_stop},
-    {"AgmSessionPause", "", ipc_agm_session_pause},
-    {"AgmSessionResume", "", ipc_agm_session_resume},
-    {"AgmSessionRead", "u", ipc_agm_session_read},
-    {"AgmSessionWrite", "uay", ipc_agm_session_write},
-    {"AgmSessionSetConfig", "(uuu)(uu)ay", ipc_agm_session_set_config},
-    {"AgmSessionEos", "", ipc_agm_session_eos},
-    {"AgmSessionGetTime", "", ipc_agm_get_session_time},
-    {"AgmGetHwProcessedBufCount", "u", ipc_agm_get_hw_processed_buff_cnt}
+    {"AgmSessionClose", "", ipc_agm_session_close,
+        AGM_DBUS_LANE_INLINE},
+    {"AgmSessionPrepare", "", ipc_agm_session_prepare,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionStart", "", ipc_agm_session_start,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionStop", "", ipc_agm_session_stop,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionPause", "", ipc_agm_session_pause,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionResume", "", ipc_agm_session_resume,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionRead", "u", ipc_agm_session_read,
+        AGM_DBUS_LANE_DATA},
+    {"AgmSessionWrite", "uay", ipc_agm_session_write,
+        AGM_DBUS_LANE_DATA},
+    {"AgmSessionSetConfig", "(uuu)(uu)ay", ipc_agm_session_set_config,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionEos", "", ipc_agm_session_eos,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionGetTime", "", ipc_agm_get_session_time,
+        AGM_DBUS_LANE_DATA},
+    {"AgmGetHwProcessedBufCount", "u", ipc_agm_get_hw_processed_buff_cnt,
+        AGM_DBUS_LANE_DATA},
+    {"AgmSessionAsyncOp", "ut", ipc_agm_session_async_op,
+        AGM_DBUS_LANE_CONTROL},
+    {"AgmSessionWritev", "auay", ipc_agm_session_writev,
+        AGM_DBUS_LANE_DATA},
+    {"AgmSessionReadv", "au", ipc_agm_session_readv,
+        AGM_DBUS_LANE_DATA},
+    {"AgmSessionShmRing", "u", ipc_agm_session_shm_ring,
+        AGM_DBUS_LANE_INLINE}
 };
 
 static agm_dbus_signal event_callback[AgmSignalMax] = {
@@ -287,6 +390,153 @@ agm_dbus_interface_info session_interface_info = {
     .signal_count=AgmSignalMax
 };
 
+/* Returns -EPIPE once the ring is being destroyed */
+static int agm_session_ring_wait(void *priv) {
+    agm_session_ring *r = (agm_session_ring *)priv;
+    uint64_t val;
+
+    if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE))
+        return -EPIPE;
+    if (read(r->srv_efd, &val, sizeof(val)) < 0 && errno != EINTR)
+        return -EPIPE;
+    return __atomic_load_n(&r->stop, __ATOMIC_ACQUIRE) ? -EPIPE : 0;
+}
+
+static void *agm_session_ring_thread(void *arg) {
+    agm_session_ring *r = (agm_session_ring *)arg;
+
+    if (agm_shm_ring_serve(r->ring, AGM_SHM_RING_SIZE, r->dir, r->handle,
+                           r->clt_efd, agm_session_ring_wait, r) == -AGM_SHM_RING_EBROKEN)
+        AGM_LOGE("ring of handle %llx is corrupt, stop serving it",
+                 (unsigned long long)r->handle);
+    return NULL;
+}
+
+static void agm_session_ring_free(agm_session_ring *r) {
+    if (r->ring)
+        munmap(r->ring, r->map_size);
+    if (r->memfd >= 0)
+        close(r->memfd);
+    if (r->srv_efd >= 0)
+        close(r->srv_efd);
+    if (r->clt_efd >= 0)
+        close(r->clt_efd);
+    free(r);
+}
+
+static int agm_session_ring_create(agm_session_data *ses_data, uint32_t dir) {
+    agm_session_ring *r = NULL;
+    void *addr = NULL;
+    int ret;
+
+    r = (agm_session_ring *)calloc(1, sizeof(agm_session_ring));
+    if (r == NULL)
+        return -ENOMEM;
+    r->handle = ses_data->handle;
+    r->dir = dir;
+    r->map_size = sizeof(struct agm_shm_ring) + AGM_SHM_RING_SIZE;
+    r->memfd = memfd_create("agm_session_ring", MFD_CLOEXEC);
+    r->srv_efd = eventfd(0, EFD_CLOEXEC);
+    r->clt_efd = eventfd(0, EFD_CLOEXEC);
+    if (r->memfd < 0 || r->srv_efd < 0 || r->clt_efd < 0 ||
+        ftruncate(r->memfd, r->map_size) < 0) {
+        ret = -errno;
+        goto fail;
+    }
+
+    addr = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                r->memfd, 0);
+    if (addr == MAP_FAILED) {
+        ret = -errno;
+        goto fail;
+    }
+    r->ring = (struct agm_shm_ring *)addr;
+    r->ring->size = AGM_SHM_RING_SIZE;
+    r->ring->dir = dir;
+
+    ret = -pthread_create(&r->thread, NULL, agm_session_ring_thread, r);
+    if (ret)
+        goto fail;
+
+    ses_data->ring = r;
+    return 0;
+
+fail:
+    agm_session_ring_free(r);
+    return ret;
+}
+
+/* Stops the ring thread, to be done before the session is closed */
+static void agm_session_ring_destroy(agm_session_data *ses_data) {
+    agm_session_ring *r = ses_data->ring;
+
+    if (r == NULL)
+        return;
+
+    ses_data->ring = NULL;
+    __atomic_store_n(&r->stop, true, __ATOMIC_RELEASE);
+    agm_shm_ring_kick(r->srv_efd);
+    pthread_join(r->thread, NULL);
+    agm_session_ring_free(r);
+}
+
+void agm_free_session(gpointer c_data);
+
+/* Closes a session once none of its calls is left on the workers */
+static void agm_session_release(void *userdata) {
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    DBusMessage *reply = NULL;
+    GList *node = NULL;
+    int ret;
+
+    agm_session_ring_destroy(ses_data);
+    ret = agm_session_close(ses_data->handle);
+    if (ret)
+        AGM_LOGE("agm_session_close failed for session %d",
+                 ses_data->session_id);
+
+    for (node = ses_data->callbacks; node != NULL; node = node->next) {
+        free(node->data);
+        node->data = NULL;
+    }
+    g_list_free(ses_data->callbacks);
+    ses_data->callbacks = NULL;
+
+    if (ses_data->close_msg != NULL) {
+        if (ret)
+            reply = dbus_message_new_error(ses_data->close_msg,
+                                           DBUS_ERROR_FAILED,
+                                           "agm_session_close failed.");
+        else
+            reply = dbus_message_new_method_return(ses_data->close_msg);
+        dbus_connection_send(ses_data->close_conn, reply, NULL);
+        dbus_message_unref(reply);
+        dbus_message_unref(ses_data->close_msg);
+        dbus_connection_unref(ses_data->close_conn);
+    }
+
+    /* the interface, and with it the object path, is gone already */
+    free(ses_data->dbus_obj_path);
+    ses_data->dbus_obj_path = NULL;
+    agm_free_session(ses_data);
+}
+
+/*
+ * Takes a session out of service from the main loop without waiting for
+ * its calls on the workers: it can no longer be looked up or called, and
+ * agm_session_release() runs once the last call in flight is done.
+ */
+static void agm_session_remove(agm_session_data *ses_data) {
+    g_hash_table_steal(mdata->sessions,
+                       GUINT_TO_POINTER(ses_data->session_id));
+    if (agm_dbus_remove_interface(mdata->conn, ses_data->dbus_obj_path,
+                                  session_interface_info.name,
+                                  agm_session_release)) {
+        AGM_LOGE("Unable to remove interface");
+        agm_session_release(ses_data);
+    }
+}
+
 static DBusHandlerResult disconnection_filter_cb(DBusConnection *conn,
                                                  DBusMessage *msg,
                                                  void *userdata) {
@@ -327,36 +577,17 @@ static DBusHandlerResult disconnection_filter_cb(DBusConnection *conn,
         }
 
         g_list_free(ses_data->callbacks);
+        ses_data->callbacks = NULL;
 
         dbus_connection_remove_filter(conn, disconnection_filter_cb, ses_data);
-
-        if (agm_session_close(ses_data->handle) != 0) {
-            AGM_LOGE("agm_session_close failed.");
-            agm_dbus_send_error(mdata->conn,
-                                msg,
-                                DBUS_ERROR_FAILED,
-                                "agm_session_close failed.");
-        }
-
-        if (agm_dbus_remove_interface(mdata->conn,
-                                      ses_data->dbus_obj_path,
-                                      session_interface_info.name) != 0) {
-            AGM_LOGE("Unable to remove interface");
-            agm_dbus_send_error(mdata->conn,
-                                msg,
-                                DBUS_ERROR_FAILED,
-                                "agm_session_close failed.");
-        }
-
-        g_hash_table_remove(mdata->sessions,
-                            GUINT_TO_POINTER(ses_data->session_id));
+        agm_session_remove(ses_data);
     }
 
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
 void agm_free_session(gpointer c_data) {
-    agm_session_data *data = (agm_session_data *)data;
+    agm_session_data *data = (agm_session_data *)c_data;
 
     if(data == NULL)
         return;
@@ -364,7 +595,7 @@ void agm_free_session(gpointer c_data) {
     if (data->dbus_obj_path != NULL) {
         if (agm_dbus_remove_interface(mdata->conn,
                                       data->dbus_obj_path,
-                                      session_interface_info.name))
+                                      session_interface_info.name, NULL))
             AGM_LOGE("Unable to remove interface.");
         free(data->dbus_obj_path);
         data->dbus_obj_path = NULL;
@@ -410,6 +641,9 @@ static agm_session_data * get_session_data(agm_module_dbus_data *mdata,
                  "/session_",
                  session_id);
         ses_data->callbacks = NULL;
+        ses_data->ring = NULL;
+        ses_data->close_conn = NULL;
+        ses_data->close_msg = NULL;
 
         if (agm_dbus_add_interface(mdata->conn,
                                    ses_data->dbus_obj_path,
@@ -504,13 +738,6 @@ static void ipc_agm_session_deregister_cb(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uut")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_deregister_cb.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                        "Invalid signature for ipc_agm_session_deregister_cb.");
-        return;
-    }
-
     dbus_message_iter_get_basic(&arg_i, &session_id);
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &evt_type);
@@ -584,13 +811,6 @@ static void ipc_agm_session_register_cb(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uut")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_register_cb.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                          "Invalid signature for ipc_agm_session_register_cb.");
-        return;
-    }
-
     dbus_message_iter_get_basic(&arg_i, &session_id);
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &evt_type);
@@ -664,13 +884,6 @@ static void ipc_agm_session_register_for_events(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u(uuuyay)")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_register_for_events.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                  "Invalid signature for ipc_agm_session_register_for_events.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -740,13 +953,6 @@ static void ipc_agm_session_get_params(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_get_params.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                           "Invalid signature for ipc_agm_session_get_params.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -810,13 +1016,6 @@ static void ipc_agm_session_aif_set_cal(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_aif_set_cal.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                          "Invalid signature for ipc_agm_session_aif_set_cal.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -882,13 +1081,6 @@ static void ipc_agm_session_aif_set_params(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_aif_set_params.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                       "Invalid signature for ipc_agm_session_aif_set_params.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -943,12 +1135,6 @@ static void ipc_agm_session_aif_get_tag_module_info_size(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuu")) {
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-         "Invalid signature for ipc_agm_session_aif_get_tag_module_info_size.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     reply = dbus_message_new_method_return(msg);
@@ -999,12 +1185,6 @@ static void ipc_agm_session_aif_get_tag_module_info(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuu")) {
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-              "Invalid signature for ipc_agm_session_aif_get_tag_module_info.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     reply = dbus_message_new_method_return(msg);
@@ -1062,13 +1242,6 @@ static void ipc_agm_session_audio_inf_connect(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uub")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_audio_inf_connect.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                    "Invalid signature for ipc_agm_session_audio_inf_connect.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -1111,13 +1284,6 @@ static void ipc_agm_session_set_ec_ref(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uub")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_set_ec_ref.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                           "Invalid signature for ipc_agm_session_set_ec_ref.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &capture_session_id);
@@ -1163,13 +1329,6 @@ static void ipc_agm_session_set_params(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_set_params.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                           "Invalid signature for ipc_agm_session_set_params.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -1247,13 +1406,6 @@ static void ipc_agm_get_aif_info_list(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u")) {
-        AGM_LOGE("Invalid signature for ipc_agm_get_aif_info_list.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "Invalid signature for ipc_agm_get_aif_info_list.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &num_aif_info);
@@ -1315,13 +1467,6 @@ static void ipc_agm_set_params_with_tag(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uu(uua(uu))")) {
-        AGM_LOGE("Invalid signature for ipc_agm_set_params_with_tag.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                          "Invalid signature for ipc_agm_set_params_with_tag.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -1394,13 +1539,6 @@ static void ipc_agm_session_set_loopback(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uub")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_set_loopback.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                         "Invalid signature for ipc_agm_session_set_loopback.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &capture_session_id);
@@ -1448,13 +1586,6 @@ static void ipc_agm_session_set_metadata(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_set_metadata.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                         "Invalid signature for ipc_agm_session_set_metadata.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -1512,12 +1643,6 @@ static void ipc_agm_session_audio_inf_set_metadata(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuuay")) {
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-               "Invalid signature for ipc_agm_session_audio_inf_set_metadata.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -1580,13 +1705,6 @@ static void ipc_agm_audio_intf_set_metadata(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_metadata.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                      "Invalid signature for ipc_agm_audio_intf_set_metadata.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &aif_id);
@@ -1641,13 +1759,6 @@ static void ipc_agm_audio_intf_set_media_config(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u(uui)")) {
-        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_media_config.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                  "Invalid signature for ipc_agm_audio_intf_set_media_config.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &aif_id);
@@ -1694,13 +1805,6 @@ static void ipc_agm_get_buffer_timestamp(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u")) {
-        AGM_LOGE("Invalid signature for ipc_agm_get_buffer_timestamp.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                         "Invalid signature for ipc_agm_get_buffer_timestamp.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -1743,13 +1847,6 @@ static void ipc_agm_get_hw_processed_buff_cnt(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u")) {
-        AGM_LOGE("Invalid signature for ipc_agm_get_hw_processed_buff_cnt.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                    "Invalid signature for ipc_agm_get_hw_processed_buff_cnt.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &direction);
@@ -1764,6 +1861,59 @@ static void ipc_agm_get_hw_processed_buff_cnt(DBusConnection *conn,
     dbus_message_unref(reply);
 }
 
+static void ipc_agm_session_async_op(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    uint32_t op;
+    uint64_t token;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_async_op has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_async_op has no arguments");
+        return;
+    }
+
+    dbus_message_iter_get_basic(&arg_i, &op);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &token);
+
+    AGM_LOGV("%s : op %d", __func__, op);
+
+    /*
+     * Close tears down the session object path the completion would be
+     * signalled on, so it has to go through AgmSessionClose.
+     */
+    if (op == AGM_SESSION_OP_CLOSE) {
+        AGM_LOGE("async close is not supported over dbus");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_NOT_SUPPORTED,
+                            "async close is not supported, use AgmSessionClose");
+        return;
+    }
+
+    if (agm_session_async_op(ses_data->handle,
+                             (enum agm_session_async_op)op, token)) {
+        AGM_LOGE("agm_session_async_op failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_async_op failed.");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
 static void ipc_agm_get_session_time(DBusConnection *conn,
                                      DBusMessage *msg,
                                      void *userdata) {
@@ -1822,13 +1972,6 @@ static void ipc_agm_session_set_config(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "(uuu)(uu)ay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_set_config.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                           "Invalid signature for ipc_agm_session_set_config.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_recurse(&arg_i, &struct_i);
@@ -1889,6 +2032,191 @@ static void ipc_agm_session_eos(DBusConnection *conn,
     dbus_message_unref(reply);
 }
 
+/*
+ * Points iov at consecutive slices of base sized by seg_sizes, which have
+ * to add up to size exactly.
+ */
+static int seg_sizes_to_iov(const uint32_t *seg_sizes, int num_segs,
+                            char *base, size_t size, struct iovec *iov)
+{
+    size_t offset = 0;
+    int i;
+
+    if (num_segs > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+
+    for (i = 0; i < num_segs; i++) {
+        if (seg_sizes[i] > size - offset)
+            return -EINVAL;
+        iov[i].iov_base = base + offset;
+        iov[i].iov_len = seg_sizes[i];
+        offset += seg_sizes[i];
+    }
+
+    return offset == size ? 0 : -EINVAL;
+}
+
+static void ipc_agm_session_writev(DBusConnection *conn,
+                                   DBusMessage *msg,
+                                   void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, array_i, r_arg;
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    struct iovec iov[AGM_SESSION_IOV_MAX];
+    uint32_t *seg_sizes = NULL;
+    char *value = NULL;
+    int num_segs = 0, n_elements = 0;
+    size_t count = 0;
+    dbus_uint64_t written;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_writev has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_writev has no arguments");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_recurse(&arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, &seg_sizes, &num_segs);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_recurse(&arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, &value, &n_elements);
+
+    /*the segments are written straight out of the message*/
+    if (seg_sizes_to_iov(seg_sizes, num_segs, value, n_elements, iov) ||
+        agm_session_writev(ses_data->handle, iov, num_segs, &count)) {
+        AGM_LOGE("agm_session_writev failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_writev failed.");
+        return;
+    }
+
+    written = count;
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT64, &written);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_readv(DBusConnection *conn,
+                                  DBusMessage *msg,
+                                  void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, array_i, r_arg, r_array_i;
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    struct iovec iov[AGM_SESSION_IOV_MAX];
+    uint32_t *seg_sizes = NULL;
+    char *buf = NULL;
+    int num_segs = 0, i;
+    size_t size = 0, count = 0;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_readv has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_readv has no arguments");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_recurse(&arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, &seg_sizes, &num_segs);
+    for (i = 0; i < num_segs; i++)
+        size += seg_sizes[i];
+
+    buf = (char *)malloc(size ? size : 1);
+    if (!buf ||
+        seg_sizes_to_iov(seg_sizes, num_segs, buf, size, iov) ||
+        agm_session_readv(ses_data->handle, iov, num_segs, &count)) {
+        AGM_LOGE("agm_session_readv failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_readv failed.");
+        free(buf);
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_open_container(&r_arg, DBUS_TYPE_ARRAY, "y", &r_array_i);
+    dbus_message_iter_append_fixed_array(&r_array_i, DBUS_TYPE_BYTE, &buf,
+                                         count);
+    dbus_message_iter_close_container(&r_arg, &r_array_i);
+    dbus_connection_send(conn, reply, NULL);
+    free(buf);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_shm_ring(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, r_arg;
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    uint32_t dir;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_shm_ring has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_shm_ring has no arguments");
+        return;
+    }
+
+    dbus_message_iter_get_basic(&arg_i, &dir);
+
+    AGM_LOGV("%s : dir %d", __func__, dir);
+
+    if (dir > AGM_SHM_RING_READ || ses_data->ring != NULL ||
+        !dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD)) {
+        AGM_LOGE("Cannot set up a ring for session %d", ses_data->session_id);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_NOT_SUPPORTED,
+                            "Cannot set up a ring for this session.");
+        return;
+    }
+
+    if (agm_session_ring_create(ses_data, dir)) {
+        AGM_LOGE("agm_session_ring_create failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_ring_create failed.");
+        return;
+    }
+
+    /* libdbus passes duplicates, the ring keeps its own fds */
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UNIX_FD,
+                                   &ses_data->ring->memfd);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UNIX_FD,
+                                   &ses_data->ring->srv_efd);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UNIX_FD,
+                                   &ses_data->ring->clt_efd);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
 static void ipc_agm_session_write(DBusConnection *conn,
                                   DBusMessage *msg,
                                   void *userdata) {
@@ -1915,13 +2243,6 @@ static void ipc_agm_session_write(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_write.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "Invalid signature for ipc_agm_session_write.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &buf_size);
@@ -1973,13 +2294,6 @@ static void ipc_agm_session_read(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_read.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "Invalid signature for ipc_agm_session_read.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &buf_size);
@@ -2145,9 +2459,7 @@ static void ipc_agm_session_prepare(DBusConnection *conn,
 static void ipc_agm_session_close(DBusConnection *conn,
                                   DBusMessage *msg,
                                   void *userdata) {
-    DBusMessage *reply = NULL;
     agm_session_data *ses_data = (agm_session_data *)userdata;
-    GList *node = NULL;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -2159,37 +2471,10 @@ static void ipc_agm_session_close(DBusConnection *conn,
     AGM_LOGV("%s : ", __func__);
 
     dbus_connection_remove_filter(conn, disconnection_filter_cb, ses_data);
-
-    if (agm_session_close(ses_data->handle)) {
-        AGM_LOGE("agm_session_close failed.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "agm_session_close failed.");
-        return;
-    }
-
-    for (node = ses_data->callbacks; node != NULL; node = node->next) {
-        if (node->data != NULL) {
-            free(node->data);
-            node->data = NULL;
-        }
-    }
-
-    g_list_free(ses_data->callbacks);
-
-    if (agm_dbus_remove_interface(mdata->conn,
-                                  ses_data->dbus_obj_path,
-                                  session_interface_info.name)) {
-        AGM_LOGE("Unable to remove interface");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                       "agm_session_close failed. Failed to remove interface.");
-        return;
-    }
-
-    g_hash_table_remove(mdata->sessions,
-                        GUINT_TO_POINTER(ses_data->session_id));
-    reply = dbus_message_new_method_return(msg);
-    dbus_connection_send(conn, reply, NULL);
-    dbus_message_unref(reply);
+    /* answered from agm_session_release() */
+    ses_data->close_conn = dbus_connection_ref(conn);
+    ses_data->close_msg = dbus_message_ref(msg);
+    agm_session_remove(ses_data);
 }
 
 static void ipc_agm_session_open(DBusConnection *conn,
@@ -2216,13 +2501,6 @@ static void ipc_agm_session_open(DBusConnection *conn,
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u")) {
-        AGM_LOGE("Invalid signature for ipc_agm_session_open.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "Invalid signature for ipc_agm_session_open.");
-        return;
-    }
-
     AGM_LOGV("%s : ", __func__);
 
     dbus_message_iter_get_basic(&arg_i, &session_id);
@@ -2251,6 +2529,125 @@ static void ipc_agm_session_open(DBusConnection *conn,
     dbus_message_unref(reply);
 }
 
+static void ipc_agm_session_batch(DBusConnection *conn,
+                                  DBusMessage *msg,
+                                  void *userdata) {
+    agm_module_dbus_data *mdata = (agm_module_dbus_data *)userdata;
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, array_i, r_arg, path_i, struct_i;
+    const struct agm_batch_op *op = NULL;
+    struct agm_batch_status *status = NULL;
+    agm_session_data *ses_data = NULL;
+    uint32_t num_ops, i;
+    dbus_int32_t ret;
+    void *ops = NULL;
+    char *value = NULL;
+    char **addr_value = &value;
+    int n_elements = 0;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_batch has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_batch has no arguments");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &num_ops);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_recurse(&arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
+
+    if (num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS) {
+        AGM_LOGE("Invalid num_ops %d", num_ops);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid num_ops for ipc_agm_session_batch.");
+        return;
+    }
+
+    /* copy out so the ops are suitably aligned for struct agm_batch_op */
+    ops = malloc(n_elements);
+    status = (struct agm_batch_status *)calloc(num_ops, sizeof(*status));
+    if (ops == NULL || status == NULL) {
+        AGM_LOGE("ops or status is NULL");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ops or status is NULL");
+        free(ops);
+        free(status);
+        return;
+    }
+    memcpy(ops, value, n_elements);
+
+    ret = agm_session_batch(ops, n_elements, num_ops, status);
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_INT32, &ret);
+    dbus_message_iter_open_container(&r_arg, DBUS_TYPE_ARRAY, "y", &array_i);
+    dbus_message_iter_append_fixed_array(&array_i, DBUS_TYPE_BYTE, &status,
+                                  num_ops * sizeof(struct agm_batch_status));
+    dbus_message_iter_close_container(&r_arg, &array_i);
+
+    /*
+     * Sessions opened by the batch get their session object exported just
+     * like AgmSessionOpen does, and are returned as (session id, path).
+     */
+    dbus_message_iter_open_container(&r_arg, DBUS_TYPE_ARRAY, "(uo)", &path_i);
+    op = (const struct agm_batch_op *)ops;
+    for (i = 0; i < num_ops && status[i].ret == 0;
+         i++, op = AGM_BATCH_OP_NEXT(op)) {
+        if (op->op_id != AGM_BATCH_OP_SESSION_OPEN)
+            continue;
+        ses_data = get_session_data(mdata, op->session_id);
+        if (ses_data == NULL) {
+            AGM_LOGE("Unable to export session %d", op->session_id);
+            continue;
+        }
+        ses_data->handle = status[i].hndl;
+        if (!dbus_connection_add_filter(conn,
+                                        disconnection_filter_cb,
+                                        ses_data,
+                                        NULL))
+            AGM_LOGE("Unable to add death notification filter");
+        dbus_message_iter_open_container(&path_i, DBUS_TYPE_STRUCT, NULL,
+                                         &struct_i);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_UINT32,
+                                       &ses_data->session_id);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_OBJECT_PATH,
+                                       &ses_data->dbus_obj_path);
+        dbus_message_iter_close_container(&path_i, &struct_i);
+    }
+    dbus_message_iter_close_container(&r_arg, &path_i);
+
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    free(status);
+    free(ops);
+}
+
+static void ipc_agm_get_method_stats(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter r_arg;
+
+    AGM_LOGV("%s : ", __func__);
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    agm_dbus_append_method_stats(mdata->conn, &r_arg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
 /* Initialize module data. Get dbus connection and register module interface
     with the connection */
 int ipc_agm_init() {
@@ -2352,7 +2749,7 @@ void ipc_agm_deinit() {
     if (mdata->dbus_obj_path != NULL) {
         if (agm_dbus_remove_interface(mdata->conn,
                                       mdata->dbus_obj_path,
-                                      module_interface_info.name) != 0)
+                                      module_interface_info.name, NULL) != 0)
             AGM_LOGE("Unable to remove interface");
         free(mdata->dbus_obj_path);
         mdata->dbus_obj_path = NULL;
@@ -37,8 +37,13 @@
 #include <vendor/qti/hardware/AGMIPC/1.0/IAGMCallback.h>
 #include <hidl/LegacySupport.h>
 #include <log/log.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <cutils/ashmem.h>
 #include <vendor/qti/hardware/AGMIPC/1.0/IAGM.h>
+#include <vendor/qti/hardware/AGMIPC/1.1/IAGM.h>
 
 #include <agm/agm_api.h>
 #include "inc/AGMCallback.h"
@@ -51,6 +56,7 @@ using vendor::qti::hardware::AGMIPC::V1_0::IAGMCallback;
 using vendor::qti::hardware::AGMIPC::V1_0::implementation::AGMCallback;
 using vendor::qti::hardware::AGMIPC::V1_0::MmapBufInfo;
 using vendor::qti::hardware::AGMIPC::V1_0::AgmDumpInfo;
+using vendor::qti::hardware::AGMIPC::V1_1::AgmBatchStatus;
 using android::hardware::defaultPassthroughServiceImplementation;
 using android::hardware::configureRpcThreadpool;
 using android::hardware::joinRpcThreadpool;
@@ -70,6 +76,38 @@ struct client_cb_data {
    uint64_t data;
 };
 
+/*
+ * Transfers above this size keep going through binder payloads, so a
+ * session never pins more than this much shared memory.
+ */
+#ifndef AGM_SHM_REGION_MAX
+#define AGM_SHM_REGION_MAX (1024 * 1024)
+#endif
+
+/*
+ * Memory shared with the service for agm_session_write/read on one session
+ * handle. Data is copied in or out of it once, and agm reads or writes it
+ * through the service's own mapping, so only offset and count travel in the
+ * transaction. A session whose region could not be registered is marked
+ * disabled and stays on the payload path, as are all sessions opened while
+ * AGM_IPC_DATA_SHM=0 is set in the environment, which lets benchmarks and
+ * bug reports compare both paths in one process.
+ */
+struct client_shm_region {
+    struct listnode node;
+    uint64_t handle;
+    pthread_mutex_t lock;
+    int fd;
+    void *addr;
+    size_t size;
+    bool disabled;
+};
+
+static list_declare(client_shm_list);
+static pthread_mutex_t client_shm_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_v1_1 = NULL;
+static bool agm_client_v1_1_checked = false;
+
 void server_death_notifier::serviceDied(uint64_t cookie,
                    const android::wp<::android::hidl::base::V1_0::IBase>& who __unused)
 {
@@ -99,6 +137,219 @@ done:
     return agm_client ;
 }
 
+/*
+ * castFrom() costs a transaction of its own, which the data path cannot
+ * afford on every call, so its result is kept.
+ */
+static android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> get_agm_server_1_1()
+{
+    android::sp<IAGM> agm_client = get_agm_server();
+    android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_server_1_1 = NULL;
+
+    pthread_mutex_lock(&agmclient_init_lock);
+    if (!agm_client_v1_1_checked && agm_client != NULL) {
+        agm_client_v1_1 = vendor::qti::hardware::AGMIPC::V1_1::IAGM::castFrom(agm_client);
+        agm_client_v1_1_checked = true;
+    }
+    agm_server_1_1 = agm_client_v1_1;
+    pthread_mutex_unlock(&agmclient_init_lock);
+    return agm_server_1_1;
+}
+
+static struct client_shm_region *client_shm_get(uint64_t handle)
+{
+    struct listnode *node = NULL;
+    struct client_shm_region *region = NULL;
+    const char *env = NULL;
+
+    pthread_mutex_lock(&client_shm_list_lock);
+    list_for_each(node, &client_shm_list) {
+        region = node_to_item(node, struct client_shm_region, node);
+        if (region->handle == handle)
+            goto exit;
+    }
+    region = (struct client_shm_region *)calloc(1, sizeof(struct client_shm_region));
+    if (region == NULL) {
+        ALOGE("%s: Cannot allocate memory for shm region\n", __func__);
+        goto exit;
+    }
+    region->handle = handle;
+    region->fd = -1;
+    env = getenv("AGM_IPC_DATA_SHM");
+    region->disabled = env && !strcmp(env, "0");
+    pthread_mutex_init(&region->lock, (const pthread_mutexattr_t *) NULL);
+    list_add_tail(&client_shm_list, &region->node);
+exit:
+    pthread_mutex_unlock(&client_shm_list_lock);
+    return region;
+}
+
+static void client_shm_unmap(struct client_shm_region *region)
+{
+    if (region->addr)
+        munmap(region->addr, region->size);
+    if (region->fd >= 0)
+        close(region->fd);
+    region->addr = NULL;
+    region->fd = -1;
+    region->size = 0;
+}
+
+/*Called once the session is closed; the service drops its mapping on close*/
+static void client_shm_release(uint64_t handle)
+{
+    struct listnode *node = NULL;
+    struct listnode *tempnode = NULL;
+    struct client_shm_region *region = NULL;
+
+    pthread_mutex_lock(&client_shm_list_lock);
+    list_for_each_safe(node, tempnode, &client_shm_list) {
+        region = node_to_item(node, struct client_shm_region, node);
+        if (region->handle != handle)
+            continue;
+        list_remove(node);
+        /*wait for a transfer still using it*/
+        pthread_mutex_lock(&region->lock);
+        client_shm_unmap(region);
+        pthread_mutex_unlock(&region->lock);
+        pthread_mutex_destroy(&region->lock);
+        free(region);
+        break;
+    }
+    pthread_mutex_unlock(&client_shm_list_lock);
+}
+
+/*
+ * Makes sure region holds at least count bytes, registering a larger
+ * region with the service in place of the current one when it does not.
+ */
+static int client_shm_reserve(
+        android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_1_1,
+        struct client_shm_region *region, size_t count)
+{
+    native_handle_t *allocHidlHandle = nullptr;
+    size_t page_size = (size_t) getpagesize();
+    size_t size;
+    void *addr;
+    int fd, ret;
+
+    if (region->addr && region->size >= count)
+        return 0;
+
+    /*grow geometrically so a slowly rising period size maps only a few times*/
+    size = count;
+    if (size < region->size * 2)
+        size = region->size * 2;
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if (size > AGM_SHM_REGION_MAX)
+        size = count;
+
+    fd = ashmem_create_region("agm_session_shm", size);
+    if (fd < 0) {
+        ALOGE("%s: ashmem_create_region of %zu bytes failed\n", __func__, size);
+        return -ENOMEM;
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("%s: mmap failed, errno %d\n", __func__, errno);
+        close(fd);
+        return -ENOMEM;
+    }
+    allocHidlHandle = native_handle_create(1, 0);
+    if (!allocHidlHandle) {
+        ALOGE("%s native_handle_create fails", __func__);
+        ret = -ENOMEM;
+        goto fail;
+    }
+    allocHidlHandle->data[0] = fd;
+
+    {
+        auto status = agm_client_1_1->ipc_agm_session_register_shm(region->handle,
+                          hidl_memory("agm_session_shm", hidl_handle(allocHidlHandle),
+                                      size));
+        ret = status.isOk() ? (int32_t) status : -EIO;
+    }
+    native_handle_delete(allocHidlHandle);
+    if (ret) {
+        ALOGE("%s: registering shm failed, ret=%d\n", __func__, ret);
+        goto fail;
+    }
+
+    client_shm_unmap(region);
+    region->fd = fd;
+    region->addr = addr;
+    region->size = size;
+    return 0;
+
+fail:
+    munmap(addr, size);
+    close(fd);
+    return ret;
+}
+
+/*
+ * Moves *byte_count bytes through the session's shared region. Returns
+ * -ENOSYS when the caller has to fall back to binder payloads.
+ */
+static int client_shm_transfer(uint64_t handle, void *buf, size_t *byte_count,
+                               bool write)
+{
+    android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_1_1 =
+            get_agm_server_1_1();
+    struct client_shm_region *region = NULL;
+    uint32_t count = 0;
+    int ret = -ENOSYS;
+
+    if (agm_client_1_1 == nullptr || *byte_count > AGM_SHM_REGION_MAX)
+        return -ENOSYS;
+
+    region = client_shm_get(handle);
+    if (!region)
+        return -ENOSYS;
+
+    pthread_mutex_lock(&region->lock);
+    if (region->disabled)
+        goto exit;
+    if (client_shm_reserve(agm_client_1_1, region, *byte_count)) {
+        ALOGI("%s: handle %llx falls back to binder payloads\n", __func__,
+              (unsigned long long) handle);
+        region->disabled = true;
+        goto exit;
+    }
+
+    if (write) {
+        memcpy(region->addr, buf, *byte_count);
+        auto status = agm_client_1_1->ipc_agm_session_write_shm(handle, 0,
+                                           (uint32_t) *byte_count,
+                                           [&](int32_t _ret, uint32_t cnt)
+                                           { ret = _ret;
+                                             count = cnt;
+                                           });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed.\n", __func__);
+            ret = -EINVAL;
+        }
+    } else {
+        auto status = agm_client_1_1->ipc_agm_session_read_shm(handle, 0,
+                                           (uint32_t) *byte_count,
+                                           [&](int32_t _ret, uint32_t cnt)
+                                           { ret = _ret;
+                                             count = cnt;
+                                           });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed.\n", __func__);
+            ret = -EINVAL;
+        }
+        if (!ret && count <= *byte_count)
+            memcpy(buf, region->addr, count);
+    }
+    if (!ret)
+        *byte_count = (size_t) count;
+exit:
+    pthread_mutex_unlock(&region->lock);
+    return ret;
+}
+
 int agm_register_service_crash_callback(agm_service_crash_cb cb, uint64_t cookie)
 {
     int ret = 0;
@@ -233,8 +484,11 @@ int agm_session_close(uint64_t handle){
     ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) handle);
     if (!agm_server_died) {
         android::sp<IAGM> agm_client = get_agm_server();
-        return agm_client->ipc_agm_session_close(handle);
+        int ret = agm_client->ipc_agm_session_close(handle);
+        client_shm_release(handle);
+        return ret;
     }
+    client_shm_release(handle);
     return -EINVAL;
 }
 
@@ -352,7 +606,10 @@ int agm_session_read(uint64_t handle, void *buf, size_t *byte_count){
         if (!handle)
             return -EINVAL;
 
-        int ret = -EINVAL;
+        int ret = client_shm_transfer(handle, buf, byte_count, false);
+        if (ret != -ENOSYS)
+            return ret;
+        ret = -EINVAL;
 
         auto status = agm_client->ipc_agm_session_read(handle, *byte_count,
                    [&](int32_t _ret, hidl_vec<uint8_t> buff_hidl, uint32_t cnt)
@@ -379,6 +636,11 @@ int agm_session_write(uint64_t handle, void *buf, size_t *byte_count) {
         if (!handle)
             return -EINVAL;
 
+        ret = client_shm_transfer(handle, buf, byte_count, true);
+        if (ret != -ENOSYS)
+            return ret;
+        ret = -EINVAL;
+
         hidl_vec<uint8_t> buf_hidl;
         buf_hidl.resize(*byte_count);
         memcpy(buf_hidl.data(), buf, *byte_count);
@@ -1111,6 +1373,158 @@ int agm_session_write_datapath_params(uint32_t session_id, struct agm_buff *buf)
     return -EINVAL;
 }
 
+int agm_session_batch(const void *ops, size_t size, uint32_t num_ops,
+                      struct agm_batch_status *status)
+{
+    int ret = -EINVAL;
+
+    ALOGV("%s called with num_ops = %d, size = %zu\n", __func__, num_ops, size);
+    if (!ops || !status || num_ops == 0)
+        return -EINVAL;
+
+    for (uint32_t i = 0; i < num_ops; i++) {
+        status[i].ret = -ECANCELED;
+        status[i].hndl = 0;
+    }
+
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_1_1 =
+                vendor::qti::hardware::AGMIPC::V1_1::IAGM::castFrom(agm_client);
+        if (agm_client_1_1 == nullptr) {
+            ALOGE("%s: AGM service does not support batching\n", __func__);
+            return -ENOSYS;
+        }
+
+        hidl_vec<uint8_t> ops_hidl;
+        ops_hidl.setToExternal((uint8_t *)ops, size);
+        auto hidl_status = agm_client_1_1->ipc_agm_session_batch(ops_hidl, num_ops,
+                              [&](int32_t _ret, hidl_vec<AgmBatchStatus> status_hidl)
+                              {  ret = _ret;
+                                 for (uint32_t i = 0; i < num_ops &&
+                                                  i < status_hidl.size(); i++) {
+                                     status[i].ret = status_hidl[i].ret;
+                                     status[i].hndl = status_hidl[i].hndl;
+                                 }
+                              });
+        if (!hidl_status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+        }
+    }
+    return ret;
+}
+
+int agm_session_async_op(uint64_t handle, enum agm_session_async_op op,
+                         uint64_t token)
+{
+    ALOGV("%s called with handle = %llx op = %d\n", __func__,
+          (unsigned long long) handle, op);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_1_1 =
+                vendor::qti::hardware::AGMIPC::V1_1::IAGM::castFrom(agm_client);
+        if (agm_client_1_1 == nullptr) {
+            ALOGE("%s: AGM service does not support async ops\n", __func__);
+            return -ENOSYS;
+        }
+        int ret = agm_client_1_1->ipc_agm_session_async_op(handle, op, token);
+        if (!ret && op == AGM_SESSION_OP_CLOSE)
+            client_shm_release(handle);
+        return ret;
+    }
+    return -EINVAL;
+}
+
+int agm_session_writev(uint64_t handle, const struct iovec *iov, int iovcnt,
+                       size_t *count)
+{
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) handle);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_1_1 =
+                vendor::qti::hardware::AGMIPC::V1_1::IAGM::castFrom(agm_client);
+        hidl_vec<uint8_t> buf_hidl;
+        hidl_vec<uint32_t> seg_sizes;
+        size_t size = 0, offset = 0;
+        int ret = -EINVAL;
+
+        if (!handle || iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX)
+            return -EINVAL;
+        if (agm_client_1_1 == nullptr) {
+            ALOGE("%s: AGM service does not support writev\n", __func__);
+            return -ENOSYS;
+        }
+
+        /*one transaction carries all segments*/
+        seg_sizes.resize(iovcnt);
+        for (int i = 0; i < iovcnt; i++) {
+            seg_sizes[i] = (uint32_t) iov[i].iov_len;
+            size += iov[i].iov_len;
+        }
+        buf_hidl.resize(size);
+        for (int i = 0; i < iovcnt; i++) {
+            memcpy(buf_hidl.data() + offset, iov[i].iov_base, iov[i].iov_len);
+            offset += iov[i].iov_len;
+        }
+
+        auto status = agm_client_1_1->ipc_agm_session_writev(handle, buf_hidl,
+                                           seg_sizes,
+                                           [&](int32_t _ret, uint64_t cnt)
+                                           { ret = _ret;
+                                             *count = (size_t) cnt;
+                                           });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+        }
+        return ret;
+    }
+    return -EINVAL;
+}
+
+int agm_session_readv(uint64_t handle, const struct iovec *iov, int iovcnt,
+                      size_t *count)
+{
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) handle);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        android::sp<vendor::qti::hardware::AGMIPC::V1_1::IAGM> agm_client_1_1 =
+                vendor::qti::hardware::AGMIPC::V1_1::IAGM::castFrom(agm_client);
+        hidl_vec<uint32_t> seg_sizes;
+        int ret = -EINVAL;
+
+        if (!handle || iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX)
+            return -EINVAL;
+        if (agm_client_1_1 == nullptr) {
+            ALOGE("%s: AGM service does not support readv\n", __func__);
+            return -ENOSYS;
+        }
+
+        seg_sizes.resize(iovcnt);
+        for (int i = 0; i < iovcnt; i++)
+            seg_sizes[i] = (uint32_t) iov[i].iov_len;
+
+        auto status = agm_client_1_1->ipc_agm_session_readv(handle, seg_sizes,
+                   [&](int32_t _ret, hidl_vec<uint8_t> buff_hidl, uint64_t cnt)
+                   { size_t offset = 0, len;
+                     ret = _ret;
+                     *count = (size_t) cnt;
+                     /*scatter what was read back over the client segments*/
+                     for (int i = 0; i < iovcnt && offset < buff_hidl.size(); i++) {
+                         len = buff_hidl.size() - offset;
+                         if (len > iov[i].iov_len)
+                             len = iov[i].iov_len;
+                         memcpy(iov[i].iov_base, buff_hidl.data() + offset, len);
+                         offset += len;
+                     }
+                   });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+        }
+        return ret;
+    }
+    return -EINVAL;
+}
+
 int agm_dump(struct agm_dump_info *dump_info) {
     if (agm_server_died) {
         ALOGE("%s: Cannot perform dump, AGM service has died", __func__);
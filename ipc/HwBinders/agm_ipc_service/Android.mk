@@ -23,6 +23,7 @@ LOCAL_SHARED_LIBRARIES := \
     libbase \
     libar-gsl \
     vendor.qti.hardware.AGMIPC@1.0 \
+    vendor.qti.hardware.AGMIPC@1.1 \
     libutilscallstack \
     libagm
 
@@ -55,6 +56,7 @@ LOCAL_SHARED_LIBRARIES := \
     libhardware \
     libhidlbase \
     vendor.qti.hardware.AGMIPC@1.0 \
+    vendor.qti.hardware.AGMIPC@1.1 \
     vendor.qti.hardware.AGMIPC@1.0-impl \
     libagm
 
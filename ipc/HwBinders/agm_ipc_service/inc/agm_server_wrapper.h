@@ -63,6 +63,7 @@
 #define ANDROID_SYSTEM_AGMIPC_V1_0_AGM_H
 
 #include <vendor/qti/hardware/AGMIPC/1.0/IAGM.h>
+#include <vendor/qti/hardware/AGMIPC/1.1/IAGM.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <vector>
@@ -85,6 +86,7 @@ using ::android::hardware::Return;
 using ::android::hardware::Void;
 using ::android::hardware::hidl_handle;
 using ::android::sp;
+using ::vendor::qti::hardware::AGMIPC::V1_1::AgmBatchStatus;
 
 class SrvrClbk
 {
@@ -127,7 +129,7 @@ typedef struct clbk_data {
    SrvrClbk *srv_clt_data;
 } clbk_data;
 
-struct AGM : public IAGM {
+struct AGM : public ::vendor::qti::hardware::AGMIPC::V1_1::IAGM {
     public :
     AGM() {
       agm_initialized = agm_init() == 0?true:false;
@@ -252,6 +254,26 @@ struct AGM : public IAGM {
                                ipc_agm_get_aif_info_list_cb _hidl_cb) override;
     Return<int32_t> ipc_agm_session_write_datapath_params(uint32_t session_id,
                                const hidl_vec<AgmBuff>& buff) override;
+    Return<void> ipc_agm_session_batch(const hidl_vec<uint8_t>& ops,
+                               uint32_t num_ops,
+                               ipc_agm_session_batch_cb _hidl_cb) override;
+    Return<int32_t> ipc_agm_session_async_op(uint64_t hndl, uint32_t op,
+                               uint64_t token) override;
+    Return<void> ipc_agm_session_writev(uint64_t hndl,
+                               const hidl_vec<uint8_t>& buff,
+                               const hidl_vec<uint32_t>& seg_sizes,
+                               ipc_agm_session_writev_cb _hidl_cb) override;
+    Return<void> ipc_agm_session_readv(uint64_t hndl,
+                               const hidl_vec<uint32_t>& seg_sizes,
+                               ipc_agm_session_readv_cb _hidl_cb) override;
+    Return<int32_t> ipc_agm_session_register_shm(uint64_t hndl,
+                               const hidl_memory& mem) override;
+    Return<void> ipc_agm_session_write_shm(uint64_t hndl, uint32_t offset,
+                               uint32_t count,
+                               ipc_agm_session_write_shm_cb _hidl_cb) override;
+    Return<void> ipc_agm_session_read_shm(uint64_t hndl, uint32_t offset,
+                               uint32_t count,
+                               ipc_agm_session_read_shm_cb _hidl_cb) override;
 
     int is_agm_initialized() { return agm_initialized;}
 
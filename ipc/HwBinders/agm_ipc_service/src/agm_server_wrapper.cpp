@@ -67,6 +67,7 @@
 #include <cutils/list.h>
 #include <cutils/android_filesystem_config.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include <signal.h>
 #include "gsl_intf.h"
 #include <hwbinder/IPCThreadState.h>
@@ -94,6 +95,18 @@ static pthread_mutex_t client_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static list_declare(clbk_data_list);
 static pthread_mutex_t clbk_data_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Region registered through ipc_agm_session_register_shm(). Doorbell calls
+ * hold a reference while agm reads or writes the mapping, so a close or a
+ * re-registration cannot unmap it from under them. refs is protected by
+ * client_list_lock.
+ */
+typedef struct {
+   uint32_t refs;
+   void *addr;
+   size_t size;
+} agm_shm_region;
+
 typedef struct {
    struct listnode list;
    uint32_t session_id;
@@ -101,6 +114,7 @@ typedef struct {
    uint64_t handle;
    std::vector<std::pair<int, int>> shared_mem_fd_list;
    std::vector<uint32_t> aif_id_list;
+   agm_shm_region *shm;
 } agm_client_session_handle;
 
 typedef struct {
@@ -110,6 +124,15 @@ typedef struct {
     struct listnode agm_client_hndl_list;
 } client_info;
 
+static void shm_region_put_l(agm_shm_region *region)
+{
+    if (!region || --region->refs)
+        return;
+
+    munmap(region->addr, region->size);
+    free(region);
+}
+
 void dumpAgmStackTrace(struct agm_dump_info *d_info) {
     if (d_info->uid == AID_AUDIOSERVER && d_info->signal > 0) {
         // In TimeCheck or ANR scenarios, HAL receives debugger signal
@@ -198,6 +221,7 @@ void client_death_notifier::serviceDied(uint64_t cookie,
                 agm_session_set_params(session_handle->session_id, NULL, 0);
 
                 session_handle->aif_id_list.clear();
+                shm_region_put_l(session_handle->shm);
                 pthread_mutex_destroy(&session_handle->handle_lock);
                 list_remove(sess_node);
                 free(session_handle);
@@ -359,6 +383,139 @@ static void add_session_handle_to_list_l(uint32_t session_id, uint64_t handle)
     ALOGV("%s: Adding session id %d and handle %x to client handle list \n", __func__, session_id, handle);
 }
 
+/*
+ * Batched completions go out through event_callback as plain bytes, so the
+ * buffers are handed back under the fd the client passed in, which is what
+ * event_callback_rw_done does for a single completion.
+ */
+static void map_batch_alloc_handles_l(client_info *client_obj,
+                uint32_t session_id,
+                struct agm_event_read_write_done_batch_payload *payload)
+{
+    struct listnode *sess_node = NULL;
+    struct listnode *sess_tempnode = NULL;
+    agm_client_session_handle *hndle = NULL;
+    struct agm_buff *buff = NULL;
+
+    list_for_each_safe(sess_node, sess_tempnode,
+                                 &client_obj->agm_client_hndl_list) {
+        hndle = node_to_item(sess_node, agm_client_session_handle, list);
+        if (hndle->session_id != session_id)
+            continue;
+
+        for (uint32_t i = 0; i < payload->num_done; i++) {
+            buff = &payload->done[i].buff;
+            buff->addr = NULL;
+            buff->metadata = NULL;
+            for (int j = 0; j < hndle->shared_mem_fd_list.size(); j++) {
+                if (hndle->shared_mem_fd_list[j].second ==
+                                      buff->alloc_info.alloc_handle) {
+                    buff->alloc_info.alloc_handle =
+                                      hndle->shared_mem_fd_list[j].first;
+                    hndle->shared_mem_fd_list.erase(
+                                      hndle->shared_mem_fd_list.begin() + j);
+                    break;
+                }
+            }
+        }
+        break;
+    }
+}
+
+static void remove_session_handle_from_list_l(int pid, uint64_t hndl)
+{
+    struct listnode *node = NULL;
+    struct listnode *tempnode = NULL;
+    agm_client_session_handle *session_handle = NULL;
+    client_info *handle = NULL;
+    struct listnode *sess_node = NULL;
+    struct listnode *sess_tempnode = NULL;
+
+    list_for_each_safe(node, tempnode, &client_list) {
+        handle = node_to_item(node, client_info, list);
+        if (handle->pid != pid)
+            continue;
+
+        list_for_each_safe(sess_node, sess_tempnode,
+                                  &handle->agm_client_hndl_list) {
+            session_handle = node_to_item(sess_node,
+                                 agm_client_session_handle,
+                                 list);
+           pthread_mutex_lock(&session_handle->handle_lock);
+           if (session_handle->handle == hndl) {
+               session_handle->handle = 0;
+               pthread_mutex_unlock(&session_handle->handle_lock);
+               session_handle->shared_mem_fd_list.clear();
+               session_handle->aif_id_list.clear();
+               shm_region_put_l(session_handle->shm);
+               pthread_mutex_destroy(&session_handle->handle_lock);
+               list_remove(sess_node);
+               free(session_handle);
+               return;
+            }
+           pthread_mutex_unlock(&session_handle->handle_lock);
+        }
+    }
+}
+
+static agm_client_session_handle* find_session_handle_l(int pid, uint64_t hndl)
+{
+    struct listnode *node = NULL;
+    struct listnode *sess_node = NULL;
+    agm_client_session_handle *session_handle = NULL;
+    client_info *handle = NULL;
+
+    list_for_each(node, &client_list) {
+        handle = node_to_item(node, client_info, list);
+        if (handle->pid != pid)
+            continue;
+
+        list_for_each(sess_node, &handle->agm_client_hndl_list) {
+            session_handle = node_to_item(sess_node,
+                                 agm_client_session_handle,
+                                 list);
+            if (session_handle->handle == hndl)
+                return session_handle;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Takes a reference on the region the calling client registered for hndl
+ * once [offset, offset + count) is known to lie within it.
+ */
+static int shm_region_get(int pid, uint64_t hndl, uint32_t offset,
+                          uint32_t count, agm_shm_region **region)
+{
+    agm_client_session_handle *session_handle = NULL;
+    int ret = 0;
+
+    pthread_mutex_lock(&client_list_lock);
+    session_handle = find_session_handle_l(pid, hndl);
+    if (!session_handle || !session_handle->shm) {
+        ret = -ENOENT;
+        goto exit;
+    }
+    if (offset > session_handle->shm->size ||
+        count > session_handle->shm->size - offset) {
+        ret = -EINVAL;
+        goto exit;
+    }
+    session_handle->shm->refs++;
+    *region = session_handle->shm;
+exit:
+    pthread_mutex_unlock(&client_list_lock);
+    return ret;
+}
+
+static void shm_region_put(agm_shm_region *region)
+{
+    pthread_mutex_lock(&client_list_lock);
+    shm_region_put_l(region);
+    pthread_mutex_unlock(&client_list_lock);
+}
+
 namespace vendor {
 namespace qti {
 namespace hardware {
@@ -498,6 +655,14 @@ void ipc_callback (uint32_t session_id,
         int8_t *dst = (int8_t *)evt_param_l.data()->event_payload.data();
         int8_t *src = (int8_t *)evt_param->event_payload;
         memcpy(dst, src, evt_param->event_payload_size);
+        if (eventId == AGM_EVENT_READ_WRITE_DONE_BATCH &&
+            evt_param->event_payload_size >
+                     sizeof(struct agm_event_read_write_done_batch_payload)) {
+            pthread_mutex_lock(&client_list_lock);
+            map_batch_alloc_handles_l(client_obj, session_id,
+                    (struct agm_event_read_write_done_batch_payload *)dst);
+            pthread_mutex_unlock(&client_list_lock);
+        }
         auto status = clbk_bdr->event_callback(session_id, evt_param_l,
                                   sr_clbk_dat->get_clnt_data());
         if (!status.isOk()) {
@@ -1019,40 +1184,10 @@ Return<int32_t> AGM::ipc_agm_session_set_config(uint64_t hndl,
 
 Return<int32_t> AGM::ipc_agm_session_close(uint64_t hndl) {
     ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
-    struct listnode *node = NULL;
-    struct listnode *tempnode = NULL;
-    agm_client_session_handle *session_handle = NULL;
-    client_info *handle = NULL;
-    struct listnode *sess_node = NULL;
-    struct listnode *sess_tempnode = NULL;
     int pid = ::android::hardware::IPCThreadState::self()->getCallingPid();
 
     pthread_mutex_lock(&client_list_lock);
-    list_for_each_safe(node, tempnode, &client_list) {
-        handle = node_to_item(node, client_info, list);
-        if (handle->pid != pid)
-            continue;
-
-        list_for_each_safe(sess_node, sess_tempnode,
-                                  &handle->agm_client_hndl_list) {
-            session_handle = node_to_item(sess_node,
-                                 agm_client_session_handle,
-                                 list);
-           pthread_mutex_lock(&session_handle->handle_lock);
-           if (session_handle->handle == hndl) {
-               session_handle->handle = 0;
-               pthread_mutex_unlock(&session_handle->handle_lock);
-               session_handle->shared_mem_fd_list.clear();
-               session_handle->aif_id_list.clear();
-               pthread_mutex_destroy(&session_handle->handle_lock);
-               list_remove(sess_node);
-               free(session_handle);
-               goto done;
-            }
-           pthread_mutex_unlock(&session_handle->handle_lock);
-        }
-    }
-done:
+    remove_session_handle_from_list_l(pid, hndl);
     pthread_mutex_unlock(&client_list_lock);
     return agm_session_close(hndl);
 }
@@ -1676,6 +1811,253 @@ exit:
     return ret;
 }
 
+Return<void> AGM::ipc_agm_session_batch(const hidl_vec<uint8_t>& ops,
+                                        uint32_t num_ops,
+                                        ipc_agm_session_batch_cb _hidl_cb)
+{
+    hidl_vec<AgmBatchStatus> status_ret;
+    struct agm_batch_status *status = NULL;
+    const struct agm_batch_op *op = NULL;
+    uint32_t i;
+    int32_t ret = -EINVAL;
+
+    ALOGV("%s: num_ops %d size %zu", __func__, num_ops, ops.size());
+    if (num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS) {
+        ALOGE("%s: Invalid num_ops %d", __func__, num_ops);
+        goto exit;
+    }
+
+    status = (struct agm_batch_status *)calloc(num_ops, sizeof(*status));
+    if (status == NULL) {
+        ALOGE("%s: Cannot allocate memory for batch status\n", __func__);
+        ret = -ENOMEM;
+        goto exit;
+    }
+
+    ret = agm_session_batch(ops.data(), ops.size(), num_ops, status);
+
+    /*
+     * Replay the client book keeping the single shot calls do, for the ops
+     * that went through, so that a dying client still gets its sessions
+     * and audio interfaces torn down.
+     */
+    pthread_mutex_lock(&client_list_lock);
+    op = (const struct agm_batch_op *)ops.data();
+    for (i = 0; i < num_ops && status[i].ret == 0; i++, op = AGM_BATCH_OP_NEXT(op)) {
+        switch (op->op_id) {
+        case AGM_BATCH_OP_SESSION_SET_METADATA:
+            if (op->payload_size >= sizeof(uint32_t) && NUM_GKV(op->payload))
+                add_session_to_list_l(op->session_id);
+            break;
+        case AGM_BATCH_OP_SESSION_AIF_SET_METADATA:
+            if (op->payload_size >= sizeof(uint32_t) && NUM_GKV(op->payload))
+                add_session_aif_to_list_l(op->session_id, op->aif_id);
+            break;
+        case AGM_BATCH_OP_SESSION_AIF_CONNECT:
+            if (op->arg)
+                add_session_aif_to_list_l(op->session_id, op->aif_id);
+            else
+                remove_session_aif_from_list_l(op->session_id, op->aif_id);
+            break;
+        case AGM_BATCH_OP_SESSION_OPEN:
+            add_session_handle_to_list_l(op->session_id, status[i].hndl);
+            break;
+        default:
+            break;
+        }
+    }
+    pthread_mutex_unlock(&client_list_lock);
+
+    status_ret.resize(num_ops);
+    for (i = 0; i < num_ops; i++) {
+        status_ret[i].ret = status[i].ret;
+        status_ret[i].reserved = 0;
+        status_ret[i].hndl = status[i].hndl;
+    }
+
+exit:
+    _hidl_cb(ret, status_ret);
+    free(status);
+    return Void();
+}
+
+Return<int32_t> AGM::ipc_agm_session_async_op(uint64_t hndl, uint32_t op,
+                                             uint64_t token)
+{
+    ALOGV("%s called with handle = %llx op = %d\n", __func__,
+          (unsigned long long) hndl, op);
+    int pid = ::android::hardware::IPCThreadState::self()->getCallingPid();
+    int32_t ret;
+
+    ret = agm_session_async_op(hndl, (enum agm_session_async_op)op, token);
+    /*
+     * The close itself is still queued, but the client is done with the
+     * handle, so drop it from the death cleanup list right away.
+     */
+    if (!ret && op == AGM_SESSION_OP_CLOSE) {
+        pthread_mutex_lock(&client_list_lock);
+        remove_session_handle_from_list_l(pid, hndl);
+        pthread_mutex_unlock(&client_list_lock);
+    }
+    return ret;
+}
+
+/*
+ * Points iov at consecutive seg_sizes sized slices of base. Fails if the
+ * segments do not add up to size or there are too many of them.
+ */
+static int seg_sizes_to_iov(const hidl_vec<uint32_t>& seg_sizes, uint8_t *base,
+                            size_t size, struct iovec *iov)
+{
+    size_t offset = 0;
+
+    if (seg_sizes.size() > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+
+    for (size_t i = 0; i < seg_sizes.size(); i++) {
+        if (seg_sizes[i] > size - offset)
+            return -EINVAL;
+        iov[i].iov_base = base + offset;
+        iov[i].iov_len = seg_sizes[i];
+        offset += seg_sizes[i];
+    }
+
+    return offset == size ? 0 : -EINVAL;
+}
+
+Return<void> AGM::ipc_agm_session_writev(uint64_t hndl,
+                                         const hidl_vec<uint8_t>& buff,
+                                         const hidl_vec<uint32_t>& seg_sizes,
+                                         ipc_agm_session_writev_cb _hidl_cb)
+{
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+    struct iovec iov[AGM_SESSION_IOV_MAX];
+    size_t count = 0;
+    int ret;
+
+    /*
+     *the segments lie back to back in the transaction buffer, so agm sends
+     *them to the DSP from there as one buffer without staging a copy
+     */
+    ret = seg_sizes_to_iov(seg_sizes, const_cast<uint8_t *>(buff.data()),
+                           buff.size(), iov);
+    if (!ret)
+        ret = agm_session_writev(hndl, iov, seg_sizes.size(), &count);
+    _hidl_cb(ret, count);
+    return Void();
+}
+
+Return<void> AGM::ipc_agm_session_readv(uint64_t hndl,
+                                        const hidl_vec<uint32_t>& seg_sizes,
+                                        ipc_agm_session_readv_cb _hidl_cb)
+{
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+    struct iovec iov[AGM_SESSION_IOV_MAX];
+    hidl_vec<uint8_t> buff_ret;
+    size_t size = 0, count = 0;
+    int ret;
+
+    for (size_t i = 0; i < seg_sizes.size(); i++)
+        size += seg_sizes[i];
+    buff_ret.resize(size);
+
+    ret = seg_sizes_to_iov(seg_sizes, buff_ret.data(), size, iov);
+    if (!ret)
+        ret = agm_session_readv(hndl, iov, seg_sizes.size(), &count);
+    buff_ret.resize(count);
+    _hidl_cb(ret, buff_ret, count);
+    return Void();
+}
+
+Return<int32_t> AGM::ipc_agm_session_register_shm(uint64_t hndl,
+                                                  const hidl_memory& mem)
+{
+    ALOGV("%s called with handle = %llx size = %zu\n", __func__,
+          (unsigned long long) hndl, (size_t) mem.size());
+    int pid = ::android::hardware::IPCThreadState::self()->getCallingPid();
+    agm_client_session_handle *session_handle = NULL;
+    agm_shm_region *region = NULL;
+    const native_handle_t *mem_handle = mem.handle();
+    void *addr = NULL;
+    int32_t ret = 0;
+
+    if (mem.size() > 0) {
+        if (!mem_handle || mem_handle->numFds < 1)
+            return -EINVAL;
+
+        addr = mmap(NULL, mem.size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+                    mem_handle->data[0], 0);
+        if (addr == MAP_FAILED) {
+            ALOGE("%s: mmap of %zu bytes failed, errno %d\n", __func__,
+                  (size_t) mem.size(), errno);
+            return -errno;
+        }
+        region = (agm_shm_region *) calloc(1, sizeof(agm_shm_region));
+        if (!region) {
+            ALOGE("%s: Cannot allocate memory for shm region\n", __func__);
+            munmap(addr, mem.size());
+            return -ENOMEM;
+        }
+        region->refs = 1;
+        region->addr = addr;
+        region->size = mem.size();
+    }
+
+    pthread_mutex_lock(&client_list_lock);
+    session_handle = find_session_handle_l(pid, hndl);
+    if (!session_handle) {
+        ret = -EINVAL;
+        shm_region_put_l(region);
+    } else {
+        shm_region_put_l(session_handle->shm);
+        session_handle->shm = region;
+    }
+    pthread_mutex_unlock(&client_list_lock);
+    return ret;
+}
+
+Return<void> AGM::ipc_agm_session_write_shm(uint64_t hndl, uint32_t offset,
+                                            uint32_t count,
+                                            ipc_agm_session_write_shm_cb _hidl_cb)
+{
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+    int pid = ::android::hardware::IPCThreadState::self()->getCallingPid();
+    agm_shm_region *region = NULL;
+    size_t cnt = count;
+    int ret;
+
+    ret = shm_region_get(pid, hndl, offset, count, &region);
+    if (ret) {
+        _hidl_cb(ret, 0);
+        return Void();
+    }
+    ret = agm_session_write(hndl, (uint8_t *) region->addr + offset, &cnt);
+    shm_region_put(region);
+    _hidl_cb(ret, cnt);
+    return Void();
+}
+
+Return<void> AGM::ipc_agm_session_read_shm(uint64_t hndl, uint32_t offset,
+                                           uint32_t count,
+                                           ipc_agm_session_read_shm_cb _hidl_cb)
+{
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+    int pid = ::android::hardware::IPCThreadState::self()->getCallingPid();
+    agm_shm_region *region = NULL;
+    size_t cnt = count;
+    int ret;
+
+    ret = shm_region_get(pid, hndl, offset, count, &region);
+    if (ret) {
+        _hidl_cb(ret, 0);
+        return Void();
+    }
+    ret = agm_session_read(hndl, (uint8_t *) region->addr + offset, &cnt);
+    shm_region_put(region);
+    _hidl_cb(ret, cnt);
+    return Void();
+}
+
 Return<int32_t> AGM::ipc_agm_dump(const hidl_vec<AgmDumpInfo>& dump_info) {
     struct agm_dump_info *d_info =
             (struct agm_dump_info *)dump_info.data();
@@ -28,11 +28,11 @@
  */
 
 #define LOG_TAG "vendor.qti.hardware.AGMIPC@1.0-service"
-#include <vendor/qti/hardware/AGMIPC/1.0/IAGM.h>
+#include <vendor/qti/hardware/AGMIPC/1.1/IAGM.h>
 #include <hidl/LegacySupport.h>
 #include "inc/agm_server_wrapper.h"
 
-using vendor::qti::hardware::AGMIPC::V1_0::IAGM;
+using vendor::qti::hardware::AGMIPC::V1_1::IAGM;
 using vendor::qti::hardware::AGMIPC::V1_0::implementation::AGM;
 using android::hardware::defaultPassthroughServiceImplementation;
 using android::hardware::configureRpcThreadpool;
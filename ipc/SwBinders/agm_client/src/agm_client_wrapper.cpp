@@ -77,6 +77,10 @@
 #include <fcntl.h>
 #include <sys/shm.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
 #include <utils/RefBase.h>
 #include <binder/IPCThreadState.h>
 #include <pthread.h>
@@ -93,6 +97,32 @@ sp<server_death_notifier> Server_death_notifier = NULL;
 sp<IAgmService> agm_client = NULL;
 bool agm_server_died = false;
 
+/*how often a wait on the ring checks whether the service died*/
+#ifndef AGM_SHM_RING_POLL_MS
+#define AGM_SHM_RING_POLL_MS 200
+#endif
+
+/*
+ * Client end of a session ring, see struct agm_shm_ring. It is set up on the
+ * first read or write of the session, which also fixes its direction; calls
+ * in the other direction and sessions whose service refused the ring stay
+ * on the blob path.
+ */
+struct client_shm_ring {
+    struct listnode list;
+    uint64_t handle;
+    pthread_mutex_t lock;
+    struct agm_shm_ring *ring;
+    size_t map_size;
+    int srv_efd;
+    int clt_efd;
+    uint32_t dir;
+    bool disabled;
+};
+
+static list_declare(client_ring_list);
+static pthread_mutex_t client_ring_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 android::sp<IAgmService> get_agm_server()
 {
@@ -125,6 +155,175 @@ void server_death_notifier::binderDied(const wp<IBinder>& who __attribute__((unu
     //add further functionality
 }
 
+static struct client_shm_ring *client_ring_get(uint64_t handle)
+{
+    struct listnode *node = NULL;
+    struct client_shm_ring *cr = NULL;
+
+    pthread_mutex_lock(&client_ring_list_lock);
+    list_for_each(node, &client_ring_list) {
+        cr = node_to_item(node, struct client_shm_ring, list);
+        if (cr->handle == handle)
+            goto exit;
+    }
+    cr = (struct client_shm_ring *)calloc(1, sizeof(struct client_shm_ring));
+    if (cr == NULL) {
+        AGM_LOGE("%s: Cannot allocate memory for ring\n", __func__);
+        goto exit;
+    }
+    cr->handle = handle;
+    cr->srv_efd = -1;
+    cr->clt_efd = -1;
+    pthread_mutex_init(&cr->lock, (const pthread_mutexattr_t *) NULL);
+    list_add_tail(&client_ring_list, &cr->list);
+exit:
+    pthread_mutex_unlock(&client_ring_list_lock);
+    return cr;
+}
+
+static void client_ring_unmap(struct client_shm_ring *cr)
+{
+    if (cr->ring)
+        munmap(cr->ring, cr->map_size);
+    if (cr->srv_efd >= 0)
+        close(cr->srv_efd);
+    if (cr->clt_efd >= 0)
+        close(cr->clt_efd);
+    cr->ring = NULL;
+    cr->srv_efd = -1;
+    cr->clt_efd = -1;
+}
+
+/*Called once the session is closed, the service has dropped its end by then*/
+static void client_ring_release(uint64_t handle)
+{
+    struct listnode *node = NULL;
+    struct listnode *tempnode = NULL;
+    struct client_shm_ring *cr = NULL;
+
+    pthread_mutex_lock(&client_ring_list_lock);
+    list_for_each_safe(node, tempnode, &client_ring_list) {
+        cr = node_to_item(node, struct client_shm_ring, list);
+        if (cr->handle != handle)
+            continue;
+        list_remove(node);
+        pthread_mutex_lock(&cr->lock);
+        client_ring_unmap(cr);
+        pthread_mutex_unlock(&cr->lock);
+        pthread_mutex_destroy(&cr->lock);
+        free(cr);
+        break;
+    }
+    pthread_mutex_unlock(&client_ring_list_lock);
+}
+
+static int client_ring_setup(struct client_shm_ring *cr, uint32_t dir)
+{
+    android::sp<IAgmService> agm_client = get_agm_server();
+    size_t map_size = sizeof(struct agm_shm_ring) + AGM_SHM_RING_SIZE;
+    void *addr = NULL;
+    int memfd, ret;
+
+    memfd = memfd_create("agm_session_ring", MFD_CLOEXEC);
+    if (memfd < 0)
+        return -errno;
+    if (ftruncate(memfd, map_size) < 0) {
+        ret = -errno;
+        goto exit;
+    }
+    addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (addr == MAP_FAILED) {
+        ret = -errno;
+        goto exit;
+    }
+    cr->ring = (struct agm_shm_ring *)addr;
+    cr->map_size = map_size;
+    cr->ring->size = AGM_SHM_RING_SIZE;
+    cr->ring->dir = dir;
+    cr->dir = dir;
+
+    cr->srv_efd = eventfd(0, EFD_CLOEXEC);
+    cr->clt_efd = eventfd(0, EFD_CLOEXEC);
+    if (cr->srv_efd < 0 || cr->clt_efd < 0) {
+        ret = -errno;
+        goto exit;
+    }
+
+    ret = agm_client->ipc_agm_session_shm_ring(cr->handle, dir, memfd,
+                                               cr->srv_efd, cr->clt_efd);
+exit:
+    /*the service maps its own copy, the mapping here keeps the memory*/
+    close(memfd);
+    if (ret)
+        client_ring_unmap(cr);
+    return ret;
+}
+
+/*Returns -EAGAIN if the service died while waiting*/
+static int client_ring_wait(void *priv)
+{
+    struct client_shm_ring *cr = (struct client_shm_ring *)priv;
+    struct pollfd pfd = { cr->clt_efd, POLLIN, 0 };
+    uint64_t val;
+    int ret;
+
+    while ((ret = poll(&pfd, 1, AGM_SHM_RING_POLL_MS)) == 0) {
+        if (agm_server_died)
+            return -EAGAIN;
+    }
+    if (ret < 0)
+        return errno == EINTR ? 0 : -EAGAIN;
+    if (read(cr->clt_efd, &val, sizeof(val)) < 0 && errno != EINTR)
+        return -EAGAIN;
+    return 0;
+}
+
+/*
+ * Moves one read or write through the session ring, returning -ENOSYS when
+ * the call has to go through the blob path instead: no ring, a ring set up
+ * for the other direction, or more data than the ring holds.
+ */
+static int client_ring_transfer(uint64_t handle, void *buf, size_t *byte_count,
+                                uint32_t dir)
+{
+    struct client_shm_ring *cr = NULL;
+    int ret;
+
+    if (*byte_count > AGM_SHM_RING_SIZE)
+        return -ENOSYS;
+    cr = client_ring_get(handle);
+    if (!cr)
+        return -ENOSYS;
+
+    pthread_mutex_lock(&cr->lock);
+    if (!cr->ring && !cr->disabled) {
+        ret = client_ring_setup(cr, dir);
+        if (ret) {
+            AGM_LOGI("%s: handle %llx stays on the blob path, ret %d\n",
+                     __func__, (unsigned long long)handle, ret);
+            cr->disabled = true;
+        }
+    }
+    if (cr->disabled || cr->dir != dir)
+        ret = -ENOSYS;
+    else if (dir == AGM_SHM_RING_WRITE)
+        ret = agm_shm_ring_client_write(cr->ring, AGM_SHM_RING_SIZE,
+                                        cr->srv_efd, buf, byte_count,
+                                        client_ring_wait, cr);
+    else
+        ret = agm_shm_ring_client_read(cr->ring, AGM_SHM_RING_SIZE,
+                                       cr->srv_efd, buf, byte_count,
+                                       client_ring_wait, cr);
+    /*-EIO and the like are the agm call failing, the ring is still fine*/
+    if (ret == -AGM_SHM_RING_EBROKEN) {
+        AGM_LOGE("%s: ring of handle %llx is broken, back to the blob path\n",
+                 __func__, (unsigned long long)handle);
+        cr->disabled = true;
+    }
+    pthread_mutex_unlock(&cr->lock);
+    return ret;
+}
+
 int agm_register_service_crash_callback(agm_service_crash_cb cb, uint64_t cookie)
 {
     return 0;
@@ -203,10 +402,15 @@ int agm_session_aif_set_metadata(uint32_t session_id, uint32_t audio_intf,
 
 int agm_session_close(uint64_t handle)
 {
+    int ret;
+
     if (!agm_server_died) {
         android::sp<IAgmService> agm_client = get_agm_server();
-        return agm_client->ipc_agm_session_close(handle);
+        ret = agm_client->ipc_agm_session_close(handle);
+        client_ring_release(handle);
+        return ret;
     }
+    client_ring_release(handle);
     AGM_LOGE("%s: agm service is not running\n", __func__);
     return -EAGAIN;
 }
@@ -293,6 +497,9 @@ int agm_session_read(uint64_t handle, void *buf, size_t *byte_count)
         if (!handle)
            return -EINVAL;
 
+        int ret = client_ring_transfer(handle, buf, byte_count, AGM_SHM_RING_READ);
+        if (ret != -ENOSYS)
+            return ret;
         return agm_client->ipc_agm_session_read(handle, buf, byte_count);
     }
     AGM_LOGE("%s: agm service is not running\n", __func__);
@@ -307,6 +514,9 @@ int agm_session_write(uint64_t handle, void *buf, size_t *byte_count)
         if (!handle)
            return -EINVAL;
 
+        int ret = client_ring_transfer(handle, buf, byte_count, AGM_SHM_RING_WRITE);
+        if (ret != -ENOSYS)
+            return ret;
         return agm_client->ipc_agm_session_write(handle, buf, byte_count);
     }
     AGM_LOGE("%s: agm service is not running\n", __func__);
@@ -516,3 +726,60 @@ int agm_session_get_buf_info(uint32_t session_id, struct agm_buf_info *buf_info,
     ALOGE("%s: agm service is not running\n", __func__);
     return -EAGAIN;
 }
+
+int agm_session_batch(const void *ops, size_t size, uint32_t num_ops,
+                      struct agm_batch_status *status)
+{
+    uint32_t i;
+
+    if (!ops || !status || num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS)
+        return -EINVAL;
+
+    for (i = 0; i < num_ops; i++) {
+        status[i].ret = -ECANCELED;
+        status[i].hndl = 0;
+    }
+
+    if (!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_batch(ops, size, num_ops, status);
+    }
+    AGM_LOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
+int agm_session_async_op(uint64_t handle, enum agm_session_async_op op,
+                         uint64_t token)
+{
+    if (!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        int ret = agm_client->ipc_agm_session_async_op(handle, op, token);
+        if (!ret && op == AGM_SESSION_OP_CLOSE)
+            client_ring_release(handle);
+        return ret;
+    }
+    AGM_LOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
+int agm_session_writev(uint64_t handle, const struct iovec *iov, int iovcnt,
+                       size_t *count)
+{
+    if (!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_writev(handle, iov, iovcnt, count);
+    }
+    AGM_LOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
+int agm_session_readv(uint64_t handle, const struct iovec *iov, int iovcnt,
+                      size_t *count)
+{
+    if (!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_readv(handle, iov, iovcnt, count);
+    }
+    AGM_LOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
@@ -22,7 +22,8 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := agmserver
 LOCAL_SRC_FILES := \
     agm_server_daemon.cpp \
-    agm_server_wrapper.cpp
+    agm_server_wrapper.cpp \
+    agm_shm_ring.cpp
 
 LOCAL_SHARED_LIBRARIES := \
     liblog \
@@ -148,6 +148,18 @@ class AgmService : public BnAgmService
                          enum agm_gapless_silence_type type, uint32_t silence);
         virtual int ipc_agm_session_get_buf_info(uint32_t session_id,
                            struct agm_buf_info *buf_info, uint32_t flag);
+        virtual int ipc_agm_session_batch(const void *ops, size_t size,
+                           uint32_t num_ops, struct agm_batch_status *status);
+        virtual int ipc_agm_session_async_op(uint64_t handle,
+                           enum agm_session_async_op op, uint64_t token);
+        virtual int ipc_agm_session_writev(uint64_t handle,
+                           const struct iovec *iov, int iovcnt,
+                           size_t *count);
+        virtual int ipc_agm_session_readv(uint64_t handle,
+                           const struct iovec *iov, int iovcnt,
+                           size_t *count);
+        virtual int ipc_agm_session_shm_ring(uint64_t handle, uint32_t dir,
+                           int memfd, int srv_efd, int clt_efd);
         ~AgmService()
         {
             AGM_LOGV("AGMService destructor");
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef __AGM_SHM_RING_H__
+#define __AGM_SHM_RING_H__
+
+#include <stdint.h>
+
+/*
+ * Service side of the session rings described in ipc_interface.h. attach
+ * maps the client's memfd, takes its own copies of the fds and starts the
+ * thread that serves calls from the ring. detach stops and joins that
+ * thread and must run before the session is closed.
+ */
+int agm_shm_ring_attach(uint64_t handle, uint32_t dir, int memfd,
+                        int srv_efd, int clt_efd);
+void agm_shm_ring_detach(uint64_t handle);
+
+#endif
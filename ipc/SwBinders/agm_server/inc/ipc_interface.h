@@ -69,8 +69,16 @@
 #include <binder/IServiceManager.h>
 #include <binder/IPCThreadState.h>
 #include <agm/agm_api.h>
+#include <agm/shm_ring.h>
 typedef void shmem_handle_t;
 
+/*
+ * SESSION_SHM_RING hands the service a per session ring so that steady
+ * state agm_session_write/read need no binder transaction. The client
+ * creates the memfd and the two eventfds, see agm/shm_ring.h for the
+ * layout and the protocol.
+ */
+
 // can be shared by both server and client.
 
 class IAgmService: public ::android::IInterface
@@ -153,6 +161,19 @@ class IAgmService: public ::android::IInterface
                                     uint32_t silence) = 0;
         virtual int ipc_agm_session_get_buf_info(uint32_t session_id,
                            struct agm_buf_info *buf_info, uint32_t flag) = 0;
+        virtual int ipc_agm_session_batch(const void *ops, size_t size,
+                           uint32_t num_ops,
+                           struct agm_batch_status *status) = 0;
+        virtual int ipc_agm_session_async_op(uint64_t handle,
+                           enum agm_session_async_op op, uint64_t token) = 0;
+        virtual int ipc_agm_session_writev(uint64_t handle,
+                           const struct iovec *iov, int iovcnt,
+                           size_t *count) = 0;
+        virtual int ipc_agm_session_readv(uint64_t handle,
+                           const struct iovec *iov, int iovcnt,
+                           size_t *count) = 0;
+        virtual int ipc_agm_session_shm_ring(uint64_t handle, uint32_t dir,
+                           int memfd, int srv_efd, int clt_efd) = 0;
 };
 
 class BnAgmService : public ::android::BnInterface<IAgmService> {
@@ -44,6 +44,7 @@
 #include <signal.h>
 #include "ipc_interface.h"
 #include "agm_death_notifier.h"
+#include "agm_shm_ring.h"
 #include "utils.h"
 
 #ifdef DYNAMIC_LOG_ENABLED
@@ -214,6 +215,7 @@ void client_death_notifier::binderDied(const wp<IBinder>& who)
                                              &handle->agm_client_hndl_list) {
                 hndl = node_to_item(sess_node, agm_client_session_handle, list);
                    if (hndl->handle) {
+                       agm_shm_ring_detach(hndl->handle);
                        agm_session_close(hndl->handle);
                        list_remove(sess_node);
                        free(hndl);
@@ -47,6 +47,7 @@
 #include <binder/IMemory.h>
 #include "utils.h"
 #include "agm_server_wrapper.h"
+#include "agm_shm_ring.h"
 
 #ifdef DYNAMIC_LOG_ENABLED
 #include <log_xml_parser.h>
@@ -108,6 +109,7 @@ int AgmService::ipc_agm_session_audio_inf_set_metadata(uint32_t session_id,
 
 int AgmService::ipc_agm_session_close(uint64_t handle){
     ALOGV("%s called\n", __func__);
+    agm_shm_ring_detach(handle);
     return agm_session_close(handle);
 };
 
@@ -285,3 +287,35 @@ int AgmService::ipc_agm_session_get_buf_info(uint32_t session_id,
     ALOGV("%s called\n", __func__);
     return agm_session_get_buf_info(session_id, buf_info, flag);
 };
+
+int AgmService::ipc_agm_session_batch(const void *ops, size_t size,
+                       uint32_t num_ops, struct agm_batch_status *status) {
+    ALOGV("%s called\n", __func__);
+    return agm_session_batch(ops, size, num_ops, status);
+};
+
+int AgmService::ipc_agm_session_async_op(uint64_t handle,
+                       enum agm_session_async_op op, uint64_t token) {
+    ALOGV("%s called\n", __func__);
+    if (op == AGM_SESSION_OP_CLOSE)
+        agm_shm_ring_detach(handle);
+    return agm_session_async_op(handle, op, token);
+};
+
+int AgmService::ipc_agm_session_writev(uint64_t handle,
+                       const struct iovec *iov, int iovcnt, size_t *count) {
+    ALOGV("%s called\n", __func__);
+    return agm_session_writev(handle, iov, iovcnt, count);
+};
+
+int AgmService::ipc_agm_session_readv(uint64_t handle,
+                       const struct iovec *iov, int iovcnt, size_t *count) {
+    ALOGV("%s called\n", __func__);
+    return agm_session_readv(handle, iov, iovcnt, count);
+};
+
+int AgmService::ipc_agm_session_shm_ring(uint64_t handle, uint32_t dir,
+                       int memfd, int srv_efd, int clt_efd) {
+    ALOGV("%s called\n", __func__);
+    return agm_shm_ring_attach(handle, dir, memfd, srv_efd, clt_efd);
+};
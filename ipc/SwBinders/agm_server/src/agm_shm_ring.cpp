@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "agm_shm_ring"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cutils/list.h>
+#include <utils/Log.h>
+#include <agm/agm_api.h>
+#include <agm/shm_ring.h>
+#include "ipc_interface.h"
+#include "agm_shm_ring.h"
+#include "utils.h"
+
+struct shm_ring_srv {
+    struct listnode list;
+    uint64_t handle;
+    struct agm_shm_ring *ring;
+    size_t map_size;
+    uint32_t size;
+    uint32_t dir;
+    int memfd;
+    int srv_efd;
+    int clt_efd;
+    pthread_t thread;
+    bool stop;
+};
+
+static list_declare(shm_ring_list);
+static pthread_mutex_t shm_ring_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Returns -EPIPE once the ring is being detached*/
+static int shm_ring_wait(void *priv)
+{
+    struct shm_ring_srv *srv = (struct shm_ring_srv *)priv;
+    uint64_t val;
+
+    if (__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE))
+        return -EPIPE;
+    if (read(srv->srv_efd, &val, sizeof(val)) < 0 && errno != EINTR)
+        return -EPIPE;
+    return __atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE) ? -EPIPE : 0;
+}
+
+static void *shm_ring_thread(void *arg)
+{
+    struct shm_ring_srv *srv = (struct shm_ring_srv *)arg;
+
+    if (agm_shm_ring_serve(srv->ring, srv->size, srv->dir, srv->handle,
+                           srv->clt_efd, shm_ring_wait, srv) == -AGM_SHM_RING_EBROKEN)
+        AGM_LOGE("ring of handle %llx is corrupt, stop serving it\n",
+                 (unsigned long long)srv->handle);
+    return NULL;
+}
+
+static void shm_ring_free(struct shm_ring_srv *srv)
+{
+    if (srv->ring)
+        munmap(srv->ring, srv->map_size);
+    if (srv->memfd >= 0)
+        close(srv->memfd);
+    if (srv->srv_efd >= 0)
+        close(srv->srv_efd);
+    if (srv->clt_efd >= 0)
+        close(srv->clt_efd);
+    free(srv);
+}
+
+int agm_shm_ring_attach(uint64_t handle, uint32_t dir, int memfd,
+                        int srv_efd, int clt_efd)
+{
+    struct shm_ring_srv *srv = NULL;
+    struct listnode *node = NULL;
+    struct stat st;
+    uint32_t size;
+    int ret = 0;
+
+    if (!handle || memfd < 0 || srv_efd < 0 || clt_efd < 0 ||
+        dir > AGM_SHM_RING_READ)
+        return -EINVAL;
+
+    srv = (struct shm_ring_srv *)calloc(1, sizeof(struct shm_ring_srv));
+    if (!srv) {
+        AGM_LOGE("Cannot allocate memory for ring\n");
+        return -ENOMEM;
+    }
+    srv->handle = handle;
+    srv->dir = dir;
+    srv->memfd = dup(memfd);
+    srv->srv_efd = dup(srv_efd);
+    srv->clt_efd = dup(clt_efd);
+    if (srv->memfd < 0 || srv->srv_efd < 0 || srv->clt_efd < 0) {
+        ret = -errno;
+        goto fail;
+    }
+
+    if (fstat(srv->memfd, &st) < 0 ||
+        st.st_size <= (off_t)sizeof(struct agm_shm_ring)) {
+        ret = -EINVAL;
+        goto fail;
+    }
+    srv->map_size = st.st_size;
+    srv->ring = (struct agm_shm_ring *)mmap(NULL, srv->map_size,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, srv->memfd, 0);
+    if (srv->ring == MAP_FAILED) {
+        srv->ring = NULL;
+        ret = -errno;
+        goto fail;
+    }
+
+    /*size is copied once so the client cannot change it under the thread*/
+    size = srv->ring->size;
+    if (!size || (size & (size - 1)) ||
+        size > srv->map_size - sizeof(struct agm_shm_ring) ||
+        srv->ring->dir != dir) {
+        AGM_LOGE("bad ring, size %u dir %u\n", size, srv->ring->dir);
+        ret = -EINVAL;
+        goto fail;
+    }
+    srv->size = size;
+
+    pthread_mutex_lock(&shm_ring_list_lock);
+    list_for_each(node, &shm_ring_list) {
+        if (node_to_item(node, struct shm_ring_srv, list)->handle == handle) {
+            pthread_mutex_unlock(&shm_ring_list_lock);
+            ret = -EBUSY;
+            goto fail;
+        }
+    }
+    ret = -pthread_create(&srv->thread, (const pthread_attr_t *) NULL,
+                          shm_ring_thread, srv);
+    if (!ret)
+        list_add_tail(&shm_ring_list, &srv->list);
+    pthread_mutex_unlock(&shm_ring_list_lock);
+    if (ret)
+        goto fail;
+
+    AGM_LOGD("handle %llx ring of %u bytes, dir %u\n",
+             (unsigned long long)handle, size, dir);
+    return 0;
+
+fail:
+    AGM_LOGE("attaching ring to handle %llx failed %d\n",
+             (unsigned long long)handle, ret);
+    shm_ring_free(srv);
+    return ret;
+}
+
+void agm_shm_ring_detach(uint64_t handle)
+{
+    struct shm_ring_srv *srv = NULL;
+    struct listnode *node = NULL;
+    struct listnode *tempnode = NULL;
+
+    pthread_mutex_lock(&shm_ring_list_lock);
+    list_for_each_safe(node, tempnode, &shm_ring_list) {
+        if (node_to_item(node, struct shm_ring_srv, list)->handle == handle) {
+            srv = node_to_item(node, struct shm_ring_srv, list);
+            list_remove(node);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shm_ring_list_lock);
+    if (!srv)
+        return;
+
+    __atomic_store_n(&srv->stop, true, __ATOMIC_RELEASE);
+    agm_shm_ring_kick(srv->srv_efd);
+    pthread_join(srv->thread, NULL);
+    shm_ring_free(srv);
+}
@@ -148,6 +148,11 @@ enum {
     AIF_SET_PARAMS,
     SET_GAPLESS_SESSION_METADATA,
     GET_BUF_INFO,
+    SESSION_BATCH,
+    SESSION_ASYNC_OP,
+    SESSION_WRITEV,
+    SESSION_READV,
+    SESSION_SHM_RING,
 };
 
 class BpAgmService : public ::android::BpInterface<IAgmService>
@@ -761,6 +766,136 @@ class BpAgmService : public ::android::BpInterface<IAgmService>
         }
         return reply.readInt32();
     }
+
+    virtual int ipc_agm_session_batch(const void *ops, size_t size,
+                          uint32_t num_ops, struct agm_batch_status *status)
+    {
+        android::Parcel data, reply;
+        android::Parcel::WritableBlob blob;
+        android::Parcel::ReadableBlob status_blob;
+        size_t status_size = num_ops * sizeof(struct agm_batch_status);
+        int ret = -EINVAL;
+
+        AGM_LOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeUint32(num_ops);
+        data.writeUint32(size);
+        data.writeBlob(size, false, &blob);
+        memcpy(blob.data(), ops, size);
+        remote()->transact(SESSION_BATCH, data, &reply);
+        blob.release();
+
+        ret = reply.readInt32();
+        if (reply.readBlob(status_size, &status_blob) == android::OK) {
+            memcpy(status, status_blob.data(), status_size);
+            status_blob.release();
+        }
+        return ret;
+    }
+
+    virtual int ipc_agm_session_async_op(uint64_t handle,
+                          enum agm_session_async_op op, uint64_t token)
+    {
+        android::Parcel data, reply;
+
+        AGM_LOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeInt64((long)handle);
+        data.writeUint32((uint32_t)op);
+        data.writeUint64(token);
+        remote()->transact(SESSION_ASYNC_OP, data, &reply);
+        return reply.readInt32();
+    }
+
+    /*
+     * Segments go as their sizes followed by one blob holding all of them
+     * back to back, the service writes/reads them in place in that blob.
+     */
+    virtual int ipc_agm_session_writev(uint64_t handle,
+                          const struct iovec *iov, int iovcnt, size_t *count)
+    {
+        android::Parcel data, reply;
+        android::Parcel::WritableBlob blob;
+        size_t size = 0, offset = 0;
+        int ret, i;
+
+        AGM_LOGV("%s:%d\n", __func__, __LINE__);
+        if (iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX)
+            return -EINVAL;
+
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeInt64((long)handle);
+        data.writeUint32((uint32_t)iovcnt);
+        for (i = 0; i < iovcnt; i++) {
+            data.writeUint32((uint32_t)iov[i].iov_len);
+            size += iov[i].iov_len;
+        }
+        data.writeBlob(size, false, &blob);
+        for (i = 0; i < iovcnt; i++) {
+            memcpy((uint8_t *)blob.data() + offset, iov[i].iov_base,
+                   iov[i].iov_len);
+            offset += iov[i].iov_len;
+        }
+        remote()->transact(SESSION_WRITEV, data, &reply);
+        blob.release();
+        ret = reply.readInt32();
+        *count = (size_t)reply.readUint64();
+        return ret;
+    }
+
+    virtual int ipc_agm_session_readv(uint64_t handle,
+                          const struct iovec *iov, int iovcnt, size_t *count)
+    {
+        android::Parcel data, reply;
+        android::Parcel::ReadableBlob blob;
+        size_t offset = 0, len;
+        int ret, i;
+
+        AGM_LOGV("%s:%d\n", __func__, __LINE__);
+        if (iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX)
+            return -EINVAL;
+
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeInt64((long)handle);
+        data.writeUint32((uint32_t)iovcnt);
+        for (i = 0; i < iovcnt; i++)
+            data.writeUint32((uint32_t)iov[i].iov_len);
+        remote()->transact(SESSION_READV, data, &reply);
+        ret = reply.readInt32();
+        *count = (size_t)reply.readUint64();
+        if (*count == 0 || reply.readBlob(*count, &blob) != android::OK)
+            return ret;
+        for (i = 0; i < iovcnt && offset < *count; i++) {
+            len = *count - offset;
+            if (len > iov[i].iov_len)
+                len = iov[i].iov_len;
+            memcpy(iov[i].iov_base, (const uint8_t *)blob.data() + offset, len);
+            offset += len;
+        }
+        blob.release();
+        return ret;
+    }
+
+    /*
+     * A service without ring support fails the transaction itself, which
+     * the client takes as a cue to stay on the blob path.
+     */
+    virtual int ipc_agm_session_shm_ring(uint64_t handle, uint32_t dir,
+                          int memfd, int srv_efd, int clt_efd)
+    {
+        android::Parcel data, reply;
+
+        AGM_LOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeInt64((long)handle);
+        data.writeUint32(dir);
+        data.writeFileDescriptor(memfd);
+        data.writeFileDescriptor(srv_efd);
+        data.writeFileDescriptor(clt_efd);
+        if (remote()->transact(SESSION_SHM_RING, data, &reply) != android::OK)
+            return -ENOSYS;
+        return reply.readInt32();
+    }
 };
 
 void ipc_cb (uint32_t session_id, struct agm_event_cb_params *event_params,
@@ -1464,6 +1599,134 @@ android::status_t BnAgmService::onTransact(uint32_t code,
         reply->writeInt32(rc);
         break; }
 
+    case SESSION_BATCH : {
+        uint32_t num_ops, i;
+        size_t size, status_size;
+        const struct agm_batch_op *op = NULL;
+        struct agm_batch_status *status = NULL;
+        void *bn_payload = NULL;
+        android::Parcel::ReadableBlob blob;
+        android::Parcel::WritableBlob status_blob;
+
+        num_ops = data.readUint32();
+        size = (size_t) data.readUint32();
+        if (num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS) {
+            AGM_LOGE("Invalid num_ops %d\n", num_ops);
+            reply->writeInt32(-EINVAL);
+            break;
+        }
+        status_size = num_ops * sizeof(struct agm_batch_status);
+        data.readBlob(size, &blob);
+
+        bn_payload = calloc(size, sizeof(uint8_t));
+        status = (struct agm_batch_status *)calloc(num_ops, sizeof(*status));
+        if (!bn_payload || !status) {
+            AGM_LOGE("calloc failed\n");
+            rc = -ENOMEM;
+            for (i = 0; status && i < num_ops; i++)
+                status[i].ret = -ECANCELED;
+            goto fail_session_batch;
+        }
+
+        memcpy(bn_payload, blob.data(), size);
+        rc = ipc_agm_session_batch(bn_payload, size, num_ops, status);
+
+        /* track opened sessions so they are closed if the client dies */
+        op = (const struct agm_batch_op *)bn_payload;
+        for (i = 0; i < num_ops && status[i].ret == 0;
+             i++, op = AGM_BATCH_OP_NEXT(op)) {
+            if (op->op_id == AGM_BATCH_OP_SESSION_OPEN && status[i].hndl != 0)
+                agm_add_session_obj_handle(status[i].hndl);
+        }
+
+    fail_session_batch:
+        reply->writeInt32(rc);
+        reply->writeBlob(status_size, false, &status_blob);
+        if (status)
+            memcpy(status_blob.data(), status, status_size);
+        else
+            memset(status_blob.data(), 0x0, status_size);
+        status_blob.release();
+        blob.release();
+        free(status);
+        free(bn_payload);
+        break; }
+
+    case SESSION_ASYNC_OP : {
+        uint64_t handle = (uint64_t )data.readInt64();
+        enum agm_session_async_op op = (enum agm_session_async_op)data.readUint32();
+        uint64_t token = data.readUint64();
+        rc = ipc_agm_session_async_op(handle, op, token);
+        if (!rc && op == AGM_SESSION_OP_CLOSE)
+            agm_remove_session_obj_handle(handle);
+        reply->writeInt32(rc);
+        break; }
+
+    case SESSION_WRITEV :
+    case SESSION_READV : {
+        struct iovec iov[AGM_SESSION_IOV_MAX];
+        android::Parcel::ReadableBlob blob;
+        android::Parcel::WritableBlob out_blob;
+        uint8_t *base = NULL, *read_buf = NULL;
+        size_t size = 0, count = 0;
+        uint64_t handle = (uint64_t )data.readInt64();
+        uint32_t i, iovcnt = data.readUint32();
+
+        if (iovcnt > AGM_SESSION_IOV_MAX) {
+            rc = -EINVAL;
+            goto fail_iov;
+        }
+        for (i = 0; i < iovcnt; i++) {
+            iov[i].iov_len = data.readUint32();
+            size += iov[i].iov_len;
+        }
+        if (code == SESSION_WRITEV) {
+            if (data.readBlob(size, &blob) != android::OK) {
+                rc = -EINVAL;
+                goto fail_iov;
+            }
+            base = (uint8_t *)blob.data();
+        } else {
+            base = read_buf = (uint8_t *)calloc(1, size ? size : 1);
+            if (!read_buf) {
+                rc = -ENOMEM;
+                goto fail_iov;
+            }
+        }
+        for (i = 0; i < iovcnt; i++) {
+            iov[i].iov_base = base;
+            base += iov[i].iov_len;
+        }
+
+        if (code == SESSION_WRITEV) {
+            rc = ipc_agm_session_writev(handle, iov, iovcnt, &count);
+            blob.release();
+        } else {
+            rc = ipc_agm_session_readv(handle, iov, iovcnt, &count);
+        }
+
+    fail_iov:
+        reply->writeInt32(rc);
+        reply->writeUint64(count);
+        if (code == SESSION_READV && count) {
+            reply->writeBlob(count, false, &out_blob);
+            memcpy(out_blob.data(), read_buf, count);
+            out_blob.release();
+        }
+        free(read_buf);
+        break; }
+
+    case SESSION_SHM_RING : {
+        uint64_t handle = (uint64_t )data.readInt64();
+        uint32_t dir = data.readUint32();
+        /*the parcel keeps these, the ring takes its own copies*/
+        int memfd = data.readFileDescriptor();
+        int srv_efd = data.readFileDescriptor();
+        int clt_efd = data.readFileDescriptor();
+        rc = ipc_agm_session_shm_ring(handle, dir, memfd, srv_efd, clt_efd);
+        reply->writeInt32(rc);
+        break; }
+
     default:
         return BBinder::onTransact(code, data, reply, flags);
     }
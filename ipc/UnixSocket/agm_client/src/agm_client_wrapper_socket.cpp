@@ -0,0 +1,1452 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "agm_client_wrapper"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <agm/agm_api.h>
+#include <agm/agm_list.h>
+#include <qti-agm-service/agm_socket_ipc.h>
+#include "utils.h"
+
+/* A call waiting for its reply */
+typedef struct {
+    struct listnode list;
+    uint32_t seq;
+    bool done;
+    int ret;
+    struct agm_socket_msg msg;
+} agm_client_pending;
+
+/* id is what the service echoes back with each event of the callback */
+typedef struct {
+    struct listnode list;
+    uint64_t id;
+    uint32_t session_id;
+    uint32_t evt_type;
+    agm_event_cb cb;
+    void *client_data;
+} agm_client_callback;
+
+typedef struct {
+    struct listnode list;
+    agm_service_crash_cb cb;
+    uint64_t cookie;
+} agm_client_crash_callback;
+
+typedef struct {
+    struct listnode list;
+    struct agm_socket_msg msg;
+} agm_client_event;
+
+/*
+ * One connection serves the whole process. Replies are matched to their
+ * callers by seq on the reader thread; events are handed to an event
+ * thread so that callbacks can call back into agm.
+ */
+typedef struct {
+    /* held across connecting and sending, taken before lock */
+    pthread_mutex_t send_lock;
+    /* protects everything below */
+    pthread_mutex_t lock;
+    pthread_cond_t reply_cond;
+    pthread_cond_t event_cond;
+    int sock;
+    uint32_t next_seq;
+    uint64_t next_cb_id;
+    bool event_thread_running;
+    struct listnode pending;
+    struct listnode callbacks;
+    struct listnode crash_callbacks;
+    struct listnode events;
+} agm_client_module_data;
+
+static agm_client_module_data *mdata = NULL;
+static pthread_once_t mdata_once = PTHREAD_ONCE_INIT;
+
+static void initialize_module_data()
+{
+    mdata = (agm_client_module_data *)calloc(1,
+                                             sizeof(agm_client_module_data));
+    if (mdata == NULL) {
+        AGM_LOGE("%s: mdata is NULL\n", __func__);
+        return;
+    }
+    pthread_mutex_init(&mdata->send_lock, NULL);
+    pthread_mutex_init(&mdata->lock, NULL);
+    pthread_cond_init(&mdata->reply_cond, NULL);
+    pthread_cond_init(&mdata->event_cond, NULL);
+    mdata->sock = -1;
+    list_init(&mdata->pending);
+    list_init(&mdata->callbacks);
+    list_init(&mdata->crash_callbacks);
+    list_init(&mdata->events);
+}
+
+static void client_dispatch_event(struct agm_socket_msg *msg)
+{
+    struct agm_socket_reader r;
+    struct agm_event_cb_params *params = NULL;
+    struct agm_event_read_write_done_payload *rw = NULL;
+    struct listnode *node = NULL;
+    agm_client_callback *cb_data = NULL;
+    const uint8_t *payload = NULL, *metadata = NULL;
+    uint32_t session_id, source_module_id, event_id;
+    uint32_t payload_size, metadata_size;
+    uint64_t id;
+    agm_event_cb cb = NULL;
+    void *client_data = NULL;
+
+    agm_socket_reader_init(&r, msg);
+    session_id = agm_socket_get_u32(&r);
+    id = agm_socket_get_u64(&r);
+    source_module_id = agm_socket_get_u32(&r);
+    event_id = agm_socket_get_u32(&r);
+    payload = agm_socket_get_blob(&r, &payload_size);
+    metadata = agm_socket_get_blob(&r, &metadata_size);
+    if (r.err) {
+        AGM_LOGE("%s: malformed event\n", __func__);
+        return;
+    }
+
+    pthread_mutex_lock(&mdata->lock);
+    list_for_each(node, &mdata->callbacks) {
+        cb_data = node_to_item(node, agm_client_callback, list);
+        if (cb_data->id == id) {
+            cb = cb_data->cb;
+            client_data = cb_data->client_data;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mdata->lock);
+    /* deregistered while the event was on its way */
+    if (cb == NULL)
+        return;
+
+    params = (struct agm_event_cb_params *)
+             calloc(1, sizeof(struct agm_event_cb_params) + payload_size);
+    if (params == NULL) {
+        AGM_LOGE("%s: no memory for event %x\n", __func__, event_id);
+        return;
+    }
+    params->source_module_id = source_module_id;
+    params->event_id = event_id;
+    params->event_payload_size = payload_size;
+    memcpy(params->event_payload, payload, payload_size);
+
+    if ((event_id == AGM_EVENT_READ_DONE || event_id == AGM_EVENT_WRITE_DONE) &&
+        payload_size >= sizeof(struct agm_event_read_write_done_payload)) {
+        rw = (struct agm_event_read_write_done_payload *)params->event_payload;
+        rw->buff.metadata = metadata_size ? (uint8_t *)metadata : NULL;
+        rw->buff.metadata_size = metadata_size;
+    }
+
+    cb(session_id, params, client_data);
+    free(params);
+}
+
+static void *client_event_thread(void *arg __unused)
+{
+    agm_client_event *event = NULL;
+
+    pthread_mutex_lock(&mdata->lock);
+    for (;;) {
+        while (list_empty(&mdata->events))
+            pthread_cond_wait(&mdata->event_cond, &mdata->lock);
+        event = node_to_item(list_head(&mdata->events), agm_client_event,
+                             list);
+        list_remove(&event->list);
+        pthread_mutex_unlock(&mdata->lock);
+
+        client_dispatch_event(&event->msg);
+        agm_socket_msg_free(&event->msg);
+        free(event);
+
+        pthread_mutex_lock(&mdata->lock);
+    }
+    pthread_mutex_unlock(&mdata->lock);
+
+    return NULL;
+}
+
+/*
+ * The service went away: fail the calls still waiting, forget the
+ * callbacks it held and let the crash callbacks know.
+ */
+static void client_connection_lost(int sock)
+{
+    struct listnode *node = NULL, *tempnode = NULL;
+    agm_client_pending *p = NULL;
+    agm_client_crash_callback *crash = NULL;
+    agm_client_crash_callback *crashes = NULL;
+    int i, num_crashes = 0;
+
+    pthread_mutex_lock(&mdata->send_lock);
+    pthread_mutex_lock(&mdata->lock);
+    if (mdata->sock == sock)
+        mdata->sock = -1;
+    list_for_each(node, &mdata->pending) {
+        p = node_to_item(node, agm_client_pending, list);
+        if (!p->done) {
+            p->done = true;
+            p->ret = -EPIPE;
+        }
+    }
+    pthread_cond_broadcast(&mdata->reply_cond);
+
+    list_for_each_safe(node, tempnode, &mdata->callbacks) {
+        list_remove(node);
+        free(node_to_item(node, agm_client_callback, list));
+    }
+
+    list_for_each(node, &mdata->crash_callbacks)
+        num_crashes++;
+    if (num_crashes)
+        crashes = (agm_client_crash_callback *)
+                  calloc(num_crashes, sizeof(agm_client_crash_callback));
+    if (crashes != NULL) {
+        i = 0;
+        list_for_each(node, &mdata->crash_callbacks) {
+            crash = node_to_item(node, agm_client_crash_callback, list);
+            crashes[i++] = *crash;
+        }
+    }
+    pthread_mutex_unlock(&mdata->lock);
+    close(sock);
+    pthread_mutex_unlock(&mdata->send_lock);
+
+    AGM_LOGE("%s: connection to agm service lost\n", __func__);
+    for (i = 0; crashes != NULL && i < num_crashes; i++)
+        crashes[i].cb(crashes[i].cookie);
+    free(crashes);
+}
+
+static void *client_reader_thread(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    struct listnode *node = NULL;
+    agm_client_pending *p = NULL;
+    agm_client_event *event = NULL;
+    struct agm_socket_msg msg;
+    uint8_t *scratch = NULL;
+    int ret;
+
+    scratch = (uint8_t *)malloc(AGM_SOCKET_MSG_MAX);
+    if (scratch == NULL) {
+        AGM_LOGE("%s: no memory\n", __func__);
+        shutdown(sock, SHUT_RDWR);
+        goto done;
+    }
+
+    for (;;) {
+        ret = agm_socket_recv(sock, scratch, &msg);
+        if (ret) {
+            if (ret != -EPIPE)
+                AGM_LOGE("%s: receive failed, ret %d\n", __func__, ret);
+            break;
+        }
+
+        if (msg.hdr.op == AGM_SOCKET_OP_EVENT) {
+            event = (agm_client_event *)calloc(1, sizeof(agm_client_event));
+            if (event == NULL) {
+                AGM_LOGE("%s: event dropped, no memory\n", __func__);
+                agm_socket_msg_free(&msg);
+                continue;
+            }
+            event->msg = msg;
+            pthread_mutex_lock(&mdata->lock);
+            list_add_tail(&mdata->events, &event->list);
+            pthread_cond_signal(&mdata->event_cond);
+            pthread_mutex_unlock(&mdata->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&mdata->lock);
+        list_for_each(node, &mdata->pending) {
+            p = node_to_item(node, agm_client_pending, list);
+            if (p->seq == msg.hdr.seq && !p->done) {
+                p->msg = msg;
+                p->done = true;
+                msg.data = NULL;
+                msg.nfds = 0;
+                pthread_cond_broadcast(&mdata->reply_cond);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&mdata->lock);
+        agm_socket_msg_free(&msg);
+    }
+
+done:
+    free(scratch);
+    client_connection_lost(sock);
+    return NULL;
+}
+
+static int client_start_thread(void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return -ret;
+}
+
+static int client_connect_l()
+{
+    struct sockaddr_un addr;
+    int sock, ret;
+
+    if (mdata->sock >= 0)
+        return 0;
+
+    if (!mdata->event_thread_running) {
+        ret = client_start_thread(client_event_thread, NULL);
+        if (ret) {
+            AGM_LOGE("%s: failed to start event thread\n", __func__);
+            return ret;
+        }
+        mdata->event_thread_running = true;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", AGM_SOCKET_PATH);
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -errno;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        ret = -errno;
+        AGM_LOGE("%s: cannot connect to %s, ret %d\n", __func__,
+                 AGM_SOCKET_PATH, ret);
+        close(sock);
+        return ret;
+    }
+
+    ret = client_start_thread(client_reader_thread, (void *)(intptr_t)sock);
+    if (ret) {
+        AGM_LOGE("%s: failed to start reader thread\n", __func__);
+        close(sock);
+        return ret;
+    }
+    mdata->sock = sock;
+    return 0;
+}
+
+/*
+ * Sends the request packed in b, which is consumed, and waits for the
+ * reply. reply, if given, is always left safe to free and holds the reply
+ * arguments whenever the service answered. Returns the call's return value.
+ */
+static int client_call(uint16_t op, struct agm_socket_buf *b, const int *fds,
+                       int nfds, struct agm_socket_msg *reply)
+{
+    struct agm_socket_hdr *hdr = NULL;
+    agm_client_pending p;
+    int sock, ret;
+
+    memset(&p, 0, sizeof(p));
+    if (reply != NULL)
+        memset(reply, 0, sizeof(*reply));
+
+    pthread_once(&mdata_once, initialize_module_data);
+    if (mdata == NULL || b->err) {
+        ret = mdata == NULL ? -ENOMEM : b->err;
+        agm_socket_buf_free(b);
+        return ret;
+    }
+
+    pthread_mutex_lock(&mdata->send_lock);
+    pthread_mutex_lock(&mdata->lock);
+    ret = client_connect_l();
+    if (ret) {
+        pthread_mutex_unlock(&mdata->lock);
+        pthread_mutex_unlock(&mdata->send_lock);
+        agm_socket_buf_free(b);
+        return ret;
+    }
+    if (++mdata->next_seq == 0)
+        ++mdata->next_seq;
+    p.seq = mdata->next_seq;
+    list_add_tail(&mdata->pending, &p.list);
+    sock = mdata->sock;
+    pthread_mutex_unlock(&mdata->lock);
+
+    hdr = agm_socket_buf_hdr(b);
+    hdr->op = op;
+    hdr->seq = p.seq;
+    hdr->ret = 0;
+    ret = agm_socket_send(sock, b, fds, nfds);
+    pthread_mutex_unlock(&mdata->send_lock);
+    agm_socket_buf_free(b);
+
+    pthread_mutex_lock(&mdata->lock);
+    while (ret == 0 && !p.done)
+        pthread_cond_wait(&mdata->reply_cond, &mdata->lock);
+    list_remove(&p.list);
+    pthread_mutex_unlock(&mdata->lock);
+
+    if (ret) {
+        AGM_LOGE("%s: op %d not sent, ret %d\n", __func__, op, ret);
+        return ret;
+    }
+    if (p.ret)
+        return p.ret;
+
+    ret = p.msg.hdr.ret;
+    if (reply != NULL)
+        *reply = p.msg;
+    else
+        agm_socket_msg_free(&p.msg);
+    return ret;
+}
+
+static int client_call_u32(uint16_t op, uint32_t v)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, v);
+    return client_call(op, &b, NULL, 0, NULL);
+}
+
+static int client_call_u64(uint16_t op, uint64_t v)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, v);
+    return client_call(op, &b, NULL, 0, NULL);
+}
+
+/* Copies a reply blob into a buffer of size bytes */
+static int client_get_blob(struct agm_socket_reader *r, void *dst, size_t size)
+{
+    const uint8_t *blob = NULL;
+    uint32_t blob_size;
+
+    blob = agm_socket_get_blob(r, &blob_size);
+    if (blob == NULL)
+        return -EPROTO;
+    if (dst != NULL && blob_size)
+        memcpy(dst, blob, blob_size < size ? blob_size : size);
+    return 0;
+}
+
+static void client_put_buffer_config(struct agm_socket_buf *b,
+                                     struct agm_buffer_config *config)
+{
+    agm_socket_put_u32(b, config != NULL);
+    agm_socket_put_u32(b, config ? config->count : 0);
+    agm_socket_put_u64(b, config ? config->size : 0);
+    agm_socket_put_u64(b, config ? config->max_metadata_size : 0);
+}
+
+int agm_register_service_crash_callback(agm_service_crash_cb cb,
+                                        uint64_t cookie)
+{
+    agm_client_crash_callback *crash = NULL;
+
+    pthread_once(&mdata_once, initialize_module_data);
+    if (mdata == NULL || cb == NULL)
+        return -EINVAL;
+
+    crash = (agm_client_crash_callback *)
+            calloc(1, sizeof(agm_client_crash_callback));
+    if (crash == NULL)
+        return -ENOMEM;
+    crash->cb = cb;
+    crash->cookie = cookie;
+
+    pthread_mutex_lock(&mdata->lock);
+    list_add_tail(&mdata->crash_callbacks, &crash->list);
+    pthread_mutex_unlock(&mdata->lock);
+    return 0;
+}
+
+static int agm_session_deregister_cb(uint32_t session_id,
+                                     enum event_type evt_type,
+                                     void *client_data)
+{
+    struct listnode *node = NULL, *tempnode = NULL;
+    struct listnode removed;
+    agm_client_callback *cb_data = NULL;
+    struct agm_socket_buf b;
+    int ret = -EINVAL;
+
+    list_init(&removed);
+    pthread_mutex_lock(&mdata->lock);
+    list_for_each_safe(node, tempnode, &mdata->callbacks) {
+        cb_data = node_to_item(node, agm_client_callback, list);
+        if (cb_data->session_id == session_id &&
+            cb_data->evt_type == (uint32_t)evt_type &&
+            cb_data->client_data == client_data) {
+            list_remove(node);
+            list_add_tail(&removed, node);
+        }
+    }
+    pthread_mutex_unlock(&mdata->lock);
+
+    list_for_each_safe(node, tempnode, &removed) {
+        cb_data = node_to_item(node, agm_client_callback, list);
+        agm_socket_buf_init(&b);
+        agm_socket_put_u32(&b, session_id);
+        agm_socket_put_u32(&b, evt_type);
+        agm_socket_put_u64(&b, cb_data->id);
+        agm_socket_put_u32(&b, 0);
+        ret = client_call(AGM_SOCKET_OP_SESSION_REGISTER_CB, &b, NULL, 0,
+                          NULL);
+        if (ret)
+            AGM_LOGE("%s: deregistering callback failed, ret %d\n", __func__,
+                     ret);
+        list_remove(node);
+        free(cb_data);
+    }
+
+    return ret;
+}
+
+int agm_session_register_cb(uint32_t session_id, agm_event_cb cb,
+                            enum event_type evt_type, void *client_data)
+{
+    agm_client_callback *cb_data = NULL;
+    struct agm_socket_buf b;
+    int ret;
+
+    pthread_once(&mdata_once, initialize_module_data);
+    if (mdata == NULL)
+        return -ENOMEM;
+
+    if (cb == NULL)
+        return agm_session_deregister_cb(session_id, evt_type, client_data);
+
+    cb_data = (agm_client_callback *)calloc(1, sizeof(agm_client_callback));
+    if (cb_data == NULL)
+        return -ENOMEM;
+    cb_data->session_id = session_id;
+    cb_data->evt_type = evt_type;
+    cb_data->cb = cb;
+    cb_data->client_data = client_data;
+
+    /* listed before the service knows it, its first event may be quick */
+    pthread_mutex_lock(&mdata->lock);
+    cb_data->id = ++mdata->next_cb_id;
+    list_add_tail(&mdata->callbacks, &cb_data->list);
+    pthread_mutex_unlock(&mdata->lock);
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, evt_type);
+    agm_socket_put_u64(&b, cb_data->id);
+    agm_socket_put_u32(&b, 1);
+    ret = client_call(AGM_SOCKET_OP_SESSION_REGISTER_CB, &b, NULL, 0, NULL);
+    if (ret) {
+        AGM_LOGE("%s: registering callback failed, ret %d\n", __func__, ret);
+        pthread_mutex_lock(&mdata->lock);
+        list_remove(&cb_data->list);
+        pthread_mutex_unlock(&mdata->lock);
+        free(cb_data);
+    }
+    return ret;
+}
+
+int agm_session_register_for_events(uint32_t session_id,
+                                    struct agm_event_reg_cfg *evt_reg_cfg)
+{
+    struct agm_socket_buf b;
+
+    if (evt_reg_cfg == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_blob_ref(&b, evt_reg_cfg,
+                            sizeof(struct agm_event_reg_cfg) +
+                            evt_reg_cfg->event_config_payload_size);
+    return client_call(AGM_SOCKET_OP_SESSION_REGISTER_FOR_EVENTS, &b, NULL, 0,
+                       NULL);
+}
+
+int agm_aif_set_media_config(uint32_t aif_id,
+                             struct agm_media_config *media_config)
+{
+    struct agm_socket_buf b;
+
+    if (media_config == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put(&b, media_config, sizeof(*media_config));
+    return client_call(AGM_SOCKET_OP_AIF_SET_MEDIA_CONFIG, &b, NULL, 0, NULL);
+}
+
+int agm_aif_group_set_media_config(uint32_t aif_group_id,
+                                   struct agm_group_media_config *media_config)
+{
+    struct agm_socket_buf b;
+
+    if (media_config == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, aif_group_id);
+    agm_socket_put(&b, media_config, sizeof(*media_config));
+    return client_call(AGM_SOCKET_OP_AIF_GROUP_SET_MEDIA_CONFIG, &b, NULL, 0,
+                       NULL);
+}
+
+int agm_aif_set_metadata(uint32_t aif_id, uint32_t size, uint8_t *metadata)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, metadata, size);
+    return client_call(AGM_SOCKET_OP_AIF_SET_METADATA, &b, NULL, 0, NULL);
+}
+
+int agm_session_set_metadata(uint32_t session_id, uint32_t size,
+                             uint8_t *metadata)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_blob_ref(&b, metadata, size);
+    return client_call(AGM_SOCKET_OP_SESSION_SET_METADATA, &b, NULL, 0, NULL);
+}
+
+int agm_session_aif_set_metadata(uint32_t session_id, uint32_t aif_id,
+                                 uint32_t size, uint8_t *metadata)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, metadata, size);
+    return client_call(AGM_SOCKET_OP_SESSION_AIF_SET_METADATA, &b, NULL, 0,
+                       NULL);
+}
+
+int agm_session_aif_connect(uint32_t session_id, uint32_t aif_id, bool state)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_u32(&b, state);
+    return client_call(AGM_SOCKET_OP_SESSION_AIF_CONNECT, &b, NULL, 0, NULL);
+}
+
+int agm_session_aif_get_tag_module_info(uint32_t session_id, uint32_t aif_id,
+                                        void *payload, size_t *size)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    size_t size_in;
+    int ret;
+
+    if (size == NULL)
+        return -EINVAL;
+    size_in = *size;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_u32(&b, payload != NULL);
+    agm_socket_put_u64(&b, size_in);
+    ret = client_call(AGM_SOCKET_OP_SESSION_AIF_GET_TAG_MODULE_INFO, &b, NULL,
+                      0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *size = agm_socket_get_u64(&r);
+        if (payload != NULL)
+            ret = client_get_blob(&r, payload, size_in);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_aif_set_params(uint32_t aif_id, void *payload, size_t size)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, payload, size);
+    return client_call(AGM_SOCKET_OP_AIF_SET_PARAMS, &b, NULL, 0, NULL);
+}
+
+int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
+                               void *payload, size_t size)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, payload, size);
+    return client_call(AGM_SOCKET_OP_SESSION_AIF_SET_PARAMS, &b, NULL, 0,
+                       NULL);
+}
+
+int agm_session_aif_set_cal(uint32_t session_id, uint32_t aif_id,
+                            struct agm_cal_config *cal_config)
+{
+    struct agm_socket_buf b;
+
+    if (cal_config == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, cal_config,
+                            sizeof(struct agm_cal_config) +
+                            cal_config->num_ckvs *
+                            sizeof(struct agm_key_value));
+    return client_call(AGM_SOCKET_OP_SESSION_AIF_SET_CAL, &b, NULL, 0, NULL);
+}
+
+int agm_session_set_params(uint32_t session_id, void *payload, size_t size)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_blob_ref(&b, payload, size);
+    return client_call(AGM_SOCKET_OP_SESSION_SET_PARAMS, &b, NULL, 0, NULL);
+}
+
+int agm_session_get_params(uint32_t session_id, void *payload, size_t size)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int ret;
+
+    if (payload == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_blob_ref(&b, payload, size);
+    ret = client_call(AGM_SOCKET_OP_SESSION_GET_PARAMS, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        ret = client_get_blob(&r, payload, size);
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_get_params_from_acdb_tunnel(void *payload, size_t *size)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    size_t size_in;
+    int ret;
+
+    if (payload == NULL || size == NULL)
+        return -EINVAL;
+    size_in = *size;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_blob_ref(&b, payload, size_in);
+    ret = client_call(AGM_SOCKET_OP_GET_PARAMS_FROM_ACDB_TUNNEL, &b, NULL, 0,
+                      &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *size = agm_socket_get_u64(&r);
+        ret = client_get_blob(&r, payload, size_in);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_set_params_with_tag(uint32_t session_id, uint32_t aif_id,
+                            struct agm_tag_config *tag_config)
+{
+    struct agm_socket_buf b;
+
+    if (tag_config == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, tag_config,
+                            sizeof(struct agm_tag_config) +
+                            tag_config->num_tkvs *
+                            sizeof(struct agm_key_value));
+    return client_call(AGM_SOCKET_OP_SET_PARAMS_WITH_TAG, &b, NULL, 0, NULL);
+}
+
+int agm_set_params_with_tag_to_acdb(uint32_t session_id, uint32_t aif_id,
+                                    void *payload, size_t size)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_blob_ref(&b, payload, size);
+    return client_call(AGM_SOCKET_OP_SET_PARAMS_WITH_TAG_TO_ACDB, &b, NULL, 0,
+                       NULL);
+}
+
+int agm_set_params_to_acdb_tunnel(void *payload, size_t size)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_blob_ref(&b, payload, size);
+    return client_call(AGM_SOCKET_OP_SET_PARAMS_TO_ACDB_TUNNEL, &b, NULL, 0,
+                       NULL);
+}
+
+int agm_session_open(uint32_t session_id, enum agm_session_mode sess_mode,
+                     uint64_t *handle)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int ret;
+
+    if (handle == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, sess_mode);
+    ret = client_call(AGM_SOCKET_OP_SESSION_OPEN, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *handle = agm_socket_get_u64(&r);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_session_set_config(uint64_t handle,
+                           struct agm_session_config *session_config,
+                           struct agm_media_config *media_config,
+                           struct agm_buffer_config *buffer_config)
+{
+    struct agm_socket_buf b;
+
+    if (session_config == NULL || media_config == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put(&b, session_config, sizeof(*session_config));
+    agm_socket_put(&b, media_config, sizeof(*media_config));
+    client_put_buffer_config(&b, buffer_config);
+    return client_call(AGM_SOCKET_OP_SESSION_SET_CONFIG, &b, NULL, 0, NULL);
+}
+
+int agm_session_set_non_tunnel_mode_config(uint64_t handle,
+                                struct agm_session_config *session_config,
+                                struct agm_media_config *in_media_config,
+                                struct agm_media_config *out_media_config,
+                                struct agm_buffer_config *in_buffer_config,
+                                struct agm_buffer_config *out_buffer_config)
+{
+    struct agm_socket_buf b;
+
+    if (session_config == NULL || in_media_config == NULL ||
+        out_media_config == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put(&b, session_config, sizeof(*session_config));
+    agm_socket_put(&b, in_media_config, sizeof(*in_media_config));
+    agm_socket_put(&b, out_media_config, sizeof(*out_media_config));
+    client_put_buffer_config(&b, in_buffer_config);
+    client_put_buffer_config(&b, out_buffer_config);
+    return client_call(AGM_SOCKET_OP_SESSION_SET_NON_TUNNEL_MODE_CONFIG, &b,
+                       NULL, 0, NULL);
+}
+
+int agm_session_close(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_CLOSE, handle);
+}
+
+int agm_session_prepare(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_PREPARE, handle);
+}
+
+int agm_session_start(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_START, handle);
+}
+
+int agm_session_stop(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_STOP, handle);
+}
+
+int agm_session_pause(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_PAUSE, handle);
+}
+
+int agm_session_flush(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_FLUSH, handle);
+}
+
+int agm_sessionid_flush(uint32_t session_id)
+{
+    return client_call_u32(AGM_SOCKET_OP_SESSIONID_FLUSH, session_id);
+}
+
+int agm_session_resume(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_RESUME, handle);
+}
+
+int agm_session_suspend(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_SUSPEND, handle);
+}
+
+int agm_session_eos(uint64_t handle)
+{
+    return client_call_u64(AGM_SOCKET_OP_SESSION_EOS, handle);
+}
+
+int agm_session_write(uint64_t handle, void *buff, size_t *count)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int ret;
+
+    if (buff == NULL || count == NULL || *count > UINT32_MAX)
+        return -EINVAL;
+
+    /* the data goes out from the caller's buffer */
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_blob_ref(&b, buff, *count);
+    ret = client_call(AGM_SOCKET_OP_SESSION_WRITE, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *count = agm_socket_get_u64(&r);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_session_read(uint64_t handle, void *buff, size_t *count)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    size_t size;
+    int ret;
+
+    if (buff == NULL || count == NULL)
+        return -EINVAL;
+    size = *count;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u64(&b, size);
+    ret = client_call(AGM_SOCKET_OP_SESSION_READ, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *count = agm_socket_get_u64(&r);
+        ret = client_get_blob(&r, buff, size);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_session_writev(uint64_t handle, const struct iovec *iov, int iovcnt,
+                       size_t *count)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int i, ret;
+
+    if (iov == NULL || count == NULL || iovcnt <= 0 ||
+        iovcnt > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+
+    /* lengths first, then the segments straight from the caller */
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u32(&b, iovcnt);
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > UINT32_MAX) {
+            agm_socket_buf_free(&b);
+            return -EINVAL;
+        }
+        agm_socket_put_u32(&b, iov[i].iov_len);
+    }
+    for (i = 0; i < iovcnt; i++)
+        agm_socket_put_ref(&b, iov[i].iov_base, iov[i].iov_len);
+
+    ret = client_call(AGM_SOCKET_OP_SESSION_WRITEV, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *count = agm_socket_get_u64(&r);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_session_readv(uint64_t handle, const struct iovec *iov, int iovcnt,
+                      size_t *count)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    const uint8_t *data = NULL;
+    uint32_t size, len;
+    int i, ret;
+
+    if (iov == NULL || count == NULL || iovcnt <= 0 ||
+        iovcnt > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u32(&b, iovcnt);
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > UINT32_MAX) {
+            agm_socket_buf_free(&b);
+            return -EINVAL;
+        }
+        agm_socket_put_u32(&b, iov[i].iov_len);
+    }
+
+    ret = client_call(AGM_SOCKET_OP_SESSION_READV, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *count = agm_socket_get_u64(&r);
+        data = agm_socket_get_blob(&r, &size);
+        if (r.err) {
+            ret = -EPROTO;
+            goto done;
+        }
+        /* scatter what was read over the segments in order */
+        for (i = 0; i < iovcnt && size; i++) {
+            len = iov[i].iov_len < size ? iov[i].iov_len : size;
+            memcpy(iov[i].iov_base, data, len);
+            data += len;
+            size -= len;
+        }
+    }
+
+done:
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+size_t agm_get_hw_processed_buff_cnt(uint64_t handle, enum direction dir)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    size_t cnt = 0;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u32(&b, dir);
+    if (client_call(AGM_SOCKET_OP_GET_HW_PROCESSED_BUFF_CNT, &b, NULL, 0,
+                    &reply) == 0) {
+        agm_socket_reader_init(&r, &reply);
+        cnt = agm_socket_get_u64(&r);
+    }
+    agm_socket_msg_free(&reply);
+    return cnt;
+}
+
+static int client_get_aif_info_list(uint16_t op, struct aif_info *aif_list,
+                                    size_t *num)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    size_t num_in;
+    int ret;
+
+    if (num == NULL)
+        return -EINVAL;
+    num_in = aif_list != NULL ? *num : 0;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, num_in);
+    ret = client_call(op, &b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *num = agm_socket_get_u64(&r);
+        ret = client_get_blob(&r, aif_list, num_in * sizeof(struct aif_info));
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_get_aif_info_list(struct aif_info *aif_list, size_t *num_aif_info)
+{
+    return client_get_aif_info_list(AGM_SOCKET_OP_GET_AIF_INFO_LIST, aif_list,
+                                    num_aif_info);
+}
+
+int agm_get_group_aif_info_list(struct aif_info *aif_list, size_t *num_groups)
+{
+    return client_get_aif_info_list(AGM_SOCKET_OP_GET_GROUP_AIF_INFO_LIST,
+                                    aif_list, num_groups);
+}
+
+int agm_session_set_loopback(uint32_t capture_session_id,
+                             uint32_t playback_session_id, bool state)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, capture_session_id);
+    agm_socket_put_u32(&b, playback_session_id);
+    agm_socket_put_u32(&b, state);
+    return client_call(AGM_SOCKET_OP_SESSION_SET_LOOPBACK, &b, NULL, 0, NULL);
+}
+
+int agm_session_set_ec_ref(uint32_t capture_session_id, uint32_t aif_id,
+                           bool state)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, capture_session_id);
+    agm_socket_put_u32(&b, aif_id);
+    agm_socket_put_u32(&b, state);
+    return client_call(AGM_SOCKET_OP_SESSION_SET_EC_REF, &b, NULL, 0, NULL);
+}
+
+static int client_get_timestamp(uint16_t op, struct agm_socket_buf *b,
+                                uint64_t *timestamp)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    int ret;
+
+    ret = client_call(op, b, NULL, 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *timestamp = agm_socket_get_u64(&r);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_get_session_time(uint64_t handle, uint64_t *timestamp)
+{
+    struct agm_socket_buf b;
+
+    if (timestamp == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    return client_get_timestamp(AGM_SOCKET_OP_GET_SESSION_TIME, &b, timestamp);
+}
+
+int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp)
+{
+    struct agm_socket_buf b;
+
+    if (timestamp == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    return client_get_timestamp(AGM_SOCKET_OP_GET_BUFFER_TIMESTAMP, &b,
+                                timestamp);
+}
+
+int agm_session_get_buf_info(uint32_t session_id,
+                             struct agm_buf_info *buf_info, uint32_t flag)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int i = 0, ret;
+
+    if (buf_info == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u32(&b, flag);
+    ret = client_call(AGM_SOCKET_OP_SESSION_GET_BUF_INFO, &b, NULL, 0, &reply);
+    if (ret)
+        goto done;
+
+    agm_socket_reader_init(&r, &reply);
+    buf_info->data_buf_size = (int32_t)agm_socket_get_u32(&r);
+    buf_info->pos_buf_size = (int32_t)agm_socket_get_u32(&r);
+    buf_info->data_buf_fd = -1;
+    buf_info->pos_buf_fd = -1;
+    if (r.err || reply.nfds != !!(flag & DATA_BUF) + !!(flag & POS_BUF)) {
+        ret = -EPROTO;
+        goto done;
+    }
+
+    /* the fds are ours now, they are not closed with the reply */
+    if (flag & DATA_BUF) {
+        buf_info->data_buf_fd = reply.fds[i];
+        reply.fds[i++] = -1;
+    }
+    if (flag & POS_BUF) {
+        buf_info->pos_buf_fd = reply.fds[i];
+        reply.fds[i++] = -1;
+    }
+
+done:
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_set_gapless_session_metadata(uint64_t handle,
+                                     enum agm_gapless_silence_type type,
+                                     uint32_t silence)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u32(&b, type);
+    agm_socket_put_u32(&b, silence);
+    return client_call(AGM_SOCKET_OP_SET_GAPLESS_SESSION_METADATA, &b, NULL, 0,
+                       NULL);
+}
+
+/*
+ * Extern buffer info of a read or write. The fd travels along only for an
+ * actual extern allocation, the service hands it back with the completion.
+ */
+static void client_put_alloc_info(struct agm_socket_buf *b,
+                                  struct agm_buff *buff, int *fd)
+{
+    bool has_fd = buff->alloc_info.alloc_size > 0 &&
+                  buff->alloc_info.alloc_handle >= 0;
+
+    *fd = has_fd ? buff->alloc_info.alloc_handle : -1;
+    agm_socket_put_u32(b, has_fd);
+    agm_socket_put_u32(b, (uint32_t)buff->alloc_info.alloc_handle);
+    agm_socket_put_u32(b, buff->alloc_info.alloc_size);
+    agm_socket_put_u32(b, buff->alloc_info.offset);
+}
+
+int agm_session_write_with_metadata(uint64_t handle, struct agm_buff *buff,
+                                    size_t *consumed_size)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int fd, ret;
+
+    if (buff == NULL || consumed_size == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u64(&b, buff->timestamp);
+    agm_socket_put_u32(&b, buff->flags);
+    agm_socket_put_u32(&b, buff->size);
+    client_put_alloc_info(&b, buff, &fd);
+    agm_socket_put_blob(&b, buff->metadata,
+                        buff->metadata ? buff->metadata_size : 0);
+    agm_socket_put_blob_ref(&b, buff->addr, buff->addr ? buff->size : 0);
+    ret = client_call(AGM_SOCKET_OP_SESSION_WRITE_WITH_METADATA, &b,
+                      fd >= 0 ? &fd : NULL, fd >= 0, &reply);
+    if (ret == 0) {
+        agm_socket_reader_init(&r, &reply);
+        *consumed_size = agm_socket_get_u64(&r);
+        if (r.err)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_session_read_with_metadata(uint64_t handle, struct agm_buff *buff,
+                                   uint32_t *captured_size)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    const uint8_t *metadata = NULL;
+    uint32_t metadata_size;
+    int fd, ret;
+
+    if (buff == NULL || captured_size == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u32(&b, buff->size);
+    agm_socket_put_u32(&b, buff->metadata ? buff->metadata_size : 0);
+    client_put_alloc_info(&b, buff, &fd);
+    ret = client_call(AGM_SOCKET_OP_SESSION_READ_WITH_METADATA, &b,
+                      fd >= 0 ? &fd : NULL, fd >= 0, &reply);
+    if (ret)
+        goto done;
+
+    agm_socket_reader_init(&r, &reply);
+    *captured_size = agm_socket_get_u32(&r);
+    buff->timestamp = agm_socket_get_u64(&r);
+    buff->flags = agm_socket_get_u32(&r);
+    metadata = agm_socket_get_blob(&r, &metadata_size);
+    if (r.err) {
+        ret = -EPROTO;
+        goto done;
+    }
+    if (buff->metadata != NULL) {
+        if (metadata_size > buff->metadata_size)
+            metadata_size = buff->metadata_size;
+        memcpy(buff->metadata, metadata, metadata_size);
+        buff->metadata_size = metadata_size;
+    }
+    ret = client_get_blob(&r, buff->addr, buff->size);
+
+done:
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_session_write_datapath_params(uint32_t session_id,
+                                      struct agm_buff *buff)
+{
+    struct agm_socket_buf b;
+
+    if (buff == NULL || buff->addr == NULL || buff->size == 0)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u64(&b, buff->timestamp);
+    agm_socket_put_u32(&b, buff->flags);
+    agm_socket_put_blob_ref(&b, buff->addr, buff->size);
+    return client_call(AGM_SOCKET_OP_SESSION_WRITE_DATAPATH_PARAMS, &b, NULL,
+                       0, NULL);
+}
+
+int agm_session_async_op(uint64_t handle, enum agm_session_async_op op,
+                         uint64_t token)
+{
+    struct agm_socket_buf b;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u64(&b, handle);
+    agm_socket_put_u32(&b, op);
+    agm_socket_put_u64(&b, token);
+    return client_call(AGM_SOCKET_OP_SESSION_ASYNC_OP, &b, NULL, 0, NULL);
+}
+
+int agm_session_batch(const void *ops, size_t size, uint32_t num_ops,
+                      struct agm_batch_status *status)
+{
+    struct agm_socket_msg reply;
+    struct agm_socket_reader r;
+    struct agm_socket_buf b;
+    int ret;
+
+    if (ops == NULL || status == NULL || num_ops == 0 ||
+        num_ops > AGM_BATCH_MAX_OPS || size > UINT32_MAX)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, num_ops);
+    agm_socket_put_blob_ref(&b, ops, size);
+    ret = client_call(AGM_SOCKET_OP_SESSION_BATCH, &b, NULL, 0, &reply);
+
+    /* the status of each op comes back even when one of them failed */
+    if (reply.hdr.len) {
+        agm_socket_reader_init(&r, &reply);
+        if (client_get_blob(&r, status,
+                            num_ops * sizeof(struct agm_batch_status)) &&
+            ret == 0)
+            ret = -EPROTO;
+    }
+    agm_socket_msg_free(&reply);
+    return ret;
+}
+
+int agm_dump(struct agm_dump_info *dump_info)
+{
+    struct agm_socket_buf b;
+
+    if (dump_info == NULL)
+        return -EINVAL;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put(&b, dump_info, sizeof(*dump_info));
+    return client_call(AGM_SOCKET_OP_DUMP, &b, NULL, 0, NULL);
+}
+
+int agm_init()
+{
+    int ret;
+
+    AGM_LOGD("%s\n", __func__);
+
+    pthread_once(&mdata_once, initialize_module_data);
+    if (mdata == NULL)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&mdata->send_lock);
+    pthread_mutex_lock(&mdata->lock);
+    ret = client_connect_l();
+    pthread_mutex_unlock(&mdata->lock);
+    pthread_mutex_unlock(&mdata->send_lock);
+    return ret;
+}
+
+int agm_deinit()
+{
+    return 0;
+}
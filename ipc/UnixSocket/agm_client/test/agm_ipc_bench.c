@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Latency and throughput of the agm IPC client library.
+ *
+ * Control calls are timed one by one and reported as p50/p99, session
+ * writes as per call latency and MB/s for a few buffer sizes, the largest
+ * one past AGM_SOCKET_MSG_MAX so that it takes the memfd path. Only
+ * agm_api.h is used, and the file is built once per client library:
+ * agm_ipc_bench_socket here and agm_ipc_bench_dbus by the D-Bus client.
+ *
+ * Both services also build an agm_server_stub on top of
+ * agm_server/test/agm_stub.c, so running each bench against its stub, the
+ * D-Bus one with AGM_DBUS_BUS=session on both sides when there is no system
+ * bus policy for agm, compares the transports alone. Against a real
+ * service, writes are paced by the DSP once its buffers are queued and only
+ * the CPU time per MB compares the transports.
+ *
+ * usage: agm_ipc_bench_<transport> [iterations [session_id [aif_id]]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <agm/agm_api.h>
+
+#define BENCH_DEFAULT_ITERATIONS 10000
+
+#ifndef AGM_IPC_BENCH_TRANSPORT
+#define AGM_IPC_BENCH_TRANSPORT "ipc"
+#endif
+
+struct bench_stats {
+    uint64_t *samples;  /* per call latency in ns */
+    int count;
+    uint64_t elapsed_ns;
+    uint64_t bytes;
+    struct rusage ru_start;
+    struct rusage ru_end;
+};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t bench_cpu_us(struct rusage *ru)
+{
+    return (uint64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000ull +
+           ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int bench_begin(struct bench_stats *stats, int iterations)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->samples = (uint64_t *)calloc(iterations, sizeof(uint64_t));
+    if (!stats->samples)
+        return -ENOMEM;
+
+    getrusage(RUSAGE_SELF, &stats->ru_start);
+    stats->elapsed_ns = bench_now_ns();
+    return 0;
+}
+
+static void bench_end(const char *name, struct bench_stats *stats)
+{
+    uint64_t cpu_us;
+
+    stats->elapsed_ns = bench_now_ns() - stats->elapsed_ns;
+    getrusage(RUSAGE_SELF, &stats->ru_end);
+
+    if (!stats->count) {
+        printf("%-28s no samples\n", name);
+        goto done;
+    }
+
+    qsort(stats->samples, stats->count, sizeof(uint64_t), bench_cmp_u64);
+    cpu_us = bench_cpu_us(&stats->ru_end) - bench_cpu_us(&stats->ru_start);
+    printf("%-28s %7d calls  p50 %6.1f us  p99 %6.1f us  max %7.1f us",
+           name, stats->count,
+           stats->samples[stats->count / 2] / 1000.0,
+           stats->samples[(stats->count * 99) / 100] / 1000.0,
+           stats->samples[stats->count - 1] / 1000.0);
+    if (stats->bytes && stats->elapsed_ns)
+        printf("  %8.1f MB/s  %5llu cpu us/MB",
+               stats->bytes * 1000.0 / stats->elapsed_ns,
+               (unsigned long long)(cpu_us * 1000000ull / stats->bytes));
+    printf("\n");
+
+done:
+    free(stats->samples);
+    stats->samples = NULL;
+}
+
+static int bench_control(uint32_t session_id, int iterations)
+{
+    struct bench_stats stats;
+    uint8_t metadata[64] = {0};
+    size_t num_aif_info = 0;
+    uint64_t start_ns;
+    int i, ret = 0;
+
+    ret = bench_begin(&stats, iterations);
+    if (ret)
+        return ret;
+    for (i = 0; i < iterations; i++) {
+        start_ns = bench_now_ns();
+        ret = agm_session_set_metadata(session_id, sizeof(metadata), metadata);
+        if (ret)
+            break;
+        stats.samples[stats.count++] = bench_now_ns() - start_ns;
+    }
+    bench_end("session_set_metadata", &stats);
+    if (ret) {
+        printf("agm_session_set_metadata failed, error %d\n", ret);
+        return ret;
+    }
+
+    ret = bench_begin(&stats, iterations);
+    if (ret)
+        return ret;
+    for (i = 0; i < iterations; i++) {
+        start_ns = bench_now_ns();
+        ret = agm_get_aif_info_list(NULL, &num_aif_info);
+        if (ret)
+            break;
+        stats.samples[stats.count++] = bench_now_ns() - start_ns;
+    }
+    bench_end("get_aif_info_list", &stats);
+    if (ret)
+        printf("agm_get_aif_info_list failed, error %d\n", ret);
+    return ret;
+}
+
+static int bench_write(uint32_t session_id, uint32_t aif_id, size_t size,
+                       int iterations)
+{
+    struct agm_session_config session_config;
+    struct agm_media_config media_config;
+    struct agm_buffer_config buffer_config;
+    struct bench_stats stats;
+    uint64_t handle = 0, start_ns;
+    uint8_t *buff = NULL;
+    size_t count;
+    char name[32];
+    int i, ret = 0;
+
+    memset(&session_config, 0, sizeof(session_config));
+    session_config.dir = RX;
+    session_config.sess_mode = AGM_SESSION_DEFAULT;
+    memset(&media_config, 0, sizeof(media_config));
+    media_config.rate = 48000;
+    media_config.channels = 8;
+    media_config.format = AGM_FORMAT_PCM_S16_LE;
+    memset(&buffer_config, 0, sizeof(buffer_config));
+    buffer_config.count = 4;
+    buffer_config.size = size;
+
+    buff = (uint8_t *)calloc(1, size);
+    if (!buff)
+        return -ENOMEM;
+
+    ret = agm_session_aif_connect(session_id, aif_id, true);
+    if (ret) {
+        printf("agm_session_aif_connect failed, error %d\n", ret);
+        goto free_buff;
+    }
+
+    ret = agm_session_open(session_id, AGM_SESSION_DEFAULT, &handle);
+    if (ret) {
+        printf("agm_session_open failed, error %d\n", ret);
+        goto disconnect;
+    }
+
+    ret = agm_session_set_config(handle, &session_config, &media_config,
+                                 &buffer_config);
+    if (!ret)
+        ret = agm_session_prepare(handle);
+    if (!ret)
+        ret = agm_session_start(handle);
+    if (ret) {
+        printf("starting session %u failed, error %d\n", session_id, ret);
+        goto close;
+    }
+
+    ret = bench_begin(&stats, iterations);
+    if (ret)
+        goto stop;
+    for (i = 0; i < iterations; i++) {
+        count = size;
+        start_ns = bench_now_ns();
+        ret = agm_session_write(handle, buff, &count);
+        if (ret)
+            break;
+        stats.samples[stats.count++] = bench_now_ns() - start_ns;
+        stats.bytes += count;
+    }
+    snprintf(name, sizeof(name), "session_write %zu", size);
+    bench_end(name, &stats);
+    if (ret)
+        printf("agm_session_write failed, error %d\n", ret);
+
+stop:
+    agm_session_stop(handle);
+close:
+    agm_session_close(handle);
+disconnect:
+    agm_session_aif_connect(session_id, aif_id, false);
+free_buff:
+    free(buff);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    /* 10 ms of 48 kHz stereo and 8 channel 16 bit, and a memfd sized one */
+    size_t sizes[] = { 1920, 7680, 32 * 1024, 256 * 1024 };
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    uint32_t session_id = 1, aif_id = 0;
+    int i, ret = 0;
+
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+    if (argc > 2)
+        session_id = atoi(argv[2]);
+    if (argc > 3)
+        aif_id = atoi(argv[3]);
+    if (iterations <= 0) {
+        printf("usage: %s [iterations [session_id [aif_id]]]\n", argv[0]);
+        return 1;
+    }
+
+    ret = agm_init();
+    if (ret) {
+        printf("agm_init failed, error %d\n", ret);
+        return 1;
+    }
+
+    printf("transport %s, %d iterations\n", AGM_IPC_BENCH_TRANSPORT,
+           iterations);
+    ret = bench_control(session_id, iterations);
+    for (i = 0; !ret && i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+        ret = bench_write(session_id, aif_id, sizes[i], iterations);
+
+    agm_deinit();
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,7 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+int ipc_agm_init();
+void ipc_agm_deinit();
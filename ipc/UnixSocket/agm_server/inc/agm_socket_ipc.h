@@ -0,0 +1,520 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef __AGM_SOCKET_IPC_H__
+#define __AGM_SOCKET_IPC_H__
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/*
+ * Wire format of the Unix socket transport.
+ *
+ * A client process keeps one SOCK_SEQPACKET connection to the service. Each
+ * packet is a struct agm_socket_hdr followed by len bytes of arguments,
+ * packed in call order with the agm_socket_put_* helpers below: integers in
+ * host order at their fixed width, byte arrays as a u32 length and the
+ * bytes. Fds travel as SCM_RIGHTS with the packet that uses them.
+ *
+ * Requests carry a client chosen seq that the reply echoes with the return
+ * value of the call in ret, so calls from several client threads can be
+ * in flight at once. Events are pushed by the service on the same
+ * connection with op AGM_SOCKET_OP_EVENT and seq 0.
+ *
+ * Arguments that do not fit in one packet are written to a memfd that is
+ * sent as the first fd, with AGM_SOCKET_F_MEMFD set in flags.
+ */
+
+#ifndef AGM_SOCKET_PATH
+#define AGM_SOCKET_PATH "/run/agm/agm_server.sock"
+#endif
+
+/* Largest packet, header included */
+#define AGM_SOCKET_MSG_MAX (64 * 1024)
+/* Largest argument block accepted through a memfd */
+#define AGM_SOCKET_PAYLOAD_MAX (16 * 1024 * 1024)
+#define AGM_SOCKET_MAX_FDS 4
+/* Gather list of one packet: the packed arguments and the byte arrays */
+#define AGM_SOCKET_MAX_IOV 66
+
+#define AGM_SOCKET_F_MEMFD 0x1
+
+enum agm_socket_op {
+    AGM_SOCKET_OP_AIF_SET_MEDIA_CONFIG = 1,
+    AGM_SOCKET_OP_AIF_SET_METADATA,
+    AGM_SOCKET_OP_SESSION_SET_METADATA,
+    AGM_SOCKET_OP_SESSION_AIF_SET_METADATA,
+    AGM_SOCKET_OP_SESSION_AIF_CONNECT,
+    AGM_SOCKET_OP_SESSION_AIF_GET_TAG_MODULE_INFO,
+    AGM_SOCKET_OP_AIF_SET_PARAMS,
+    AGM_SOCKET_OP_SESSION_AIF_SET_PARAMS,
+    AGM_SOCKET_OP_SESSION_AIF_SET_CAL,
+    AGM_SOCKET_OP_SESSION_SET_PARAMS,
+    AGM_SOCKET_OP_SESSION_GET_PARAMS,
+    AGM_SOCKET_OP_GET_PARAMS_FROM_ACDB_TUNNEL,
+    AGM_SOCKET_OP_SET_PARAMS_WITH_TAG,
+    AGM_SOCKET_OP_SET_PARAMS_WITH_TAG_TO_ACDB,
+    AGM_SOCKET_OP_SET_PARAMS_TO_ACDB_TUNNEL,
+    AGM_SOCKET_OP_SESSION_REGISTER_CB,
+    AGM_SOCKET_OP_SESSION_REGISTER_FOR_EVENTS,
+    AGM_SOCKET_OP_SESSION_OPEN,
+    AGM_SOCKET_OP_SESSION_SET_CONFIG,
+    AGM_SOCKET_OP_SESSION_CLOSE,
+    AGM_SOCKET_OP_SESSION_PREPARE,
+    AGM_SOCKET_OP_SESSION_START,
+    AGM_SOCKET_OP_SESSION_STOP,
+    AGM_SOCKET_OP_SESSION_PAUSE,
+    AGM_SOCKET_OP_SESSION_FLUSH,
+    AGM_SOCKET_OP_SESSIONID_FLUSH,
+    AGM_SOCKET_OP_SESSION_RESUME,
+    AGM_SOCKET_OP_SESSION_SUSPEND,
+    AGM_SOCKET_OP_SESSION_READ,
+    AGM_SOCKET_OP_SESSION_WRITE,
+    AGM_SOCKET_OP_SESSION_READV,
+    AGM_SOCKET_OP_SESSION_WRITEV,
+    AGM_SOCKET_OP_GET_HW_PROCESSED_BUFF_CNT,
+    AGM_SOCKET_OP_GET_AIF_INFO_LIST,
+    AGM_SOCKET_OP_SESSION_SET_LOOPBACK,
+    AGM_SOCKET_OP_SESSION_SET_EC_REF,
+    AGM_SOCKET_OP_SESSION_EOS,
+    AGM_SOCKET_OP_GET_SESSION_TIME,
+    AGM_SOCKET_OP_GET_BUFFER_TIMESTAMP,
+    AGM_SOCKET_OP_SESSION_GET_BUF_INFO,
+    AGM_SOCKET_OP_SET_GAPLESS_SESSION_METADATA,
+    AGM_SOCKET_OP_SESSION_WRITE_WITH_METADATA,
+    AGM_SOCKET_OP_SESSION_READ_WITH_METADATA,
+    AGM_SOCKET_OP_SESSION_SET_NON_TUNNEL_MODE_CONFIG,
+    AGM_SOCKET_OP_GET_GROUP_AIF_INFO_LIST,
+    AGM_SOCKET_OP_AIF_GROUP_SET_MEDIA_CONFIG,
+    AGM_SOCKET_OP_SESSION_WRITE_DATAPATH_PARAMS,
+    AGM_SOCKET_OP_SESSION_ASYNC_OP,
+    AGM_SOCKET_OP_SESSION_BATCH,
+    AGM_SOCKET_OP_DUMP,
+    /* service to client: session_id, evt_type, client_data, event params */
+    AGM_SOCKET_OP_EVENT,
+    AGM_SOCKET_OP_MAX,
+};
+
+struct agm_socket_hdr {
+    uint16_t op;     /* enum agm_socket_op */
+    uint16_t flags;  /* AGM_SOCKET_F_* */
+    uint32_t seq;    /* request id echoed by the reply, 0 for events */
+    int32_t ret;     /* return value of the call, replies only */
+    uint32_t len;    /* bytes of arguments after the header */
+};
+
+/*
+ * Packet being built. data starts with room for the header. Bytes added by
+ * reference are sent straight from the caller's memory; once one is added
+ * nothing can be packed after it, so only the trailing arguments qualify.
+ */
+struct agm_socket_buf {
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+    struct iovec ref[AGM_SOCKET_MAX_IOV - 1];
+    int nref;
+    size_t ref_size;
+    int err;
+};
+
+/* Packet received, data holds hdr.len bytes of arguments */
+struct agm_socket_msg {
+    struct agm_socket_hdr hdr;
+    uint8_t *data;
+    int fds[AGM_SOCKET_MAX_FDS];
+    int nfds;
+};
+
+/* Unpacks the arguments of a received packet */
+struct agm_socket_reader {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    int err;
+};
+
+static inline void agm_socket_buf_init(struct agm_socket_buf *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->cap = 256;
+    b->data = (uint8_t *)calloc(1, b->cap);
+    if (b->data == NULL)
+        b->err = -ENOMEM;
+    else
+        b->size = sizeof(struct agm_socket_hdr);
+}
+
+static inline void agm_socket_buf_free(struct agm_socket_buf *b)
+{
+    free(b->data);
+    b->data = NULL;
+}
+
+static inline struct agm_socket_hdr *agm_socket_buf_hdr(struct agm_socket_buf *b)
+{
+    return (struct agm_socket_hdr *)b->data;
+}
+
+/* Returns room for n bytes at the end of the packed arguments */
+static inline uint8_t *agm_socket_reserve(struct agm_socket_buf *b, size_t n)
+{
+    uint8_t *p;
+    size_t cap;
+
+    if (b->err || b->nref) {
+        b->err = b->err ? b->err : -EINVAL;
+        return NULL;
+    }
+    if (b->size + n > b->cap) {
+        for (cap = b->cap; cap < b->size + n; cap *= 2)
+            ;
+        p = (uint8_t *)realloc(b->data, cap);
+        if (p == NULL) {
+            b->err = -ENOMEM;
+            return NULL;
+        }
+        b->data = p;
+        b->cap = cap;
+    }
+    p = b->data + b->size;
+    b->size += n;
+    return p;
+}
+
+static inline void agm_socket_put(struct agm_socket_buf *b, const void *p,
+                                  size_t n)
+{
+    uint8_t *dst = agm_socket_reserve(b, n);
+
+    if (dst != NULL && n)
+        memcpy(dst, p, n);
+}
+
+static inline void agm_socket_put_u32(struct agm_socket_buf *b, uint32_t v)
+{
+    agm_socket_put(b, &v, sizeof(v));
+}
+
+static inline void agm_socket_put_u64(struct agm_socket_buf *b, uint64_t v)
+{
+    agm_socket_put(b, &v, sizeof(v));
+}
+
+static inline void agm_socket_put_blob(struct agm_socket_buf *b, const void *p,
+                                       uint32_t n)
+{
+    agm_socket_put_u32(b, n);
+    agm_socket_put(b, p, n);
+}
+
+/* Adds n bytes to send from p without copying them */
+static inline void agm_socket_put_ref(struct agm_socket_buf *b, const void *p,
+                                      size_t n)
+{
+    if (b->err)
+        return;
+    if (b->nref == AGM_SOCKET_MAX_IOV - 1) {
+        b->err = -E2BIG;
+        return;
+    }
+    if (!n)
+        return;
+    b->ref[b->nref].iov_base = (void *)p;
+    b->ref[b->nref].iov_len = n;
+    b->nref++;
+    b->ref_size += n;
+}
+
+static inline void agm_socket_put_blob_ref(struct agm_socket_buf *b,
+                                           const void *p, uint32_t n)
+{
+    agm_socket_put_u32(b, n);
+    agm_socket_put_ref(b, p, n);
+}
+
+static inline void agm_socket_reader_init(struct agm_socket_reader *r,
+                                          const struct agm_socket_msg *m)
+{
+    r->data = m->data;
+    r->size = m->hdr.len;
+    r->pos = 0;
+    r->err = 0;
+}
+
+/* Returns n bytes of arguments in place, NULL once they ran out */
+static inline const uint8_t *agm_socket_get(struct agm_socket_reader *r,
+                                            size_t n)
+{
+    const uint8_t *p;
+
+    if (r->err || n > r->size - r->pos) {
+        r->err = -EPROTO;
+        return NULL;
+    }
+    p = r->data + r->pos;
+    r->pos += n;
+    return p;
+}
+
+static inline uint32_t agm_socket_get_u32(struct agm_socket_reader *r)
+{
+    const uint8_t *p = agm_socket_get(r, sizeof(uint32_t));
+    uint32_t v = 0;
+
+    if (p != NULL)
+        memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t agm_socket_get_u64(struct agm_socket_reader *r)
+{
+    const uint8_t *p = agm_socket_get(r, sizeof(uint64_t));
+    uint64_t v = 0;
+
+    if (p != NULL)
+        memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Copies exactly n bytes into dst */
+static inline void agm_socket_get_copy(struct agm_socket_reader *r, void *dst,
+                                       size_t n)
+{
+    const uint8_t *p = agm_socket_get(r, n);
+
+    if (p != NULL && n)
+        memcpy(dst, p, n);
+}
+
+static inline const uint8_t *agm_socket_get_blob(struct agm_socket_reader *r,
+                                                 uint32_t *n)
+{
+    *n = agm_socket_get_u32(r);
+    return agm_socket_get(r, *n);
+}
+
+static inline void agm_socket_close_fds(struct agm_socket_msg *m)
+{
+    int i;
+
+    for (i = 0; i < m->nfds; i++) {
+        if (m->fds[i] >= 0)
+            close(m->fds[i]);
+    }
+    m->nfds = 0;
+}
+
+static inline void agm_socket_msg_free(struct agm_socket_msg *m)
+{
+    agm_socket_close_fds(m);
+    free(m->data);
+    m->data = NULL;
+}
+
+static inline int agm_socket_sendmsg(int sock, struct iovec *iov, int iovcnt,
+                                     const int *fds, int nfds)
+{
+    struct msghdr mh;
+    char cbuf[CMSG_SPACE(sizeof(int) * AGM_SOCKET_MAX_FDS)];
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = iovcnt;
+    if (nfds > 0) {
+        memset(cbuf, 0, sizeof(cbuf));
+        mh.msg_control = cbuf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    do {
+        n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? -errno : 0;
+}
+
+/*
+ * Sends the packet with the fds given. The caller fills op, seq and ret of
+ * the header; len and flags are set here.
+ */
+static inline int agm_socket_send(int sock, struct agm_socket_buf *b,
+                                  const int *fds, int nfds)
+{
+    struct agm_socket_hdr *hdr = agm_socket_buf_hdr(b);
+    struct iovec iov[AGM_SOCKET_MAX_IOV];
+    int memfds[AGM_SOCKET_MAX_FDS];
+    size_t total = b->size + b->ref_size;
+    ssize_t n;
+    int i, memfd, ret;
+
+    if (b->err)
+        return b->err;
+    if (nfds > AGM_SOCKET_MAX_FDS ||
+        total - sizeof(*hdr) > AGM_SOCKET_PAYLOAD_MAX)
+        return -E2BIG;
+
+    hdr->len = total - sizeof(*hdr);
+    hdr->flags = 0;
+    iov[0].iov_base = b->data;
+    iov[0].iov_len = b->size;
+    for (i = 0; i < b->nref; i++)
+        iov[i + 1] = b->ref[i];
+
+    if (total <= AGM_SOCKET_MSG_MAX)
+        return agm_socket_sendmsg(sock, iov, b->nref + 1, fds, nfds);
+
+    if (nfds == AGM_SOCKET_MAX_FDS)
+        return -E2BIG;
+    memfd = memfd_create("agm_socket", MFD_CLOEXEC);
+    if (memfd < 0)
+        return -errno;
+    iov[0].iov_base = b->data + sizeof(*hdr);
+    iov[0].iov_len = b->size - sizeof(*hdr);
+    for (i = 0; i < b->nref + 1; i++) {
+        for (size_t off = 0; off < iov[i].iov_len; off += n) {
+            n = write(memfd, (uint8_t *)iov[i].iov_base + off,
+                      iov[i].iov_len - off);
+            if (n < 0 && errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            if (n <= 0) {
+                ret = n < 0 ? -errno : -EIO;
+                close(memfd);
+                return ret;
+            }
+        }
+    }
+
+    hdr->flags = AGM_SOCKET_F_MEMFD;
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(*hdr);
+    memfds[0] = memfd;
+    for (i = 0; i < nfds; i++)
+        memfds[i + 1] = fds[i];
+    ret = agm_socket_sendmsg(sock, iov, 1, memfds, nfds + 1);
+    close(memfd);
+    return ret;
+}
+
+/*
+ * Receives one packet into m, using scratch of AGM_SOCKET_MSG_MAX bytes.
+ * Returns -EPIPE once the peer closed the connection.
+ */
+static inline int agm_socket_recv(int sock, uint8_t *scratch,
+                                  struct agm_socket_msg *m)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    char cbuf[CMSG_SPACE(sizeof(int) * AGM_SOCKET_MAX_FDS)];
+    struct cmsghdr *cmsg;
+    struct stat st;
+    ssize_t n;
+    size_t off;
+    int i, cnt, memfd = -1, ret = 0;
+
+    memset(m, 0, sizeof(*m));
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = scratch;
+    iov.iov_len = AGM_SOCKET_MSG_MAX;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+
+    do {
+        n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return -errno;
+    if (n == 0)
+        return -EPIPE;
+
+    for (cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        cnt = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < cnt; i++) {
+            if (m->nfds < AGM_SOCKET_MAX_FDS)
+                memcpy(&m->fds[m->nfds++], CMSG_DATA(cmsg) + i * sizeof(int),
+                       sizeof(int));
+        }
+    }
+
+    if ((mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        (size_t)n < sizeof(m->hdr)) {
+        ret = -EPROTO;
+        goto fail;
+    }
+    memcpy(&m->hdr, scratch, sizeof(m->hdr));
+
+    if (!(m->hdr.flags & AGM_SOCKET_F_MEMFD)) {
+        if ((size_t)n - sizeof(m->hdr) != m->hdr.len) {
+            ret = -EPROTO;
+            goto fail;
+        }
+        m->data = (uint8_t *)malloc(m->hdr.len ? m->hdr.len : 1);
+        if (m->data == NULL) {
+            ret = -ENOMEM;
+            goto fail;
+        }
+        memcpy(m->data, scratch + sizeof(m->hdr), m->hdr.len);
+        return 0;
+    }
+
+    /* the arguments are in the memfd, the other fds belong to the call */
+    if (m->nfds == 0 || m->hdr.len > AGM_SOCKET_PAYLOAD_MAX) {
+        ret = -EPROTO;
+        goto fail;
+    }
+    memfd = m->fds[0];
+    m->nfds--;
+    memmove(&m->fds[0], &m->fds[1], m->nfds * sizeof(int));
+    if (fstat(memfd, &st) < 0 || st.st_size < (off_t)m->hdr.len) {
+        ret = -EPROTO;
+        goto fail;
+    }
+    m->data = (uint8_t *)malloc(m->hdr.len ? m->hdr.len : 1);
+    if (m->data == NULL) {
+        ret = -ENOMEM;
+        goto fail;
+    }
+    for (off = 0; off < m->hdr.len; off += n) {
+        n = pread(memfd, m->data + off, m->hdr.len - off, off);
+        if (n < 0 && errno == EINTR) {
+            n = 0;
+            continue;
+        }
+        if (n <= 0) {
+            ret = -EPROTO;
+            goto fail;
+        }
+    }
+    close(memfd);
+    return 0;
+
+fail:
+    if (memfd >= 0)
+        close(memfd);
+    agm_socket_msg_free(m);
+    return ret;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "agm_server_daemon"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include "agm_server_wrapper_socket.h"
+#include "utils.h"
+
+int main() {
+    sigset_t set;
+    int rc = 0;
+    int sig = 0;
+
+    /* the service threads inherit the mask, signals are taken below */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    rc = ipc_agm_init();
+    if (rc != 0) {
+        AGM_LOGE("AGM init failed\n");
+        return rc;
+    }
+
+    AGM_LOGD("agm init done\n");
+
+    sigwait(&set, &sig);
+    AGM_LOGE("Terminating signal %d received\n", sig);
+    ipc_agm_deinit();
+    return 0;
+}
@@ -0,0 +1,1749 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "agm_server_wrapper_socket"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <agm/agm_api.h>
+#include <agm/agm_list.h>
+#include "agm_socket_ipc.h"
+#include "agm_server_wrapper_socket.h"
+
+#include "utils.h"
+
+#ifndef AGM_SOCKET_WORKERS
+#define AGM_SOCKET_WORKERS 8
+#endif
+
+#ifndef AGM_SOCKET_MODE
+#define AGM_SOCKET_MODE 0660
+#endif
+
+#define AGM_SOCKET_BACKLOG 16
+
+/*
+ * One client process. Everything it opened or registered is tracked here
+ * and undone once its connection goes away and its requests have drained.
+ */
+typedef struct {
+    struct listnode list;
+    int sock;
+    pid_t pid;
+    /* serializes replies and events on sock */
+    pthread_mutex_t send_lock;
+    /* protects inflight and the lists below, never held across agm calls */
+    pthread_mutex_t lock;
+    pthread_cond_t idle_cond;
+    int inflight;
+    struct listnode sessions;
+    struct listnode callbacks;
+    struct listnode fds;
+} socket_conn;
+
+typedef struct {
+    struct listnode list;
+    uint32_t session_id;
+    uint64_t handle;
+} socket_session;
+
+/* client_data of a callback registered with agm on behalf of a client */
+typedef struct {
+    struct listnode list;
+    socket_conn *conn;
+    uint32_t session_id;
+    uint32_t evt_type;
+    uint64_t client_data;
+} socket_cb;
+
+/*
+ * Extern buffer fd received with a read or write, held until its
+ * completion event hands the buffer back under the client's fd number.
+ * A read also keeps its metadata buffer here, which agm fills in by then.
+ * The completion can race with the reply of the read, both hold a ref.
+ */
+typedef struct {
+    struct listnode list;
+    uint32_t session_id;
+    int clt_fd;
+    int srv_fd;
+    int refs;
+    uint8_t *metadata;
+} socket_fd;
+
+typedef struct {
+    struct listnode list;
+    socket_conn *conn;
+    struct agm_socket_msg msg;
+} socket_req;
+
+typedef struct {
+    socket_conn *conn;
+    struct agm_socket_msg *msg;
+    struct agm_socket_reader in;
+    struct agm_socket_buf out;
+    /* borrowed from agm, not closed after the reply */
+    int fds[AGM_SOCKET_MAX_FDS];
+    int nfds;
+} socket_call;
+
+typedef struct {
+    int listen_fd;
+    pthread_t listener;
+    pthread_t workers[AGM_SOCKET_WORKERS];
+    int num_workers;
+    pthread_mutex_t lock;
+    /* a request was queued or the workers are to stop */
+    pthread_cond_t queue_cond;
+    /* a connection went away */
+    pthread_cond_t conns_cond;
+    struct listnode queue;
+    struct listnode conns;
+    bool closing;
+    bool stop;
+} agm_socket_server;
+
+static agm_socket_server *sdata = NULL;
+
+static void conn_add_session(socket_conn *conn, uint32_t session_id,
+                             uint64_t handle)
+{
+    socket_session *ses = NULL;
+
+    ses = (socket_session *)calloc(1, sizeof(socket_session));
+    if (ses == NULL) {
+        AGM_LOGE("%s: failed to track session %d\n", __func__, session_id);
+        return;
+    }
+    ses->session_id = session_id;
+    ses->handle = handle;
+
+    pthread_mutex_lock(&conn->lock);
+    list_add_tail(&conn->sessions, &ses->list);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static socket_session *conn_find_session_l(socket_conn *conn, uint64_t handle)
+{
+    struct listnode *node = NULL;
+    socket_session *ses = NULL;
+
+    list_for_each(node, &conn->sessions) {
+        ses = node_to_item(node, socket_session, list);
+        if (ses->handle == handle)
+            return ses;
+    }
+    return NULL;
+}
+
+static void socket_fd_free(socket_fd *entry)
+{
+    close(entry->srv_fd);
+    free(entry->metadata);
+    free(entry);
+}
+
+static void conn_put_fd(socket_conn *conn, socket_fd *entry)
+{
+    bool last;
+
+    pthread_mutex_lock(&conn->lock);
+    last = --entry->refs == 0;
+    pthread_mutex_unlock(&conn->lock);
+    if (last)
+        socket_fd_free(entry);
+}
+
+/* Drops the session and the buffers still held for it, after its close */
+static void conn_remove_session(socket_conn *conn, uint64_t handle)
+{
+    struct listnode *node = NULL, *tempnode = NULL;
+    struct listnode done;
+    socket_session *ses = NULL;
+    socket_fd *entry = NULL;
+
+    list_init(&done);
+    pthread_mutex_lock(&conn->lock);
+    ses = conn_find_session_l(conn, handle);
+    if (ses == NULL) {
+        pthread_mutex_unlock(&conn->lock);
+        return;
+    }
+    list_remove(&ses->list);
+    list_for_each_safe(node, tempnode, &conn->fds) {
+        entry = node_to_item(node, socket_fd, list);
+        if (entry->session_id == ses->session_id) {
+            list_remove(node);
+            list_add_tail(&done, node);
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    list_for_each_safe(node, tempnode, &done) {
+        list_remove(node);
+        conn_put_fd(conn, node_to_item(node, socket_fd, list));
+    }
+    free(ses);
+}
+
+/*
+ * Hands the fd that came with a read or write to agm and remembers which
+ * client fd it stands for. Returns the fd agm sees in alloc_handle. With
+ * ref set the caller gets a reference too, dropped with conn_put_fd().
+ */
+static int conn_hold_fd(socket_call *c, uint64_t handle, int idx, int clt_fd,
+                        uint8_t *metadata, socket_fd **ref)
+{
+    socket_conn *conn = c->conn;
+    socket_session *ses = NULL;
+    socket_fd *entry = NULL;
+
+    if (idx >= c->msg->nfds)
+        return -EINVAL;
+
+    entry = (socket_fd *)calloc(1, sizeof(socket_fd));
+    if (entry == NULL)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&conn->lock);
+    ses = conn_find_session_l(conn, handle);
+    if (ses == NULL) {
+        pthread_mutex_unlock(&conn->lock);
+        free(entry);
+        return -EINVAL;
+    }
+    entry->session_id = ses->session_id;
+    entry->clt_fd = clt_fd;
+    entry->srv_fd = c->msg->fds[idx];
+    entry->metadata = metadata;
+    entry->refs = 1;
+    if (ref != NULL) {
+        entry->refs++;
+        *ref = entry;
+    }
+    c->msg->fds[idx] = -1;
+    list_add_tail(&conn->fds, &entry->list);
+    pthread_mutex_unlock(&conn->lock);
+
+    return entry->srv_fd;
+}
+
+/*
+ * Looks up and unlinks the buffer a completion is for. The caller drops
+ * the reference of the list with conn_put_fd() once done with it.
+ */
+static socket_fd *conn_release_fd(socket_conn *conn, uint32_t session_id,
+                                  int srv_fd)
+{
+    struct listnode *node = NULL;
+    socket_fd *entry = NULL;
+
+    pthread_mutex_lock(&conn->lock);
+    list_for_each(node, &conn->fds) {
+        entry = node_to_item(node, socket_fd, list);
+        if (entry->session_id == session_id && entry->srv_fd == srv_fd) {
+            list_remove(node);
+            pthread_mutex_unlock(&conn->lock);
+            return entry;
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    return NULL;
+}
+
+static void socket_put_rw_done(socket_conn *conn, uint32_t session_id,
+                               struct agm_socket_buf *b,
+                               struct agm_event_cb_params *evt_param)
+{
+    struct agm_event_read_write_done_payload rw;
+    socket_fd *entry = NULL;
+    uint8_t *metadata = NULL;
+
+    memcpy(&rw, evt_param->event_payload, sizeof(rw));
+    entry = conn_release_fd(conn, session_id, rw.buff.alloc_info.alloc_handle);
+    rw.buff.alloc_info.alloc_handle = entry ? entry->clt_fd : -1;
+    if (entry != NULL)
+        metadata = entry->metadata;
+    /* only a buffer held for a read is known to still be alive */
+    if (metadata == NULL || rw.buff.metadata != metadata)
+        rw.buff.metadata_size = 0;
+    rw.buff.addr = NULL;
+    rw.buff.metadata = NULL;
+
+    agm_socket_put_blob(b, &rw, sizeof(rw));
+    agm_socket_put_blob(b, metadata, rw.buff.metadata_size);
+    if (entry != NULL)
+        conn_put_fd(conn, entry);
+}
+
+static void socket_put_rw_done_batch(socket_conn *conn, uint32_t session_id,
+                                     struct agm_socket_buf *b,
+                                     struct agm_event_cb_params *evt_param)
+{
+    struct agm_event_read_write_done_batch_payload *batch = NULL;
+    struct agm_buff *buff = NULL;
+    socket_fd *entry = NULL;
+    uint32_t i, num_done;
+
+    num_done = (evt_param->event_payload_size - sizeof(*batch)) /
+               sizeof(struct agm_event_read_write_done_payload);
+
+    batch = (struct agm_event_read_write_done_batch_payload *)
+            agm_socket_reserve(b, sizeof(uint32_t) +
+                                  evt_param->event_payload_size);
+    if (batch == NULL)
+        return;
+    memcpy(batch, &evt_param->event_payload_size, sizeof(uint32_t));
+    batch = (struct agm_event_read_write_done_batch_payload *)
+            ((uint8_t *)batch + sizeof(uint32_t));
+    memcpy(batch, evt_param->event_payload, evt_param->event_payload_size);
+
+    if (batch->num_done < num_done)
+        num_done = batch->num_done;
+    for (i = 0; i < num_done; i++) {
+        buff = &batch->done[i].buff;
+        entry = conn_release_fd(conn, session_id,
+                                buff->alloc_info.alloc_handle);
+        buff->alloc_info.alloc_handle = entry ? entry->clt_fd : -1;
+        if (entry != NULL)
+            conn_put_fd(conn, entry);
+        buff->addr = NULL;
+        buff->metadata = NULL;
+        buff->metadata_size = 0;
+    }
+    agm_socket_put_blob(b, NULL, 0);
+}
+
+/*
+ * Event from agm, pushed to the client that registered for it. The buffers
+ * carried by data path completions are mapped back to the client's fds.
+ */
+static void socket_event_cb(uint32_t session_id,
+                            struct agm_event_cb_params *evt_param,
+                            void *client_data)
+{
+    socket_cb *cb_data = (socket_cb *)client_data;
+    socket_conn *conn = cb_data->conn;
+    struct agm_socket_buf b;
+    struct agm_socket_hdr *hdr = NULL;
+    uint32_t event_id = evt_param->event_id;
+    int ret;
+
+    agm_socket_buf_init(&b);
+    agm_socket_put_u32(&b, session_id);
+    agm_socket_put_u64(&b, cb_data->client_data);
+    agm_socket_put_u32(&b, evt_param->source_module_id);
+    agm_socket_put_u32(&b, event_id);
+
+    if ((event_id == AGM_EVENT_READ_DONE || event_id == AGM_EVENT_WRITE_DONE) &&
+        evt_param->event_payload_size >=
+                        sizeof(struct agm_event_read_write_done_payload)) {
+        socket_put_rw_done(conn, session_id, &b, evt_param);
+    } else if (event_id == AGM_EVENT_READ_WRITE_DONE_BATCH &&
+               evt_param->event_payload_size >
+                  sizeof(struct agm_event_read_write_done_batch_payload)) {
+        socket_put_rw_done_batch(conn, session_id, &b, evt_param);
+    } else {
+        agm_socket_put_blob(&b, evt_param->event_payload,
+                            evt_param->event_payload_size);
+        agm_socket_put_blob(&b, NULL, 0);
+    }
+
+    if (b.err == 0) {
+        hdr = agm_socket_buf_hdr(&b);
+        hdr->op = AGM_SOCKET_OP_EVENT;
+        hdr->seq = 0;
+        hdr->ret = 0;
+    }
+
+    pthread_mutex_lock(&conn->send_lock);
+    ret = agm_socket_send(conn->sock, &b, NULL, 0);
+    pthread_mutex_unlock(&conn->send_lock);
+    if (ret)
+        AGM_LOGE("%s: event %x for session %d not sent, ret %d\n", __func__,
+                 event_id, session_id, ret);
+    agm_socket_buf_free(&b);
+}
+
+static void socket_get_buffer_config(struct agm_socket_reader *r,
+                                     struct agm_buffer_config *config,
+                                     bool *present)
+{
+    *present = agm_socket_get_u32(r) != 0;
+    config->count = agm_socket_get_u32(r);
+    config->size = agm_socket_get_u64(r);
+    config->max_metadata_size = agm_socket_get_u64(r);
+}
+
+/* Blob holding a struct with a counted array of kvs at its end */
+static const uint8_t *socket_get_kv_blob(struct agm_socket_reader *r,
+                                         size_t hdr_size, size_t count_offset)
+{
+    const uint8_t *blob = NULL;
+    uint32_t size, count;
+
+    blob = agm_socket_get_blob(r, &size);
+    if (blob == NULL || size < hdr_size) {
+        r->err = -EINVAL;
+        return NULL;
+    }
+    memcpy(&count, blob + count_offset, sizeof(count));
+    if (count > (size - hdr_size) / sizeof(struct agm_key_value)) {
+        r->err = -EINVAL;
+        return NULL;
+    }
+    return blob;
+}
+
+static int socket_aif_set_media_config(socket_call *c)
+{
+    struct agm_media_config config;
+    uint32_t aif_id = agm_socket_get_u32(&c->in);
+
+    agm_socket_get_copy(&c->in, &config, sizeof(config));
+    if (c->in.err)
+        return -EINVAL;
+    return agm_aif_set_media_config(aif_id, &config);
+}
+
+static int socket_aif_group_set_media_config(socket_call *c)
+{
+    struct agm_group_media_config config;
+    uint32_t group_id = agm_socket_get_u32(&c->in);
+
+    agm_socket_get_copy(&c->in, &config, sizeof(config));
+    if (c->in.err)
+        return -EINVAL;
+    return agm_aif_group_set_media_config(group_id, &config);
+}
+
+static int socket_set_metadata(socket_call *c)
+{
+    uint32_t session_id = 0, aif_id = 0, size;
+    uint16_t op = c->msg->hdr.op;
+    const uint8_t *metadata = NULL;
+
+    if (op != AGM_SOCKET_OP_AIF_SET_METADATA)
+        session_id = agm_socket_get_u32(&c->in);
+    if (op != AGM_SOCKET_OP_SESSION_SET_METADATA)
+        aif_id = agm_socket_get_u32(&c->in);
+    metadata = agm_socket_get_blob(&c->in, &size);
+    if (c->in.err)
+        return -EINVAL;
+
+    /* agm only reads the metadata, it is passed in place */
+    if (op == AGM_SOCKET_OP_AIF_SET_METADATA)
+        return agm_aif_set_metadata(aif_id, size, (uint8_t *)metadata);
+    if (op == AGM_SOCKET_OP_SESSION_SET_METADATA)
+        return agm_session_set_metadata(session_id, size, (uint8_t *)metadata);
+    return agm_session_aif_set_metadata(session_id, aif_id, size,
+                                        (uint8_t *)metadata);
+}
+
+static int socket_set_params(socket_call *c)
+{
+    uint32_t session_id = 0, aif_id = 0, size;
+    uint16_t op = c->msg->hdr.op;
+    const uint8_t *payload = NULL;
+
+    if (op != AGM_SOCKET_OP_AIF_SET_PARAMS &&
+        op != AGM_SOCKET_OP_SET_PARAMS_TO_ACDB_TUNNEL)
+        session_id = agm_socket_get_u32(&c->in);
+    if (op != AGM_SOCKET_OP_SESSION_SET_PARAMS &&
+        op != AGM_SOCKET_OP_SET_PARAMS_TO_ACDB_TUNNEL)
+        aif_id = agm_socket_get_u32(&c->in);
+    payload = agm_socket_get_blob(&c->in, &size);
+    if (c->in.err)
+        return -EINVAL;
+
+    switch (op) {
+    case AGM_SOCKET_OP_AIF_SET_PARAMS:
+        return agm_aif_set_params(aif_id, (void *)payload, size);
+    case AGM_SOCKET_OP_SESSION_AIF_SET_PARAMS:
+        return agm_session_aif_set_params(session_id, aif_id,
+                                          (void *)payload, size);
+    case AGM_SOCKET_OP_SESSION_SET_PARAMS:
+        return agm_session_set_params(session_id, (void *)payload, size);
+    case AGM_SOCKET_OP_SET_PARAMS_WITH_TAG_TO_ACDB:
+        return agm_set_params_with_tag_to_acdb(session_id, aif_id,
+                                               (void *)payload, size);
+    default:
+        return agm_set_params_to_acdb_tunnel((void *)payload, size);
+    }
+}
+
+static int socket_session_aif_connect(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t aif_id = agm_socket_get_u32(&c->in);
+    uint32_t state = agm_socket_get_u32(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+    return agm_session_aif_connect(session_id, aif_id, state != 0);
+}
+
+static int socket_session_aif_get_tag_module_info(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t aif_id = agm_socket_get_u32(&c->in);
+    uint32_t has_payload = agm_socket_get_u32(&c->in);
+    uint64_t size_in = agm_socket_get_u64(&c->in);
+    size_t size = size_in;
+    void *payload = NULL;
+    int ret;
+
+    if (c->in.err || size_in > AGM_SOCKET_PAYLOAD_MAX)
+        return -EINVAL;
+
+    if (has_payload) {
+        payload = calloc(1, size_in ? size_in : 1);
+        if (payload == NULL)
+            return -ENOMEM;
+    }
+    ret = agm_session_aif_get_tag_module_info(session_id, aif_id, payload,
+                                              &size);
+    if (ret == 0) {
+        agm_socket_put_u64(&c->out, size);
+        if (has_payload)
+            agm_socket_put_blob(&c->out, payload, size_in);
+    }
+    free(payload);
+    return ret;
+}
+
+static int socket_session_aif_set_cal(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t aif_id = agm_socket_get_u32(&c->in);
+    const uint8_t *cal = NULL;
+
+    cal = socket_get_kv_blob(&c->in, sizeof(struct agm_cal_config),
+                             offsetof(struct agm_cal_config, num_ckvs));
+    if (c->in.err)
+        return -EINVAL;
+    return agm_session_aif_set_cal(session_id, aif_id,
+                                   (struct agm_cal_config *)cal);
+}
+
+static int socket_set_params_with_tag(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t aif_id = agm_socket_get_u32(&c->in);
+    const uint8_t *tag = NULL;
+
+    tag = socket_get_kv_blob(&c->in, sizeof(struct agm_tag_config),
+                             offsetof(struct agm_tag_config, num_tkvs));
+    if (c->in.err)
+        return -EINVAL;
+    return agm_set_params_with_tag(session_id, aif_id,
+                                   (struct agm_tag_config *)tag);
+}
+
+static int socket_session_get_params(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    const uint8_t *payload = NULL;
+    uint8_t *out = NULL;
+    uint32_t size;
+    int ret;
+
+    payload = agm_socket_get_blob(&c->in, &size);
+    if (c->in.err)
+        return -EINVAL;
+
+    /* the parameters asked for are overwritten with their values */
+    out = agm_socket_reserve(&c->out, sizeof(uint32_t) + size);
+    if (out == NULL)
+        return -ENOMEM;
+    memcpy(out, &size, sizeof(size));
+    out += sizeof(size);
+    memcpy(out, payload, size);
+    ret = agm_session_get_params(session_id, out, size);
+    if (ret)
+        c->out.size = sizeof(struct agm_socket_hdr);
+    return ret;
+}
+
+static int socket_get_params_from_acdb_tunnel(socket_call *c)
+{
+    const uint8_t *payload = NULL;
+    uint8_t *out = NULL;
+    uint32_t size_in;
+    size_t size;
+    int ret;
+
+    payload = agm_socket_get_blob(&c->in, &size_in);
+    if (c->in.err)
+        return -EINVAL;
+
+    size = size_in;
+    out = (uint8_t *)malloc(size_in ? size_in : 1);
+    if (out == NULL)
+        return -ENOMEM;
+    memcpy(out, payload, size_in);
+    ret = agm_get_params_from_acdb_tunnel(out, &size);
+    if (ret == 0) {
+        agm_socket_put_u64(&c->out, size);
+        agm_socket_put_blob(&c->out, out, size_in);
+    }
+    free(out);
+    return ret;
+}
+
+static int socket_session_register_cb(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t evt_type = agm_socket_get_u32(&c->in);
+    uint64_t client_data = agm_socket_get_u64(&c->in);
+    uint32_t reg = agm_socket_get_u32(&c->in);
+    socket_conn *conn = c->conn;
+    struct listnode *node = NULL;
+    socket_cb *cb_data = NULL;
+    int ret;
+
+    if (c->in.err)
+        return -EINVAL;
+
+    if (!reg) {
+        pthread_mutex_lock(&conn->lock);
+        list_for_each(node, &conn->callbacks) {
+            cb_data = node_to_item(node, socket_cb, list);
+            if (cb_data->session_id == session_id &&
+                cb_data->evt_type == evt_type &&
+                cb_data->client_data == client_data) {
+                list_remove(node);
+                break;
+            }
+            cb_data = NULL;
+        }
+        pthread_mutex_unlock(&conn->lock);
+        if (cb_data == NULL)
+            return -EINVAL;
+
+        /* returns once no event is being delivered to cb_data anymore */
+        ret = agm_session_register_cb(session_id, NULL,
+                                      (enum event_type)evt_type, cb_data);
+        free(cb_data);
+        return ret;
+    }
+
+    cb_data = (socket_cb *)calloc(1, sizeof(socket_cb));
+    if (cb_data == NULL)
+        return -ENOMEM;
+    cb_data->conn = conn;
+    cb_data->session_id = session_id;
+    cb_data->evt_type = evt_type;
+    cb_data->client_data = client_data;
+
+    ret = agm_session_register_cb(session_id, socket_event_cb,
+                                  (enum event_type)evt_type, cb_data);
+    if (ret) {
+        free(cb_data);
+        return ret;
+    }
+    pthread_mutex_lock(&conn->lock);
+    list_add_tail(&conn->callbacks, &cb_data->list);
+    pthread_mutex_unlock(&conn->lock);
+    return 0;
+}
+
+static int socket_session_register_for_events(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    struct agm_event_reg_cfg *cfg = NULL;
+    const uint8_t *blob = NULL;
+    uint32_t size;
+
+    blob = agm_socket_get_blob(&c->in, &size);
+    if (c->in.err || size < sizeof(struct agm_event_reg_cfg))
+        return -EINVAL;
+    cfg = (struct agm_event_reg_cfg *)blob;
+    if (cfg->event_config_payload_size > size - sizeof(*cfg))
+        return -EINVAL;
+    return agm_session_register_for_events(session_id, cfg);
+}
+
+static int socket_session_open(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t sess_mode = agm_socket_get_u32(&c->in);
+    uint64_t handle = 0;
+    int ret;
+
+    if (c->in.err)
+        return -EINVAL;
+
+    ret = agm_session_open(session_id, (enum agm_session_mode)sess_mode,
+                           &handle);
+    if (ret)
+        return ret;
+    conn_add_session(c->conn, session_id, handle);
+    agm_socket_put_u64(&c->out, handle);
+    return 0;
+}
+
+static int socket_session_set_config(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    struct agm_session_config session_config;
+    struct agm_media_config media_config;
+    struct agm_buffer_config buffer_config;
+    bool has_buffer_config;
+
+    agm_socket_get_copy(&c->in, &session_config, sizeof(session_config));
+    agm_socket_get_copy(&c->in, &media_config, sizeof(media_config));
+    socket_get_buffer_config(&c->in, &buffer_config, &has_buffer_config);
+    if (c->in.err)
+        return -EINVAL;
+    return agm_session_set_config(handle, &session_config, &media_config,
+                                  has_buffer_config ? &buffer_config : NULL);
+}
+
+static int socket_session_set_non_tunnel_mode_config(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    struct agm_session_config session_config;
+    struct agm_media_config in_media_config, out_media_config;
+    struct agm_buffer_config in_buffer_config, out_buffer_config;
+    bool has_in, has_out;
+
+    agm_socket_get_copy(&c->in, &session_config, sizeof(session_config));
+    agm_socket_get_copy(&c->in, &in_media_config, sizeof(in_media_config));
+    agm_socket_get_copy(&c->in, &out_media_config, sizeof(out_media_config));
+    socket_get_buffer_config(&c->in, &in_buffer_config, &has_in);
+    socket_get_buffer_config(&c->in, &out_buffer_config, &has_out);
+    if (c->in.err)
+        return -EINVAL;
+    return agm_session_set_non_tunnel_mode_config(handle, &session_config,
+                                        &in_media_config, &out_media_config,
+                                        has_in ? &in_buffer_config : NULL,
+                                        has_out ? &out_buffer_config : NULL);
+}
+
+static int socket_session_close(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    int ret;
+
+    if (c->in.err)
+        return -EINVAL;
+
+    ret = agm_session_close(handle);
+    if (ret == 0)
+        conn_remove_session(c->conn, handle);
+    return ret;
+}
+
+static int socket_session_state(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+
+    switch (c->msg->hdr.op) {
+    case AGM_SOCKET_OP_SESSION_PREPARE:
+        return agm_session_prepare(handle);
+    case AGM_SOCKET_OP_SESSION_START:
+        return agm_session_start(handle);
+    case AGM_SOCKET_OP_SESSION_STOP:
+        return agm_session_stop(handle);
+    case AGM_SOCKET_OP_SESSION_PAUSE:
+        return agm_session_pause(handle);
+    case AGM_SOCKET_OP_SESSION_FLUSH:
+        return agm_session_flush(handle);
+    case AGM_SOCKET_OP_SESSION_RESUME:
+        return agm_session_resume(handle);
+    case AGM_SOCKET_OP_SESSION_SUSPEND:
+        return agm_session_suspend(handle);
+    default:
+        return agm_session_eos(handle);
+    }
+}
+
+static int socket_sessionid_flush(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+    return agm_sessionid_flush(session_id);
+}
+
+static int socket_session_write(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    const uint8_t *data = NULL;
+    uint32_t size;
+    size_t count;
+    int ret;
+
+    data = agm_socket_get_blob(&c->in, &size);
+    if (c->in.err)
+        return -EINVAL;
+
+    count = size;
+    ret = agm_session_write(handle, (void *)data, &count);
+    if (ret == 0)
+        agm_socket_put_u64(&c->out, count);
+    return ret;
+}
+
+/*
+ * Reads land straight in the reply after a u64 count and the length of the
+ * data blob, both filled in here once the count is known.
+ */
+static void socket_patch_count(uint8_t *data, size_t count)
+{
+    uint64_t count64 = count;
+    uint32_t count32 = count;
+
+    data -= sizeof(count32) + sizeof(count64);
+    memcpy(data, &count64, sizeof(count64));
+    memcpy(data + sizeof(count64), &count32, sizeof(count32));
+}
+
+static int socket_session_read(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint64_t size = agm_socket_get_u64(&c->in);
+    uint8_t *data = NULL;
+    size_t count;
+    int ret;
+
+    if (c->in.err || size > AGM_SOCKET_PAYLOAD_MAX)
+        return -EINVAL;
+
+    agm_socket_put_u64(&c->out, 0);
+    agm_socket_put_u32(&c->out, 0);
+    data = agm_socket_reserve(&c->out, size);
+    if (data == NULL)
+        return -ENOMEM;
+    count = size;
+    ret = agm_session_read(handle, data, &count);
+    if (ret) {
+        c->out.size = sizeof(struct agm_socket_hdr);
+        return ret;
+    }
+    if (count > size)
+        count = size;
+    c->out.size -= size - count;
+    socket_patch_count(data, count);
+    return 0;
+}
+
+static int socket_get_iov_sizes(socket_call *c, uint32_t *sizes, int *iovcnt,
+                                uint64_t *total)
+{
+    int i;
+
+    *iovcnt = agm_socket_get_u32(&c->in);
+    if (c->in.err || *iovcnt <= 0 || *iovcnt > AGM_SESSION_IOV_MAX)
+        return -EINVAL;
+    *total = 0;
+    for (i = 0; i < *iovcnt; i++) {
+        sizes[i] = agm_socket_get_u32(&c->in);
+        *total += sizes[i];
+    }
+    if (c->in.err || *total > AGM_SOCKET_PAYLOAD_MAX)
+        return -EINVAL;
+    return 0;
+}
+
+static int socket_session_writev(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint32_t sizes[AGM_SESSION_IOV_MAX];
+    struct iovec iov[AGM_SESSION_IOV_MAX];
+    uint64_t total;
+    size_t count = 0;
+    int i, iovcnt, ret;
+
+    ret = socket_get_iov_sizes(c, sizes, &iovcnt, &total);
+    if (ret)
+        return ret;
+    /* the segments follow back to back and are written in place */
+    for (i = 0; i < iovcnt; i++) {
+        iov[i].iov_base = (void *)agm_socket_get(&c->in, sizes[i]);
+        iov[i].iov_len = sizes[i];
+    }
+    if (c->in.err)
+        return -EINVAL;
+
+    ret = agm_session_writev(handle, iov, iovcnt, &count);
+    if (ret == 0)
+        agm_socket_put_u64(&c->out, count);
+    return ret;
+}
+
+static int socket_session_readv(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint32_t sizes[AGM_SESSION_IOV_MAX];
+    struct iovec iov[AGM_SESSION_IOV_MAX];
+    uint8_t *data = NULL;
+    uint64_t total;
+    size_t count = 0;
+    int i, iovcnt, ret;
+
+    ret = socket_get_iov_sizes(c, sizes, &iovcnt, &total);
+    if (ret)
+        return ret;
+
+    agm_socket_put_u64(&c->out, 0);
+    agm_socket_put_u32(&c->out, 0);
+    data = agm_socket_reserve(&c->out, total);
+    if (data == NULL)
+        return -ENOMEM;
+    for (i = 0; i < iovcnt; i++) {
+        iov[i].iov_base = data;
+        iov[i].iov_len = sizes[i];
+        data += sizes[i];
+    }
+
+    ret = agm_session_readv(handle, iov, iovcnt, &count);
+    if (ret) {
+        c->out.size = sizeof(struct agm_socket_hdr);
+        return ret;
+    }
+    if (count > total)
+        count = total;
+    c->out.size -= total - count;
+    socket_patch_count(data - total, count);
+    return 0;
+}
+
+static int socket_get_hw_processed_buff_cnt(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint32_t dir = agm_socket_get_u32(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+    agm_socket_put_u64(&c->out,
+                       agm_get_hw_processed_buff_cnt(handle,
+                                                     (enum direction)dir));
+    return 0;
+}
+
+static int socket_get_aif_info_list(socket_call *c)
+{
+    uint64_t num_in = agm_socket_get_u64(&c->in);
+    struct aif_info *aif_list = NULL;
+    size_t num = num_in;
+    int ret;
+
+    if (c->in.err ||
+        num_in > AGM_SOCKET_PAYLOAD_MAX / sizeof(struct aif_info))
+        return -EINVAL;
+
+    if (num_in) {
+        aif_list = (struct aif_info *)calloc(num_in, sizeof(struct aif_info));
+        if (aif_list == NULL)
+            return -ENOMEM;
+    }
+    if (c->msg->hdr.op == AGM_SOCKET_OP_GET_AIF_INFO_LIST)
+        ret = agm_get_aif_info_list(aif_list, &num);
+    else
+        ret = agm_get_group_aif_info_list(aif_list, &num);
+    if (ret == 0) {
+        agm_socket_put_u64(&c->out, num);
+        agm_socket_put_blob(&c->out, aif_list,
+                            num_in * sizeof(struct aif_info));
+    }
+    free(aif_list);
+    return ret;
+}
+
+static int socket_session_set_loopback(socket_call *c)
+{
+    uint32_t capture_session_id = agm_socket_get_u32(&c->in);
+    uint32_t id = agm_socket_get_u32(&c->in);
+    uint32_t state = agm_socket_get_u32(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+    if (c->msg->hdr.op == AGM_SOCKET_OP_SESSION_SET_LOOPBACK)
+        return agm_session_set_loopback(capture_session_id, id, state != 0);
+    return agm_session_set_ec_ref(capture_session_id, id, state != 0);
+}
+
+static int socket_get_session_time(socket_call *c)
+{
+    uint64_t timestamp = 0;
+    int ret;
+
+    if (c->msg->hdr.op == AGM_SOCKET_OP_GET_SESSION_TIME) {
+        uint64_t handle = agm_socket_get_u64(&c->in);
+
+        if (c->in.err)
+            return -EINVAL;
+        ret = agm_get_session_time(handle, &timestamp);
+    } else {
+        uint32_t session_id = agm_socket_get_u32(&c->in);
+
+        if (c->in.err)
+            return -EINVAL;
+        ret = agm_get_buffer_timestamp(session_id, &timestamp);
+    }
+    if (ret == 0)
+        agm_socket_put_u64(&c->out, timestamp);
+    return ret;
+}
+
+static int socket_session_get_buf_info(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    uint32_t flag = agm_socket_get_u32(&c->in);
+    struct agm_buf_info buf_info;
+    int ret;
+
+    if (c->in.err)
+        return -EINVAL;
+
+    memset(&buf_info, 0, sizeof(buf_info));
+    ret = agm_session_get_buf_info(session_id, &buf_info, flag);
+    if (ret)
+        return ret;
+
+    /* the fds stay with agm, the client gets its own copies */
+    agm_socket_put_u32(&c->out, buf_info.data_buf_size);
+    agm_socket_put_u32(&c->out, buf_info.pos_buf_size);
+    if (flag & DATA_BUF)
+        c->fds[c->nfds++] = buf_info.data_buf_fd;
+    if (flag & POS_BUF)
+        c->fds[c->nfds++] = buf_info.pos_buf_fd;
+    return 0;
+}
+
+static int socket_set_gapless_session_metadata(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint32_t type = agm_socket_get_u32(&c->in);
+    uint32_t silence = agm_socket_get_u32(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+    return agm_set_gapless_session_metadata(handle,
+                                (enum agm_gapless_silence_type)type, silence);
+}
+
+/*
+ * Extern buffer info of a read or write, followed by its fd if any. A read
+ * gets a reference to the held fd in ref, for its metadata.
+ */
+static int socket_get_alloc_info(socket_call *c, uint64_t handle,
+                                 struct agm_buff *buf, uint8_t *metadata,
+                                 socket_fd **ref)
+{
+    uint32_t has_fd = agm_socket_get_u32(&c->in);
+    int32_t clt_fd = (int32_t)agm_socket_get_u32(&c->in);
+    int ret;
+
+    buf->alloc_info.alloc_size = agm_socket_get_u32(&c->in);
+    buf->alloc_info.offset = agm_socket_get_u32(&c->in);
+    buf->alloc_info.alloc_handle = clt_fd;
+    if (c->in.err)
+        return -EINVAL;
+    if (!has_fd)
+        return 0;
+
+    ret = conn_hold_fd(c, handle, 0, clt_fd, metadata, ref);
+    if (ret < 0)
+        return ret;
+    buf->alloc_info.alloc_handle = ret;
+    return 0;
+}
+
+static int socket_session_write_with_metadata(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    struct agm_buff buf;
+    uint32_t size, data_size, metadata_size;
+    uint8_t *data = NULL;
+    size_t consumed_size = 0;
+    int ret;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.timestamp = agm_socket_get_u64(&c->in);
+    buf.flags = agm_socket_get_u32(&c->in);
+    size = agm_socket_get_u32(&c->in);
+    ret = socket_get_alloc_info(c, handle, &buf, NULL, NULL);
+    if (ret)
+        return ret;
+    buf.metadata = (uint8_t *)agm_socket_get_blob(&c->in, &metadata_size);
+    buf.metadata_size = metadata_size;
+    buf.addr = (uint8_t *)agm_socket_get_blob(&c->in, &data_size);
+    buf.size = size;
+    if (c->in.err || (data_size != 0 && data_size != size) ||
+        size > AGM_SOCKET_PAYLOAD_MAX)
+        return -EINVAL;
+
+    /* extern buffers come without data, agm still gets a buffer of size */
+    if (data_size == 0) {
+        data = (uint8_t *)calloc(1, size ? size : 1);
+        if (data == NULL)
+            return -ENOMEM;
+        buf.addr = data;
+    }
+
+    ret = agm_session_write_with_metadata(handle, &buf, &consumed_size);
+    if (ret == 0)
+        agm_socket_put_u64(&c->out, consumed_size);
+    free(data);
+    return ret;
+}
+
+static int socket_session_read_with_metadata(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint32_t size = agm_socket_get_u32(&c->in);
+    uint32_t metadata_size = agm_socket_get_u32(&c->in);
+    uint32_t captured_size = 0;
+    uint8_t *metadata = NULL;
+    struct agm_buff buf;
+    socket_fd *held = NULL;
+    int ret;
+
+    if (c->in.err || size > AGM_SOCKET_PAYLOAD_MAX ||
+        metadata_size > AGM_SOCKET_PAYLOAD_MAX)
+        return -EINVAL;
+
+    memset(&buf, 0, sizeof(buf));
+    metadata = (uint8_t *)calloc(1, metadata_size ? metadata_size : 1);
+    buf.addr = (uint8_t *)calloc(1, size ? size : 1);
+    if (metadata == NULL || buf.addr == NULL) {
+        ret = -ENOMEM;
+        goto done;
+    }
+    buf.size = size;
+    buf.metadata = metadata;
+    buf.metadata_size = metadata_size;
+
+    /* once held, metadata goes with the fd, the completion may come first */
+    ret = socket_get_alloc_info(c, handle, &buf, metadata, &held);
+    if (ret)
+        goto done;
+
+    ret = agm_session_read_with_metadata(handle, &buf, &captured_size);
+    if (ret == 0) {
+        agm_socket_put_u32(&c->out, captured_size);
+        agm_socket_put_u64(&c->out, buf.timestamp);
+        agm_socket_put_u32(&c->out, buf.flags);
+        agm_socket_put_blob(&c->out, buf.metadata,
+                            buf.metadata_size <= metadata_size ?
+                            buf.metadata_size : metadata_size);
+        agm_socket_put_blob(&c->out, buf.addr,
+                            buf.size <= size ? buf.size : size);
+    }
+    if (held != NULL) {
+        conn_put_fd(c->conn, held);
+        metadata = NULL;
+    }
+
+done:
+    free(buf.addr);
+    free(metadata);
+    return ret;
+}
+
+static int socket_session_write_datapath_params(socket_call *c)
+{
+    uint32_t session_id = agm_socket_get_u32(&c->in);
+    struct agm_buff buf;
+    uint32_t size;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.timestamp = agm_socket_get_u64(&c->in);
+    buf.flags = agm_socket_get_u32(&c->in);
+    buf.addr = (uint8_t *)agm_socket_get_blob(&c->in, &size);
+    buf.size = size;
+    if (c->in.err || size == 0)
+        return -EINVAL;
+    return agm_session_write_datapath_params(session_id, &buf);
+}
+
+static int socket_session_async_op(socket_call *c)
+{
+    uint64_t handle = agm_socket_get_u64(&c->in);
+    uint32_t op = agm_socket_get_u32(&c->in);
+    uint64_t token = agm_socket_get_u64(&c->in);
+
+    if (c->in.err)
+        return -EINVAL;
+    return agm_session_async_op(handle, (enum agm_session_async_op)op, token);
+}
+
+static int socket_session_batch(socket_call *c)
+{
+    uint32_t num_ops = agm_socket_get_u32(&c->in);
+    struct agm_batch_status *status = NULL;
+    const struct agm_batch_op *op = NULL;
+    const uint8_t *blob = NULL, *end = NULL;
+    uint8_t *ops = NULL;
+    uint32_t ops_size, status_size, i;
+    int ret;
+
+    blob = agm_socket_get_blob(&c->in, &ops_size);
+    if (c->in.err || num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS ||
+        ops_size == 0)
+        return -EINVAL;
+
+    /* entries are read in place by agm, keep them off the packed message */
+    status_size = num_ops * sizeof(struct agm_batch_status);
+    ops = (uint8_t *)malloc(ops_size);
+    status = (struct agm_batch_status *)calloc(1, status_size);
+    if (ops == NULL || status == NULL) {
+        ret = -ENOMEM;
+        goto done;
+    }
+    memcpy(ops, blob, ops_size);
+
+    ret = agm_session_batch(ops, ops_size, num_ops, status);
+    agm_socket_put_blob(&c->out, status, status_size);
+
+    /* sessions the batch opened belong to this client as well */
+    end = ops + ops_size;
+    op = (const struct agm_batch_op *)ops;
+    for (i = 0; i < num_ops; i++) {
+        if ((const uint8_t *)op + sizeof(*op) > end ||
+            (const uint8_t *)op + AGM_BATCH_OP_SIZE(op->payload_size) > end)
+            break;
+        if (op->op_id == AGM_BATCH_OP_SESSION_OPEN && status[i].ret == 0 &&
+            status[i].hndl != 0)
+            conn_add_session(c->conn, op->session_id, status[i].hndl);
+        op = AGM_BATCH_OP_NEXT(op);
+    }
+
+done:
+    free(ops);
+    free(status);
+    return ret;
+}
+
+static int socket_dump(socket_call *c)
+{
+    struct agm_dump_info dump_info;
+
+    agm_socket_get_copy(&c->in, &dump_info, sizeof(dump_info));
+    if (c->in.err)
+        return -EINVAL;
+    if (dump_info.signal)
+        AGM_LOGD("%s: client with pid %d received signal %d\n", __func__,
+                 dump_info.pid, dump_info.signal);
+    return agm_dump(&dump_info);
+}
+
+static int socket_call_handler(socket_call *c)
+{
+    switch (c->msg->hdr.op) {
+    case AGM_SOCKET_OP_AIF_SET_MEDIA_CONFIG:
+        return socket_aif_set_media_config(c);
+    case AGM_SOCKET_OP_AIF_GROUP_SET_MEDIA_CONFIG:
+        return socket_aif_group_set_media_config(c);
+    case AGM_SOCKET_OP_AIF_SET_METADATA:
+    case AGM_SOCKET_OP_SESSION_SET_METADATA:
+    case AGM_SOCKET_OP_SESSION_AIF_SET_METADATA:
+        return socket_set_metadata(c);
+    case AGM_SOCKET_OP_AIF_SET_PARAMS:
+    case AGM_SOCKET_OP_SESSION_AIF_SET_PARAMS:
+    case AGM_SOCKET_OP_SESSION_SET_PARAMS:
+    case AGM_SOCKET_OP_SET_PARAMS_WITH_TAG_TO_ACDB:
+    case AGM_SOCKET_OP_SET_PARAMS_TO_ACDB_TUNNEL:
+        return socket_set_params(c);
+    case AGM_SOCKET_OP_SESSION_AIF_CONNECT:
+        return socket_session_aif_connect(c);
+    case AGM_SOCKET_OP_SESSION_AIF_GET_TAG_MODULE_INFO:
+        return socket_session_aif_get_tag_module_info(c);
+    case AGM_SOCKET_OP_SESSION_AIF_SET_CAL:
+        return socket_session_aif_set_cal(c);
+    case AGM_SOCKET_OP_SESSION_GET_PARAMS:
+        return socket_session_get_params(c);
+    case AGM_SOCKET_OP_GET_PARAMS_FROM_ACDB_TUNNEL:
+        return socket_get_params_from_acdb_tunnel(c);
+    case AGM_SOCKET_OP_SET_PARAMS_WITH_TAG:
+        return socket_set_params_with_tag(c);
+    case AGM_SOCKET_OP_SESSION_REGISTER_CB:
+        return socket_session_register_cb(c);
+    case AGM_SOCKET_OP_SESSION_REGISTER_FOR_EVENTS:
+        return socket_session_register_for_events(c);
+    case AGM_SOCKET_OP_SESSION_OPEN:
+        return socket_session_open(c);
+    case AGM_SOCKET_OP_SESSION_SET_CONFIG:
+        return socket_session_set_config(c);
+    case AGM_SOCKET_OP_SESSION_SET_NON_TUNNEL_MODE_CONFIG:
+        return socket_session_set_non_tunnel_mode_config(c);
+    case AGM_SOCKET_OP_SESSION_CLOSE:
+        return socket_session_close(c);
+    case AGM_SOCKET_OP_SESSION_PREPARE:
+    case AGM_SOCKET_OP_SESSION_START:
+    case AGM_SOCKET_OP_SESSION_STOP:
+    case AGM_SOCKET_OP_SESSION_PAUSE:
+    case AGM_SOCKET_OP_SESSION_FLUSH:
+    case AGM_SOCKET_OP_SESSION_RESUME:
+    case AGM_SOCKET_OP_SESSION_SUSPEND:
+    case AGM_SOCKET_OP_SESSION_EOS:
+        return socket_session_state(c);
+    case AGM_SOCKET_OP_SESSIONID_FLUSH:
+        return socket_sessionid_flush(c);
+    case AGM_SOCKET_OP_SESSION_READ:
+        return socket_session_read(c);
+    case AGM_SOCKET_OP_SESSION_WRITE:
+        return socket_session_write(c);
+    case AGM_SOCKET_OP_SESSION_READV:
+        return socket_session_readv(c);
+    case AGM_SOCKET_OP_SESSION_WRITEV:
+        return socket_session_writev(c);
+    case AGM_SOCKET_OP_GET_HW_PROCESSED_BUFF_CNT:
+        return socket_get_hw_processed_buff_cnt(c);
+    case AGM_SOCKET_OP_GET_AIF_INFO_LIST:
+    case AGM_SOCKET_OP_GET_GROUP_AIF_INFO_LIST:
+        return socket_get_aif_info_list(c);
+    case AGM_SOCKET_OP_SESSION_SET_LOOPBACK:
+    case AGM_SOCKET_OP_SESSION_SET_EC_REF:
+        return socket_session_set_loopback(c);
+    case AGM_SOCKET_OP_GET_SESSION_TIME:
+    case AGM_SOCKET_OP_GET_BUFFER_TIMESTAMP:
+        return socket_get_session_time(c);
+    case AGM_SOCKET_OP_SESSION_GET_BUF_INFO:
+        return socket_session_get_buf_info(c);
+    case AGM_SOCKET_OP_SET_GAPLESS_SESSION_METADATA:
+        return socket_set_gapless_session_metadata(c);
+    case AGM_SOCKET_OP_SESSION_WRITE_WITH_METADATA:
+        return socket_session_write_with_metadata(c);
+    case AGM_SOCKET_OP_SESSION_READ_WITH_METADATA:
+        return socket_session_read_with_metadata(c);
+    case AGM_SOCKET_OP_SESSION_WRITE_DATAPATH_PARAMS:
+        return socket_session_write_datapath_params(c);
+    case AGM_SOCKET_OP_SESSION_ASYNC_OP:
+        return socket_session_async_op(c);
+    case AGM_SOCKET_OP_SESSION_BATCH:
+        return socket_session_batch(c);
+    case AGM_SOCKET_OP_DUMP:
+        return socket_dump(c);
+    default:
+        AGM_LOGE("%s: unknown op %d\n", __func__, c->msg->hdr.op);
+        return -EINVAL;
+    }
+}
+
+static void socket_dispatch(socket_req *req)
+{
+    socket_conn *conn = req->conn;
+    struct agm_socket_hdr *hdr = NULL;
+    socket_call c;
+    int ret;
+
+    memset(&c, 0, sizeof(c));
+    c.conn = conn;
+    c.msg = &req->msg;
+    agm_socket_reader_init(&c.in, &req->msg);
+    agm_socket_buf_init(&c.out);
+
+    ret = socket_call_handler(&c);
+    if (c.out.err) {
+        /* the reply could not be built, report that instead */
+        ret = c.out.err;
+        c.nfds = 0;
+        agm_socket_buf_free(&c.out);
+        agm_socket_buf_init(&c.out);
+    }
+
+    if (c.out.err == 0) {
+        hdr = agm_socket_buf_hdr(&c.out);
+        hdr->op = req->msg.hdr.op;
+        hdr->seq = req->msg.hdr.seq;
+        hdr->ret = ret;
+    }
+
+    pthread_mutex_lock(&conn->send_lock);
+    ret = agm_socket_send(conn->sock, &c.out, c.fds, c.nfds);
+    pthread_mutex_unlock(&conn->send_lock);
+    if (ret)
+        AGM_LOGE("%s: reply to op %d not sent to pid %d, ret %d\n", __func__,
+                 req->msg.hdr.op, conn->pid, ret);
+
+    agm_socket_buf_free(&c.out);
+    agm_socket_msg_free(&req->msg);
+}
+
+static void *socket_worker_thread(void *arg __unused)
+{
+    socket_req *req = NULL;
+    socket_conn *conn = NULL;
+
+    pthread_mutex_lock(&sdata->lock);
+    for (;;) {
+        while (list_empty(&sdata->queue) && !sdata->stop)
+            pthread_cond_wait(&sdata->queue_cond, &sdata->lock);
+        if (list_empty(&sdata->queue))
+            break;
+
+        req = node_to_item(list_head(&sdata->queue), socket_req, list);
+        list_remove(&req->list);
+        pthread_mutex_unlock(&sdata->lock);
+
+        conn = req->conn;
+        socket_dispatch(req);
+        free(req);
+
+        pthread_mutex_lock(&conn->lock);
+        if (--conn->inflight == 0)
+            pthread_cond_broadcast(&conn->idle_cond);
+        pthread_mutex_unlock(&conn->lock);
+
+        pthread_mutex_lock(&sdata->lock);
+    }
+    pthread_mutex_unlock(&sdata->lock);
+
+    return NULL;
+}
+
+/*
+ * Undoes what the client left behind: callbacks first so no event is on
+ * its way to the connection, then its sessions and the buffers they held.
+ */
+static void socket_conn_release(socket_conn *conn)
+{
+    struct listnode *node = NULL, *tempnode = NULL;
+    socket_session *ses = NULL;
+    socket_cb *cb_data = NULL;
+
+    pthread_mutex_lock(&conn->lock);
+    while (conn->inflight)
+        pthread_cond_wait(&conn->idle_cond, &conn->lock);
+    pthread_mutex_unlock(&conn->lock);
+
+    list_for_each_safe(node, tempnode, &conn->callbacks) {
+        cb_data = node_to_item(node, socket_cb, list);
+        list_remove(node);
+        if (agm_session_register_cb(cb_data->session_id, NULL,
+                                    (enum event_type)cb_data->evt_type,
+                                    cb_data) != 0)
+            AGM_LOGE("%s: deregistering callback of session %d failed\n",
+                     __func__, cb_data->session_id);
+        free(cb_data);
+    }
+
+    list_for_each_safe(node, tempnode, &conn->sessions) {
+        ses = node_to_item(node, socket_session, list);
+        AGM_LOGD("%s: closing session %d of pid %d\n", __func__,
+                 ses->session_id, conn->pid);
+        if (agm_session_close(ses->handle) != 0)
+            AGM_LOGE("%s: agm_session_close failed for session %d\n",
+                     __func__, ses->session_id);
+        conn_remove_session(conn, ses->handle);
+    }
+
+    list_for_each_safe(node, tempnode, &conn->fds) {
+        list_remove(node);
+        socket_fd_free(node_to_item(node, socket_fd, list));
+    }
+
+    close(conn->sock);
+    pthread_mutex_destroy(&conn->send_lock);
+    pthread_mutex_destroy(&conn->lock);
+    pthread_cond_destroy(&conn->idle_cond);
+
+    pthread_mutex_lock(&sdata->lock);
+    list_remove(&conn->list);
+    pthread_cond_broadcast(&sdata->conns_cond);
+    pthread_mutex_unlock(&sdata->lock);
+    free(conn);
+}
+
+/* Reads the requests of one client and queues them for the workers */
+static void *socket_conn_thread(void *arg)
+{
+    socket_conn *conn = (socket_conn *)arg;
+    socket_req *req = NULL;
+    uint8_t *scratch = NULL;
+    int ret;
+
+    scratch = (uint8_t *)malloc(AGM_SOCKET_MSG_MAX);
+    if (scratch == NULL) {
+        AGM_LOGE("%s: no memory for pid %d\n", __func__, conn->pid);
+        goto done;
+    }
+
+    for (;;) {
+        req = (socket_req *)calloc(1, sizeof(socket_req));
+        if (req == NULL) {
+            AGM_LOGE("%s: no memory for pid %d\n", __func__, conn->pid);
+            break;
+        }
+        ret = agm_socket_recv(conn->sock, scratch, &req->msg);
+        if (ret) {
+            if (ret != -EPIPE)
+                AGM_LOGE("%s: dropping pid %d, ret %d\n", __func__,
+                         conn->pid, ret);
+            free(req);
+            break;
+        }
+        req->conn = conn;
+
+        pthread_mutex_lock(&conn->lock);
+        conn->inflight++;
+        pthread_mutex_unlock(&conn->lock);
+
+        pthread_mutex_lock(&sdata->lock);
+        list_add_tail(&sdata->queue, &req->list);
+        pthread_cond_signal(&sdata->queue_cond);
+        pthread_mutex_unlock(&sdata->lock);
+    }
+
+done:
+    AGM_LOGD("%s: pid %d disconnected\n", __func__, conn->pid);
+    free(scratch);
+    socket_conn_release(conn);
+    return NULL;
+}
+
+static int socket_conn_start(int sock)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    socket_conn *conn = NULL;
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    int ret;
+
+    conn = (socket_conn *)calloc(1, sizeof(socket_conn));
+    if (conn == NULL)
+        return -ENOMEM;
+
+    conn->sock = sock;
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+        conn->pid = cred.pid;
+    pthread_mutex_init(&conn->send_lock, NULL);
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_cond_init(&conn->idle_cond, NULL);
+    list_init(&conn->sessions);
+    list_init(&conn->callbacks);
+    list_init(&conn->fds);
+
+    pthread_mutex_lock(&sdata->lock);
+    list_add_tail(&sdata->conns, &conn->list);
+    pthread_mutex_unlock(&sdata->lock);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, socket_conn_thread, conn);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        AGM_LOGE("%s: failed to start reader for pid %d\n", __func__,
+                 conn->pid);
+        pthread_mutex_lock(&sdata->lock);
+        list_remove(&conn->list);
+        pthread_mutex_unlock(&sdata->lock);
+        pthread_mutex_destroy(&conn->send_lock);
+        pthread_mutex_destroy(&conn->lock);
+        pthread_cond_destroy(&conn->idle_cond);
+        free(conn);
+        return -ret;
+    }
+
+    AGM_LOGD("%s: pid %d connected\n", __func__, conn->pid);
+    return 0;
+}
+
+static void *socket_listen_thread(void *arg __unused)
+{
+    bool closing;
+    int sock;
+
+    for (;;) {
+        sock = accept4(sdata->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+        pthread_mutex_lock(&sdata->lock);
+        closing = sdata->closing;
+        pthread_mutex_unlock(&sdata->lock);
+        if (closing) {
+            if (sock >= 0)
+                close(sock);
+            break;
+        }
+
+        if (sock < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                AGM_LOGE("%s: accept failed, errno %d\n", __func__, errno);
+                usleep(100 * 1000);
+            }
+            continue;
+        }
+        if (socket_conn_start(sock))
+            close(sock);
+    }
+
+    return NULL;
+}
+
+static int socket_listen(void)
+{
+    struct sockaddr_un addr;
+    char dir[sizeof(addr.sun_path)];
+    char *slash = NULL;
+    int fd, ret;
+
+    if (strlen(AGM_SOCKET_PATH) >= sizeof(addr.sun_path))
+        return -ENAMETOOLONG;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", AGM_SOCKET_PATH);
+
+    snprintf(dir, sizeof(dir), "%s", AGM_SOCKET_PATH);
+    slash = strrchr(dir, '/');
+    if (slash != NULL && slash != dir) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) && errno != EEXIST)
+            AGM_LOGE("%s: cannot create %s, errno %d\n", __func__, dir, errno);
+    }
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+
+    /* a socket left behind by an earlier instance */
+    unlink(AGM_SOCKET_PATH);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        chmod(AGM_SOCKET_PATH, AGM_SOCKET_MODE) ||
+        listen(fd, AGM_SOCKET_BACKLOG)) {
+        ret = -errno;
+        AGM_LOGE("%s: cannot listen on %s, ret %d\n", __func__,
+                 AGM_SOCKET_PATH, ret);
+        close(fd);
+        return ret;
+    }
+
+    return fd;
+}
+
+static void socket_stop_workers(void)
+{
+    int i;
+
+    pthread_mutex_lock(&sdata->lock);
+    sdata->stop = true;
+    pthread_cond_broadcast(&sdata->queue_cond);
+    pthread_mutex_unlock(&sdata->lock);
+
+    for (i = 0; i < sdata->num_workers; i++)
+        pthread_join(sdata->workers[i], NULL);
+    sdata->num_workers = 0;
+}
+
+static void socket_server_free(void)
+{
+    pthread_mutex_destroy(&sdata->lock);
+    pthread_cond_destroy(&sdata->queue_cond);
+    pthread_cond_destroy(&sdata->conns_cond);
+    free(sdata);
+    sdata = NULL;
+}
+
+int ipc_agm_init()
+{
+    int rc = 0;
+
+    AGM_LOGV("%s : ", __func__);
+
+    sdata = (agm_socket_server *)calloc(1, sizeof(agm_socket_server));
+    if (sdata == NULL) {
+        AGM_LOGE("sdata is NULL");
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&sdata->lock, NULL);
+    pthread_cond_init(&sdata->queue_cond, NULL);
+    pthread_cond_init(&sdata->conns_cond, NULL);
+    list_init(&sdata->queue);
+    list_init(&sdata->conns);
+
+    if ((rc = agm_init()) != 0) {
+        AGM_LOGE("agm initialization failed");
+        socket_server_free();
+        return rc;
+    }
+
+    for (; sdata->num_workers < AGM_SOCKET_WORKERS; sdata->num_workers++) {
+        rc = pthread_create(&sdata->workers[sdata->num_workers], NULL,
+                            socket_worker_thread, NULL);
+        if (rc) {
+            AGM_LOGE("Failed to start socket workers");
+            rc = -rc;
+            goto fail;
+        }
+    }
+
+    sdata->listen_fd = socket_listen();
+    if (sdata->listen_fd < 0) {
+        rc = sdata->listen_fd;
+        goto fail;
+    }
+
+    rc = pthread_create(&sdata->listener, NULL, socket_listen_thread, NULL);
+    if (rc) {
+        AGM_LOGE("Failed to start socket listener");
+        close(sdata->listen_fd);
+        unlink(AGM_SOCKET_PATH);
+        rc = -rc;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    socket_stop_workers();
+    agm_deinit();
+    socket_server_free();
+    return rc;
+}
+
+void ipc_agm_deinit()
+{
+    struct listnode *node = NULL;
+    socket_conn *conn = NULL;
+
+    AGM_LOGV("%s : ", __func__);
+
+    if (sdata == NULL) {
+        AGM_LOGE("ipc_agm_deinit failed");
+        return;
+    }
+
+    /* no new clients, then let the current ones wind down */
+    pthread_mutex_lock(&sdata->lock);
+    sdata->closing = true;
+    pthread_mutex_unlock(&sdata->lock);
+    shutdown(sdata->listen_fd, SHUT_RDWR);
+    pthread_join(sdata->listener, NULL);
+    close(sdata->listen_fd);
+    unlink(AGM_SOCKET_PATH);
+
+    pthread_mutex_lock(&sdata->lock);
+    list_for_each(node, &sdata->conns) {
+        conn = node_to_item(node, socket_conn, list);
+        shutdown(conn->sock, SHUT_RDWR);
+    }
+    while (!list_empty(&sdata->conns))
+        pthread_cond_wait(&sdata->conns_cond, &sdata->lock);
+    pthread_mutex_unlock(&sdata->lock);
+
+    socket_stop_workers();
+    socket_server_free();
+
+    if (agm_deinit() != 0)
+        AGM_LOGE("agm deinitialization failed");
+}
@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * agm with nothing behind it, linked into the agm_server_stub of the socket
+ * and of the D-Bus service in place of libagm, so that the transports can be
+ * measured against the same service on any Linux host: no sound card,
+ * ACDB or DSP is touched and every call returns as soon as its arguments
+ * have been looked at. Writes are consumed whole, reads return silence and
+ * WRITE_DONE/READ_DONE are raised for sessions that registered for them,
+ * so the event path is exercised along with the data path.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <agm/agm_api.h>
+
+#define AGM_STUB_MAX_SESSIONS 128
+
+struct agm_stub_session {
+    agm_event_cb cb;
+    void *client_data;
+};
+
+static struct agm_stub_session stub_sessions[AGM_STUB_MAX_SESSIONS];
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Handles are the session id plus one so that 0 stays invalid */
+static uint32_t stub_session_id(uint64_t hndl)
+{
+    return (uint32_t)(hndl - 1);
+}
+
+static int stub_check(uint32_t session_id)
+{
+    return session_id < AGM_STUB_MAX_SESSIONS ? 0 : -EINVAL;
+}
+
+static void stub_event(uint64_t hndl, uint32_t event_id)
+{
+    struct {
+        struct agm_event_cb_params params;
+        struct agm_event_read_write_done_payload payload;
+    } event;
+    uint32_t session_id = stub_session_id(hndl);
+    agm_event_cb cb = NULL;
+    void *client_data = NULL;
+
+    if (stub_check(session_id))
+        return;
+
+    pthread_mutex_lock(&stub_lock);
+    cb = stub_sessions[session_id].cb;
+    client_data = stub_sessions[session_id].client_data;
+    pthread_mutex_unlock(&stub_lock);
+    if (!cb)
+        return;
+
+    memset(&event, 0, sizeof(event));
+    event.params.event_id = event_id;
+    event.params.event_payload_size = sizeof(event.payload);
+    cb(session_id, &event.params, client_data);
+}
+
+int agm_init()
+{
+    return 0;
+}
+
+int agm_deinit()
+{
+    pthread_mutex_lock(&stub_lock);
+    memset(stub_sessions, 0, sizeof(stub_sessions));
+    pthread_mutex_unlock(&stub_lock);
+    return 0;
+}
+
+int agm_dump(struct agm_dump_info *dump_info __unused)
+{
+    return 0;
+}
+
+int agm_get_aif_info_list(struct aif_info *aif_list, size_t *num_aif_info)
+{
+    if (!aif_list) {
+        *num_aif_info = 1;
+        return 0;
+    }
+    if (*num_aif_info < 1)
+        return -EINVAL;
+
+    memset(aif_list, 0, sizeof(*aif_list));
+    snprintf(aif_list->aif_name, sizeof(aif_list->aif_name), "STUB-RX");
+    aif_list->dir = RX;
+    *num_aif_info = 1;
+    return 0;
+}
+
+int agm_get_group_aif_info_list(struct aif_info *aif_list __unused,
+                                size_t *num_groups)
+{
+    *num_groups = 0;
+    return 0;
+}
+
+int agm_aif_set_media_config(uint32_t aif_id __unused,
+                             struct agm_media_config *media_config __unused)
+{
+    return 0;
+}
+
+int agm_aif_group_set_media_config(uint32_t aif_group_id __unused,
+                        struct agm_group_media_config *media_config __unused)
+{
+    return 0;
+}
+
+int agm_aif_set_metadata(uint32_t aif_id __unused, uint32_t size __unused,
+                         uint8_t *metadata __unused)
+{
+    return 0;
+}
+
+int agm_aif_set_params(uint32_t aif_id __unused, void *payload __unused,
+                       size_t size __unused)
+{
+    return 0;
+}
+
+int agm_session_set_metadata(uint32_t session_id, uint32_t size __unused,
+                             uint8_t *metadata __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_aif_set_metadata(uint32_t session_id, uint32_t aif_id __unused,
+                                 uint32_t size __unused,
+                                 uint8_t *metadata __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_aif_connect(uint32_t session_id, uint32_t aif_id __unused,
+                            bool state __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_aif_get_tag_module_info(uint32_t session_id,
+                                        uint32_t aif_id __unused,
+                                        void *payload __unused, size_t *size)
+{
+    *size = 0;
+    return stub_check(session_id);
+}
+
+int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id __unused,
+                               void *payload __unused, size_t size __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_aif_set_cal(uint32_t session_id, uint32_t aif_id __unused,
+                            struct agm_cal_config *cal_config __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_set_params(uint32_t session_id, void *payload __unused,
+                           size_t size __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_get_params(uint32_t session_id, void *payload __unused,
+                           size_t size __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_get_params_from_acdb_tunnel(void *payload __unused, size_t *size)
+{
+    *size = 0;
+    return 0;
+}
+
+int agm_set_params_with_tag(uint32_t session_id, uint32_t aif_id __unused,
+                            struct agm_tag_config *tag_config __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_set_params_with_tag_to_acdb(uint32_t session_id,
+                                    uint32_t aif_id __unused,
+                                    void *payload __unused,
+                                    size_t size __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_set_params_to_acdb_tunnel(void *payload __unused, size_t size __unused)
+{
+    return 0;
+}
+
+int agm_session_register_cb(uint32_t session_id, agm_event_cb cb,
+                            enum event_type evt_type, void *client_data)
+{
+    if (stub_check(session_id))
+        return -EINVAL;
+    if (evt_type != AGM_EVENT_DATA_PATH)
+        return 0;
+
+    pthread_mutex_lock(&stub_lock);
+    if (cb) {
+        stub_sessions[session_id].cb = cb;
+        stub_sessions[session_id].client_data = client_data;
+    } else if (stub_sessions[session_id].client_data == client_data) {
+        stub_sessions[session_id].cb = NULL;
+        stub_sessions[session_id].client_data = NULL;
+    }
+    pthread_mutex_unlock(&stub_lock);
+    return 0;
+}
+
+int agm_session_register_for_events(uint32_t session_id,
+                                struct agm_event_reg_cfg *evt_reg_cfg __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_open(uint32_t session_id,
+                     enum agm_session_mode sess_mode __unused,
+                     uint64_t *handle)
+{
+    if (stub_check(session_id))
+        return -EINVAL;
+
+    *handle = (uint64_t)session_id + 1;
+    return 0;
+}
+
+int agm_session_set_config(uint64_t hndl,
+                           struct agm_session_config *session_config __unused,
+                           struct agm_media_config *media_config __unused,
+                           struct agm_buffer_config *buffer_config __unused)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_set_non_tunnel_mode_config(uint64_t hndl,
+                struct agm_session_config *session_config __unused,
+                struct agm_media_config *in_media_config __unused,
+                struct agm_media_config *out_media_config __unused,
+                struct agm_buffer_config *in_buffer_config __unused,
+                struct agm_buffer_config *out_buffer_config __unused)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_close(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_prepare(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_start(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_stop(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_pause(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_resume(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_suspend(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_flush(uint64_t hndl)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_sessionid_flush(uint32_t session_id)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_eos(uint64_t handle)
+{
+    return stub_check(stub_session_id(handle));
+}
+
+int agm_session_async_op(uint64_t hndl, enum agm_session_async_op op __unused,
+                         uint64_t token __unused)
+{
+    return stub_check(stub_session_id(hndl));
+}
+
+int agm_session_batch(const void *ops __unused, size_t size __unused,
+                      uint32_t num_ops __unused,
+                      struct agm_batch_status *status __unused)
+{
+    return -ENOSYS;
+}
+
+int agm_session_write(uint64_t hndl, void *buff __unused, size_t *count __unused)
+{
+    if (stub_check(stub_session_id(hndl)))
+        return -EINVAL;
+
+    stub_event(hndl, AGM_EVENT_WRITE_DONE);
+    return 0;
+}
+
+int agm_session_read(uint64_t handle, void *buff, size_t *count)
+{
+    if (stub_check(stub_session_id(handle)))
+        return -EINVAL;
+
+    memset(buff, 0, *count);
+    stub_event(handle, AGM_EVENT_READ_DONE);
+    return 0;
+}
+
+int agm_session_writev(uint64_t hndl, const struct iovec *iov, int iovcnt,
+                       size_t *count)
+{
+    int i;
+
+    if (stub_check(stub_session_id(hndl)))
+        return -EINVAL;
+
+    *count = 0;
+    for (i = 0; i < iovcnt; i++)
+        *count += iov[i].iov_len;
+    stub_event(hndl, AGM_EVENT_WRITE_DONE);
+    return 0;
+}
+
+int agm_session_readv(uint64_t hndl, const struct iovec *iov, int iovcnt,
+                      size_t *count)
+{
+    int i;
+
+    if (stub_check(stub_session_id(hndl)))
+        return -EINVAL;
+
+    *count = 0;
+    for (i = 0; i < iovcnt; i++) {
+        memset(iov[i].iov_base, 0, iov[i].iov_len);
+        *count += iov[i].iov_len;
+    }
+    stub_event(hndl, AGM_EVENT_READ_DONE);
+    return 0;
+}
+
+int agm_session_write_with_metadata(uint64_t hndl, struct agm_buff *buff,
+                                    size_t *consumed_size)
+{
+    if (stub_check(stub_session_id(hndl)))
+        return -EINVAL;
+
+    *consumed_size = buff->size;
+    return 0;
+}
+
+int agm_session_read_with_metadata(uint64_t hndl, struct agm_buff *buff,
+                                   uint32_t *captured_size)
+{
+    if (stub_check(stub_session_id(hndl)))
+        return -EINVAL;
+
+    *captured_size = buff->size;
+    return 0;
+}
+
+int agm_session_write_datapath_params(uint32_t session_id,
+                                      struct agm_buff *buff __unused)
+{
+    return stub_check(session_id);
+}
+
+int agm_session_get_buf_info(uint32_t session_id __unused,
+                             struct agm_buf_info *buf_info __unused,
+                             uint32_t flag __unused)
+{
+    return -ENOSYS;
+}
+
+size_t agm_get_hw_processed_buff_cnt(uint64_t hndl __unused,
+                                     enum direction dir __unused)
+{
+    return 0;
+}
+
+int agm_get_session_time(uint64_t handle, uint64_t *timestamp)
+{
+    *timestamp = 0;
+    return stub_check(stub_session_id(handle));
+}
+
+int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp)
+{
+    *timestamp = 0;
+    return stub_check(session_id);
+}
+
+int agm_set_gapless_session_metadata(uint64_t handle,
+                                 enum agm_gapless_silence_type type __unused,
+                                 uint32_t silence __unused)
+{
+    return stub_check(stub_session_id(handle));
+}
+
+int agm_session_set_loopback(uint32_t capture_session_id,
+                             uint32_t playback_session_id __unused,
+                             bool state __unused)
+{
+    return stub_check(capture_session_id);
+}
+
+int agm_session_set_ec_ref(uint32_t capture_session_id,
+                           uint32_t aif_id __unused, bool state __unused)
+{
+    return stub_check(capture_session_id);
+}
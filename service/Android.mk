@@ -18,6 +18,7 @@ LOCAL_VENDOR_MODULE := true
 LOCAL_CFLAGS        := -D_ANDROID_ -DAGM_DEBUG_METADATA
 LOCAL_CFLAGS        += -Wno-tautological-compare -Wno-macro-redefined -Wall
 LOCAL_CFLAGS        += -D_GNU_SOURCE -DACDB_PATH=\"/vendor/etc/acdbdata/\"
+LOCAL_CFLAGS        += -DGRAPH_POOL_WARMUP_FILE=\"/vendor/etc/agm_graph_pool.conf\"
 LOCAL_CFLAGS        += -DACDB_DELTA_FILE_PATH="/data/vendor/audio/acdbdata/delta"
 
 LOCAL_C_INCLUDES    := $(LOCAL_PATH)/inc/public
@@ -75,7 +76,36 @@ ifeq ($(strip $(AUDIO_FEATURE_ENABLED_DEVICE_PREPARE_SEQ)), true)
     LOCAL_CFLAGS += -DENABLE_DEV_PREPARE_BEFORE_GRAPH_START_SEQ
 endif
 
+ifeq ($(strip $(AUDIO_FEATURE_ENABLED_GRAPH_WARM_POOL)), false)
+    LOCAL_CFLAGS += -DGRAPH_POOL_MAX_ENTRIES=0
+endif
+
+ifeq ($(strip $(AUDIO_FEATURE_ENABLED_GRAPH_WARM_POOL_PREPARE)), true)
+    LOCAL_CFLAGS += -DGRAPH_POOL_PREPARE=1
+endif
+
+ifneq ($(strip $(AUDIO_AGM_EVENT_DISPATCH_PRIO)),)
+    LOCAL_CFLAGS += -DSESSION_EVENT_DISPATCH_PRIO=$(AUDIO_AGM_EVENT_DISPATCH_PRIO)
+endif
+
 include $(BUILD_SHARED_LIBRARY)
 
 endif
 
+# Build agm_ipc_test, the agm tests and benchmarks run through libagmclient
+include $(CLEAR_VARS)
+
+LOCAL_MODULE        := agm_ipc_test
+LOCAL_MODULE_OWNER  := qti
+LOCAL_MODULE_TAGS   := optional
+LOCAL_VENDOR_MODULE := true
+
+LOCAL_CFLAGS        += -Wno-unused-parameter -Wno-unused-result
+LOCAL_CFLAGS        += -Wno-unused-variable
+LOCAL_SRC_FILES     := test/src/agm_test.c
+
+LOCAL_HEADER_LIBRARIES := libagm_headers
+
+LOCAL_SHARED_LIBRARIES := libagmclient
+
+include $(BUILD_EXECUTABLE)
@@ -62,6 +62,14 @@ struct agm_meta_data_gsl {
      * Used to lookup the property ids
      */
      struct sg_prop sg_props;
+    /**
+     * Changes whenever the contents are modified, 0 if empty
+     */
+     uint32_t gen;
+    /**
+     * Single allocation backing gkv, ckv and sg_props, if owned separately
+     */
+     void *buf;
 };
 
 struct agm_tag_config_gsl {
@@ -160,12 +160,26 @@ typedef struct hw_ep_info
     union hw_ep_config ep_config;
 }hw_ep_info_t;
 
+struct module_cfg_cache;
+
+/*
+ * Payloads last sent to the hw endpoint modules of a pcm device, shared by
+ * every graph on it. Maintained by graph_module.c, taken through
+ * device_get_cfg_cache() only.
+ */
+struct device_cfg_cache {
+    pthread_mutex_t lock;
+    struct module_cfg_cache *head;
+};
+
 struct device_group_data {
     char name[MAX_DEV_NAME_LEN];
     bool has_multiple_dai_link;
     struct refcount refcnt;
     struct agm_group_media_config media_config;
     struct listnode list_node;
+    /* serializes start/stop sequencing of all devices in the group */
+    pthread_mutex_t hwep_lock;
 };
 
 struct device_obj {
@@ -181,6 +195,13 @@ struct device_obj {
 
     struct listnode list_node;
     pthread_mutex_t lock;
+    /*
+     * serializes hardware endpoint start/stop sequencing across sessions,
+     * held around graph and device prepare/start/stop. Taken through
+     * device_get_hwep_lock() only.
+     */
+    pthread_mutex_t hwep_lock;
+    struct device_cfg_cache cfg_cache;
     /* pcm device info associated with the device object */
     uint32_t card_id;
     hw_ep_info_t hw_ep_info;
@@ -242,5 +263,12 @@ int device_get_group_list(struct aif_info *aif_list, size_t *num_groups);
 
 int device_get_start_refcnt(struct device_obj *dev_obj);
 int device_get_state(struct device_obj *dev_obj);
+/*
+ * Returns the lock serializing hw endpoint sequencing for dev_obj. Virtual
+ * devices share the lock of their parent and grouped devices the lock of
+ * their group.
+ */
+pthread_mutex_t *device_get_hwep_lock(struct device_obj *dev_obj);
+struct device_cfg_cache *device_get_cfg_cache(struct device_obj *dev_obj);
 bool get_file_path_extn(char* file_path_extn, char* file_path_extn_wo_variant);
 #endif
@@ -184,6 +184,20 @@ int graph_read(struct graph_obj *gph_obj, struct agm_buff *buffer, size_t *size)
  */
 int graph_write(struct graph_obj *gph_obj, struct agm_buff *buffer, size_t *size);
 
+/**
+ *\brief read/write a list of buffers as a single gsl read/write
+ *\param [in] graph_obj: associated graph obj
+ *\param [in] iov: segments, gathered into one buffer when more than one
+ *\param [in] iovcnt: number of segments
+ *\param [out] size: total bytes transferred
+ *
+ * return zero on success, error code otherwise.
+ */
+int graph_readv(struct graph_obj *gph_obj, const struct iovec *iov,
+                int iovcnt, size_t *size);
+int graph_writev(struct graph_obj *gph_obj, const struct iovec *iov,
+                 int iovcnt, size_t *size);
+
 /**
  *\brief pause an existing graph.
  *\param [in] graph_obj: associated graph obj
@@ -289,6 +303,26 @@ int graph_stop(struct graph_obj *gph_obj,
  */
 int graph_close(struct graph_obj *gph_obj);
 
+/**
+ *\brief Log warm graph pool occupancy, hit rate and the graph
+ * open time saved by adopting pooled graphs, along with the number of
+ * GSL events that did not fit the per graph event slab.
+ */
+void graph_pool_dump();
+
+/**
+ *\brief Open the usecases listed in GRAPH_POOL_WARMUP_FILE and park
+ * them in the warm graph pool, prepared when the usecase gives a media
+ * config. One usecase per line, '#' starts a comment:
+ *   mode=<sess_mode> dir=<1 rx|2 tx> [aif=<id>] gkv=<key>:<value>,...
+ *   [ckv=<key>:<value>,...] [media=<rate>,<channels>,<format>]
+ *   [buffer=<size>,<count>]
+ * The GKV is the session's merged one, as graph_open logs it.
+ *
+ * returns the number of graphs parked.
+ */
+int graph_pool_warmup();
+
 /**
  *\brief return the no of buffers consumed/captured by the HW(SPF).
  * memory.
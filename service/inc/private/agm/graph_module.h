@@ -29,6 +29,7 @@
 #ifndef GPH_MODULE_H
 #define GPH_MODULE_H
 
+#include <stdatomic.h>
 #include <agm/agm_list.h>
 #include <agm/device.h>
 
@@ -108,6 +109,21 @@ enum  channel_num{
     CHANNEL_8,
 };
 
+/*
+ *Last payload a configure hook sent to a module instance for a param id.
+ *It stays valid for as long as the module holds that configuration, i.e.
+ *until the module's subgraph is closed or a client sets that param itself,
+ *and lets a re-prepare skip identical payloads. Hardware endpoint entries
+ *live on the device, see device_get_cfg_cache().
+ */
+struct module_cfg_cache {
+    struct module_cfg_cache *next;
+    uint32_t miid;
+    uint32_t param_id;
+    size_t size;
+    uint8_t payload[];
+};
+
 struct module_info {
     struct listnode list;
     /*local enum based module identification*/
@@ -130,6 +146,13 @@ struct module_info {
      *gsl_set_config/gsl_set_custom_config api's.
      */
     int (*configure)(struct module_info *mod, struct graph_obj *gph_obj);
+    /*
+     *configure only sends through graph_module_set_custom_config() and is
+     *run again on every prepare, the cache dropping what did not change
+     */
+    bool reconfigure;
+    /*payloads sent by configure, see graph_module_set_custom_config()*/
+    struct module_cfg_cache *cfg_cache;
 };
 
 typedef struct module_info module_info_t;
@@ -139,6 +162,67 @@ struct graph_buf_info {
     uint64_t timestamp;
 };
 
+/*
+ *GSL events are translated into one of these preallocated slots instead of a
+ *heap copy; a slot is only held for the duration of the event callback.
+ *Payloads larger than GRAPH_EVENT_MAX_PAYLOAD or events arriving while all
+ *slots are held fall back to the heap and are counted as overflows.
+ */
+#define GRAPH_EVENT_SLOTS 4
+#define GRAPH_EVENT_MAX_PAYLOAD 256
+#define GRAPH_EVENT_SLOT_WORDS ((sizeof(struct agm_event_cb_params) + \
+                GRAPH_EVENT_MAX_PAYLOAD + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+struct graph_event_slab {
+    atomic_uint busy;    /*bitmask of slots handed out*/
+    uint64_t slot[GRAPH_EVENT_SLOTS][GRAPH_EVENT_SLOT_WORDS];
+};
+
+/*
+ *Module params collected while graph_prepare() runs the configure hooks, so
+ *they can be sent to SPF as a single multi-param command.
+ */
+struct graph_cfg_batch_entry {
+    struct module_info *mod;
+    size_t offset;    /*of the param data block in buf*/
+    size_t size;
+};
+
+struct graph_cfg_batch {
+    bool active;
+    uint8_t *buf;
+    size_t size;
+    size_t buf_cap;
+    struct graph_cfg_batch_entry *entry;
+    size_t num_entries;
+    size_t entry_cap;
+};
+
+/*
+ *Open addressed index over tagged_mod_list, rebuilt whenever the list
+ *changes. tag resolves to the first module carrying it in list order.
+ */
+struct graph_mod_index_slot {
+    uint32_t key;
+    struct module_info *mod;
+};
+
+struct graph_mod_index {
+    uint32_t mask;    /*table size - 1, 0 while no table is built*/
+    struct graph_mod_index_slot *by_tag;
+    struct graph_mod_index_slot *by_miid;
+};
+
+/*session and device config a parked graph was left prepared with*/
+struct graph_pool_config {
+    struct agm_session_config stream_config;
+    struct agm_media_config in_media_config;
+    struct agm_media_config out_media_config;
+    struct agm_buffer_config in_buffer_config;
+    struct agm_buffer_config out_buffer_config;
+    struct agm_media_config dev_media_config;
+};
+
 struct graph_obj {
     pthread_mutex_t lock;
     pthread_mutex_t gph_open_thread_lock;
@@ -155,9 +239,50 @@ struct graph_obj {
     uint32_t spr_miid;
     struct graph_buf_info buf_info;
     bool is_config_buf_params_done;
+    /*warm pool bookkeeping, see graph_pool_park()*/
+    struct listnode pool_node;
+    struct graph_pool_key *pool_key;
+    size_t pool_size;
+    uint64_t open_time_ns;
+    uint64_t prepare_time_ns;
+    uint32_t acdb_gen;
+    bool pool_eligible;
+    bool pool_prepared;
+    struct graph_pool_config pool_config;
+    struct graph_event_slab event_slab;
+    struct graph_cfg_batch cfg_batch;
+    struct graph_mod_index mod_index;
+    /*staging buffer for readv/writev, used under the session data_lock*/
+    uint8_t *iov_buf;
+    size_t iov_buf_size;
 };
 
 void get_stream_module_list_array(module_info_t **info, size_t *size);
 void get_hw_ep_module_list_array(module_info_t **info, size_t *size);
 
+/*
+ *Sends a module configuration payload through gsl_set_custom_config()
+ *unless it is byte for byte the payload last sent for its param id, and
+ *remembers it on success. Returns a GSL error code.
+ */
+int graph_module_set_custom_config(struct module_info *mod,
+                                   struct graph_obj *graph_obj,
+                                   uint8_t *payload, size_t payload_size);
+/*Drops the payloads remembered for mod, to be used when its subgraph goes*/
+void graph_module_cfg_cache_free(struct module_info *mod);
+/*Drops the payload remembered for one param of mod, set behind the cache*/
+void graph_module_cfg_cache_drop(struct module_info *mod, uint32_t param_id);
+
+/*
+ *Between begin and end, graph_module_set_custom_config() appends to the
+ *graph's batch instead of sending. flush sends what was collected in one
+ *command, falling back to one command per param to find the failing module;
+ *modules whose params did not reach SPF get is_configured cleared. flush
+ *returns a GSL error code. end discards anything not flushed.
+ */
+void graph_module_cfg_batch_begin(struct graph_obj *graph_obj);
+int graph_module_cfg_batch_flush(struct graph_obj *graph_obj);
+void graph_module_cfg_batch_end(struct graph_obj *graph_obj);
+void graph_module_cfg_batch_free(struct graph_obj *graph_obj);
+
 #endif /*GPH_MODULE_H*/
@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <agm/agm_list.h>
 #include <agm/agm_priv.h>
 #include <agm/metadata.h>
@@ -49,12 +50,40 @@ enum aif_state {
     AIF_STARTED,
 };
 
+/*
+ * Merged metadata is kept around and rebuilt only when the generation of
+ * one of the metadata it was merged from has changed.
+ */
+struct merged_meta_cache {
+    struct agm_meta_data_gsl *meta;
+    uint32_t sess_gen;
+    uint32_t aif_gen;
+    uint32_t dev_gen;
+};
+
+struct merged_meta_input {
+    uint32_t aif_id;
+    uint32_t aif_gen;
+    uint32_t dev_gen;
+};
+
+/* merged metadata across all connected aifs of a session */
+struct session_meta_cache {
+    struct agm_meta_data_gsl *meta;
+    uint32_t sess_gen;
+    uint32_t num_inputs;
+    uint32_t max_inputs;
+    struct merged_meta_input *inputs;
+};
+
 struct aif {
     struct listnode node;
     uint32_t aif_id;
     struct device_obj *dev_obj;
     enum aif_state state;
     struct agm_meta_data_gsl sess_aif_meta;
+    struct merged_meta_cache merged_meta;
+    struct merged_meta_cache merged_aif_dev_meta;
     void *params;
     size_t params_size;
     struct agm_tag_config *tag_config;
@@ -69,19 +98,121 @@ enum session_state {
 };
 
 struct session_cb {
-    struct listnode node;
     agm_event_cb cb;
     enum event_type evt_type;
     void *client_data;
 };
 
+/*
+ * Registered callbacks live in immutable arrays, one per event type, that
+ * register/deregister replace under cb_pool_lock. Event delivery reads the
+ * current array without taking a lock and announces itself in the
+ * cb_readers slot selected by cb_epoch. A writer publishes the new array,
+ * flips the epoch and waits for the readers of the old slot to leave before
+ * freeing the old array, so a deregistered callback is never run once
+ * deregistration has returned.
+ */
+#define SESSION_CB_EVENT_TYPES 3    /* AGM_EVENT_DATA_PATH .. AGM_EVENT_SESSION_OP */
+#define SESSION_CB_INDEX(evt_type) ((evt_type) - AGM_EVENT_DATA_PATH)
+
+struct session_cb_list {
+    uint32_t num_cbs;
+    struct session_cb cbs[];
+};
+
+/*
+ * GSL events are copied into a bounded per-session queue on the GSL callback
+ * thread and handed to the registered callbacks by an event dispatch thread,
+ * so a slow client callback no longer holds up the DSP events behind it.
+ * The queue is a lock-free multi-producer ring with a single consumer; slot
+ * sequence numbers tell producers and the dispatcher whose turn a slot is.
+ * Sessions are spread over SESSION_EVENT_DISPATCH_THREADS dispatchers by
+ * session id, so one session is always drained by the same thread while a
+ * slow client only delays the sessions sharing its dispatcher.
+ *
+ * The GSL thread never waits on a full queue. Once the ring is full, events
+ * spill to a per-session heap list (counted as overflows) and keep going
+ * there until the dispatcher has emptied it, which keeps them in order. The
+ * spill list is capped at SESSION_EVENT_SPILL_MAX events; past that, or if
+ * the copy cannot be allocated, the event is dropped, logged and counted in
+ * dropped. Payloads above SESSION_EVENT_MAX_PAYLOAD do not fit a slot and
+ * are queued as a heap copy instead.
+ */
+#define SESSION_EVENT_QUEUE_DEPTH 16    /* power of 2 */
+#define SESSION_EVENT_MAX_PAYLOAD 256
+#define SESSION_EVENT_SPILL_MAX 1024
+#define SESSION_EVENT_SLOT_WORDS ((sizeof(struct agm_event_cb_params) + \
+            SESSION_EVENT_MAX_PAYLOAD + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+struct session_event_slot {
+    atomic_uint seq;
+    uint64_t queued_ns;
+    struct agm_event_cb_params *large_event;
+    uint64_t event[SESSION_EVENT_SLOT_WORDS];
+};
+
+struct session_event_spill {
+    struct listnode node;
+    uint64_t queued_ns;
+    struct agm_event_cb_params *event;  /* follows the node */
+};
+
+struct session_event_queue {
+    atomic_uint head;           /* next slot claimed by a producer */
+    unsigned int tail;          /* next slot read, dispatcher only */
+    atomic_bool pending;        /* set while queued for the dispatcher */
+    struct listnode dispatch_node;
+    pthread_mutex_t spill_lock;
+    struct listnode spill_list; /* events that did not fit the ring */
+    atomic_uint spilled;        /* length of spill_list */
+    atomic_ullong overflows;
+    atomic_ullong dropped;
+    atomic_ullong large_events;
+    /* updated by the dispatcher only, read unlocked by session_obj_dump() */
+    uint64_t dispatched;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    struct session_event_slot slot[SESSION_EVENT_QUEUE_DEPTH];
+};
+
+/*
+ * READ_DONE/WRITE_DONE coalescing state, see struct agm_event_coalesce_cfg.
+ * The config is packed in one word (max_count << 32 | max_delay_us, 0 when
+ * off) so the dispatcher always reads a consistent pair; everything else is
+ * owned by the dispatcher.
+ */
+#define SESSION_EVENT_BATCH_WORDS ((sizeof(struct agm_event_cb_params) + \
+            sizeof(struct agm_event_read_write_done_batch_payload) + \
+            AGM_EVENT_COALESCE_MAX_COUNT * \
+            sizeof(struct agm_event_read_write_done_payload) + \
+            sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+struct session_event_batch {
+    atomic_ullong cfg;
+    struct listnode node;       /* on the dispatcher's list while pending */
+    uint64_t deadline_ns;
+    uint32_t max_count;
+    uint32_t entry_size;        /* payload size of the batched events */
+    uint64_t event[SESSION_EVENT_BATCH_WORDS];
+};
+
+struct session_async_op {
+    struct listnode node;
+    enum agm_session_async_op op;
+    uint64_t token;
+};
+
 struct session_obj {
     struct listnode node;
+    struct listnode id_hash_node;
+    uint32_t slot;          /* SESSION_SLOT_NONE unless the session is open */
     uint32_t sess_id;
     enum session_state state;
     struct agm_meta_data_gsl sess_meta;
+    struct session_meta_cache merged_meta;
+    struct session_meta_cache merged_meta_without_dev;
     struct listnode aif_pool;
-    struct listnode cb_pool;
+    _Atomic(struct session_cb_list *) cb_lists[SESSION_CB_EVENT_TYPES];
     struct graph_obj *graph;
     struct agm_session_config stream_config;
     struct agm_media_config in_media_config;
@@ -97,24 +228,77 @@ struct session_obj {
     uint32_t rx_metadata_sz;
     uint32_t tx_metadata_sz;
     pthread_mutex_t lock;
+    /*
+     * Serializes read/write against each other and against the graph being
+     * opened or closed underneath them; graph is only changed with both lock
+     * and data_lock held, in that order. Control ops that leave the graph in
+     * place do not take it.
+     */
+    pthread_mutex_t data_lock;
     pthread_mutex_t cb_pool_lock;
+    atomic_uint cb_epoch;
+    atomic_uint cb_readers[2];
+    atomic_bool cb_sync_waiting;
+    pthread_mutex_t cb_sync_lock;
+    pthread_cond_t cb_sync_cond;
+    /* ops queued by session_obj_async_op(), run by async_thread */
+    struct listnode async_list;
+    pthread_mutex_t async_lock;
+    pthread_cond_t async_cond;
+    pthread_t async_thread;
+    bool async_thread_started;
+    bool async_exit;
+    struct session_event_queue event_queue;
+    struct session_event_batch event_batch;
+};
+
+/*
+ * Session objects are looked up by session id on most API calls, so the pool
+ * keeps them hashed on it. Lookups take the lock for reading; only creation
+ * and teardown of the pool take it for writing.
+ */
+#define SESSION_POOL_HASH_BITS 6
+#define SESSION_POOL_HASH_SIZE (1 << SESSION_POOL_HASH_BITS)
+
+/*
+ * Handles returned by session_obj_open() carry the slot index of the session
+ * object in the low 32 bits (biased by one) and the slot generation in the
+ * high 32 bits. The generation is odd while the session is open and is bumped
+ * on open and on close, so a handle is valid only if it matches the current
+ * generation of its slot. A slot is held only while its session is open and
+ * goes back on free_slots on close; its generation keeps counting across
+ * owners, so handles of an earlier owner stay invalid.
+ */
+#define SESSION_POOL_MAX_SLOTS 256
+#define SESSION_SLOT_NONE UINT32_MAX
+
+struct session_slot {
+    atomic_uint gen;
+    _Atomic(struct session_obj *) obj;
 };
 
 struct session_pool {
     struct listnode session_list;
-    pthread_mutex_t lock;
+    struct listnode id_hash[SESSION_POOL_HASH_SIZE];
+    struct session_slot slots[SESSION_POOL_MAX_SLOTS];
+    uint32_t num_slots;
+    /* slots released by closed sessions, under slot_lock with num_slots */
+    uint32_t free_slots[SESSION_POOL_MAX_SLOTS];
+    uint32_t num_free_slots;
+    pthread_mutex_t slot_lock;
+    pthread_rwlock_t lock;
 };
 
 struct session_pool *sess_pool;
 
 int session_obj_init();
 int session_obj_deinit();
-int session_obj_valid_check(uint64_t hndl);
+struct session_obj *session_obj_from_handle(uint64_t hndl);
 int session_obj_get(int session_id, struct session_obj **sess_obj);
 struct session_obj *session_obj_retrieve_from_pool(uint32_t session_id);
 int session_obj_open(uint32_t session_id,
                      enum agm_session_mode sess_mode,
-                     struct session_obj **sess_obj);
+                     uint64_t *hndl);
 int session_obj_set_config(struct session_obj *session,
                              struct agm_session_config *stream_config,
                              struct agm_media_config *media_config,
@@ -129,6 +313,10 @@ int session_obj_resume(struct session_obj *sess_obj);
 int session_obj_suspend(struct session_obj *sess_obj);
 int session_obj_read(struct session_obj *sess_obj, void *buff, size_t *count);
 int session_obj_write(struct session_obj *sess_obj, void *buff, size_t *count);
+int session_obj_readv(struct session_obj *sess_obj, const struct iovec *iov,
+                      int iovcnt, size_t *count);
+int session_obj_writev(struct session_obj *sess_obj, const struct iovec *iov,
+                       int iovcnt, size_t *count);
 int session_obj_sess_aif_connect(struct session_obj *sess_obj,
                              uint32_t audio_intf, bool state);
 int session_obj_set_sess_metadata(struct session_obj *sess_obj, uint32_t size,
@@ -193,5 +381,10 @@ int session_obj_set_non_tunnel_mode_config(struct session_obj *sess_obj,
                                    struct agm_media_config *out_media_config,
                                    struct agm_buffer_config *rx_buffer_config,
                                    struct agm_buffer_config *tx_buffer_config);
+int session_obj_batch(const void *ops, uint32_t num_ops,
+                      struct agm_batch_status *status);
+int session_obj_async_op(struct session_obj *sess_obj,
+                         enum agm_session_async_op op, uint64_t token);
+void session_obj_dump();
 
 #endif
@@ -112,6 +112,7 @@ extern "C" {
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 struct session_obj;
 
@@ -498,6 +499,23 @@ enum event_type
 {
     AGM_EVENT_DATA_PATH = 1,/**< Events on the Data path, READ_DONE or WRITE_DONE */
     AGM_EVENT_MODULE,       /**< Events raised by modules */
+    AGM_EVENT_SESSION_OP,   /**< Completions of agm_session_async_op() */
+};
+
+/**
+ * Session operations that can be queued with agm_session_async_op()
+ */
+enum agm_session_async_op {
+    AGM_SESSION_OP_PREPARE = 1, /**< agm_session_prepare */
+    AGM_SESSION_OP_START,       /**< agm_session_start */
+    AGM_SESSION_OP_STOP,        /**< agm_session_stop */
+    AGM_SESSION_OP_CLOSE,       /**< agm_session_close */
+};
+
+struct agm_event_session_op_done_payload {
+    uint32_t op;    /**< enum agm_session_async_op that completed */
+    int32_t status; /**< 0 on success, error code otherwise */
+    uint64_t token; /**< token passed to agm_session_async_op */
 };
 
 struct agm_event_read_write_done_payload {
@@ -507,6 +525,36 @@ struct agm_event_read_write_done_payload {
     struct agm_buff buff; /**< buffer that was passed to agm_read/agm_write */
 };
 
+/**
+ * module_instance_id of an agm_event_reg_cfg addressed to the session itself
+ * rather than to a module of its graph.
+ */
+#define AGM_MODULE_INSTANCE_ID_SESSION 0
+
+/** Most completions AGM_EVENT_READ_WRITE_DONE_BATCH carries */
+#define AGM_EVENT_COALESCE_MAX_COUNT 16
+
+/**
+ * Registering AGM_EVENT_READ_WRITE_DONE_BATCH on
+ * AGM_MODULE_INSTANCE_ID_SESSION with this payload makes the session hold
+ * back READ_DONE/WRITE_DONE events and deliver them in batches; is_register
+ * set to 0 turns coalescing off again.
+ */
+struct agm_event_coalesce_cfg {
+    uint32_t max_count;    /**< completions per batch, 2..AGM_EVENT_COALESCE_MAX_COUNT */
+    uint32_t max_delay_us; /**< longest a completion is held back */
+};
+
+struct agm_event_read_write_done_batch_payload {
+    uint32_t event_id; /**< AGM_EVENT_READ_DONE or AGM_EVENT_WRITE_DONE */
+    uint32_t num_done; /**< number of completions in this batch */
+    /**
+     * one entry per completion, or none when the individual events carry
+     * no payload
+     */
+    struct agm_event_read_write_done_payload done[];
+};
+
 /**
  * Event registration structure.
  */
@@ -552,6 +600,19 @@ enum agm_event_id {
     */
 
     AGM_EVENT_WRITE_DONE = 0x2,
+   /**
+    * Indicates an operation queued with agm_session_async_op() has
+    * completed, payload is struct agm_event_session_op_done_payload
+    */
+
+    AGM_EVENT_SESSION_OP_DONE = 0x3,
+   /**
+    * Carries several READ_DONE or WRITE_DONE completions at once when
+    * coalescing is enabled, payload is
+    * struct agm_event_read_write_done_batch_payload
+    */
+
+    AGM_EVENT_READ_WRITE_DONE_BATCH = 0x4,
    /**
     * Indicates early EOS event
     */
@@ -586,6 +647,70 @@ struct agm_dump_info {
     uint32_t uid;
 };
 
+/**
+ * Operations accepted by agm_session_batch(). Each maps to the
+ * single-shot API of the same name; the payload column describes what
+ * follows struct agm_batch_op in the batch buffer.
+ */
+enum agm_batch_op_id {
+    AGM_BATCH_OP_AIF_SET_MEDIA_CONFIG = 1, /**< aif_id, struct agm_media_config */
+    AGM_BATCH_OP_AIF_SET_METADATA,         /**< aif_id, metadata */
+    AGM_BATCH_OP_SESSION_SET_METADATA,     /**< session_id, metadata */
+    AGM_BATCH_OP_SESSION_AIF_SET_METADATA, /**< session_id, aif_id, metadata */
+    AGM_BATCH_OP_SESSION_SET_PARAMS,       /**< session_id, params */
+    AGM_BATCH_OP_SESSION_AIF_SET_PARAMS,   /**< session_id, aif_id, params */
+    AGM_BATCH_OP_SESSION_AIF_CONNECT,      /**< session_id, aif_id, arg = state */
+    AGM_BATCH_OP_SESSION_OPEN,             /**< session_id, arg = agm_session_mode */
+    AGM_BATCH_OP_SESSION_SET_CONFIG,       /**< session_id, struct agm_batch_session_config */
+    AGM_BATCH_OP_SESSION_PREPARE,          /**< session_id */
+    AGM_BATCH_OP_SESSION_START,            /**< session_id */
+    AGM_BATCH_OP_MAX,
+};
+
+/**
+ * One entry of a batch buffer. Entries are laid out back to back, each
+ * padded to AGM_BATCH_ALIGN bytes; use AGM_BATCH_OP_SIZE() to size an
+ * entry and AGM_BATCH_OP_NEXT() to step to the following one.
+ */
+struct agm_batch_op {
+    uint32_t op_id;        /**< enum agm_batch_op_id */
+    uint32_t session_id;   /**< target session, if any */
+    uint32_t aif_id;       /**< target audio interface, if any */
+    uint32_t arg;          /**< op specific scalar argument */
+    uint32_t payload_size; /**< size of payload in bytes */
+    uint32_t reserved;
+    uint8_t payload[];
+};
+
+#define AGM_BATCH_MAX_OPS 64
+#define AGM_BATCH_ALIGN 8
+#define AGM_BATCH_OP_SIZE(payload_size) \
+    ((sizeof(struct agm_batch_op) + (payload_size) + AGM_BATCH_ALIGN - 1) & \
+     ~((size_t)AGM_BATCH_ALIGN - 1))
+#define AGM_BATCH_OP_NEXT(op) \
+    ((struct agm_batch_op *)((uint8_t *)(op) + \
+                             AGM_BATCH_OP_SIZE((op)->payload_size)))
+
+/**
+ * Payload of AGM_BATCH_OP_SESSION_SET_CONFIG. Buffer sizes are carried as
+ * fixed width fields so the layout is the same for 32 and 64 bit clients.
+ */
+struct agm_batch_session_config {
+    struct agm_session_config session_config;
+    struct agm_media_config media_config;
+    uint32_t buffer_count;
+    uint32_t buffer_size;
+    uint32_t max_metadata_size;
+    uint32_t reserved;
+};
+
+/** Per operation result of agm_session_batch() */
+struct agm_batch_status {
+    int32_t ret;   /**< 0 on success, error code otherwise */
+    uint32_t reserved;
+    uint64_t hndl; /**< session handle, valid for a successful SESSION_OPEN */
+};
+
 /**
  * \brief Callback function signature for events to client
  *
@@ -854,6 +979,9 @@ int agm_session_register_cb(uint32_t session_id, agm_event_cb cb,
 /**
   * \brief Register for events from Modules. Not needed for data path events.
   *
+  * Also configures coalescing of the data path completions, see
+  * struct agm_event_coalesce_cfg.
+  *
   * \param[in] session_id - Valid audio session id
   * \param[out] evt_reg_info - event specific configuration.
   *
@@ -1019,6 +1147,45 @@ int agm_session_read(uint64_t handle, void *buff, size_t *count);
  */
 int agm_session_write(uint64_t hndl, void *buff, size_t *count);
 
+/**
+ * Maximum number of segments accepted by agm_session_writev/readv
+ */
+#define AGM_SESSION_IOV_MAX 64
+
+/**
+ * \brief Write data to session from a list of buffers
+ *
+ * The segments are written in order as one buffer, as if their contents
+ * were concatenated and passed to agm_session_write.
+ *
+ * \param[in] hndl: session handle returned from
+ *       agm_session_open
+ * \param[in] iov: segments to write
+ * \param[in] iovcnt: number of segments, at most AGM_SESSION_IOV_MAX
+ * \param[out] count: total number of bytes consumed
+ *
+ * \return 0 on success, error code otherwise
+ */
+int agm_session_writev(uint64_t hndl, const struct iovec *iov, int iovcnt,
+                       size_t *count);
+
+/**
+ * \brief Read data from session into a list of buffers
+ *
+ * One buffer is read, as with agm_session_read, and scattered over the
+ * segments in order.
+ *
+ * \param[in] hndl: session handle returned from
+ *       agm_session_open
+ * \param[in] iov: segments to fill
+ * \param[in] iovcnt: number of segments, at most AGM_SESSION_IOV_MAX
+ * \param[out] count: total number of bytes read
+ *
+ * \return 0 on success, error code otherwise
+ */
+int agm_session_readv(uint64_t hndl, const struct iovec *iov, int iovcnt,
+                      size_t *count);
+
 /**
   * \brief Get count of Buffer processed by h/w
   *
@@ -1241,6 +1408,47 @@ int agm_aif_group_set_media_config(uint32_t aif_group_id,
  */
 int agm_session_write_datapath_params(uint32_t session_id, struct agm_buff *buff);
 
+/**
+  * \brief Queue a prepare, start, stop or close of the session.
+  *
+  * The operation runs on a worker of the session, in submission order
+  * with the other operations queued on that session, and the call returns
+  * as soon as it is queued. Completion is reported through the callbacks
+  * registered for AGM_EVENT_SESSION_OP with an AGM_EVENT_SESSION_OP_DONE
+  * event carrying op, token and the result of the operation.
+  *
+  * \param[in] hndl - Valid session handle obtained from agm_session_open
+  * \param[in] op - operation to run
+  * \param[in] token - client value echoed back in the completion event
+  *
+  * \return 0 if the operation was queued, error code otherwise
+  */
+int agm_session_async_op(uint64_t hndl, enum agm_session_async_op op,
+                         uint64_t token);
+
+/**
+  * \brief Execute a list of session setup operations in one call.
+  *
+  * Operations run in order. Consecutive operations on the same session
+  * are executed under a single acquisition of the session lock, so no
+  * other client call on that session can interleave with them.
+  * Execution stops at the first failing operation; the operations after
+  * it are not attempted and report -ECANCELED. A malformed batch is
+  * rejected with -EINVAL before any operation runs.
+  *
+  * \param[in] ops - buffer of num_ops packed struct agm_batch_op entries
+  * \param[in] size - size of ops in bytes, i.e. the sum of
+  *       AGM_BATCH_OP_SIZE() over all entries
+  * \param[in] num_ops - number of entries in ops
+  * \param[out] status - array of num_ops entries updated with the result
+  *       of each operation
+  *
+  * \return 0 if all operations succeeded, otherwise the error code of
+  *       the first failing operation
+  */
+int agm_session_batch(const void *ops, size_t size, uint32_t num_ops,
+                      struct agm_batch_status *status);
+
 /**
   * \brief Dump AGM information based on client
   *
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef __AGM_SHM_RING_H_
+#define __AGM_SHM_RING_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <agm/agm_api.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Per session data ring shared between an IPC client library and the AGM
+ * service, so steady state agm_session_write/read need no IPC message.
+ * The transport hands over a memfd holding this header followed by size
+ * bytes of data, plus two eventfds: srv_efd rings the service, clt_efd
+ * rings the client. How the fds travel is up to the transport; the layout
+ * and the protocol below are common to all of them.
+ *
+ * head and tail count every byte ever produced and consumed, the producer
+ * being the client for AGM_SHM_RING_WRITE and the service for
+ * AGM_SHM_RING_READ. One call is in flight at a time and maps to exactly
+ * one agm_session_write/read on the service:
+ *  - a request always occupies req_bytes contiguous bytes; when they do
+ *    not fit before the end of the data area the producer skips to its
+ *    start, see agm_shm_ring_pad(),
+ *  - requests larger than the ring are not sent through it, the client
+ *    uses the transport's copying path for them instead,
+ *  - for a write the client copies the whole request in and publishes
+ *    head before req_bytes and req_seq; the service calls
+ *    agm_session_write once on it and releases it by moving tail,
+ *  - for a read the client publishes req_bytes and req_seq; the service
+ *    calls agm_session_read once straight into the ring and moves head
+ *    past the pad and the bytes read,
+ *  - done_ret and done_bytes are set before done_seq = req_seq.
+ * Fields are accessed with __atomic builtins only. The service treats the
+ * header as untrusted and stops serving a ring whose counters do not add up.
+ */
+/*
+ * Error returned, negated, by both sides once a ring's counters do not add
+ * up. agm calls never fail with it, so a client can tell a broken ring,
+ * to be given up on, from an error of the call it carried.
+ */
+#define AGM_SHM_RING_EBROKEN EBADMSG
+
+#ifndef AGM_SHM_RING_SIZE
+#define AGM_SHM_RING_SIZE (64 * 1024)
+#endif
+
+enum agm_shm_ring_dir {
+    AGM_SHM_RING_WRITE = 0,
+    AGM_SHM_RING_READ,
+};
+
+struct agm_shm_ring {
+    uint32_t size;        /*bytes of data, a power of two*/
+    uint32_t dir;         /*enum agm_shm_ring_dir*/
+    uint64_t head;
+    uint64_t tail;
+    uint64_t req_seq;
+    uint64_t req_bytes;
+    uint64_t done_seq;
+    int32_t done_ret;
+    uint32_t done_bytes;
+};
+
+#define AGM_SHM_RING_DATA(r) ((uint8_t *)((struct agm_shm_ring *)(r) + 1))
+
+/*
+ * Blocks until the other side kicks, returns 0 to go on or a negative error
+ * to give up on the call, e.g. when the peer died or the wait timed out.
+ */
+typedef int (*agm_shm_ring_wait_t)(void *priv);
+
+static inline void agm_shm_ring_kick(int efd)
+{
+    uint64_t val = 1;
+
+    /*a full eventfd counter already wakes the peer*/
+    (void)!write(efd, &val, sizeof(val));
+}
+
+/*Bytes skipped at pos so that a request of bytes stays contiguous*/
+static inline uint64_t agm_shm_ring_pad(uint64_t pos, uint32_t size,
+                                        uint64_t bytes)
+{
+    uint64_t room = size - (pos & (size - 1));
+
+    return room < bytes ? room : 0;
+}
+
+static inline int agm_shm_ring_wait_done(struct agm_shm_ring *ring,
+                                         uint64_t seq,
+                                         agm_shm_ring_wait_t wait, void *priv)
+{
+    int ret;
+
+    while (__atomic_load_n(&ring->done_seq, __ATOMIC_ACQUIRE) != seq) {
+        ret = wait(priv);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+ * Client side of a write. Returns -ENOSYS, without touching the ring, when
+ * the request does not fit it and has to take the transport's other path.
+ */
+static inline int agm_shm_ring_client_write(struct agm_shm_ring *ring,
+                                            uint32_t size, int srv_efd,
+                                            const void *buf, size_t *count,
+                                            agm_shm_ring_wait_t wait,
+                                            void *priv)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t seq = __atomic_load_n(&ring->req_seq, __ATOMIC_RELAXED) + 1;
+    int ret;
+
+    if (*count > size)
+        return -ENOSYS;
+    /*the previous call has been consumed as a whole*/
+    if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head)
+        return -AGM_SHM_RING_EBROKEN;
+
+    head += agm_shm_ring_pad(head, size, *count);
+    memcpy(AGM_SHM_RING_DATA(ring) + (head & (size - 1)), buf, *count);
+    __atomic_store_n(&ring->head, head + *count, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->req_bytes, (uint64_t)*count, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->req_seq, seq, __ATOMIC_RELEASE);
+    agm_shm_ring_kick(srv_efd);
+
+    ret = agm_shm_ring_wait_done(ring, seq, wait, priv);
+    if (ret)
+        return ret;
+    *count = __atomic_load_n(&ring->done_bytes, __ATOMIC_RELAXED);
+    return __atomic_load_n(&ring->done_ret, __ATOMIC_RELAXED);
+}
+
+/*Client side of a read, -ENOSYS as for agm_shm_ring_client_write()*/
+static inline int agm_shm_ring_client_read(struct agm_shm_ring *ring,
+                                           uint32_t size, int srv_efd,
+                                           void *buf, size_t *count,
+                                           agm_shm_ring_wait_t wait,
+                                           void *priv)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint64_t seq = __atomic_load_n(&ring->req_seq, __ATOMIC_RELAXED) + 1;
+    uint64_t head, pad;
+    uint32_t got;
+    int ret;
+
+    if (*count > size)
+        return -ENOSYS;
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != tail)
+        return -AGM_SHM_RING_EBROKEN;
+
+    __atomic_store_n(&ring->req_bytes, (uint64_t)*count, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->req_seq, seq, __ATOMIC_RELEASE);
+    agm_shm_ring_kick(srv_efd);
+
+    ret = agm_shm_ring_wait_done(ring, seq, wait, priv);
+    if (ret)
+        return ret;
+
+    got = __atomic_load_n(&ring->done_bytes, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    pad = agm_shm_ring_pad(tail, size, *count);
+    if (got > *count || head - tail != pad + got)
+        return -AGM_SHM_RING_EBROKEN;
+    memcpy(buf, AGM_SHM_RING_DATA(ring) + ((tail + pad) & (size - 1)), got);
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+    *count = got;
+    return __atomic_load_n(&ring->done_ret, __ATOMIC_RELAXED);
+}
+
+/*
+ * Service side: serves the calls of one ring until wait() fails, e.g.
+ * because the ring is being torn down, or the ring turns out corrupt, in
+ * which case -AGM_SHM_RING_EBROKEN is returned. size and dir are the values validated when
+ * the ring was attached, not the ones in the shared header.
+ */
+static inline int agm_shm_ring_serve(struct agm_shm_ring *ring, uint32_t size,
+                                     uint32_t dir, uint64_t handle,
+                                     int clt_efd, agm_shm_ring_wait_t wait,
+                                     void *priv)
+{
+    uint8_t *data = AGM_SHM_RING_DATA(ring);
+    uint64_t done_seq = __atomic_load_n(&ring->done_seq, __ATOMIC_RELAXED);
+    uint64_t seq, bytes, head, tail, pad;
+    bool corrupt;
+    size_t cnt;
+    int ret;
+
+    while (!wait(priv)) {
+        seq = __atomic_load_n(&ring->req_seq, __ATOMIC_ACQUIRE);
+        if (seq == done_seq)
+            continue;
+
+        bytes = __atomic_load_n(&ring->req_bytes, __ATOMIC_RELAXED);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        pad = agm_shm_ring_pad(dir == AGM_SHM_RING_WRITE ? tail : head,
+                               size, bytes);
+        cnt = bytes;
+
+        /*a write is all in before req_seq moves, a read starts empty*/
+        if (dir == AGM_SHM_RING_WRITE)
+            corrupt = bytes > size || head - tail != pad + bytes;
+        else
+            corrupt = bytes > size || head != tail;
+
+        if (corrupt) {
+            ret = -AGM_SHM_RING_EBROKEN;
+        } else if (dir == AGM_SHM_RING_WRITE) {
+            ret = agm_session_write(handle,
+                                data + ((tail + pad) & (size - 1)), &cnt);
+            __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+        } else {
+            ret = agm_session_read(handle,
+                                data + ((head + pad) & (size - 1)), &cnt);
+            if (ret || cnt > bytes)
+                cnt = 0;
+            __atomic_store_n(&ring->head, head + pad + cnt, __ATOMIC_RELEASE);
+        }
+        if (ret || cnt > bytes)
+            cnt = 0;
+
+        __atomic_store_n(&ring->done_ret, ret, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring->done_bytes, (uint32_t)cnt, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring->done_seq, seq, __ATOMIC_RELEASE);
+        done_seq = seq;
+        agm_shm_ring_kick(clt_efd);
+        if (corrupt)
+            return -AGM_SHM_RING_EBROKEN;
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* __AGM_SHM_RING_H_ */
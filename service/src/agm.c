@@ -674,12 +674,11 @@ int agm_session_open(uint32_t session_id,
                      uint64_t *hndl)
 {
 
-    struct session_obj **handle = (struct session_obj**) hndl;
-    if (!handle) {
+    if (!hndl) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-    return session_obj_open(session_id, sess_mode, handle);
+    return session_obj_open(session_id, sess_mode, hndl);
 }
 
 int agm_session_set_config(uint64_t hndl,
@@ -687,17 +686,12 @@ int agm_session_set_config(uint64_t hndl,
                            struct agm_media_config *media_config,
                            struct agm_buffer_config *buffer_config)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
 
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
-
     return session_obj_set_config(handle, stream_config, media_config,
                                                        buffer_config);
 }
@@ -705,93 +699,63 @@ int agm_session_set_config(uint64_t hndl,
 int agm_session_prepare(uint64_t hndl)
 {
 
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_prepare(handle);
 }
 
 int agm_session_start(uint64_t hndl)
 {
 
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_start(handle);
 }
 
 int agm_session_stop(uint64_t hndl)
 {
 
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_stop(handle);
 }
 
 int agm_session_close(uint64_t hndl)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_close(handle);
 }
 
 int agm_session_pause(uint64_t hndl)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_pause(handle);
 }
 
 int agm_session_flush(uint64_t hndl)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_flush(handle);
 }
 
@@ -811,73 +775,70 @@ int agm_sessionid_flush(uint32_t session_id)
 
 int agm_session_resume(uint64_t hndl)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_resume(handle);
 }
 
 int agm_session_suspend(uint64_t hndl)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_suspend(handle);
 }
 
 int agm_session_write(uint64_t hndl, void *buff, size_t *count)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-
-    if (!session_obj_valid_check(hndl)) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
     return session_obj_write(handle, buff, count);
 }
 
 int agm_session_read(uint64_t hndl, void *buff, size_t *count)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
+    return session_obj_read(handle, buff, count);
+}
 
-    if (!session_obj_valid_check(hndl)) {
+int agm_session_writev(uint64_t hndl, const struct iovec *iov, int iovcnt,
+                       size_t *count)
+{
+    struct session_obj *handle = session_obj_from_handle(hndl);
+    if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-    return session_obj_read(handle, buff, count);
+    return session_obj_writev(handle, iov, iovcnt, count);
 }
 
-size_t agm_get_hw_processed_buff_cnt(uint64_t hndl, enum direction dir)
+int agm_session_readv(uint64_t hndl, const struct iovec *iov, int iovcnt,
+                      size_t *count)
 {
-    struct session_obj *handle = (struct session_obj *) hndl;
+    struct session_obj *handle = session_obj_from_handle(hndl);
     if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
+    return session_obj_readv(handle, iov, iovcnt, count);
+}
 
-    if (!session_obj_valid_check(hndl)) {
+size_t agm_get_hw_processed_buff_cnt(uint64_t hndl, enum direction dir)
+{
+    struct session_obj *handle = session_obj_from_handle(hndl);
+    if (!handle) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
@@ -935,30 +896,24 @@ done:
 
 int agm_session_eos(uint64_t handle)
 {
-    if (!handle) {
-        AGM_LOGE("Invalid handle\n");
-        return -EINVAL;
-    }
+    struct session_obj *obj = session_obj_from_handle(handle);
 
-    if (!session_obj_valid_check(handle)) {
+    if (!obj) {
         AGM_LOGE("Invalid handle\n");
         return -EINVAL;
     }
-    return session_obj_eos((struct session_obj *) handle);
+    return session_obj_eos(obj);
 }
 
 int agm_get_session_time(uint64_t handle, uint64_t *timestamp)
 {
-    if (!handle || !timestamp) {
-        AGM_LOGE("Invalid handle or timestamp pointer\n");
-        return -EINVAL;
-    }
+    struct session_obj *obj = session_obj_from_handle(handle);
 
-    if (!session_obj_valid_check(handle)) {
-        AGM_LOGE("Invalid handle\n");
+    if (!obj || !timestamp) {
+        AGM_LOGE("Invalid handle or timestamp pointer\n");
         return -EINVAL;
     }
-    return session_obj_get_timestamp((struct session_obj *) handle, timestamp);
+    return session_obj_get_timestamp(obj, timestamp);
 }
 
 int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp)
@@ -1014,48 +969,39 @@ int agm_set_gapless_session_metadata(uint64_t handle,
                          enum agm_gapless_silence_type type,
                          uint32_t silence)
 {
-    if (!handle) {
-        AGM_LOGE("%s Invalid handle\n", __func__);
-        return -EINVAL;
-    }
+    struct session_obj *obj = session_obj_from_handle(handle);
 
-    if (!session_obj_valid_check(handle)) {
-        AGM_LOGE("Invalid handle\n");
+    if (!obj) {
+        AGM_LOGE("%s Invalid handle\n", __func__);
         return -EINVAL;
     }
-    return session_obj_set_gapless_metadata((struct session_obj *) handle, type,
+    return session_obj_set_gapless_metadata(obj, type,
                                              silence);
 }
 
 int agm_session_write_with_metadata(uint64_t handle, struct agm_buff *buff,
                                     size_t *consumed_size)
 {
-    if (!handle) {
-        AGM_LOGE("%s Invalid handle\n", __func__);
-        return -EINVAL;
-    }
+    struct session_obj *obj = session_obj_from_handle(handle);
 
-    if (!session_obj_valid_check(handle)) {
-        AGM_LOGE("Invalid handle\n");
+    if (!obj) {
+        AGM_LOGE("%s Invalid handle\n", __func__);
         return -EINVAL;
     }
-    return session_obj_write_with_metadata((struct session_obj *) handle, buff,
+    return session_obj_write_with_metadata(obj, buff,
                                             consumed_size);
 }
 
 int agm_session_read_with_metadata(uint64_t handle, struct agm_buff *buff,
                                     uint32_t *captured_size )
 {
-    if (!handle) {
-        AGM_LOGE("%s Invalid handle\n", __func__);
-        return -EINVAL;
-    }
+    struct session_obj *obj = session_obj_from_handle(handle);
 
-    if (!session_obj_valid_check(handle)) {
-        AGM_LOGE("Invalid handle\n");
+    if (!obj) {
+        AGM_LOGE("%s Invalid handle\n", __func__);
         return -EINVAL;
     }
-    return session_obj_read_with_metadata((struct session_obj *) handle, buff,
+    return session_obj_read_with_metadata(obj, buff,
                                            captured_size);
 }
 
@@ -1066,16 +1012,13 @@ int agm_session_set_non_tunnel_mode_config(uint64_t handle,
                                        struct agm_buffer_config *in_buffer_config,
                                        struct agm_buffer_config *out_buffer_config)
 {
-    if (!handle) {
-        AGM_LOGE("%s Invalid handle\n", __func__);
-        return -EINVAL;
-    }
+    struct session_obj *obj = session_obj_from_handle(handle);
 
-    if (!session_obj_valid_check(handle)) {
-        AGM_LOGE("Invalid handle\n");
+    if (!obj) {
+        AGM_LOGE("%s Invalid handle\n", __func__);
         return -EINVAL;
     }
-    return session_obj_set_non_tunnel_mode_config((struct session_obj *) handle,
+    return session_obj_set_non_tunnel_mode_config(obj,
                                             session_config,
                                             in_media_config,
                                             out_media_config,
@@ -1099,8 +1042,59 @@ int agm_session_write_datapath_params(uint32_t session_id, struct agm_buff *buff
     return session_obj_write_with_metadata(obj, buff, &consumed_size);
 }
 
+int agm_session_async_op(uint64_t hndl, enum agm_session_async_op op,
+                         uint64_t token)
+{
+    struct session_obj *handle = session_obj_from_handle(hndl);
+    if (!handle) {
+        AGM_LOGE("Invalid handle\n");
+        return -EINVAL;
+    }
+    return session_obj_async_op(handle, op, token);
+}
+
+int agm_session_batch(const void *ops, size_t size, uint32_t num_ops,
+                      struct agm_batch_status *status)
+{
+    const struct agm_batch_op *op = NULL;
+    size_t offset = 0;
+    uint32_t i;
+
+    if (!ops || !status || num_ops == 0 || num_ops > AGM_BATCH_MAX_OPS) {
+        AGM_LOGE("Invalid batch, num_ops %u\n", num_ops);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < num_ops; i++) {
+        status[i].ret = -ECANCELED;
+        status[i].hndl = 0;
+    }
+
+    /* Make sure every op lies within the buffer before running any of them */
+    for (i = 0; i < num_ops; i++) {
+        if (size - offset < sizeof(struct agm_batch_op)) {
+            AGM_LOGE("Batch op %u header exceeds batch size %zu\n", i, size);
+            return -EINVAL;
+        }
+        op = (const struct agm_batch_op *)((const uint8_t *)ops + offset);
+        if (op->op_id == 0 || op->op_id >= AGM_BATCH_OP_MAX) {
+            AGM_LOGE("Invalid batch op id %u at index %u\n", op->op_id, i);
+            return -EINVAL;
+        }
+        if (op->payload_size > size ||
+            AGM_BATCH_OP_SIZE(op->payload_size) > size - offset) {
+            AGM_LOGE("Batch op %u payload exceeds batch size %zu\n", i, size);
+            return -EINVAL;
+        }
+        offset += AGM_BATCH_OP_SIZE(op->payload_size);
+    }
+
+    return session_obj_batch(ops, num_ops, status);
+}
+
 int agm_dump(struct agm_dump_info *dump_info __unused)
 {
-    // Placeholder for future enhancements
+    graph_pool_dump();
+    session_obj_dump();
     return 0;
 }
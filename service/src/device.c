@@ -903,6 +903,21 @@ int device_get_start_refcnt(struct device_obj *dev_obj)
 
 }
 
+pthread_mutex_t *device_get_hwep_lock(struct device_obj *dev_obj)
+{
+    struct device_obj *obj = device_get_pcm_obj(dev_obj);
+
+    if (obj->group_data)
+        return &obj->group_data->hwep_lock;
+    else
+        return &obj->hwep_lock;
+}
+
+struct device_cfg_cache *device_get_cfg_cache(struct device_obj *dev_obj)
+{
+    return &device_get_pcm_obj(dev_obj)->cfg_cache;
+}
+
 int device_get_state(struct device_obj *dev_obj)
 {
     if (dev_obj == NULL) {
@@ -945,6 +960,7 @@ static struct device_group_data* device_get_group_data_by_name(char *dev_name)
     }
 
     strlcpy(grp_data->name, group_name, pos);
+    pthread_mutex_init(&grp_data->hwep_lock, (const pthread_mutexattr_t *) NULL);
     list_add_tail(&device_group_data_list, &grp_data->list_node);
     num_group_devices++;
 
@@ -1003,6 +1019,8 @@ int parse_snd_card()
         }
 
         pthread_mutex_init(&dev_obj->lock, (const pthread_mutexattr_t *) NULL);
+        pthread_mutex_init(&dev_obj->hwep_lock, (const pthread_mutexattr_t *) NULL);
+        pthread_mutex_init(&dev_obj->cfg_cache.lock, (const pthread_mutexattr_t *) NULL);
         list_add_tail(&device_list, &dev_obj->list_node);
         count++;
         if (dev_obj->num_virtual_child) {
@@ -1123,6 +1141,10 @@ void device_deinit()
         if (dev_obj->params)
             free(dev_obj->params);
 
+        /*cached configs went with the graphs, all closed by now*/
+        if (!dev_obj->parent_dev)
+            pthread_mutex_destroy(&dev_obj->cfg_cache.lock);
+
         free(dev_obj);
         dev_obj = NULL;
     }
@@ -1130,6 +1152,7 @@ void device_deinit()
     list_for_each_safe(grp_node, temp, &device_group_data_list) {
             grp_data = node_to_item(grp_node, struct device_group_data, list_node);
             list_remove(grp_node);
+            pthread_mutex_destroy(&grp_data->hwep_lock);
             free(grp_data);
             grp_data = NULL;
     }
@@ -69,6 +69,7 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #include <unistd.h>
+#include <time.h>
 #include "gsl_intf.h"
 #include <agm/graph.h>
 #include <agm/graph_module.h>
@@ -114,13 +115,11 @@ enum {
                    add_mod;\
                  })
 
-typedef struct module_info_link_list {
-   module_info_t *data;
-   struct listnode tagged_list;
-}module_info_link_list_t;
-
 static char acdb_path[ACDB_PATH_MAX_LENGTH];
 static void print_graph_alias(const struct agm_meta_data_gsl *meta_data_kv);
+static void tag_module_cache_invalidate();
+static void graph_pool_flush();
+static int graph_destroy(struct graph_obj *graph_obj);
 
 static int get_acdb_files_from_directory(const char* acdb_files_path,
                                          struct gsl_acdb_data_files *data_files)
@@ -371,6 +370,7 @@ int graph_init()
     init_data.acdb_addr = 0x0;
     init_data.max_num_ready_checks = 1;
     init_data.ready_check_interval_ms = 1000;
+    tag_module_cache_invalidate();
     ret = gsl_init(&init_data);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
@@ -384,16 +384,59 @@ err:
 int graph_deinit()
 {
 
+    graph_pool_flush();
+    tag_module_cache_invalidate();
     gsl_deinit();
     return 0;
 }
 
+static atomic_ullong graph_event_count;
+static atomic_ullong graph_event_overflows;
+
+static struct agm_event_cb_params *graph_event_get(struct graph_obj *graph_obj,
+                                                   uint32_t payload_size,
+                                                   int *slot_idx)
+{
+    struct graph_event_slab *slab = &graph_obj->event_slab;
+    unsigned int busy, idx;
+
+    *slot_idx = -1;
+    if (payload_size <= GRAPH_EVENT_MAX_PAYLOAD) {
+        busy = atomic_load_explicit(&slab->busy, memory_order_relaxed);
+        while (busy != (1u << GRAPH_EVENT_SLOTS) - 1) {
+            idx = __builtin_ctz(~busy);
+            if (atomic_compare_exchange_weak_explicit(&slab->busy, &busy,
+                                        busy | (1u << idx),
+                                        memory_order_acquire,
+                                        memory_order_relaxed)) {
+                *slot_idx = idx;
+                return (struct agm_event_cb_params *)slab->slot[idx];
+            }
+        }
+    }
+
+    atomic_fetch_add_explicit(&graph_event_overflows, 1, memory_order_relaxed);
+    return calloc(1, sizeof(struct agm_event_cb_params) + payload_size);
+}
+
+static void graph_event_put(struct graph_obj *graph_obj,
+                            struct agm_event_cb_params *ev, int slot_idx)
+{
+    if (slot_idx < 0) {
+        free(ev);
+        return;
+    }
+    atomic_fetch_and_explicit(&graph_obj->event_slab.busy, ~(1u << slot_idx),
+                              memory_order_release);
+}
+
 void gsl_callback_func(struct gsl_event_cb_params *event_params,
                        void *client_data)
 {
      struct graph_obj *graph_obj = (struct graph_obj *) client_data;
      struct agm_event_cb_params *ev;
      struct gsl_event_read_write_done_payload *rw_done_payload;
+     int slot_idx;
 
      if (graph_obj == NULL) {
          AGM_LOGE("Invalid graph object");
@@ -404,11 +447,13 @@ void gsl_callback_func(struct gsl_event_cb_params *event_params,
          goto done;
      }
 
-     ev = calloc(1, sizeof(struct agm_event_cb_params) + event_params->event_payload_size);
+     ev = graph_event_get(graph_obj, event_params->event_payload_size,
+                          &slot_idx);
      if (!ev) {
         AGM_LOGE("Not enough memory for payload\n");
         goto done;
      }
+     atomic_fetch_add_explicit(&graph_event_count, 1, memory_order_relaxed);
 
      ev->source_module_id = event_params->source_module_id;
      ev->event_id = event_params->event_id;
@@ -428,7 +473,7 @@ void gsl_callback_func(struct gsl_event_cb_params *event_params,
      if (graph_obj->cb)
          graph_obj->cb(ev,
                        graph_obj->client_data);
-     free(ev);
+     graph_event_put(graph_obj, ev, slot_idx);
 done:
      return;
 }
@@ -498,53 +543,758 @@ done:
     return ret;
 }
 
-static int add_to_list(uint32_t module_list_count, module_info_t *info, struct listnode *node)
+/*
+ * Tag to module mapping of a GKV as reported by ACDB. It depends only on the
+ * loaded ACDB data, so it is cached per GKV (most recently used first) and
+ * dropped once a write to ACDB has completed. acdb_gen is bumped with it, a
+ * mapping queried before the bump is handed out but not cached.
+ */
+#define TAG_MODULE_CACHE_MAX_ENTRIES 32
+
+struct tag_module_map {
+    uint32_t tag;
+    uint32_t num_modules;
+    uint32_t module_id;    /* first module carrying the tag */
+    uint32_t module_iid;
+};
+
+struct tag_module_cache_entry {
+    struct listnode node;
+    uint32_t hash;
+    uint32_t refcnt;
+    size_t num_gkvs;
+    struct agm_key_value *gkv;
+    uint32_t num_tags;
+    struct tag_module_map *map;
+};
+
+static list_declare(tag_module_cache);
+static uint32_t tag_module_cache_count;
+static pthread_mutex_t tag_module_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint acdb_gen;
+
+#define KV_HASH_INIT 2166136261u
+
+static uint32_t kv_hash(uint32_t hash, const struct agm_key_value *kv,
+                        size_t num_kvs)
 {
-    uint32_t count = 0;
-    int ret = 0;
-    module_info_link_list_t *mod_list = NULL;
+    size_t i;
 
-    for (count = 0; count < module_list_count; count++) {
-        mod_list = calloc(1, sizeof(module_info_link_list_t));
-        if (!mod_list) {
-            AGM_LOGE("Not enough memory for payload\n");
-            ret = -ENOMEM;
-            goto done;
+    for (i = 0; i < num_kvs; i++) {
+        hash = (hash ^ kv[i].key) * 16777619u;
+        hash = (hash ^ kv[i].value) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t gkv_hash(struct agm_key_vector_gsl *gkv)
+{
+    return kv_hash(KV_HASH_INIT, gkv->kv, gkv->num_kvs);
+}
+
+static int tag_module_cache_entry_create(struct agm_key_vector_gsl *gkv,
+                       uint32_t hash, struct tag_module_cache_entry **new_entry)
+{
+    struct tag_module_cache_entry *entry = NULL;
+    struct gsl_tag_module_info *tag_module_info = NULL;
+    struct gsl_tag_module_info_entry *gsl_tag_entry;
+    size_t tag_module_info_size;
+    uint32_t i;
+    int ret;
+
+    ret = get_tags_with_module_info(gkv, (void **) &tag_module_info,
+                                    &tag_module_info_size);
+    if (ret != 0)
+        return ret;
+
+    entry = calloc(1, sizeof(*entry) +
+                      gkv->num_kvs * sizeof(struct agm_key_value) +
+                      tag_module_info->num_tags * sizeof(struct tag_module_map));
+    if (!entry) {
+        AGM_LOGE("No memory for tag module cache entry\n");
+        ret = -ENOMEM;
+        goto done;
+    }
+
+    entry->hash = hash;
+    entry->refcnt = 1;
+    entry->num_gkvs = gkv->num_kvs;
+    entry->gkv = (struct agm_key_value *)(entry + 1);
+    memcpy(entry->gkv, gkv->kv, gkv->num_kvs * sizeof(struct agm_key_value));
+    entry->num_tags = tag_module_info->num_tags;
+    entry->map = (struct tag_module_map *)(entry->gkv + gkv->num_kvs);
+
+    gsl_tag_entry = (struct gsl_tag_module_info_entry *)
+                                 (tag_module_info->tag_module_entry);
+    for (i = 0; i < tag_module_info->num_tags; i++) {
+        entry->map[i].tag = gsl_tag_entry->tag_id;
+        entry->map[i].num_modules = gsl_tag_entry->num_modules;
+        if (gsl_tag_entry->num_modules > 0) {
+            entry->map[i].module_id = gsl_tag_entry->module_entry[0].module_id;
+            entry->map[i].module_iid = gsl_tag_entry->module_entry[0].module_iid;
         }
-        mod_list->data = info + count;
-        list_add_tail(node, &mod_list->tagged_list);
+        gsl_tag_entry = (struct gsl_tag_module_info_entry *)
+                              ((char *)gsl_tag_entry +
+                               sizeof(struct gsl_tag_module_info_entry) +
+                               (sizeof(struct gsl_module_id_info_entry) *
+                               gsl_tag_entry->num_modules));
     }
+
+    *new_entry = entry;
+
 done:
+    free(tag_module_info);
     return ret;
 }
 
+static void tag_module_cache_put(struct tag_module_cache_entry *entry)
+{
+    bool release;
+
+    pthread_mutex_lock(&tag_module_cache_lock);
+    release = (--entry->refcnt == 0);
+    pthread_mutex_unlock(&tag_module_cache_lock);
+
+    if (release)
+        free(entry);
+}
+
+/* must be called with tag_module_cache_lock held */
+static void tag_module_cache_unlink_l(struct tag_module_cache_entry *entry)
+{
+    list_remove(&entry->node);
+    tag_module_cache_count--;
+    if (--entry->refcnt == 0)
+        free(entry);
+}
+
+/*
+ * Gets the tag to module mapping of gkv, querying ACDB only if it is not
+ * cached yet. The entry must be released with tag_module_cache_put().
+ */
+static int tag_module_cache_get(struct agm_key_vector_gsl *gkv,
+                                struct tag_module_cache_entry **cache_entry)
+{
+    struct tag_module_cache_entry *entry, *new_entry = NULL;
+    struct listnode *node;
+    uint32_t hash = gkv_hash(gkv);
+    uint32_t gen = atomic_load(&acdb_gen);
+    int ret;
+
+    pthread_mutex_lock(&tag_module_cache_lock);
+    list_for_each(node, &tag_module_cache) {
+        entry = node_to_item(node, struct tag_module_cache_entry, node);
+        if (entry->hash == hash && entry->num_gkvs == gkv->num_kvs &&
+            !memcmp(entry->gkv, gkv->kv,
+                    gkv->num_kvs * sizeof(struct agm_key_value))) {
+            list_remove(&entry->node);
+            list_add_head(&tag_module_cache, &entry->node);
+            entry->refcnt++;
+            pthread_mutex_unlock(&tag_module_cache_lock);
+            *cache_entry = entry;
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&tag_module_cache_lock);
+
+    ret = tag_module_cache_entry_create(gkv, hash, &new_entry);
+    if (ret)
+        return ret;
+
+    pthread_mutex_lock(&tag_module_cache_lock);
+    /*ACDB was written meanwhile, the mapping may predate it*/
+    if (atomic_load(&acdb_gen) != gen) {
+        pthread_mutex_unlock(&tag_module_cache_lock);
+        *cache_entry = new_entry;
+        return 0;
+    }
+    if (tag_module_cache_count >= TAG_MODULE_CACHE_MAX_ENTRIES) {
+        entry = node_to_item(list_tail(&tag_module_cache),
+                             struct tag_module_cache_entry, node);
+        tag_module_cache_unlink_l(entry);
+    }
+    new_entry->refcnt++;
+    list_add_head(&tag_module_cache, &new_entry->node);
+    tag_module_cache_count++;
+    pthread_mutex_unlock(&tag_module_cache_lock);
+
+    *cache_entry = new_entry;
+    return 0;
+}
+
+static struct tag_module_map *tag_module_cache_find(
+                       struct tag_module_cache_entry *entry, uint32_t tag)
+{
+    uint32_t i;
+
+    for (i = 0; i < entry->num_tags; i++) {
+        if (entry->map[i].tag == tag)
+            return &entry->map[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Looks up the first module carrying tag in the graph described by gkv,
+ * falling back to querying GSL if the tag is not in the cached mapping.
+ */
+static int graph_get_tagged_module(struct agm_key_vector_gsl *gkv,
+                                   uint32_t tag, uint32_t *mid, uint32_t *miid)
+{
+    struct tag_module_cache_entry *entry = NULL;
+    struct tag_module_map *map = NULL;
+    struct gsl_module_id_info *module_info;
+    size_t module_info_size;
+    int ret = 0;
+
+    if (!tag_module_cache_get(gkv, &entry)) {
+        map = tag_module_cache_find(entry, tag);
+        if (map && map->num_modules > 0) {
+            *mid = map->module_id;
+            *miid = map->module_iid;
+        }
+        tag_module_cache_put(entry);
+        if (map && map->num_modules > 0)
+            return 0;
+    }
+
+    ret = gsl_get_tagged_module_info((struct gsl_key_vector *)gkv, tag,
+                                     &module_info, (uint32_t *) &module_info_size);
+    if (ret != 0)
+        return ar_err_get_lnx_err_code(ret);
+
+    *mid = module_info->module_entry[0].module_id;
+    *miid = module_info->module_entry[0].module_iid;
+
+    return 0;
+}
+
+static void tag_module_cache_invalidate()
+{
+    struct tag_module_cache_entry *entry;
+    struct listnode *node, *next;
+
+    pthread_mutex_lock(&tag_module_cache_lock);
+    atomic_fetch_add(&acdb_gen, 1);
+    list_for_each_safe(node, next, &tag_module_cache) {
+        entry = node_to_item(node, struct tag_module_cache_entry, node);
+        tag_module_cache_unlink_l(entry);
+    }
+    pthread_mutex_unlock(&tag_module_cache_lock);
+}
+
+/*
+ * Warm graph pool. Graphs of closed sessions are parked here with their
+ * GSL handle still open instead of being torn down, and a later graph_open
+ * with the same GKV, CKV, session mode and device adopts one of them,
+ * skipping the ACDB lookups and gsl_open. Parked graphs are kept most
+ * recently used first and the oldest ones are closed once either the entry
+ * count or the memory budget is exceeded.
+ *
+ * Only graphs still matching the metadata they were opened with are parked,
+ * so graph_add/change/remove, graph_set_cal, subgraph close and custom event
+ * registration make a graph ineligible. Neither are graphs opened before the
+ * last ACDB write, the pool is flushed after each write. Parameters applied
+ * with graph_set_config stay in the parked graph and are expected to be
+ * reapplied by the next user, as sessions already do on every connect.
+ *
+ * Graphs opened with a device are parked stopped or prepared, never started,
+ * and are reconfigured on the hw endpoint when adopted. A graph_open on the
+ * same hw endpoint that does not adopt a parked graph first closes the
+ * prepared graphs parked on it, so a parked graph never holds an endpoint
+ * prepared for another usecase.
+ *
+ * With GRAPH_POOL_PREPARE, stopped graphs are prepared again as they are
+ * parked. A prepared graph adopted by a session configured the same way
+ * skips module configuration and GSL_CMD_PREPARE altogether, otherwise it is
+ * stopped and prepared as usual. graph_pool_warmup() fills the pool at boot
+ * from GRAPH_POOL_WARMUP_FILE.
+ */
+#ifndef GRAPH_POOL_MAX_ENTRIES
+#define GRAPH_POOL_MAX_ENTRIES 4
+#endif
+
+#ifndef GRAPH_POOL_MEM_BUDGET
+#define GRAPH_POOL_MEM_BUDGET (64 * 1024)
+#endif
+
+#ifndef GRAPH_POOL_PREPARE
+#define GRAPH_POOL_PREPARE 0
+#endif
+
+#define GRAPH_POOL_WARMUP_MAX_KVS 16
+
+struct graph_pool_key {
+    uint32_t hash;
+    enum agm_session_mode sess_mode;
+    struct device_obj *dev_obj;
+    uint32_t num_gkvs;
+    uint32_t num_ckvs;
+    struct agm_key_value kv[];    /* gkv followed by ckv */
+};
+
+struct graph_pool_stats {
+    uint64_t hits;
+    uint64_t prepared_hits;
+    uint64_t misses;
+    uint64_t parked;
+    uint64_t evicted;
+    uint64_t warmed;
+    uint64_t saved_ns;    /* open and prepare time of the adopted graphs */
+};
+
+static list_declare(graph_pool);
+static uint32_t graph_pool_count;
+static size_t graph_pool_bytes;
+static struct graph_pool_stats graph_pool_stats;
+static pthread_mutex_t graph_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t graph_pool_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct graph_pool_key *graph_pool_key_create(
+                       struct agm_meta_data_gsl *meta_data_kv,
+                       struct session_obj *sess_obj, struct device_obj *dev_obj)
+{
+    struct graph_pool_key *key;
+    uint32_t num_kvs = meta_data_kv->gkv.num_kvs + meta_data_kv->ckv.num_kvs;
+
+    if (GRAPH_POOL_MAX_ENTRIES == 0)
+        return NULL;
+
+    key = calloc(1, sizeof(*key) + num_kvs * sizeof(struct agm_key_value));
+    if (!key)
+        return NULL;
+
+    key->sess_mode = sess_obj->stream_config.sess_mode;
+    key->dev_obj = dev_obj;
+    key->num_gkvs = meta_data_kv->gkv.num_kvs;
+    key->num_ckvs = meta_data_kv->ckv.num_kvs;
+    memcpy(key->kv, meta_data_kv->gkv.kv,
+           key->num_gkvs * sizeof(struct agm_key_value));
+    memcpy(key->kv + key->num_gkvs, meta_data_kv->ckv.kv,
+           key->num_ckvs * sizeof(struct agm_key_value));
+
+    key->hash = kv_hash(KV_HASH_INIT, key->kv, num_kvs);
+    key->hash = (key->hash ^ key->num_gkvs) * 16777619u;
+    key->hash = (key->hash ^ key->sess_mode) * 16777619u;
+    key->hash = (key->hash ^ (uint32_t)(uintptr_t)dev_obj) * 16777619u;
+
+    return key;
+}
+
+static bool graph_pool_key_equal(const struct graph_pool_key *a,
+                                 const struct graph_pool_key *b)
+{
+    return a->hash == b->hash &&
+           a->sess_mode == b->sess_mode &&
+           a->dev_obj == b->dev_obj &&
+           a->num_gkvs == b->num_gkvs &&
+           a->num_ckvs == b->num_ckvs &&
+           !memcmp(a->kv, b->kv, (a->num_gkvs + a->num_ckvs) *
+                                 sizeof(struct agm_key_value));
+}
+
+/* host memory held by a parked graph, charged against the pool budget */
+static size_t graph_pool_entry_size(struct graph_obj *graph_obj)
+{
+    struct listnode *node;
+    module_info_t *mod;
+    size_t size = sizeof(*graph_obj) + sizeof(*graph_obj->pool_key) +
+                  (graph_obj->pool_key->num_gkvs +
+                   graph_obj->pool_key->num_ckvs) * sizeof(struct agm_key_value);
+
+    list_for_each(node, &graph_obj->tagged_mod_list) {
+        mod = node_to_item(node, module_info_t, list);
+        size += sizeof(*mod);
+        if (mod->gkv)
+            size += sizeof(*mod->gkv) +
+                    mod->gkv->num_kvs * sizeof(struct agm_key_value);
+    }
+
+    return size;
+}
+
+/* session and device config the graph is prepared with, see graph_prepare() */
+static void graph_pool_config_get(struct graph_obj *graph_obj,
+                                  struct session_obj *sess_obj,
+                                  struct graph_pool_config *config)
+{
+    struct device_obj *dev_obj = graph_obj->pool_key->dev_obj;
+
+    memset(config, 0, sizeof(*config));
+    config->stream_config = sess_obj->stream_config;
+    config->in_media_config = sess_obj->in_media_config;
+    config->out_media_config = sess_obj->out_media_config;
+    config->in_buffer_config = sess_obj->in_buffer_config;
+    config->out_buffer_config = sess_obj->out_buffer_config;
+    if (dev_obj)
+        config->dev_media_config = dev_obj->group_data ?
+                    dev_obj->group_data->media_config.config :
+                    dev_obj->media_config;
+}
+
+/*
+ * Takes a parked graph matching key out of the pool and hands it to
+ * sess_obj. The graph keeps its GSL state (opened, prepared or stopped).
+ * Unless graph_prepare finds it prepared with the session's config, all
+ * modules, including the hw endpoint, and buffers are configured again.
+ */
+static struct graph_obj *graph_pool_adopt(struct graph_pool_key *key,
+                                          struct session_obj *sess_obj)
+{
+    struct graph_obj *graph_obj = NULL, *temp;
+    struct listnode *node;
+    module_info_t *mod;
+
+    if (!key)
+        return NULL;
+
+    pthread_mutex_lock(&graph_pool_lock);
+    list_for_each(node, &graph_pool) {
+        temp = node_to_item(node, struct graph_obj, pool_node);
+        if (graph_pool_key_equal(temp->pool_key, key)) {
+            graph_obj = temp;
+            break;
+        }
+    }
+    if (graph_obj) {
+        list_remove(&graph_obj->pool_node);
+        graph_pool_count--;
+        graph_pool_bytes -= graph_obj->pool_size;
+        graph_pool_stats.hits++;
+        graph_pool_stats.saved_ns += graph_obj->open_time_ns;
+    } else {
+        graph_pool_stats.misses++;
+    }
+    pthread_mutex_unlock(&graph_pool_lock);
+
+    if (!graph_obj)
+        return NULL;
+
+    pthread_mutex_lock(&graph_obj->lock);
+    graph_obj->sess_obj = sess_obj;
+    graph_obj->is_config_buf_params_done = false;
+    graph_obj->buf_info.timestamp = 0;
+    list_for_each(node, &graph_obj->tagged_mod_list) {
+        mod = node_to_item(node, module_info_t, list);
+        mod->is_configured = false;
+    }
+    pthread_mutex_unlock(&graph_obj->lock);
+
+    AGM_LOGD("adopted pooled graph_handle %p%s\n", graph_obj->graph_handle,
+             graph_obj->pool_prepared ? " (prepared)" : "");
+    return graph_obj;
+}
+
+/*
+ * Parks graph_obj in the pool instead of closing it. Returns false if the
+ * graph is not eligible, in which case the caller closes it. Graphs pushed
+ * out by the new one are returned in evict_list for closing outside the
+ * pool lock.
+ */
+static bool graph_pool_park(struct graph_obj *graph_obj,
+                            struct listnode *evict_list)
+{
+    struct graph_obj *temp;
+    size_t size;
+    int ret;
+
+    if (!graph_obj->pool_key || !graph_obj->pool_eligible ||
+        !(graph_obj->state & (OPENED | PREPARED | STOPPED)) ||
+        !graph_obj->sess_obj ||
+        graph_obj->acdb_gen != atomic_load(&acdb_gen))
+        return false;
+
+    size = graph_pool_entry_size(graph_obj);
+    if (size > GRAPH_POOL_MEM_BUDGET)
+        return false;
+
+    pthread_mutex_lock(&graph_obj->lock);
+    if (GRAPH_POOL_PREPARE && graph_obj->state == STOPPED &&
+        graph_obj->pool_key->sess_mode != AGM_SESSION_NO_CONFIG) {
+        ret = gsl_ioctl(graph_obj->graph_handle, GSL_CMD_PREPARE, NULL, 0);
+        if (ret == 0)
+            graph_obj->state = PREPARED;
+        else
+            AGM_LOGD("parking graph_handle %p stopped, prepare failed %d\n",
+                     graph_obj->graph_handle, ret);
+    }
+    /*an adopted graph not prepared again keeps the config it was parked with*/
+    if (graph_obj->state == PREPARED && !graph_obj->pool_prepared)
+        graph_pool_config_get(graph_obj, graph_obj->sess_obj,
+                              &graph_obj->pool_config);
+    graph_obj->pool_prepared = (graph_obj->state == PREPARED);
+    graph_obj->cb = NULL;
+    graph_obj->client_data = NULL;
+    graph_obj->sess_obj = NULL;
+    pthread_mutex_unlock(&graph_obj->lock);
+
+    pthread_mutex_lock(&graph_pool_lock);
+    /*recheck under the lock, graph_pool_flush may be running*/
+    if (graph_obj->acdb_gen != atomic_load(&acdb_gen)) {
+        pthread_mutex_unlock(&graph_pool_lock);
+        return false;
+    }
+    graph_obj->pool_size = size;
+    list_add_head(&graph_pool, &graph_obj->pool_node);
+    graph_pool_count++;
+    graph_pool_bytes += size;
+    graph_pool_stats.parked++;
+
+    while (graph_pool_count > GRAPH_POOL_MAX_ENTRIES ||
+           graph_pool_bytes > GRAPH_POOL_MEM_BUDGET) {
+        temp = node_to_item(list_tail(&graph_pool), struct graph_obj,
+                            pool_node);
+        list_remove(&temp->pool_node);
+        graph_pool_count--;
+        graph_pool_bytes -= temp->pool_size;
+        graph_pool_stats.evicted++;
+        list_add_tail(evict_list, &temp->pool_node);
+    }
+    pthread_mutex_unlock(&graph_pool_lock);
+
+    AGM_LOGD("parked graph_handle %p%s\n", graph_obj->graph_handle,
+             graph_obj->pool_prepared ? " (prepared)" : "");
+    return true;
+}
+
+static void graph_pool_detach_all(struct listnode *evict_list)
+{
+    struct listnode *node, *next;
+
+    pthread_mutex_lock(&graph_pool_lock);
+    list_for_each_safe(node, next, &graph_pool) {
+        list_remove(node);
+        list_add_tail(evict_list, node);
+    }
+    graph_pool_count = 0;
+    graph_pool_bytes = 0;
+    pthread_mutex_unlock(&graph_pool_lock);
+}
+
+static void graph_pool_close_list(struct listnode *evict_list)
+{
+    struct listnode *node, *next;
+
+    list_for_each_safe(node, next, evict_list) {
+        list_remove(node);
+        graph_destroy(node_to_item(node, struct graph_obj, pool_node));
+    }
+}
+
+static void graph_pool_flush()
+{
+    list_declare(evict_list);
+
+    graph_pool_detach_all(&evict_list);
+    graph_pool_close_list(&evict_list);
+}
+
+/*
+ * Closes the prepared graphs parked on the hw endpoint of dev_obj, called
+ * before a graph is opened on it without adopting one.
+ */
+static void graph_pool_release_hw_ep(struct device_obj *dev_obj)
+{
+    pthread_mutex_t *hwep_lock = device_get_hwep_lock(dev_obj);
+    struct listnode *node, *next;
+    struct graph_obj *temp;
+    list_declare(evict_list);
+
+    pthread_mutex_lock(&graph_pool_lock);
+    list_for_each_safe(node, next, &graph_pool) {
+        temp = node_to_item(node, struct graph_obj, pool_node);
+        if (!temp->pool_prepared || !temp->pool_key->dev_obj ||
+            device_get_hwep_lock(temp->pool_key->dev_obj) != hwep_lock)
+            continue;
+        list_remove(node);
+        graph_pool_count--;
+        graph_pool_bytes -= temp->pool_size;
+        graph_pool_stats.evicted++;
+        list_add_tail(&evict_list, node);
+    }
+    pthread_mutex_unlock(&graph_pool_lock);
+
+    if (list_empty(&evict_list))
+        return;
+
+    pthread_mutex_lock(hwep_lock);
+    graph_pool_close_list(&evict_list);
+    pthread_mutex_unlock(hwep_lock);
+}
+
+void graph_pool_dump()
+{
+    struct graph_pool_stats stats;
+    uint32_t count;
+    size_t bytes;
+    uint64_t lookups;
+
+    pthread_mutex_lock(&graph_pool_lock);
+    stats = graph_pool_stats;
+    count = graph_pool_count;
+    bytes = graph_pool_bytes;
+    pthread_mutex_unlock(&graph_pool_lock);
+
+    lookups = stats.hits + stats.misses;
+    AGM_LOGI("graph pool: %u graphs, %zu/%d bytes, hits %llu (%llu prepared) "
+             "misses %llu (%llu%%), parked %llu evicted %llu warmed %llu, "
+             "start time saved %llu us\n",
+             count, bytes, GRAPH_POOL_MEM_BUDGET,
+             (unsigned long long)stats.hits,
+             (unsigned long long)stats.prepared_hits,
+             (unsigned long long)stats.misses,
+             (unsigned long long)(lookups ? stats.hits * 100 / lookups : 0),
+             (unsigned long long)stats.parked, (unsigned long long)stats.evicted,
+             (unsigned long long)stats.warmed,
+             (unsigned long long)(stats.saved_ns / 1000));
+    AGM_LOGI("graph events: %llu dispatched, %llu slab overflows\n",
+             (unsigned long long)atomic_load(&graph_event_count),
+             (unsigned long long)atomic_load(&graph_event_overflows));
+}
+
+static module_info_t *module_template_find(module_info_t *info,
+                                           size_t count, uint32_t tag)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (info[i].tag == tag)
+            return &info[i];
+    }
+    return NULL;
+}
+
+static uint32_t mod_index_hash(uint32_t key, uint32_t mask)
+{
+    return ((key ^ (key >> 16)) * 0x45d9f3bu) & mask;
+}
+
+static void mod_index_insert(struct graph_mod_index_slot *table, uint32_t mask,
+                             uint32_t key, module_info_t *mod)
+{
+    uint32_t i = mod_index_hash(key, mask);
+
+    while (table[i].mod) {
+        /*keep the first module for a key, as a list walk would*/
+        if (table[i].key == key)
+            return;
+        i = (i + 1) & mask;
+    }
+    table[i].key = key;
+    table[i].mod = mod;
+}
+
+static module_info_t *mod_index_find(struct graph_obj *graph_obj,
+                                     struct graph_mod_index_slot *table,
+                                     uint32_t key, bool by_tag)
+{
+    struct graph_mod_index *index = &graph_obj->mod_index;
+    struct listnode *node;
+    module_info_t *mod;
+    uint32_t i;
+
+    if (index->mask) {
+        for (i = mod_index_hash(key, index->mask); table[i].mod;
+             i = (i + 1) & index->mask) {
+            if (table[i].key == key)
+                return table[i].mod;
+        }
+        return NULL;
+    }
+
+    /*no table could be built, resolve from the list*/
+    list_for_each(node, &graph_obj->tagged_mod_list) {
+        mod = node_to_item(node, module_info_t, list);
+        if ((by_tag ? mod->tag : mod->miid) == key)
+            return mod;
+    }
+    return NULL;
+}
+
+static module_info_t *graph_module_by_tag(struct graph_obj *graph_obj,
+                                          uint32_t tag)
+{
+    return mod_index_find(graph_obj, graph_obj->mod_index.by_tag, tag, true);
+}
+
+static module_info_t *graph_module_by_miid(struct graph_obj *graph_obj,
+                                           uint32_t miid)
+{
+    return mod_index_find(graph_obj, graph_obj->mod_index.by_miid, miid, false);
+}
+
+static void graph_mod_index_free(struct graph_obj *graph_obj)
+{
+    free(graph_obj->mod_index.by_tag);
+    memset(&graph_obj->mod_index, 0, sizeof(graph_obj->mod_index));
+}
+
+/* must be called with graph_obj->lock held, or before the graph is shared */
+static void graph_mod_index_rebuild(struct graph_obj *graph_obj)
+{
+    struct graph_mod_index *index = &graph_obj->mod_index;
+    struct graph_mod_index_slot *table;
+    struct listnode *node;
+    module_info_t *mod;
+    uint32_t count = 0, size = 16;
+
+    list_for_each(node, &graph_obj->tagged_mod_list)
+        count++;
+    /*keep the load factor at or below one half*/
+    while (size < 2 * count)
+        size <<= 1;
+
+    if (size - 1 != index->mask) {
+        table = realloc(index->by_tag, 2 * size * sizeof(*table));
+        if (!table) {
+            AGM_LOGE("no memory for module index, using list lookups");
+            graph_mod_index_free(graph_obj);
+            return;
+        }
+        index->by_tag = table;
+        index->by_miid = table + size;
+        index->mask = size - 1;
+    }
+    memset(index->by_tag, 0, 2 * size * sizeof(*index->by_tag));
+
+    list_for_each(node, &graph_obj->tagged_mod_list) {
+        mod = node_to_item(node, module_info_t, list);
+        mod_index_insert(index->by_tag, index->mask, mod->tag, mod);
+        mod_index_insert(index->by_miid, index->mask, mod->miid, mod);
+    }
+}
+
 int graph_open(struct agm_meta_data_gsl *meta_data_kv,
                struct session_obj *sess_obj, struct device_obj *dev_obj,
                struct graph_obj **gph_obj)
 {
     struct graph_obj *graph_obj = NULL;
     int ret = 0;
-    struct listnode *temp_node, *node = NULL, *node_list = NULL;
+    struct listnode *temp_node, *node = NULL;
 
-    struct gsl_tag_module_info *tag_module_info = NULL;
-    size_t tag_module_info_size;
-    struct gsl_tag_module_info_entry *gsl_tag_entry = NULL;
+    struct graph_pool_key *pool_key = NULL;
+    uint64_t open_start_ns = graph_pool_now_ns();
+    uint32_t open_acdb_gen = atomic_load(&acdb_gen);
+    struct tag_module_cache_entry *tag_module_entry = NULL;
+    struct tag_module_map *tag_map = NULL;
     struct agm_key_vector_gsl *gkv;
     int i = 0;
     size_t module_list_count =  0;
     module_info_t *mod, *temp_mod = NULL;
-    module_info_link_list_t *mod_list = NULL;
-    size_t arraysize = 0;
+    size_t arraysize = 0, hw_ep_count = 0;
     module_info_t *stream_module_list = NULL;
     module_info_t *hw_ep_module = NULL;
     module_info_t *add_module = NULL;
 
-    list_declare(node_sess);
-    list_init(&node_sess);
-    list_declare(node_hw);
-    list_init(&node_hw);
-
-
     AGM_LOGD("entry\n");
     if (meta_data_kv == NULL || gph_obj == NULL || sess_obj == NULL) {
         AGM_LOGE("Invalid input\n");
@@ -552,6 +1302,15 @@ int graph_open(struct agm_meta_data_gsl *meta_data_kv,
         goto done;
     }
 
+    pool_key = graph_pool_key_create(meta_data_kv, sess_obj, dev_obj);
+    graph_obj = graph_pool_adopt(pool_key, sess_obj);
+    if (graph_obj) {
+        *gph_obj = graph_obj;
+        goto done;
+    }
+    if (pool_key && dev_obj)
+        graph_pool_release_hw_ep(dev_obj);
+
     graph_obj = calloc (1, sizeof(struct graph_obj));
     if (graph_obj == NULL) {
         AGM_LOGE("failed to allocate graph object\n");
@@ -577,113 +1336,91 @@ int graph_open(struct agm_meta_data_gsl *meta_data_kv,
      *only in case of a no hostless session.
      */
 
-    /*Get all the tags info of the graph and store it tag_module_info structure*/
-    ret = get_tags_with_module_info(&meta_data_kv->gkv,
-                                    (void**) &tag_module_info, &tag_module_info_size);
-    if (ret != 0 || !tag_module_info)
+    /*Get all the tags info of the graph, cached per GKV*/
+    ret = tag_module_cache_get(&meta_data_kv->gkv, &tag_module_entry);
+    if (ret != 0)
         goto free_graph_obj;
 
-    gsl_tag_entry = (struct gsl_tag_module_info_entry *)(tag_module_info->tag_module_entry);
-
-    /* Add all default stream_module to node_sess list */
     get_stream_module_list_array(&stream_module_list, &arraysize);
     module_list_count =  arraysize /sizeof(struct module_info);
-    ret = add_to_list(module_list_count, stream_module_list, &node_sess);
-    if (ret != 0)
-        goto free_graph_obj;
-
-    /* Add all default hw_ep_module to node_hw list */
     get_hw_ep_module_list_array(&hw_ep_module, &arraysize);
-    module_list_count =  arraysize /sizeof(struct module_info);
-    ret = add_to_list(module_list_count, hw_ep_module, &node_hw);
-    if (ret != 0)
-        goto free_graph_obj;
+    hw_ep_count =  arraysize /sizeof(struct module_info);
 
-    for (i = 0; i < tag_module_info->num_tags; i++) {
+    for (i = 0; i < tag_module_entry->num_tags; i++) {
+        tag_map = &tag_module_entry->map[i];
         if (sess_obj != NULL) {
             /**
-             * Compare each stream_module present in node_sess list with
-             * gsl_tag_entry and if match found we are adding it to the graph
-             * module_list using ADD_MODULE . And remove this module from
-             * node_sess list . So that in next iterationit will not compare the
-             * same module with gsl_tag_entry again.
+             * If a stream module handles this tag, add it to the graph
+             * module_list using ADD_MODULE.
              */
-            list_for_each(node_list, &node_sess) {
-                mod_list = node_to_item(node_list, module_info_link_list_t, tagged_list);
-                if (gsl_tag_entry->tag_id == mod_list->data->tag) {
-                    if (gsl_tag_entry->num_modules > 1) {
-                        AGM_LOGE("modules num  is invalid");
-                        goto free_graph_obj;
-                    }
-                    mod = mod_list->data;
-                    add_module = ADD_MODULE(*mod, NULL);
-                    if (!add_module) {
-                        AGM_LOGE("no memory to allocate add_module");
-                        ret = -ENOMEM;
-                        goto free_graph_obj;
-                    }
-                    add_module->miid = gsl_tag_entry->module_entry[0].module_iid;
-                    add_module->mid = gsl_tag_entry->module_entry[0].module_id;
-                    add_module->gkv = NULL;
-                    AGM_LOGD("miid %x mid %x tag %x", add_module->miid, add_module->mid, add_module->tag);
-                    goto tag_list;
+            mod = module_template_find(stream_module_list, module_list_count,
+                                       tag_map->tag);
+            if (mod) {
+                if (tag_map->num_modules > 1) {
+                    AGM_LOGE("modules num  is invalid");
+                    goto free_graph_obj;
+                }
+                add_module = ADD_MODULE(*mod, NULL);
+                if (!add_module) {
+                    AGM_LOGE("no memory to allocate add_module");
+                    ret = -ENOMEM;
+                    goto free_graph_obj;
                 }
+                add_module->miid = tag_map->module_iid;
+                add_module->mid = tag_map->module_id;
+                add_module->gkv = NULL;
+                AGM_LOGD("miid %x mid %x tag %x", add_module->miid, add_module->mid, add_module->tag);
+                goto tag_list;
             }
         }
 
         if (dev_obj != NULL) {
             /**
-             * Compare each hw_ep_module present in node_hw list with
-             * gsl_tag_entry and if match found we are adding it to the graph
-             * module_list using ADD_MODULE . And remove this module from
-             * node_hw list.So that in next iteration it will not compare the
-             * same module with gsl_tag_entry again.
+             * If a hw_ep module handles this tag, add it to the graph
+             * module_list using ADD_MODULE.
              */
-            list_for_each(node_list, &node_hw) {
-                mod_list = node_to_item(node_list, module_info_link_list_t, tagged_list);
-                if (gsl_tag_entry->tag_id == mod_list->data->tag) {
-                    if (gsl_tag_entry->num_modules > 1) {
-                        AGM_LOGE("modules num  is invalid");
-                        goto free_graph_obj;
-                    }
-                    mod = mod_list->data;
-                    add_module = ADD_MODULE(*mod, dev_obj);
-                    if (!add_module) {
-                        AGM_LOGE("no memory to allocate add_module");
-                        ret = -ENOMEM;
-                        goto free_graph_obj;
-                    }
-                    add_module->miid = gsl_tag_entry->module_entry[0].module_iid;
-                    add_module->mid = gsl_tag_entry->module_entry[0].module_id;
-                    /*store GKV which describes/contains this module*/
-                    gkv = calloc(1, sizeof(struct agm_key_vector_gsl));
-                    if (!gkv) {
-                        AGM_LOGE("No memory to create merged metadata\n");
-                        ret = -ENOMEM;
-                        goto free_graph_obj;
-                    }
-                    gkv->num_kvs = meta_data_kv->gkv.num_kvs;
-                    gkv->kv = calloc(gkv->num_kvs, sizeof(struct agm_key_value));
-                    if (!gkv->kv) {
-                        AGM_LOGE("No memory to create merged metadata gkv\n");
-                        free(gkv);
-                        ret = -ENOMEM;
-                        goto free_graph_obj;
-                    }
-                    memcpy(gkv->kv, meta_data_kv->gkv.kv,
-                          gkv->num_kvs * sizeof(struct agm_key_value));
-                    add_module->gkv = gkv;
-                    AGM_LOGD("miid %x mid %x tag %x", add_module->miid, add_module->mid, add_module->tag);
-                    goto tag_list;
+            mod = module_template_find(hw_ep_module, hw_ep_count,
+                                       tag_map->tag);
+            if (mod) {
+                if (tag_map->num_modules > 1) {
+                    AGM_LOGE("modules num  is invalid");
+                    goto free_graph_obj;
+                }
+                add_module = ADD_MODULE(*mod, dev_obj);
+                if (!add_module) {
+                    AGM_LOGE("no memory to allocate add_module");
+                    ret = -ENOMEM;
+                    goto free_graph_obj;
                 }
+                add_module->miid = tag_map->module_iid;
+                add_module->mid = tag_map->module_id;
+                /*store GKV which describes/contains this module*/
+                gkv = calloc(1, sizeof(struct agm_key_vector_gsl));
+                if (!gkv) {
+                    AGM_LOGE("No memory to create merged metadata\n");
+                    ret = -ENOMEM;
+                    goto free_graph_obj;
+                }
+                gkv->num_kvs = meta_data_kv->gkv.num_kvs;
+                gkv->kv = calloc(gkv->num_kvs, sizeof(struct agm_key_value));
+                if (!gkv->kv) {
+                    AGM_LOGE("No memory to create merged metadata gkv\n");
+                    free(gkv);
+                    ret = -ENOMEM;
+                    goto free_graph_obj;
+                }
+                memcpy(gkv->kv, meta_data_kv->gkv.kv,
+                      gkv->num_kvs * sizeof(struct agm_key_value));
+                add_module->gkv = gkv;
+                AGM_LOGD("miid %x mid %x tag %x", add_module->miid, add_module->mid, add_module->tag);
+                goto tag_list;
             }
         }
 tag_list:
-        gsl_tag_entry  = (struct gsl_tag_module_info_entry *) ((char *)gsl_tag_entry + sizeof(struct gsl_tag_module_info_entry) +
-                               (sizeof(struct gsl_module_id_info_entry) *
-                               gsl_tag_entry->num_modules));
+        continue;
     }
 no_config:
+    graph_mod_index_rebuild(graph_obj);
     graph_obj->sess_obj = sess_obj;
 
     ret = gsl_open((struct gsl_key_vector *)&meta_data_kv->gkv,
@@ -703,6 +1440,11 @@ no_config:
         goto close_graph;
     }
     graph_obj->state = OPENED;
+    graph_obj->pool_key = pool_key;
+    graph_obj->pool_eligible = (pool_key != NULL);
+    graph_obj->open_time_ns = graph_pool_now_ns() - open_start_ns;
+    graph_obj->acdb_gen = open_acdb_gen;
+    pool_key = NULL;
     *gph_obj = graph_obj;
     AGM_LOGD("graph_handle %p\n", graph_obj->graph_handle);
 
@@ -720,42 +1462,27 @@ free_graph_obj:
                 free(temp_mod->gkv->kv);
             free(temp_mod->gkv);
         }
+        graph_module_cfg_cache_free(temp_mod);
         free(temp_mod);
     }
+    graph_module_cfg_batch_free(graph_obj);
+    graph_mod_index_free(graph_obj);
     pthread_mutex_destroy(&graph_obj->lock);
     free(graph_obj);
 done:
-    // free memory allocated in node sess/hw
-    list_for_each_safe(node, temp_node, &node_sess) {
-        list_remove(node);
-        mod_list = node_to_item(node, module_info_link_list_t, tagged_list);
-        if (mod_list)
-            free(mod_list);
-    }
-
-    list_for_each_safe(node, temp_node, &node_hw) {
-        list_remove(node);
-        mod_list = node_to_item(node, module_info_link_list_t, tagged_list);
-        if (mod_list)
-            free(mod_list);
-    }
-
     AGM_LOGD("exit, ret %d", ret);
-    if (tag_module_info)
-        free(tag_module_info);
+    if (tag_module_entry)
+        tag_module_cache_put(tag_module_entry);
+    free(pool_key);
     return ret;
 }
 
-int graph_close(struct graph_obj *graph_obj)
+static int graph_destroy(struct graph_obj *graph_obj)
 {
     int ret = 0;
     struct listnode *temp_node,*node = NULL;
     module_info_t *temp_mod = NULL;
 
-    if (graph_obj == NULL) {
-        AGM_LOGE("invalid graph object\n");
-        return -EINVAL;
-    }
     pthread_mutex_lock(&graph_obj->lock);
     AGM_LOGD("entry handle %p", graph_obj->graph_handle);
 
@@ -772,15 +1499,197 @@ int graph_close(struct graph_obj *graph_obj)
             free(temp_mod->gkv->kv);
             free(temp_mod->gkv);
         }
+        graph_module_cfg_cache_free(temp_mod);
         free(temp_mod);
     }
+    graph_module_cfg_batch_free(graph_obj);
+    graph_mod_index_free(graph_obj);
     pthread_mutex_unlock(&graph_obj->lock);
     pthread_mutex_destroy(&graph_obj->lock);
+    free(graph_obj->iov_buf);
+    free(graph_obj->pool_key);
     free(graph_obj);
     AGM_LOGD("exit, ret %d", ret);
     return ret;
 }
 
+int graph_close(struct graph_obj *graph_obj)
+{
+    list_declare(evict_list);
+
+    if (graph_obj == NULL) {
+        AGM_LOGE("invalid graph object\n");
+        return -EINVAL;
+    }
+
+    if (graph_pool_park(graph_obj, &evict_list)) {
+        graph_pool_close_list(&evict_list);
+        return 0;
+    }
+
+    return graph_destroy(graph_obj);
+}
+
+#ifdef GRAPH_POOL_WARMUP_FILE
+static int graph_pool_parse_kvs(char *str, struct agm_key_value *kv,
+                                size_t *num_kvs)
+{
+    char *save = NULL, *tok, *end;
+
+    *num_kvs = 0;
+    for (tok = strtok_r(str, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (*num_kvs == GRAPH_POOL_WARMUP_MAX_KVS)
+            return -E2BIG;
+        kv[*num_kvs].key = strtoul(tok, &end, 0);
+        if (*end != ':')
+            return -EINVAL;
+        kv[*num_kvs].value = strtoul(end + 1, &end, 0);
+        if (*end != '\0')
+            return -EINVAL;
+        (*num_kvs)++;
+    }
+    return 0;
+}
+
+static int graph_pool_warmup_usecase(char *line)
+{
+    struct agm_key_value gkv[GRAPH_POOL_WARMUP_MAX_KVS];
+    struct agm_key_value ckv[GRAPH_POOL_WARMUP_MAX_KVS];
+    struct agm_meta_data_gsl meta_data_kv;
+    struct agm_media_config media_config = {0};
+    struct agm_media_config dev_media_config;
+    struct agm_buffer_config buffer_config = {0};
+    struct session_obj *sess_obj = NULL;
+    struct device_obj *dev_obj = NULL;
+    struct graph_obj *graph_obj = NULL;
+    pthread_mutex_t *hwep_lock = NULL;
+    char *save = NULL, *tok;
+    unsigned long aif_id;
+    bool prepare = false, parked;
+    list_declare(evict_list);
+    int ret = 0;
+
+    sess_obj = calloc(1, sizeof(*sess_obj));
+    if (!sess_obj)
+        return -ENOMEM;
+
+    memset(&meta_data_kv, 0, sizeof(meta_data_kv));
+    meta_data_kv.gkv.kv = gkv;
+    meta_data_kv.ckv.kv = ckv;
+    sess_obj->stream_config.dir = RX;
+    for (tok = strtok_r(line, " \t\n", &save); tok && !ret;
+         tok = strtok_r(NULL, " \t\n", &save)) {
+        if (!strncmp(tok, "mode=", 5)) {
+            sess_obj->stream_config.sess_mode = strtoul(tok + 5, NULL, 0);
+        } else if (!strncmp(tok, "dir=", 4)) {
+            sess_obj->stream_config.dir = strtoul(tok + 4, NULL, 0);
+        } else if (!strncmp(tok, "aif=", 4)) {
+            aif_id = strtoul(tok + 4, NULL, 0);
+            ret = device_get_obj(aif_id, &dev_obj);
+        } else if (!strncmp(tok, "gkv=", 4)) {
+            ret = graph_pool_parse_kvs(tok + 4, gkv, &meta_data_kv.gkv.num_kvs);
+        } else if (!strncmp(tok, "ckv=", 4)) {
+            ret = graph_pool_parse_kvs(tok + 4, ckv, &meta_data_kv.ckv.num_kvs);
+        } else if (!strncmp(tok, "media=", 6)) {
+            if (sscanf(tok + 6, "%u,%u,%u", &media_config.rate,
+                       &media_config.channels,
+                       (uint32_t *)&media_config.format) != 3)
+                ret = -EINVAL;
+            prepare = true;
+        } else if (!strncmp(tok, "buffer=", 7)) {
+            if (sscanf(tok + 7, "%zu,%u", &buffer_config.size,
+                       &buffer_config.count) != 2)
+                ret = -EINVAL;
+        } else {
+            ret = -EINVAL;
+        }
+    }
+    if (ret || !meta_data_kv.gkv.num_kvs) {
+        AGM_LOGE("invalid warmup usecase, error %d\n", ret);
+        ret = ret ? ret : -EINVAL;
+        goto done;
+    }
+
+    if (sess_obj->stream_config.dir == TX) {
+        sess_obj->in_media_config = media_config;
+        sess_obj->in_buffer_config = buffer_config;
+    } else {
+        sess_obj->out_media_config = media_config;
+        sess_obj->out_buffer_config = buffer_config;
+    }
+
+    if (dev_obj) {
+        hwep_lock = device_get_hwep_lock(dev_obj);
+        dev_media_config = dev_obj->group_data ?
+                    dev_obj->group_data->media_config.config :
+                    dev_obj->media_config;
+        /*the hw endpoint cannot be configured before the device is*/
+        if (prepare && !dev_media_config.rate) {
+            AGM_LOGD("no media config on %s yet, warming up unprepared\n",
+                     dev_obj->name);
+            prepare = false;
+        }
+    }
+
+    ret = graph_open(&meta_data_kv, sess_obj, dev_obj, &graph_obj);
+    if (ret)
+        goto done;
+
+    if (hwep_lock)
+        pthread_mutex_lock(hwep_lock);
+    if (prepare) {
+        ret = graph_prepare(graph_obj);
+        if (ret)
+            AGM_LOGE("warmup prepare failed %d, parking unprepared\n", ret);
+    }
+
+    parked = graph_pool_park(graph_obj, &evict_list);
+    if (parked)
+        graph_pool_close_list(&evict_list);
+    else
+        graph_destroy(graph_obj);
+    ret = parked ? 0 : -EBUSY;
+    if (hwep_lock)
+        pthread_mutex_unlock(hwep_lock);
+
+done:
+    free(sess_obj);
+    return ret;
+}
+#endif
+
+int graph_pool_warmup()
+{
+    int count = 0;
+#ifdef GRAPH_POOL_WARMUP_FILE
+    char line[512];
+    FILE *fp;
+
+    if (GRAPH_POOL_MAX_ENTRIES == 0)
+        return 0;
+
+    fp = fopen(GRAPH_POOL_WARMUP_FILE, "r");
+    if (!fp)
+        return 0;
+
+    while (count < GRAPH_POOL_MAX_ENTRIES && fgets(line, sizeof(line), fp)) {
+        if (line[strspn(line, " \t")] == '#' ||
+            line[strspn(line, " \t\n")] == '\0')
+            continue;
+        if (graph_pool_warmup_usecase(line) == 0)
+            count++;
+    }
+    fclose(fp);
+
+    pthread_mutex_lock(&graph_pool_lock);
+    graph_pool_stats.warmed += count;
+    pthread_mutex_unlock(&graph_pool_lock);
+    AGM_LOGI("warmed up %d graphs from %s\n", count, GRAPH_POOL_WARMUP_FILE);
+#endif
+    return count;
+}
+
 int graph_prepare(struct graph_obj *graph_obj)
 {
     int ret = 0;
@@ -788,6 +1697,8 @@ int graph_prepare(struct graph_obj *graph_obj)
     module_info_t *mod = NULL;
     struct session_obj *sess_obj = NULL;
     struct agm_session_config stream_config;
+    struct graph_pool_config pool_config;
+    uint64_t prepare_start_ns = graph_pool_now_ns();
 
     if (graph_obj == NULL) {
         AGM_LOGE("invalid graph object\n");
@@ -803,6 +1714,32 @@ int graph_prepare(struct graph_obj *graph_obj)
 
     AGM_LOGD("entry graph_handle %p", graph_obj->graph_handle);
     pthread_mutex_lock(&graph_obj->lock);
+    if (graph_obj->state == PREPARED && graph_obj->pool_prepared) {
+        /*adopted from the pool already prepared, possibly for another config*/
+        graph_obj->pool_prepared = false;
+        graph_pool_config_get(graph_obj, sess_obj, &pool_config);
+        if (!memcmp(&pool_config, &graph_obj->pool_config,
+                    sizeof(pool_config))) {
+            list_for_each(node, &graph_obj->tagged_mod_list) {
+                mod = node_to_item(node, module_info_t, list);
+                mod->is_configured = true;
+            }
+            graph_obj->is_config_buf_params_done = true;
+            pthread_mutex_lock(&graph_pool_lock);
+            graph_pool_stats.prepared_hits++;
+            graph_pool_stats.saved_ns += graph_obj->prepare_time_ns;
+            pthread_mutex_unlock(&graph_pool_lock);
+            AGM_LOGD("pooled graph already prepared with this config");
+            goto done;
+        }
+        ret = gsl_ioctl(graph_obj->graph_handle, GSL_CMD_STOP, NULL, 0);
+        if (ret != 0) {
+            ret = ar_err_get_lnx_err_code(ret);
+            AGM_LOGE("stopping pooled graph failed %d\n", ret);
+            goto done;
+        }
+        graph_obj->state = STOPPED;
+    }
     if (graph_obj->state == PREPARED) {
         AGM_LOGD("Graph already prepared");
         goto done;
@@ -811,11 +1748,13 @@ int graph_prepare(struct graph_obj *graph_obj)
      *Iterate over mod list to configure each module
      *present in the graph. Also validate if the module list
      *matches the configuration passed by the client.
+     *Module params are collected and sent to SPF in one go below.
      */
+    graph_module_cfg_batch_begin(graph_obj);
     list_for_each(node, &graph_obj->tagged_mod_list) {
         mod = node_to_item(node, module_info_t, list);
         if (mod->is_configured) {
-            if ((mod->tag == DEVICE_HW_ENDPOINT_RX) || (mod->tag == DEVICE_HW_ENDPOINT_TX))
+            if (mod->reconfigure)
                 goto force_configure;
             else
                 continue;
@@ -858,6 +1797,12 @@ force_configure:
 
         }
     }
+    ret = graph_module_cfg_batch_flush(graph_obj);
+    if (ret != 0) {
+        ret = ar_err_get_lnx_err_code(ret);
+        AGM_LOGE("Module configuration failed:%d\n", ret);
+        goto done;
+    }
 
     /*Configure buffers only if it is not a hostless session*/
     if ((sess_obj != NULL) &&
@@ -876,8 +1821,10 @@ force_configure:
         goto done;
     }
     graph_obj->state = PREPARED;
+    graph_obj->prepare_time_ns = graph_pool_now_ns() - prepare_start_ns;
 
 done:
+    graph_module_cfg_batch_end(graph_obj);
     pthread_mutex_unlock(&graph_obj->lock);
     AGM_LOGD("exit, ret %d", ret);
     return ret;
@@ -914,6 +1861,8 @@ int graph_stop(struct graph_obj *graph_obj,
 {
     int ret = 0;
     struct gsl_cmd_properties gsl_cmd_prop = {0};
+    struct listnode *node = NULL;
+    module_info_t *mod = NULL;
 
     if (graph_obj == NULL) {
         AGM_LOGE("invalid graph object\n");
@@ -933,6 +1882,7 @@ int graph_stop(struct graph_obj *graph_obj,
 #ifdef AGM_DEBUG_METADATA
         metadata_print(meta_data);
 #endif
+        graph_obj->pool_eligible = false;
         memcpy (&(gsl_cmd_prop.gkv), &(meta_data->gkv),
                                        sizeof(struct gsl_key_vector));
         gsl_cmd_prop.property_id = meta_data->sg_props.prop_id;
@@ -953,6 +1903,11 @@ int graph_stop(struct graph_obj *graph_obj,
             ret = ar_err_get_lnx_err_code(ret);
             AGM_LOGE("graph close with prop failed %d\n", ret);
         }
+        /*modules of the closed subgraphs lose their configuration*/
+        list_for_each(node, &graph_obj->tagged_mod_list) {
+            mod = node_to_item(node, module_info_t, list);
+            graph_module_cfg_cache_free(mod);
+        }
     } else {
         if (graph_obj->state & (STOPPED)) {
            AGM_LOGE("graph object is already in STOP state\n");
@@ -975,7 +1930,6 @@ done:
 int graph_pause_resume(struct graph_obj *graph_obj, bool pause)
 {
     int ret = 0;
-    struct listnode *node = NULL;
     module_info_t *mod;
     struct apm_module_param_data_t *header;
     size_t payload_size = 0;
@@ -986,46 +1940,44 @@ int graph_pause_resume(struct graph_obj *graph_obj, bool pause)
         return -EINVAL;
     }
 
+    pthread_mutex_lock(&graph_obj->lock);
     /* Pause module info is retrived and added to list in graph_open */
-    list_for_each(node, &graph_obj->tagged_mod_list) {
-        mod = node_to_item(node, module_info_t, list);
-        if (mod->tag == TAG_PAUSE) {
-            AGM_LOGD("Soft Pause module IID 0x%x, Pause: %d\n", mod->miid, pause);
+    mod = graph_module_by_tag(graph_obj, TAG_PAUSE);
+    if (!mod)
+        goto done;
 
-            payload_size = sizeof(struct apm_module_param_data_t);
-            ALIGN_PAYLOAD(payload_size, 8);
+    AGM_LOGD("Soft Pause module IID 0x%x, Pause: %d\n", mod->miid, pause);
 
-            payload = calloc(1, (size_t)payload_size);
-            if (!payload) {
-                AGM_LOGE("No memory to allocate for payload\n");
-                ret = -ENOMEM;
-                goto done;
-            }
+    payload_size = sizeof(struct apm_module_param_data_t);
+    ALIGN_PAYLOAD(payload_size, 8);
 
-            header = (struct apm_module_param_data_t*)payload;
-            header->module_instance_id = mod->miid;
-            if (pause)
-                header->param_id = PARAM_ID_SOFT_PAUSE_START;
-            else
-                header->param_id = PARAM_ID_SOFT_PAUSE_RESUME;
+    payload = calloc(1, (size_t)payload_size);
+    if (!payload) {
+        AGM_LOGE("No memory to allocate for payload\n");
+        ret = -ENOMEM;
+        goto done;
+    }
 
-            header->error_code = 0x0;
-            header->param_size = 0x0;
+    header = (struct apm_module_param_data_t*)payload;
+    header->module_instance_id = mod->miid;
+    if (pause)
+        header->param_id = PARAM_ID_SOFT_PAUSE_START;
+    else
+        header->param_id = PARAM_ID_SOFT_PAUSE_RESUME;
 
-            pthread_mutex_lock(&graph_obj->lock);
-            ret = gsl_set_custom_config(graph_obj->graph_handle,
-                                         payload, payload_size);
-            if (ret !=0) {
-                ret = ar_err_get_lnx_err_code(ret);
-                AGM_LOGE("graph_set_custom_config failed %d\n", ret);
-            }
-            pthread_mutex_unlock(&graph_obj->lock);
-            free(payload);
-            break;
-        }
+    header->error_code = 0x0;
+    header->param_size = 0x0;
+
+    ret = gsl_set_custom_config(graph_obj->graph_handle,
+                                 payload, payload_size);
+    if (ret !=0) {
+        ret = ar_err_get_lnx_err_code(ret);
+        AGM_LOGE("graph_set_custom_config failed %d\n", ret);
     }
+    free(payload);
 
 done:
+    pthread_mutex_unlock(&graph_obj->lock);
     return ret;
 }
 
@@ -1092,6 +2044,41 @@ done:
     return ret;
 }
 
+/*
+ *Params a client sets behind the configure hooks' back make what they sent
+ *last stale, so the cached payload of every param in payload is dropped.
+ *Must be called with graph_obj->lock held.
+ */
+static void graph_cfg_cache_drop_params(struct graph_obj *graph_obj,
+                                        uint8_t *payload, size_t payload_size)
+{
+    struct apm_module_param_data_t *header;
+    module_info_t *mod;
+    size_t offset = 0, size;
+
+    while (offset + sizeof(*header) <= payload_size) {
+        header = (struct apm_module_param_data_t *)(payload + offset);
+        mod = graph_module_by_miid(graph_obj, header->module_instance_id);
+        if (mod)
+            graph_module_cfg_cache_drop(mod, header->param_id);
+        size = sizeof(*header) + header->param_size;
+        ALIGN_PAYLOAD(size, 8);
+        offset += size;
+    }
+}
+
+/*as above, for configs whose modules and params are not known here*/
+static void graph_cfg_cache_drop_all(struct graph_obj *graph_obj)
+{
+    struct listnode *node;
+    module_info_t *mod;
+
+    list_for_each(node, &graph_obj->tagged_mod_list) {
+        mod = node_to_item(node, module_info_t, list);
+        graph_module_cfg_cache_free(mod);
+    }
+}
+
 int graph_set_config(struct graph_obj *graph_obj, void *payload,
                      size_t payload_size)
 {
@@ -1103,6 +2090,7 @@ int graph_set_config(struct graph_obj *graph_obj, void *payload,
 
     pthread_mutex_lock(&graph_obj->lock);
     AGM_LOGD("entry graph_handle %p", graph_obj->graph_handle);
+    graph_cfg_cache_drop_params(graph_obj, payload, payload_size);
     ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
     if (ret !=0) {
         ret = ar_err_get_lnx_err_code(ret);
@@ -1147,6 +2135,7 @@ int graph_set_config_with_tag(struct graph_obj *graph_obj,
      }
 
      pthread_mutex_lock(&graph_obj->lock);
+     graph_cfg_cache_drop_all(graph_obj);
      ret = gsl_set_config(graph_obj->graph_handle, (struct gsl_key_vector *)gkv,
                           tag_config->tag_id,
                           (struct gsl_key_vector *)&tag_config->tkv);
@@ -1171,6 +2160,8 @@ int graph_set_cal(struct graph_obj *graph_obj,
      }
 
      pthread_mutex_lock(&graph_obj->lock);
+     graph_obj->pool_eligible = false;
+     graph_cfg_cache_drop_all(graph_obj);
      ret = gsl_set_cal(graph_obj->graph_handle,
                        (struct gsl_key_vector *)&metadata->gkv,
                        (struct gsl_key_vector *)&metadata->ckv);
@@ -1319,6 +2310,10 @@ int graph_rw_acdb_param(void *payload, bool is_param_write)
             ret = gsl_set_tag_data_to_acdb(&gkv, tag, &kv, ptr_to_param, actual_size);
         else
             ret = gsl_set_cal_data_to_acdb(&gkv, &kv, ptr_to_param, actual_size);
+        if (ret == 0) {
+            tag_module_cache_invalidate();
+            graph_pool_flush();
+        }
     } else {
         if (payloadACDBTunnelInfo->isTKV)
             ret = graph_get_tckv_data_from_acdb(&gkv, tag, &kv, ptr_to_param, &actual_size);
@@ -1419,6 +2414,94 @@ int graph_read(struct graph_obj *graph_obj, struct agm_buff *buffer, size_t *siz
     return ret;
 }
 
+static int graph_transfer_iov(struct graph_obj *graph_obj,
+                              const struct iovec *iov, int iovcnt,
+                              size_t *size, bool is_write)
+{
+    struct agm_buff buffer = {0};
+    size_t total = 0, copied, len;
+    uint8_t *buf = NULL;
+    bool contiguous = true;
+    int i, ret = 0;
+
+    *size = 0;
+    if (graph_obj == NULL || iov == NULL || iovcnt < 0) {
+        AGM_LOGE("invalid arguments\n");
+        return -EINVAL;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0)
+            continue;
+        if (!buf)
+            buf = (uint8_t *)iov[i].iov_base;
+        else if ((uint8_t *)iov[i].iov_base != buf + total)
+            contiguous = false;
+        total += iov[i].iov_len;
+    }
+    if (total == 0)
+        return 0;
+
+    /*
+     *A writev/readv is one DSP buffer. Segments that follow each other in
+     *memory, as the IPC servers lay them out in their transaction buffer,
+     *are used in place as one; scattered ones are gathered into the
+     *staging buffer and sent in one go.
+     */
+    if (!contiguous) {
+        if (graph_obj->iov_buf_size < total) {
+            buf = realloc(graph_obj->iov_buf, total);
+            if (!buf) {
+                AGM_LOGE("no memory for %zu byte staging buffer\n", total);
+                return -ENOMEM;
+            }
+            graph_obj->iov_buf = buf;
+            graph_obj->iov_buf_size = total;
+        }
+        buf = graph_obj->iov_buf;
+        if (is_write) {
+            for (i = 0, copied = 0; i < iovcnt; i++) {
+                memcpy(buf + copied, iov[i].iov_base, iov[i].iov_len);
+                copied += iov[i].iov_len;
+            }
+        }
+    }
+
+    buffer.addr = buf;
+    buffer.size = total;
+    if (is_write)
+        ret = graph_write(graph_obj, &buffer, &total);
+    else
+        ret = graph_read(graph_obj, &buffer, &total);
+    if (ret != 0)
+        return ret;
+
+    if (!is_write && !contiguous) {
+        for (i = 0, copied = 0; i < iovcnt && copied < total; i++) {
+            len = iov[i].iov_len;
+            if (len > total - copied)
+                len = total - copied;
+            memcpy(iov[i].iov_base, buf + copied, len);
+            copied += len;
+        }
+    }
+    *size = total;
+
+    return 0;
+}
+
+int graph_readv(struct graph_obj *graph_obj, const struct iovec *iov,
+                int iovcnt, size_t *size)
+{
+    return graph_transfer_iov(graph_obj, iov, iovcnt, size, false);
+}
+
+int graph_writev(struct graph_obj *graph_obj, const struct iovec *iov,
+                 int iovcnt, size_t *size)
+{
+    return graph_transfer_iov(graph_obj, iov, iovcnt, size, true);
+}
+
 int graph_add(struct graph_obj *graph_obj,
               struct agm_meta_data_gsl *meta_data_kv,
               struct device_obj *dev_obj)
@@ -1436,6 +2519,7 @@ int graph_add(struct graph_obj *graph_obj,
     }
 
     pthread_mutex_lock(&graph_obj->lock);
+    graph_obj->pool_eligible = false;
     AGM_LOGD("entry graph_handle %p\n", graph_obj->graph_handle);
 
     if (graph_obj->state < OPENED) {
@@ -1467,8 +2551,7 @@ int graph_add(struct graph_obj *graph_obj,
     }
     if (dev_obj != NULL) {
         module_info_t *temp_mod = NULL;
-        size_t module_info_size;
-        struct gsl_module_id_info *module_info;
+        uint32_t tagged_mid = 0, tagged_miid = 0;
         bool mod_present = false;
         size_t arraysize;
         module_info_t *hw_ep_module = NULL;
@@ -1480,12 +2563,9 @@ int graph_add(struct graph_obj *graph_obj,
         else
             mod = &hw_ep_module[1];
 
-        ret = gsl_get_tagged_module_info((struct gsl_key_vector *)
-                                           &meta_data_kv->gkv,
-                                           mod->tag,
-                                           &module_info, (uint32_t*) &module_info_size);
+        ret = graph_get_tagged_module(&meta_data_kv->gkv, mod->tag,
+                                      &tagged_mid, &tagged_miid);
         if (ret != 0) {
-            ret = ar_err_get_lnx_err_code(ret);
             AGM_LOGE("cannot get tagged module info for module %x\n",
                           mod->tag);
             goto done;
@@ -1496,18 +2576,15 @@ int graph_add(struct graph_obj *graph_obj,
          *present in the graph object with the one returned from the above api.
          *if it is a new module we add it to the list and configure it.
          */
-        list_for_each(node, &graph_obj->tagged_mod_list) {
-            temp_mod = node_to_item(node, module_info_t, list);
-            if (temp_mod->miid == module_info->module_entry[0].module_iid) {
-                mod_present = true;
-                /**
-                 * Module might have configured previously as we don't reset in
-                 * graph_remove() API. Reset is_configured flag here.
-                 * Ex: back to back device switch scenario.
-                 */
-                temp_mod->is_configured = false;
-                break;
-            }
+        temp_mod = graph_module_by_miid(graph_obj, tagged_miid);
+        if (temp_mod) {
+            mod_present = true;
+            /**
+             * Module might have configured previously as we don't reset in
+             * graph_remove() API. Reset is_configured flag here.
+             * Ex: back to back device switch scenario.
+             */
+            temp_mod->is_configured = false;
         }
         if (!mod_present) {
             /**
@@ -1521,8 +2598,9 @@ int graph_add(struct graph_obj *graph_obj,
                 ret = -ENOMEM;
                 goto done;
             }
-            add_module->miid = module_info->module_entry[0].module_iid;
-            add_module->mid = module_info->module_entry[0].module_id;
+            add_module->miid = tagged_miid;
+            add_module->mid = tagged_mid;
+            graph_mod_index_rebuild(graph_obj);
             gkv = calloc(1, sizeof(struct agm_key_vector_gsl));
             if (!gkv) {
                 AGM_LOGE("No memory to allocate for gkv\n");
@@ -1598,14 +2676,14 @@ int graph_change(struct graph_obj *graph_obj,
     }
 
     pthread_mutex_lock(&graph_obj->lock);
+    graph_obj->pool_eligible = false;
     AGM_LOGD("entry graph_handle %p", graph_obj->graph_handle);
     metadata_print(meta_data_kv);
 
     if (dev_obj != NULL) {
         mod = NULL;
         module_info_t *add_module, *temp_mod = NULL;
-        size_t module_info_size;
-        struct gsl_module_id_info *module_info;
+        uint32_t tagged_mid = 0, tagged_miid = 0;
         bool mod_present = false;
         size_t arraysize;
         module_info_t *hw_ep_module = NULL;
@@ -1615,12 +2693,9 @@ int graph_change(struct graph_obj *graph_obj,
         else
             mod = &hw_ep_module[1];
 
-        ret = gsl_get_tagged_module_info((struct gsl_key_vector *)
-                                           &meta_data_kv->gkv,
-                                           mod->tag,
-                                           &module_info, (uint32_t*) &module_info_size);
+        ret = graph_get_tagged_module(&meta_data_kv->gkv, mod->tag,
+                                      &tagged_mid, &tagged_miid);
         if (ret != 0) {
-            ret = ar_err_get_lnx_err_code(ret);
             AGM_LOGE("cannot get tagged module info for module %x\n",
                           mod->tag);
             goto done;
@@ -1633,30 +2708,29 @@ int graph_change(struct graph_obj *graph_obj,
          *as it is not part of the graph anymore (would have been removed as a
          *part of graph_remove).
          */
-        list_for_each(node, &graph_obj->tagged_mod_list) {
-            temp_mod = node_to_item(node, module_info_t, list);
-            if (temp_mod->miid == module_info->module_entry[0].module_iid) {
-                AGM_LOGV("info for module %x, config flag = %d\n", temp_mod->tag, temp_mod->is_configured);
-                mod_present = true;
-                temp_mod->is_configured = false;
-                break;
-            }
+        temp_mod = graph_module_by_miid(graph_obj, tagged_miid);
+        if (temp_mod) {
+            AGM_LOGV("info for module %x, config flag = %d\n", temp_mod->tag, temp_mod->is_configured);
+            mod_present = true;
+            temp_mod->is_configured = false;
         }
         /* Delete the current hw_ep(Device module) from the list */
         list_for_each_safe(node, temp_node, &graph_obj->tagged_mod_list) {
             temp_mod = node_to_item(node, module_info_t, list);
             if (((temp_mod->tag == DEVICE_HW_ENDPOINT_TX) ||
                 (temp_mod->tag == DEVICE_HW_ENDPOINT_RX)) &&
-                (temp_mod->miid != module_info->module_entry[0].module_iid)) {
+                (temp_mod->miid != tagged_miid)) {
                 list_remove(node);
                 if (temp_mod->gkv) {
                     free(temp_mod->gkv->kv);
                     free(temp_mod->gkv);
                 }
+                graph_module_cfg_cache_free(temp_mod);
                 free(temp_mod);
                 temp_mod = NULL;
             }
         }
+        graph_mod_index_rebuild(graph_obj);
         if (!mod_present) {
             /*This is a new device object, add this module to the list */
             add_module = ADD_MODULE(*mod, dev_obj);
@@ -1665,8 +2739,9 @@ int graph_change(struct graph_obj *graph_obj,
                 ret = -ENOMEM;
                 goto done;
             }
-            add_module->miid = module_info->module_entry[0].module_iid;
-            add_module->mid = module_info->module_entry[0].module_id;
+            add_module->miid = tagged_miid;
+            add_module->mid = tagged_mid;
+            graph_mod_index_rebuild(graph_obj);
             /*Make a local copy of gkv and use when we query gsl
             for tagged data*/
             gkv = calloc(1, sizeof(struct agm_key_vector_gsl));
@@ -1732,6 +2807,7 @@ int graph_remove(struct graph_obj *graph_obj,
         return -EINVAL;
     }
     pthread_mutex_lock(&graph_obj->lock);
+    graph_obj->pool_eligible = false;
     AGM_LOGD("entry graph_handle %p\n", graph_obj->graph_handle);
 
     /**
@@ -1751,6 +2827,8 @@ int graph_remove(struct graph_obj *graph_obj,
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("graph add failed with error %d\n", ret);
     }
+    /*modules of the removed subgraphs come back unconfigured if added again*/
+    graph_cfg_cache_drop_all(graph_obj);
 
     pthread_mutex_unlock(&graph_obj->lock);
     AGM_LOGD("exit, ret %d", ret);
@@ -1805,6 +2883,7 @@ int graph_register_for_events(struct graph_obj *gph_obj,
         ret = -EINVAL;
         goto done;
     }
+    gph_obj->pool_eligible = false;
     payload_size = sizeof(struct gsl_cmd_register_custom_event) +
                                        evt_reg_cfg->event_config_payload_size;
 
@@ -2074,7 +3153,6 @@ int graph_set_gapless_metadata(struct graph_obj *graph_obj,
                                uint32_t silence)
 {
     int ret = 0;
-    struct listnode *node = NULL;
     struct module_info *mod;
     struct apm_module_param_data_t *header;
     struct param_id_remove_initial_silence_t *pid_is;
@@ -2089,13 +3167,10 @@ int graph_set_gapless_metadata(struct graph_obj *graph_obj,
     }
     pthread_mutex_lock(&graph_obj->lock);
 
-    list_for_each(node, &graph_obj->tagged_mod_list) {
-        mod = node_to_item(node, module_info_t, list);
-        if (mod->tag == TAG_STREAM_PLACEHOLDER_DECODER) {
-            AGM_LOGD("Decoder module IID %x", mod->miid);
-            decoder_miid = mod->miid;
-            break;
-        }
+    mod = graph_module_by_tag(graph_obj, TAG_STREAM_PLACEHOLDER_DECODER);
+    if (mod) {
+        AGM_LOGD("Decoder module IID %x", mod->miid);
+        decoder_miid = mod->miid;
     }
     if (decoder_miid == 0) {
         AGM_LOGE("Decoder MIID not found");
@@ -2145,9 +3220,16 @@ int graph_set_tag_data_to_acdb(
     struct agm_key_vector_gsl *tag_key_vect, uint8_t *payload,
     uint32_t payload_size)
 {
-    return gsl_set_tag_data_to_acdb((struct gsl_key_vector *)graph_key_vect,
+    int ret;
+
+    ret = gsl_set_tag_data_to_acdb((struct gsl_key_vector *)graph_key_vect,
                  tag_id, (struct gsl_key_vector *)tag_key_vect,
                  payload, payload_size);
+    if (ret == 0) {
+        tag_module_cache_invalidate();
+        graph_pool_flush();
+    }
+    return ret;
 }
 
 int graph_set_cal_data_to_acdb(
@@ -2155,9 +3237,16 @@ int graph_set_cal_data_to_acdb(
     struct agm_key_vector_gsl *cal_key_vect, uint8_t *payload,
     uint32_t payload_size)
 {
-    return gsl_set_cal_data_to_acdb((struct gsl_key_vector *)graph_key_vect,
+    int ret;
+
+    ret = gsl_set_cal_data_to_acdb((struct gsl_key_vector *)graph_key_vect,
                 (struct gsl_key_vector *)cal_key_vect,
                 payload, payload_size);
+    if (ret == 0) {
+        tag_module_cache_invalidate();
+        graph_pool_flush();
+    }
+    return ret;
 }
 
 int graph_get_tagged_data(
@@ -2287,19 +3376,16 @@ static bool is_media_config_needed_on_datapath(enum agm_media_format format)
 int graph_set_media_config_datapath(struct graph_obj *graph_obj)
 {
     int ret = 0;
-    struct listnode *node = NULL;
     module_info_t *mod = NULL;
     struct session_obj *sess_obj = graph_obj->sess_obj;
 
     if (is_media_config_needed_on_datapath(sess_obj->out_media_config.format)) {
-        list_for_each(node, &graph_obj->tagged_mod_list) {
-            mod = node_to_item(node, module_info_t, list);
-            if (mod->tag == STREAM_INPUT_MEDIA_FORMAT) {
-                ret = mod->configure(mod, graph_obj);
-                if (ret != 0) {
-                    AGM_LOGE("Module configuration for miid %x, mid %x, tag %x, failed:%d\n",
-                              mod->miid, mod->mid, mod->tag, ret);
-                }
+        mod = graph_module_by_tag(graph_obj, STREAM_INPUT_MEDIA_FORMAT);
+        if (mod) {
+            ret = mod->configure(mod, graph_obj);
+            if (ret != 0) {
+                AGM_LOGE("Module configuration for miid %x, mid %x, tag %x, failed:%d\n",
+                          mod->miid, mod->mid, mod->tag, ret);
             }
         }
     } else {
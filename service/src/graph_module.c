@@ -98,6 +98,7 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <string.h>
 #include "gsl_intf.h"
 #include <agm/graph.h>
 #include <agm/graph_module.h>
@@ -117,6 +118,276 @@
 /*qfactor should be set to 23 only for 24_3LE and 24_LE formats*/
 #define GET_Q_FACTOR(format, bit_width) (bit_width - 1)
 
+/*
+ *Hardware endpoint modules are shared by every graph on their device, so
+ *their payloads are kept on the device, where a graph reconfiguring the
+ *endpoint replaces what another one sent. Stream modules keep their own.
+ */
+static struct module_cfg_cache **cfg_cache_head(struct module_info *mod,
+                                                pthread_mutex_t **lock)
+{
+    struct device_cfg_cache *dev_cache;
+
+    if (mod->dev_obj == NULL) {
+        *lock = NULL;
+        return &mod->cfg_cache;
+    }
+    dev_cache = device_get_cfg_cache(mod->dev_obj);
+    *lock = &dev_cache->lock;
+    return &dev_cache->head;
+}
+
+static void cfg_cache_lock(pthread_mutex_t *lock)
+{
+    if (lock)
+        pthread_mutex_lock(lock);
+}
+
+static void cfg_cache_unlock(pthread_mutex_t *lock)
+{
+    if (lock)
+        pthread_mutex_unlock(lock);
+}
+
+static struct module_cfg_cache **cfg_cache_lookup(struct module_cfg_cache **head,
+                                                  uint32_t miid,
+                                                  uint32_t param_id)
+{
+    struct module_cfg_cache **prev;
+
+    for (prev = head; *prev; prev = &(*prev)->next) {
+        if ((*prev)->miid == miid && (*prev)->param_id == param_id)
+            break;
+    }
+    return prev;
+}
+
+/*drops the entries of mod for param_id, or all of them if all is set*/
+static void cfg_cache_drop(struct module_info *mod, uint32_t param_id, bool all)
+{
+    struct module_cfg_cache **prev, *cache;
+    pthread_mutex_t *lock;
+
+    prev = cfg_cache_head(mod, &lock);
+    cfg_cache_lock(lock);
+    while ((cache = *prev) != NULL) {
+        if (cache->miid == mod->miid && (all || cache->param_id == param_id)) {
+            *prev = cache->next;
+            free(cache);
+        } else {
+            prev = &cache->next;
+        }
+    }
+    cfg_cache_unlock(lock);
+}
+
+void graph_module_cfg_cache_free(struct module_info *mod)
+{
+    cfg_cache_drop(mod, 0, true);
+}
+
+void graph_module_cfg_cache_drop(struct module_info *mod, uint32_t param_id)
+{
+    cfg_cache_drop(mod, param_id, false);
+}
+
+/*records the outcome of sending payload to mod, ret being the GSL status*/
+static void cfg_cache_update(struct module_info *mod, uint8_t *payload,
+                             size_t payload_size, int ret)
+{
+    struct apm_module_param_data_t *header =
+                             (struct apm_module_param_data_t *)payload;
+    struct module_cfg_cache **head, **prev, *cache;
+    pthread_mutex_t *lock;
+
+    head = cfg_cache_head(mod, &lock);
+    cfg_cache_lock(lock);
+    prev = cfg_cache_lookup(head, mod->miid, header->param_id);
+    cache = *prev;
+    if (ret != 0) {
+        /*the module state is unknown now, resend next time*/
+        if (cache) {
+            *prev = cache->next;
+            free(cache);
+        }
+        goto done;
+    }
+
+    if (!cache || cache->size != payload_size) {
+        if (cache)
+            *prev = cache->next;
+        free(cache);
+        cache = malloc(sizeof(struct module_cfg_cache) + payload_size);
+        if (!cache)
+            goto done;
+        cache->miid = mod->miid;
+        cache->param_id = header->param_id;
+        cache->size = payload_size;
+        cache->next = *head;
+        *head = cache;
+    }
+    memcpy(cache->payload, payload, payload_size);
+
+done:
+    cfg_cache_unlock(lock);
+}
+
+static int cfg_batch_append(struct graph_cfg_batch *batch,
+                            struct module_info *mod,
+                            uint8_t *payload, size_t payload_size)
+{
+    struct graph_cfg_batch_entry *entry;
+    size_t offset = batch->size, new_size;
+    uint8_t *buf;
+
+    ALIGN_PAYLOAD(offset, 8);
+    new_size = offset + payload_size;
+
+    if (new_size > batch->buf_cap) {
+        size_t cap = batch->buf_cap ? batch->buf_cap : 512;
+
+        while (cap < new_size)
+            cap *= 2;
+        buf = realloc(batch->buf, cap);
+        if (!buf)
+            return -ENOMEM;
+        batch->buf = buf;
+        batch->buf_cap = cap;
+    }
+    if (batch->num_entries == batch->entry_cap) {
+        size_t cap = batch->entry_cap ? batch->entry_cap * 2 : 8;
+
+        entry = realloc(batch->entry, cap * sizeof(*entry));
+        if (!entry)
+            return -ENOMEM;
+        batch->entry = entry;
+        batch->entry_cap = cap;
+    }
+
+    memset(batch->buf + batch->size, 0, offset - batch->size);
+    memcpy(batch->buf + offset, payload, payload_size);
+    entry = &batch->entry[batch->num_entries++];
+    entry->mod = mod;
+    entry->offset = offset;
+    entry->size = payload_size;
+    batch->size = new_size;
+    return 0;
+}
+
+int graph_module_set_custom_config(struct module_info *mod,
+                                   struct graph_obj *graph_obj,
+                                   uint8_t *payload, size_t payload_size)
+{
+    struct apm_module_param_data_t *header =
+                             (struct apm_module_param_data_t *)payload;
+    struct module_cfg_cache **head, *cache;
+    pthread_mutex_t *lock;
+    bool unchanged;
+    int ret = 0;
+
+    head = cfg_cache_head(mod, &lock);
+    cfg_cache_lock(lock);
+    cache = *cfg_cache_lookup(head, mod->miid, header->param_id);
+    unchanged = cache && cache->size == payload_size &&
+                !memcmp(cache->payload, payload, payload_size);
+    cfg_cache_unlock(lock);
+    if (unchanged) {
+        AGM_LOGD("miid %x param %x unchanged, not resent", mod->miid,
+                 header->param_id);
+        return 0;
+    }
+
+    /*on allocation failure just send it on its own*/
+    if (graph_obj->cfg_batch.active &&
+        !cfg_batch_append(&graph_obj->cfg_batch, mod, payload, payload_size))
+        return 0;
+
+    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    cfg_cache_update(mod, payload, payload_size, ret);
+    return ret;
+}
+
+void graph_module_cfg_batch_begin(struct graph_obj *graph_obj)
+{
+    struct graph_cfg_batch *batch = &graph_obj->cfg_batch;
+
+    batch->size = 0;
+    batch->num_entries = 0;
+    batch->active = true;
+}
+
+int graph_module_cfg_batch_flush(struct graph_obj *graph_obj)
+{
+    struct graph_cfg_batch *batch = &graph_obj->cfg_batch;
+    struct graph_cfg_batch_entry *entry;
+    size_t i, num_entries = batch->num_entries, size = batch->size;
+    int ret = 0;
+
+    if (num_entries == 0)
+        return 0;
+
+    batch->size = 0;
+    batch->num_entries = 0;
+
+    /*
+     *APM takes any number of param data blocks in one command; only when
+     *that fails are the blocks resent one by one to isolate the failure.
+     */
+    if (num_entries > 1) {
+        ret = gsl_set_custom_config(graph_obj->graph_handle, batch->buf, size);
+        if (ret == 0) {
+            for (i = 0; i < num_entries; i++) {
+                entry = &batch->entry[i];
+                cfg_cache_update(entry->mod, batch->buf + entry->offset,
+                                 entry->size, 0);
+            }
+            AGM_LOGD("%zu module params sent in one command", num_entries);
+            return 0;
+        }
+        AGM_LOGE("batched config of %zu params failed %d, resending singly",
+                 num_entries, ret);
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        entry = &batch->entry[i];
+        ret = gsl_set_custom_config(graph_obj->graph_handle,
+                                    batch->buf + entry->offset, entry->size);
+        cfg_cache_update(entry->mod, batch->buf + entry->offset,
+                         entry->size, ret);
+        if (ret != 0) {
+            AGM_LOGE("config of miid %x, mid %x, tag %x failed %d",
+                     entry->mod->miid, entry->mod->mid, entry->mod->tag, ret);
+            break;
+        }
+    }
+    /*anything not sent has to be configured again on the next prepare*/
+    for (; i < num_entries; i++)
+        batch->entry[i].mod->is_configured = false;
+
+    return ret;
+}
+
+void graph_module_cfg_batch_end(struct graph_obj *graph_obj)
+{
+    struct graph_cfg_batch *batch = &graph_obj->cfg_batch;
+    size_t i;
+
+    for (i = 0; i < batch->num_entries; i++)
+        batch->entry[i].mod->is_configured = false;
+    batch->size = 0;
+    batch->num_entries = 0;
+    batch->active = false;
+}
+
+void graph_module_cfg_batch_free(struct graph_obj *graph_obj)
+{
+    struct graph_cfg_batch *batch = &graph_obj->cfg_batch;
+
+    free(batch->buf);
+    free(batch->entry);
+    memset(batch, 0, sizeof(*batch));
+}
+
 static void get_default_channel_map(uint8_t *channel_map, int channels)
 {
     switch (channels) {
@@ -313,7 +584,7 @@ static int configure_codec_dma_ep(struct module_info *mod,
               codec_config->lpaif_type, codec_config->intf_indx,
               codec_config->active_channels_mask);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_sz);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_sz);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config for module %d failed with error %d",
@@ -404,7 +675,7 @@ static int configure_i2s_ep(struct module_info *mod,
               i2s_config->lpaif_type, i2s_config->intf_idx,
               i2s_config->sd_line_idx, i2s_config->ws_src);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_sz);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_sz);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config for module %d failed with error %d",
@@ -499,7 +770,7 @@ static int configure_tdm_ep(struct module_info *mod,
     AGM_LOGV("inv_sync_pulse %d sync_data_delay %d",
              tdm_config->ctrl_invert_sync_pulse, tdm_config->ctrl_sync_data_delay);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_sz);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_sz);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config for module %d failed with error %d",
@@ -587,7 +858,7 @@ static int configure_aux_pcm_ep(struct module_info *mod,
              aux_pcm_cfg->slot_mask, aux_pcm_cfg->frame_setting,
              aux_pcm_cfg->aux_mode);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_sz);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_sz);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config for module %d failed with error %d",
@@ -665,7 +936,7 @@ static int configure_slimbus_ep(struct module_info *mod,
         AGM_LOGV("shared_chnl_mapping[%d] = 0x%x\n", i, slimbus_cfg->shared_channel_mapping[i]);
     }
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_sz);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_sz);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config for module %d failed with error %d",
@@ -726,7 +997,7 @@ int configure_hw_ep_media_config(struct module_info *mod,
                     hw_ep_media_conf->bit_width, media_config.channels,
                     media_config.data_format);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config command for module %d failed with error %d",
@@ -938,7 +1209,7 @@ int configure_output_media_format(struct module_info *mod,
      */
     get_default_channel_map(channel_map, num_channels);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config command for module %d failed with error %d",
@@ -980,7 +1251,7 @@ static int configure_pcm_encoder_frame_size(struct module_info *mod,
     frame_size_payload->frame_size_type = 1; /* frame_size_in_samples */
     frame_size_payload->frame_size_in_samples = frame_size_samples;
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("pcm encoder frame size config for module %d failed with error %d",
@@ -1273,8 +1544,14 @@ int configure_placeholder_dec(struct module_info *mod,
 
     AGM_LOGD("Placeholder mod TKV key:%0x value: %0x", tkv.kvp->key,
              tkv.kvp->value);
-    ret = gsl_set_config(graph_obj->graph_handle, (struct gsl_key_vector *)mod->gkv,
-                         TAG_STREAM_PLACEHOLDER_DECODER, &tkv);
+    /*params batched so far must reach SPF before the placeholder is replaced*/
+    ret = graph_module_cfg_batch_flush(graph_obj);
+    if (ret == 0)
+        ret = gsl_set_config(graph_obj->graph_handle, (struct gsl_key_vector *)mod->gkv,
+                             TAG_STREAM_PLACEHOLDER_DECODER, &tkv);
+    /*the module was replaced, nothing sent to the old one holds*/
+    if (ret == 0)
+        graph_module_cfg_cache_free(mod);
 
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
@@ -1357,7 +1634,7 @@ int configure_encoder_output_media_format(struct module_info *mod,
     header->error_code = 0x0;
     header->param_size = sizeof(struct param_id_encoder_output_config_t);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE(
@@ -1411,7 +1688,7 @@ int configure_encoder_output_media_format(struct module_info *mod,
     header->error_code = 0x0;
     header->param_size = sizeof(struct param_id_enc_bitrate_param_t);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE(
@@ -1487,8 +1764,14 @@ int configure_placeholder_enc(struct module_info *mod,
 
     AGM_LOGD("Placeholder mod TKV key:%0x value: %0x", tkv.kvp->key,
              tkv.kvp->value);
-    ret = gsl_set_config(graph_obj->graph_handle, (struct gsl_key_vector *)mod->gkv,
-                         TAG_STREAM_PLACEHOLDER_ENCODER, &tkv);
+    /*params batched so far must reach SPF before the placeholder is replaced*/
+    ret = graph_module_cfg_batch_flush(graph_obj);
+    if (ret == 0)
+        ret = gsl_set_config(graph_obj->graph_handle, (struct gsl_key_vector *)mod->gkv,
+                             TAG_STREAM_PLACEHOLDER_ENCODER, &tkv);
+    /*the module was replaced, nothing sent to the old one holds*/
+    if (ret == 0)
+        graph_module_cfg_cache_free(mod);
 
     if (tkv.kvp)
         free(tkv.kvp);
@@ -1567,7 +1850,7 @@ int configure_compress_shared_mem_ep(struct module_info *mod,
         goto free_payload;
     }
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config command for module %d failed with error %d",
@@ -1723,7 +2006,7 @@ int configure_pcm_shared_mem_ep(struct module_info *mod,
      */
     get_default_channel_map(channel_map, num_channels);
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config command for module %d failed with error %d",
@@ -1836,7 +2119,7 @@ int configure_rd_shared_mem_ep(struct module_info *mod,
     }
 
 
-    ret = gsl_set_custom_config(graph_obj->graph_handle, payload, payload_size);
+    ret = graph_module_set_custom_config(mod, graph_obj, payload, payload_size);
     if (ret != 0) {
         ret = ar_err_get_lnx_err_code(ret);
         AGM_LOGE("custom_config command for module %d failed with error %d",
@@ -1952,11 +2235,13 @@ module_info_t stream_module_list[] = {
         .module = MODULE_PCM_ENCODER,
         .tag = STREAM_PCM_ENCODER,
         .configure = configure_pcm_encoder_params,
+        .reconfigure = true,
     },
     {
         .module = MODULE_PCM_DECODER,
         .tag = STREAM_PCM_DECODER,
         .configure = configure_output_media_format,
+        .reconfigure = true,
     },
     {
         .module = MODULE_PLACEHOLDER_ENCODER,
@@ -1972,11 +2257,13 @@ module_info_t stream_module_list[] = {
         .module = MODULE_PCM_CONVERTER,
         .tag = STREAM_PCM_CONVERTER,
         .configure = configure_output_media_format,
+        .reconfigure = true,
     },
     {
         .module = MODULE_WR_SHARED_MEM,
         .tag = STREAM_INPUT_MEDIA_FORMAT,
         .configure = configure_wr_shared_mem_ep,
+        .reconfigure = true,
     },
     {
         .module = MODULE_STREAM_PAUSE,
@@ -1997,6 +2284,7 @@ module_info_t stream_module_list[] = {
         .module = MODULE_RD_SHARED_MEM,
         .tag = RD_SHMEM_ENDPOINT,
         .configure = configure_rd_shared_mem_ep,
+        .reconfigure = true,
     },
 };
 
@@ -2005,11 +2293,13 @@ module_info_t hw_ep_module[] = {
         .module = MODULE_HW_EP_RX,
         .tag = DEVICE_HW_ENDPOINT_RX,
         .configure = configure_hw_ep,
+        .reconfigure = true,
     },
     {
         .module = MODULE_HW_EP_TX,
         .tag = DEVICE_HW_ENDPOINT_TX,
         .configure = configure_hw_ep,
+        .reconfigure = true,
     }
 };
 
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include <agm/metadata.h>
 #include <agm/utils.h>
@@ -73,6 +74,24 @@
 
 #define MAX_KVPAIR_PROPS 48
 
+static atomic_uint metadata_gen_counter;
+
+/*
+ * Generations are unique across all metadata objects, so users caching
+ * something derived from metadata can tell whether any input changed by
+ * comparing generations alone.
+ */
+static uint32_t metadata_next_gen()
+{
+    uint32_t gen;
+
+    do {
+        gen = atomic_fetch_add(&metadata_gen_counter, 1) + 1;
+    } while (gen == 0);
+
+    return gen;
+}
+
 void metadata_print(struct agm_meta_data_gsl* metadata)
 {
     int i, count = metadata->gkv.num_kvs;
@@ -104,66 +123,87 @@ void metadata_print(struct agm_meta_data_gsl* metadata)
 
 }
 
-static void metadata_remove_dup(
-       struct agm_meta_data_gsl* meta_data) {
+/*
+ * Open-addressed index over the keys of a key vector (or over property
+ * values), mapping a key to the position of its first occurrence. Metadata
+ * vectors are capped at MAX_KVPAIR_PROPS entries, so a fixed table of more
+ * than twice that size keeps probe sequences short.
+ */
+#define KV_INDEX_BITS 7
+#define KV_INDEX_SIZE (1 << KV_INDEX_BITS)
+#define KV_INDEX_EMPTY -1
 
-    int i, j, k, count;
+struct kv_index {
+    uint32_t keys[KV_INDEX_SIZE];
+    int16_t pos[KV_INDEX_SIZE];
+};
 
-    //remove duplicate gkvs
-    count = meta_data->gkv.num_kvs;
-    for (i = 0; i < count; i++) {
-        for (j = i + 1; j < count; j++) {
-            if (meta_data->gkv.kv[i].key == meta_data->gkv.kv[j].key) {
-                for (k = j; k < count-1; k++) {
-                    meta_data->gkv.kv[k].key = meta_data->gkv.kv[k + 1].key;
-                    meta_data->gkv.kv[k].value = meta_data->gkv.kv[k + 1].value;
-                }
-                count--;
-                j--;
-            }
-        }
-    }
-    meta_data->gkv.num_kvs = count;
+static void kv_index_init(struct kv_index *idx)
+{
+    memset(idx->pos, 0xff, sizeof(idx->pos));
+}
 
-    //remove duplicate ckvs
-    count = meta_data->ckv.num_kvs;
-    for (i = 0; i < count; i++) {
-        for (j = i + 1; j < count; j++) {
-            if (meta_data->ckv.kv[i].key == meta_data->ckv.kv[j].key) {
-                for (k = j; k < count-1; k++) {
-                    meta_data->ckv.kv[k].key = meta_data->ckv.kv[k + 1].key;
-                    meta_data->ckv.kv[k].value = meta_data->ckv.kv[k + 1].value;
-                }
-                count--;
-                j--;
-            }
-        }
-    }
-    meta_data->ckv.num_kvs = count;
+/* returns the slot holding key, or the empty slot it would be added at */
+static uint32_t kv_index_slot(struct kv_index *idx, uint32_t key)
+{
+    uint32_t slot = (key * 2654435761u) >> (32 - KV_INDEX_BITS);
 
-    //remove duplicate props
-    count = meta_data->sg_props.num_values;
-    for (i = 0; i < count; i++) {
-        for (j = i + 1; j < count; j++) {
-            if (meta_data->sg_props.values[i] == meta_data->sg_props.values[j]) {
-                for (k = j; k < count-1; k++) {
-                    meta_data->sg_props.values[k] =
-                        meta_data->sg_props.values[k+1];
-                }
-                count--;
-                j--;
-            }
-        }
+    while (idx->pos[slot] != KV_INDEX_EMPTY && idx->keys[slot] != key)
+        slot = (slot + 1) & (KV_INDEX_SIZE - 1);
+
+    return slot;
+}
+
+/*
+ * Adds key at position pos unless it is already present. Returns true if
+ * the key was added.
+ */
+static bool kv_index_add(struct kv_index *idx, uint32_t key, int pos)
+{
+    uint32_t slot = kv_index_slot(idx, key);
+
+    if (idx->pos[slot] != KV_INDEX_EMPTY)
+        return false;
+
+    idx->keys[slot] = key;
+    idx->pos[slot] = pos;
+
+    return true;
+}
+
+/* appends the key values of src whose keys are not in dst yet */
+static void kv_append_unique(struct kv_index *idx,
+                             struct agm_key_vector_gsl *dst,
+                             const struct agm_key_value *src, size_t num)
+{
+    size_t i;
+
+    for (i = 0; i < num; i++) {
+        if (kv_index_add(idx, src[i].key, dst->num_kvs))
+            dst->kv[dst->num_kvs++] = src[i];
     }
-    meta_data->sg_props.num_values = count;
+}
 
-    //metadata_print(meta_data);
+/* appends the values of src which are not in dst yet */
+static void props_append_unique(struct kv_index *idx, struct sg_prop *dst,
+                                const uint32_t *src, uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+        if (kv_index_add(idx, src[i], dst->num_values))
+            dst->values[dst->num_values++] = src[i];
+    }
 }
 
 void metadata_update_cal(struct agm_meta_data_gsl *meta_data,
                                      struct agm_key_vector_gsl *ckv)
 {
-    int i, j;
+    struct kv_index idx;
+    int16_t next[MAX_KVPAIR_PROPS];
+    uint32_t slot;
+    int i, pos;
+    bool changed = false;
 
     if (!meta_data || !ckv) {
         AGM_LOGE("Invalid params\n");
@@ -180,119 +220,132 @@ void metadata_update_cal(struct agm_meta_data_gsl *meta_data,
                                     ckv->num_kvs);
         return;
     }
+    if (meta_data->ckv.num_kvs > MAX_KVPAIR_PROPS) {
+        AGM_LOGE("Num CKVs %d more than expected: %d",
+                                    meta_data->ckv.num_kvs, MAX_KVPAIR_PROPS);
+        return;
+    }
 
-    for (i = 0; i < meta_data->ckv.num_kvs; i++) {
-        for (j = 0; j < ckv->num_kvs; j++) {
-            if (meta_data->ckv.kv[i].key == ckv->kv[j].key) {
-                meta_data->ckv.kv[i].value = ckv->kv[j].value;
+    /*
+     * Index the CKVs being updated, chaining repeated keys through next[]
+     * so that every occurrence of a key gets the new value.
+     */
+    kv_index_init(&idx);
+    for (i = meta_data->ckv.num_kvs - 1; i >= 0; i--) {
+        slot = kv_index_slot(&idx, meta_data->ckv.kv[i].key);
+        next[i] = idx.pos[slot];
+        idx.keys[slot] = meta_data->ckv.kv[i].key;
+        idx.pos[slot] = i;
+    }
+
+    /* a later entry in ckv overrides an earlier one with the same key */
+    for (i = 0; i < ckv->num_kvs; i++) {
+        slot = kv_index_slot(&idx, ckv->kv[i].key);
+        for (pos = idx.pos[slot]; pos != KV_INDEX_EMPTY; pos = next[pos]) {
+            if (meta_data->ckv.kv[pos].value != ckv->kv[i].value) {
+                meta_data->ckv.kv[pos].value = ckv->kv[i].value;
+                changed = true;
             }
         }
     }
+
+    if (changed)
+        meta_data->gen = metadata_next_gen();
 }
 
 struct agm_meta_data_gsl* metadata_merge(int num, ...)
 {
-    struct agm_key_value *gkv_offset;
-    struct agm_key_value *ckv_offset;
-    uint32_t *prop_offset;
+    struct kv_index gkv_idx, ckv_idx, prop_idx;
     struct agm_meta_data_gsl *temp, *merged = NULL;
+    size_t num_gkv = 0, num_ckv = 0, num_props = 0;
 
     va_list valist;
     int i = 0;
 
 
-    merged = calloc(1, sizeof(struct agm_meta_data_gsl));
-    if (!merged) {
-        AGM_LOGE("No memory to create merged metadata\n");
-        return NULL;
-    }
-
-
     va_start(valist, num);
     for (i = 0; i < num; i++) {
         temp = va_arg(valist, struct agm_meta_data_gsl*);
         if (temp) {
-            merged->gkv.num_kvs += temp->gkv.num_kvs;
-            merged->ckv.num_kvs += temp->ckv.num_kvs;
-            merged->sg_props.num_values += temp->sg_props.num_values;
+            num_gkv += temp->gkv.num_kvs;
+            num_ckv += temp->ckv.num_kvs;
+            num_props += temp->sg_props.num_values;
         }
     }
     va_end(valist);
 
-    if ((merged->gkv.num_kvs > MAX_KVPAIR_PROPS) || (merged->ckv.num_kvs > MAX_KVPAIR_PROPS)
-                                             || (merged->sg_props.num_values > MAX_KVPAIR_PROPS)) {
-        AGM_LOGE("Num GKVs %d Num CKVs %d Num Props %d more than expected: %d", merged->gkv.num_kvs,
-                                merged->ckv.num_kvs, merged->sg_props.num_values, MAX_KVPAIR_PROPS);
-        free(merged);
-        return NULL;
-    }
-
-    merged->gkv.kv = calloc(merged->gkv.num_kvs, sizeof(struct agm_key_value));
-    if (!merged->gkv.kv) {
-        AGM_LOGE("No memory to merge gkv\n");
-        free(merged);
-        return NULL;
-    }
-
-    merged->ckv.kv = calloc(merged->ckv.num_kvs, sizeof(struct agm_key_value));
-    if (!merged->ckv.kv) {
-        AGM_LOGE("No memory to merge ckv\n");
-        free(merged->gkv.kv);
-        free(merged);
+    if ((num_gkv > MAX_KVPAIR_PROPS) || (num_ckv > MAX_KVPAIR_PROPS)
+                                     || (num_props > MAX_KVPAIR_PROPS)) {
+        AGM_LOGE("Num GKVs %d Num CKVs %d Num Props %d more than expected: %d",
+                 num_gkv, num_ckv, num_props, MAX_KVPAIR_PROPS);
         return NULL;
     }
 
-    merged->sg_props.values = calloc(merged->sg_props.num_values,
-                                               sizeof(uint32_t));
-    if (!merged->sg_props.values) {
-        AGM_LOGE("No memory to merge properties\n");
-        free(merged->gkv.kv);
-        free(merged->ckv.kv);
-        free(merged);
+    /*
+     * The container and all its arrays are one allocation, so a merged
+     * object is released with metadata_free() followed by free() as before,
+     * and metadata_free() has nothing separate to release.
+     */
+    merged = calloc(1, sizeof(struct agm_meta_data_gsl) +
+                       (num_gkv + num_ckv) * sizeof(struct agm_key_value) +
+                       num_props * sizeof(uint32_t));
+    if (!merged) {
+        AGM_LOGE("No memory to create merged metadata\n");
         return NULL;
     }
+    merged->gkv.kv = (struct agm_key_value *)(merged + 1);
+    merged->ckv.kv = merged->gkv.kv + num_gkv;
+    merged->sg_props.values = (uint32_t *)(merged->ckv.kv + num_ckv);
 
-    gkv_offset = merged->gkv.kv;
-    ckv_offset = merged->ckv.kv;
-    prop_offset = merged->sg_props.values;
+    /*
+     * Entries are appended in argument order and a key (or property value)
+     * seen before is skipped, so the first occurrence wins and keeps its
+     * position.
+     */
+    kv_index_init(&gkv_idx);
+    kv_index_init(&ckv_idx);
+    kv_index_init(&prop_idx);
 
     va_start(valist, num);
     for (i = 0; i < num; i++) {
         temp = va_arg(valist, struct agm_meta_data_gsl*);
         if (temp) {
-            if (temp->gkv.kv) {
-                memcpy(gkv_offset, temp->gkv.kv, temp->gkv.num_kvs *
-                                      sizeof(struct agm_key_value));
-                gkv_offset += temp->gkv.num_kvs;
-            }
+            if (temp->gkv.kv)
+                kv_append_unique(&gkv_idx, &merged->gkv, temp->gkv.kv,
+                                 temp->gkv.num_kvs);
 
-            if (temp->ckv.kv) {
-                memcpy(ckv_offset, temp->ckv.kv, temp->ckv.num_kvs *
-                                      sizeof(struct agm_key_value));
-                ckv_offset += temp->ckv.num_kvs;
-            }
+            if (temp->ckv.kv)
+                kv_append_unique(&ckv_idx, &merged->ckv, temp->ckv.kv,
+                                 temp->ckv.num_kvs);
 
             if (temp->sg_props.values) {
                 merged->sg_props.prop_id = temp->sg_props.prop_id;
-                memcpy(prop_offset, temp->sg_props.values,
-                       temp->sg_props.num_values * sizeof(uint32_t));
-                prop_offset += temp->sg_props.num_values;
+                props_append_unique(&prop_idx, &merged->sg_props,
+                                    temp->sg_props.values,
+                                    temp->sg_props.num_values);
             }
         }
     }
     va_end(valist);
     //metadata_print(merged);
-    metadata_remove_dup(merged);
 
     return merged;
 }
 
+/*
+ * The key vectors and properties in the payload are already laid out as
+ * arrays, so stored metadata keeps a single copy of the payload and points
+ * gkv, ckv and sg_props into it.
+ */
 int metadata_copy(struct agm_meta_data_gsl *dest, uint32_t size,
                                               uint8_t *metadata)
 {
 
     int ret = 0;
-    int min_req_len = 0;
+    size_t min_req_len = 0;
+    size_t ckv_offset = 0, props_offset = 0;
+    uint32_t num_gkv, num_ckv = 0, num_props = 0, prop_id = 0;
+    uint8_t *buf = NULL;
 
     if (!metadata) {
         AGM_LOGI("NULL metadata passed, ignoring\n");
@@ -307,90 +360,86 @@ int metadata_copy(struct agm_meta_data_gsl *dest, uint32_t size,
 
     }
 
-    dest->gkv.num_kvs = NUM_GKV(metadata);
-    if (dest->gkv.num_kvs > MAX_KVPAIR_PROPS) {
-        AGM_LOGE("Num GKVs %d more than expected: %d",dest->gkv.num_kvs, MAX_KVPAIR_PROPS);
+    num_gkv = NUM_GKV(metadata);
+    if (num_gkv > MAX_KVPAIR_PROPS) {
+        AGM_LOGE("Num GKVs %d more than expected: %d", num_gkv, MAX_KVPAIR_PROPS);
         ret = -EINVAL;
-        goto free_metadata;
-    }
-    dest->gkv.kv =  calloc(dest->gkv.num_kvs, sizeof(struct agm_key_value));
-    if (!dest->gkv.kv) {
-        AGM_LOGE("Memory allocation failed to copy GKV\n");
-        ret = -ENOMEM;
-        goto free_metadata;
+        goto done;
     }
 
-    min_req_len += (dest->gkv.num_kvs * sizeof(struct agm_key_value));
+    min_req_len += (num_gkv * sizeof(struct agm_key_value));
     if (size < min_req_len) {
         AGM_LOGE("Invalid GKV passed\n");
         ret = -EINVAL;
-        goto free_metadata;
+        goto done;
     }
-    memcpy(dest->gkv.kv, PTR_TO_GKV(metadata), dest->gkv.num_kvs *
-                                    sizeof(struct agm_key_value));
+
+    if (size < min_req_len + sizeof(uint32_t))
+        goto copy;
 
     min_req_len += sizeof(uint32_t);
-    if (size < min_req_len) {
-        goto done;
-    }
-    dest->ckv.num_kvs = NUM_CKV(metadata);
-    if (dest->ckv.num_kvs > MAX_KVPAIR_PROPS) {
-        AGM_LOGE("Num CKVs %d more than expected: %d",dest->ckv.num_kvs, MAX_KVPAIR_PROPS);
+    num_ckv = NUM_CKV(metadata);
+    if (num_ckv > MAX_KVPAIR_PROPS) {
+        AGM_LOGE("Num CKVs %d more than expected: %d", num_ckv, MAX_KVPAIR_PROPS);
         ret = -EINVAL;
-        goto free_metadata;
-    }
-    dest->ckv.kv =  calloc(dest->ckv.num_kvs, sizeof(struct agm_key_value));
-    if (!dest->ckv.kv) {
-        AGM_LOGE("Memory allocation failed to copy CKV\n");
-        ret = -ENOMEM;
-        goto free_metadata;
+        goto done;
     }
-    min_req_len += (dest->ckv.num_kvs * sizeof(struct agm_key_value));
+    ckv_offset = min_req_len;
+    min_req_len += (num_ckv * sizeof(struct agm_key_value));
     if (size < min_req_len) {
         AGM_LOGE("Invalid CKV passed\n");
         ret = -EINVAL;
-        goto free_metadata;
+        goto done;
     }
-    memcpy(dest->ckv.kv, PTR_TO_CKV(metadata), dest->ckv.num_kvs *
-                                    sizeof(struct agm_key_value));
+
+    if (size < min_req_len + sizeof(uint32_t))
+        goto copy;
 
     min_req_len += sizeof(uint32_t);
-    if (size < min_req_len) {
-        goto done;
-    }
-    dest->sg_props.prop_id = PROP_ID(metadata);
+    prop_id = PROP_ID(metadata);
 
     min_req_len += sizeof(uint32_t);
     if (size < min_req_len) {
         AGM_LOGE("Invalid properties passed\n");
         ret = -EINVAL;
-        goto free_metadata;
+        goto done;
     }
-    dest->sg_props.num_values = NUM_PROPS(metadata);
-    if (dest->sg_props.num_values > MAX_KVPAIR_PROPS) {
-        AGM_LOGE("Num Props %d more than expected: %d",dest->sg_props.num_values, MAX_KVPAIR_PROPS);
+    num_props = NUM_PROPS(metadata);
+    if (num_props > MAX_KVPAIR_PROPS) {
+        AGM_LOGE("Num Props %d more than expected: %d", num_props, MAX_KVPAIR_PROPS);
         ret = -EINVAL;
-        goto free_metadata;
-    }
-
-    dest->sg_props.values =  calloc(dest->sg_props.num_values, sizeof(uint32_t));
-    if (!dest->sg_props.values) {
-        AGM_LOGE("Memory allocation failed to copy properties\n");
-        ret = -ENOMEM;
-        goto free_metadata;
+        goto done;
     }
-    min_req_len += (dest->sg_props.num_values * sizeof(uint32_t));
+    props_offset = min_req_len;
+    min_req_len += (num_props * sizeof(uint32_t));
     if (size < min_req_len) {
         AGM_LOGE("Invalid properties passed\n");
         ret = -EINVAL;
-        goto free_metadata;
+        goto done;
     }
-    memcpy(dest->sg_props.values, PTR_TO_PROPS(metadata),
-           dest->sg_props.num_values * sizeof(uint32_t));
-    goto done;
 
-free_metadata:
-    metadata_free(dest);
+copy:
+    buf = malloc(min_req_len);
+    if (!buf) {
+        AGM_LOGE("Memory allocation failed to copy metadata\n");
+        ret = -ENOMEM;
+        goto done;
+    }
+    memcpy(buf, metadata, min_req_len);
+
+    dest->buf = buf;
+    dest->gkv.num_kvs = num_gkv;
+    dest->gkv.kv = (struct agm_key_value *)PTR_TO_GKV(buf);
+    if (ckv_offset) {
+        dest->ckv.num_kvs = num_ckv;
+        dest->ckv.kv = (struct agm_key_value *)(buf + ckv_offset);
+    }
+    if (props_offset) {
+        dest->sg_props.prop_id = prop_id;
+        dest->sg_props.num_values = num_props;
+        dest->sg_props.values = (uint32_t *)(buf + props_offset);
+    }
+    dest->gen = metadata_next_gen();
 
 done:
     return ret;
@@ -400,18 +449,7 @@ done:
 void metadata_free(struct agm_meta_data_gsl *metadata)
 {
     if (metadata) {
-        if (metadata->ckv.kv)
-            free(metadata->ckv.kv);
-        metadata->ckv.kv = NULL;
-
-        if (metadata->gkv.kv)
-            free(metadata->gkv.kv);
-        metadata->gkv.kv = NULL;
-
-        if (metadata->sg_props.values)
-            free(metadata->sg_props.values);
-        metadata->sg_props.values = NULL;
-
+        free(metadata->buf);
         memset(metadata, 0, sizeof(struct agm_meta_data_gsl));
     }
 }
@@ -33,7 +33,9 @@
 #define LOG_TAG "AGM: session"
 
 #include <malloc.h>
+#include <sched.h>
 #include <string.h>
+#include <time.h>
 #include <agm/session_obj.h>
 #include <agm/utils.h>
 
@@ -49,7 +51,11 @@
 static int session_close(struct session_obj *sess_obj);
 static int session_set_loopback(struct session_obj *sess_obj,
                            uint32_t session_id, bool enable);
-static pthread_mutex_t hwep_lock;
+static void session_async_stop(struct session_obj *sess_obj);
+static int session_event_dispatch_start();
+static void session_event_dispatch_stop();
+static void session_event_queue_init(struct session_event_queue *queue);
+static void session_event_queue_deinit(struct session_event_queue *queue);
 static struct aif *aif_obj_get_from_pool(struct session_obj *sess_obj,
                                       uint32_t aif)
 {
@@ -141,44 +147,140 @@ uint32_t aif_obj_get_count_with_state(struct session_obj *sess_obj,
     return count;
 }
 
-static struct agm_meta_data_gsl* session_get_merged_metadata(struct session_obj *sess_obj)
+static void merged_meta_release(struct agm_meta_data_gsl **meta)
+{
+    if (*meta) {
+        metadata_free(*meta);
+        free(*meta);
+        *meta = NULL;
+    }
+}
+
+/*
+ * Returns sess_meta (if any) + sess_aif + device metadata of an aif. The
+ * result is owned by the cache and must not be freed by the caller.
+ * Called with sess_obj->lock held.
+ */
+static struct agm_meta_data_gsl *merged_meta_cache_get(
+                        struct merged_meta_cache *cache,
+                        struct agm_meta_data_gsl *sess_meta,
+                        struct aif *aif_obj)
+{
+    struct device_obj *dev_obj = aif_obj->dev_obj;
+    uint32_t sess_gen = sess_meta ? sess_meta->gen : 0;
+
+    pthread_mutex_lock(&dev_obj->lock);
+    if (!cache->meta || cache->sess_gen != sess_gen ||
+        cache->aif_gen != aif_obj->sess_aif_meta.gen ||
+        cache->dev_gen != dev_obj->metadata.gen) {
+        merged_meta_release(&cache->meta);
+        cache->meta = metadata_merge(3, sess_meta, &aif_obj->sess_aif_meta,
+                                     &dev_obj->metadata);
+        cache->sess_gen = sess_gen;
+        cache->aif_gen = aif_obj->sess_aif_meta.gen;
+        cache->dev_gen = dev_obj->metadata.gen;
+    }
+    pthread_mutex_unlock(&dev_obj->lock);
+
+    return cache->meta;
+}
+
+static struct agm_meta_data_gsl *session_get_aif_merged_metadata(
+                        struct session_obj *sess_obj, struct aif *aif_obj)
+{
+    return merged_meta_cache_get(&aif_obj->merged_meta, &sess_obj->sess_meta,
+                                 aif_obj);
+}
+
+static struct agm_meta_data_gsl *session_get_aif_dev_merged_metadata(
+                        struct aif *aif_obj)
+{
+    return merged_meta_cache_get(&aif_obj->merged_aif_dev_meta, NULL, aif_obj);
+}
+
+static void merged_meta_cache_free(struct merged_meta_cache *cache)
+{
+    merged_meta_release(&cache->meta);
+}
+
+static void session_meta_cache_free(struct session_meta_cache *cache)
+{
+    merged_meta_release(&cache->meta);
+    free(cache->inputs);
+    cache->inputs = NULL;
+    cache->num_inputs = 0;
+    cache->max_inputs = 0;
+}
+
+static uint32_t aif_dev_meta_gen(struct aif *aif_obj)
+{
+    uint32_t gen;
+
+    pthread_mutex_lock(&aif_obj->dev_obj->lock);
+    gen = aif_obj->dev_obj->metadata.gen;
+    pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+
+    return gen;
+}
+
+static bool session_meta_cache_valid(struct session_obj *sess_obj,
+                        struct session_meta_cache *cache, bool with_dev)
 {
-    struct agm_meta_data_gsl *merged = NULL;
-    struct agm_meta_data_gsl *temp = NULL;
-    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
     struct listnode *node;
     struct aif *aif_node;
+    struct merged_meta_input *input;
+    uint32_t i = 0;
 
-    if (sess_mode != AGM_SESSION_NON_TUNNEL) {
-        list_for_each(node, &sess_obj->aif_pool) {
-            aif_node = node_to_item(node, struct aif, node);
-            if (aif_node->state == AIF_CLOSED) {
-                AGM_LOGD("ignore closed AIF node");
-                continue;
-            }
-            pthread_mutex_lock(&aif_node->dev_obj->lock);
-            merged = metadata_merge(4, temp, &sess_obj->sess_meta,
-                           &aif_node->sess_aif_meta, &aif_node->dev_obj->metadata);
-            pthread_mutex_unlock(&aif_node->dev_obj->lock);
-            if (temp) {
-                metadata_free(temp);
-                free(temp);
-            }
-            temp = merged;
-        }
-    } else {
-        merged = &sess_obj->sess_meta;
+    if (!cache->meta || cache->sess_gen != sess_obj->sess_meta.gen)
+        return false;
+
+    list_for_each(node, &sess_obj->aif_pool) {
+        aif_node = node_to_item(node, struct aif, node);
+        if (aif_node->state == AIF_CLOSED)
+            continue;
+        if (i >= cache->num_inputs)
+            return false;
+        input = &cache->inputs[i++];
+        if (input->aif_id != aif_node->aif_id ||
+            input->aif_gen != aif_node->sess_aif_meta.gen ||
+            (with_dev && input->dev_gen != aif_dev_meta_gen(aif_node)))
+            return false;
     }
 
-    return merged;
+    return i == cache->num_inputs;
 }
 
-static struct agm_meta_data_gsl* session_get_merged_metadata_without_aif(struct session_obj *sess_obj)
+/*
+ * Merges session metadata with the metadata of every connected aif and,
+ * if with_dev is set, their devices. When a cache is passed in, the inputs
+ * used for the merge are recorded in it.
+ */
+static struct agm_meta_data_gsl *session_build_merged_metadata(
+                        struct session_obj *sess_obj, bool with_dev,
+                        struct session_meta_cache *cache)
 {
     struct agm_meta_data_gsl *merged = NULL;
     struct agm_meta_data_gsl *temp = NULL;
+    struct merged_meta_input *inputs;
     struct listnode *node;
     struct aif *aif_node;
+    uint32_t count = 0;
+
+    if (cache) {
+        list_for_each(node, &sess_obj->aif_pool)
+            count++;
+        if (count > cache->max_inputs) {
+            inputs = realloc(cache->inputs, count * sizeof(*inputs));
+            if (!inputs) {
+                AGM_LOGE("No memory to track merged metadata inputs\n");
+                return NULL;
+            }
+            cache->inputs = inputs;
+            cache->max_inputs = count;
+        }
+        cache->num_inputs = 0;
+        cache->sess_gen = sess_obj->sess_meta.gen;
+    }
 
     list_for_each(node, &sess_obj->aif_pool) {
         aif_node = node_to_item(node, struct aif, node);
@@ -186,21 +288,75 @@ static struct agm_meta_data_gsl* session_get_merged_metadata_without_aif(struct
             AGM_LOGD("ignore closed AIF node");
             continue;
         }
-        merged = metadata_merge(3, temp, &sess_obj->sess_meta,
-                                    &aif_node->sess_aif_meta);
+        if (with_dev) {
+            pthread_mutex_lock(&aif_node->dev_obj->lock);
+            merged = metadata_merge(4, temp, &sess_obj->sess_meta,
+                           &aif_node->sess_aif_meta, &aif_node->dev_obj->metadata);
+            if (cache)
+                cache->inputs[cache->num_inputs].dev_gen =
+                                          aif_node->dev_obj->metadata.gen;
+            pthread_mutex_unlock(&aif_node->dev_obj->lock);
+        } else {
+            merged = metadata_merge(3, temp, &sess_obj->sess_meta,
+                                        &aif_node->sess_aif_meta);
+            if (cache)
+                cache->inputs[cache->num_inputs].dev_gen = 0;
+        }
         if (temp) {
             metadata_free(temp);
             free(temp);
         }
         temp = merged;
+        if (!merged)
+            break;
+        if (cache) {
+            cache->inputs[cache->num_inputs].aif_id = aif_node->aif_id;
+            cache->inputs[cache->num_inputs].aif_gen =
+                                          aif_node->sess_aif_meta.gen;
+            cache->num_inputs++;
+        }
     }
 
     return merged;
 }
 
+/*
+ * Returns the merged metadata of the session and all its connected aifs.
+ * The result is owned by the session and must not be freed by the caller.
+ * Called with sess_obj->lock held.
+ */
+static struct agm_meta_data_gsl* session_get_merged_metadata(struct session_obj *sess_obj)
+{
+    struct session_meta_cache *cache = &sess_obj->merged_meta;
+    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
+
+    if (sess_mode == AGM_SESSION_NON_TUNNEL)
+        return &sess_obj->sess_meta;
+
+    if (!session_meta_cache_valid(sess_obj, cache, true)) {
+        merged_meta_release(&cache->meta);
+        cache->meta = session_build_merged_metadata(sess_obj, true, cache);
+    }
+
+    return cache->meta;
+}
+
+/* Same as session_get_merged_metadata() but leaves out device metadata */
+static struct agm_meta_data_gsl* session_get_merged_metadata_without_aif(struct session_obj *sess_obj)
+{
+    struct session_meta_cache *cache = &sess_obj->merged_meta_without_dev;
+
+    if (!session_meta_cache_valid(sess_obj, cache, false)) {
+        merged_meta_release(&cache->meta);
+        cache->meta = session_build_merged_metadata(sess_obj, false, cache);
+    }
+
+    return cache->meta;
+}
+
 static int session_pool_init()
 {
-    int ret = 0;
+    int ret = 0, i;
     sess_pool = calloc(1, sizeof(struct session_pool));
     if (!sess_pool) {
         AGM_LOGE("No Memory to create sess_pool\n");
@@ -208,7 +364,19 @@ static int session_pool_init()
         goto done;
     }
     list_init(&sess_pool->session_list);
-    pthread_mutex_init(&sess_pool->lock, (const pthread_mutexattr_t *) NULL);
+    for (i = 0; i < SESSION_POOL_HASH_SIZE; i++) {
+        list_init(&sess_pool->id_hash[i]);
+    }
+    pthread_rwlock_init(&sess_pool->lock, (const pthread_rwlockattr_t *) NULL);
+    pthread_mutex_init(&sess_pool->slot_lock, (const pthread_mutexattr_t *) NULL);
+
+    ret = session_event_dispatch_start();
+    if (ret) {
+        pthread_mutex_destroy(&sess_pool->slot_lock);
+        pthread_rwlock_destroy(&sess_pool->lock);
+        free(sess_pool);
+        sess_pool = NULL;
+    }
 
 done:
     return ret;
@@ -216,6 +384,8 @@ done:
 
 static void aif_free(struct aif *aif_obj)
 {
+    merged_meta_cache_free(&aif_obj->merged_meta);
+    merged_meta_cache_free(&aif_obj->merged_aif_dev_meta);
     metadata_free(&aif_obj->sess_aif_meta);
     free(aif_obj->params);
     free(aif_obj);
@@ -235,23 +405,28 @@ static void aif_pool_free(struct session_obj *sess_obj)
 
 static void session_cb_pool_free(struct session_obj *sess_obj)
 {
-    struct session_cb *sess_cb;
-    struct listnode *node, *next;
+    int i;
 
-    list_for_each_safe(node, next, &sess_obj->cb_pool) {
-        sess_cb = node_to_item(node, struct session_cb, node);
-        list_remove(&sess_cb->node);
-        free(sess_cb);
+    for (i = 0; i < SESSION_CB_EVENT_TYPES; i++) {
+        free(atomic_load(&sess_obj->cb_lists[i]));
+        atomic_store(&sess_obj->cb_lists[i], NULL);
     }
-
+    pthread_cond_destroy(&sess_obj->cb_sync_cond);
+    pthread_mutex_destroy(&sess_obj->cb_sync_lock);
 }
 
 static void sess_obj_free(struct session_obj *sess_obj)
 {
     aif_pool_free(sess_obj);
     session_cb_pool_free(sess_obj);
+    session_meta_cache_free(&sess_obj->merged_meta);
+    session_meta_cache_free(&sess_obj->merged_meta_without_dev);
     metadata_free(&sess_obj->sess_meta);
     free(sess_obj->params);
+    pthread_cond_destroy(&sess_obj->async_cond);
+    pthread_mutex_destroy(&sess_obj->async_lock);
+    pthread_mutex_destroy(&sess_obj->data_lock);
+    session_event_queue_deinit(&sess_obj->event_queue);
     free(sess_obj);
 }
 
@@ -261,7 +436,21 @@ static void session_pool_free()
     struct listnode *node, *next;
     int ret = 0;
 
-    pthread_mutex_lock(&sess_pool->lock);
+    /*
+     * Drain the async workers first, the ops they run may look up other
+     * sessions and would block on the pool lock taken for writing below.
+     */
+    pthread_rwlock_rdlock(&sess_pool->lock);
+    list_for_each(node, &sess_pool->session_list) {
+        sess_obj = node_to_item(node, struct session_obj, node);
+        session_async_stop(sess_obj);
+    }
+    pthread_rwlock_unlock(&sess_pool->lock);
+
+    /* events raised while the sessions close are delivered inline */
+    session_event_dispatch_stop();
+
+    pthread_rwlock_wrlock(&sess_pool->lock);
     list_for_each_safe(node, next, &sess_pool->session_list) {
         sess_obj = node_to_item(node, struct session_obj, node);
         pthread_mutex_lock(&sess_obj->lock);
@@ -274,9 +463,12 @@ static void session_pool_free()
 
         //cleanup aif pool from session_object
         list_remove(&sess_obj->node);
+        list_remove(&sess_obj->id_hash_node);
         sess_obj_free(sess_obj);
     }
-    pthread_mutex_unlock(&sess_pool->lock);
+    pthread_rwlock_unlock(&sess_pool->lock);
+    pthread_mutex_destroy(&sess_pool->slot_lock);
+    pthread_rwlock_destroy(&sess_pool->lock);
     free(sess_pool);
 }
 
@@ -291,79 +483,168 @@ static struct session_obj* session_obj_create(int session_id)
     }
 
     obj->sess_id = session_id;
+    obj->slot = SESSION_SLOT_NONE;
     list_init(&obj->aif_pool);
-    list_init(&obj->cb_pool);
+    list_init(&obj->async_list);
     pthread_mutex_init(&obj->lock, (const pthread_mutexattr_t *) NULL);
+    pthread_mutex_init(&obj->data_lock, (const pthread_mutexattr_t *) NULL);
     pthread_mutex_init(&obj->cb_pool_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_mutex_init(&obj->cb_sync_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&obj->cb_sync_cond, (const pthread_condattr_t *) NULL);
+    pthread_mutex_init(&obj->async_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&obj->async_cond, (const pthread_condattr_t *) NULL);
+    session_event_queue_init(&obj->event_queue);
 
     return obj;
 }
 
-struct session_obj *session_obj_retrieve_from_pool(uint32_t session_id)
+static inline uint32_t session_pool_hash_id(uint32_t session_id)
 {
-    struct session_obj *obj = NULL;
+    return (session_id * 2654435761u) >> (32 - SESSION_POOL_HASH_BITS);
+}
+
+/* must be called with sess_pool->lock held, for reading or writing */
+static struct session_obj *session_pool_lookup_l(uint32_t session_id)
+{
+    struct session_obj *obj;
     struct listnode *node;
 
-    pthread_mutex_lock(&sess_pool->lock);
-    list_for_each(node, &sess_pool->session_list) {
-        obj = node_to_item(node, struct session_obj, node);
+    list_for_each(node, &sess_pool->id_hash[session_pool_hash_id(session_id)]) {
+        obj = node_to_item(node, struct session_obj, id_hash_node);
         if (obj->sess_id == session_id)
-            break;
-        else
-            obj = NULL;
+            return obj;
     }
-    pthread_mutex_unlock(&sess_pool->lock);
+
+    return NULL;
+}
+
+struct session_obj *session_obj_retrieve_from_pool(uint32_t session_id)
+{
+    struct session_obj *obj = NULL;
+
+    pthread_rwlock_rdlock(&sess_pool->lock);
+    obj = session_pool_lookup_l(session_id);
+    pthread_rwlock_unlock(&sess_pool->lock);
 
     return obj;
 }
 
 struct session_obj *session_obj_get_from_pool(uint32_t session_id)
 {
-    struct session_obj *obj = NULL;
-    struct listnode *node;
+    struct session_obj *obj = NULL, *new_obj = NULL;
 
-    pthread_mutex_lock(&sess_pool->lock);
-    list_for_each(node, &sess_pool->session_list) {
-        obj = node_to_item(node, struct session_obj, node);
-        if (obj->sess_id == session_id)
-            break;
-        else
-            obj = NULL;
+    obj = session_obj_retrieve_from_pool(session_id);
+    if (obj)
+        return obj;
+
+    /*
+     * Allocate outside the pool lock so that lookups of other sessions
+     * are not held off while a new object is being set up.
+     */
+    new_obj = session_obj_create(session_id);
+    if (!new_obj) {
+        AGM_LOGE("Couldnt create a session object\n");
+        return NULL;
     }
 
+    pthread_rwlock_wrlock(&sess_pool->lock);
+    obj = session_pool_lookup_l(session_id);
     if (!obj) {
-        //AGM_LOGE("Couldnt find a session object in the list,
-        //                             creating one\n");
-        obj = session_obj_create(session_id);
-        if (!obj) {
-            AGM_LOGE("Couldnt create a session object\n");
-            goto done;
-        }
+        obj = new_obj;
+        new_obj = NULL;
         list_add_tail(&sess_pool->session_list, &obj->node);
+        list_add_tail(&sess_pool->id_hash[session_pool_hash_id(session_id)],
+                      &obj->id_hash_node);
+    }
+    pthread_rwlock_unlock(&sess_pool->lock);
+
+    if (new_obj) {
+        /* lost the race against another creator */
+        pthread_mutex_destroy(&new_obj->lock);
+        pthread_mutex_destroy(&new_obj->data_lock);
+        pthread_mutex_destroy(&new_obj->cb_pool_lock);
+        pthread_mutex_destroy(&new_obj->cb_sync_lock);
+        pthread_cond_destroy(&new_obj->cb_sync_cond);
+        pthread_mutex_destroy(&new_obj->async_lock);
+        pthread_cond_destroy(&new_obj->async_cond);
+        session_event_queue_deinit(&new_obj->event_queue);
+        free(new_obj);
     }
 
-done:
-    pthread_mutex_unlock(&sess_pool->lock);
     return obj;
 }
-int session_obj_valid_check(uint64_t hndl)
-{
-
-    struct session_obj *obj = NULL;
-    struct listnode *node;
 
-    pthread_mutex_lock(&sess_pool->lock);
-    list_for_each(node, &sess_pool->session_list) {
-        obj = node_to_item(node, struct session_obj, node);
-        if (obj == hndl) {
-            pthread_mutex_unlock(&sess_pool->lock);
-            return  1;
-        }
+/* must be called with sess_obj->lock held */
+static int session_obj_publish_handle(struct session_obj *sess_obj,
+                                      uint64_t *hndl)
+{
+    struct session_slot *slot;
+    uint32_t idx, gen;
+
+    pthread_mutex_lock(&sess_pool->slot_lock);
+    if (sess_pool->num_free_slots) {
+        idx = sess_pool->free_slots[--sess_pool->num_free_slots];
+    } else if (sess_pool->num_slots < SESSION_POOL_MAX_SLOTS) {
+        idx = sess_pool->num_slots++;
+    } else {
+        pthread_mutex_unlock(&sess_pool->slot_lock);
+        AGM_LOGE("No free session slot for session id:%d\n",
+                 sess_obj->sess_id);
+        return -ENOSPC;
     }
-    pthread_mutex_unlock(&sess_pool->lock);
+    pthread_mutex_unlock(&sess_pool->slot_lock);
+
+    sess_obj->slot = idx;
+    slot = &sess_pool->slots[idx];
+    atomic_store_explicit(&slot->obj, sess_obj, memory_order_release);
+    gen = atomic_fetch_add_explicit(&slot->gen, 1, memory_order_release) + 1;
+    *hndl = ((uint64_t)gen << 32) | (idx + 1);
     return 0;
 }
 
+/* must be called with sess_obj->lock held */
+static void session_obj_retire_handle(struct session_obj *sess_obj)
+{
+    struct session_slot *slot;
+
+    if (sess_obj->slot == SESSION_SLOT_NONE)
+        return;
+
+    slot = &sess_pool->slots[sess_obj->slot];
+    if (atomic_load_explicit(&slot->gen, memory_order_relaxed) & 1)
+        atomic_fetch_add_explicit(&slot->gen, 1, memory_order_release);
+
+    pthread_mutex_lock(&sess_pool->slot_lock);
+    sess_pool->free_slots[sess_pool->num_free_slots++] = sess_obj->slot;
+    pthread_mutex_unlock(&sess_pool->slot_lock);
+    sess_obj->slot = SESSION_SLOT_NONE;
+}
+
+struct session_obj *session_obj_from_handle(uint64_t hndl)
+{
+    uint32_t idx = (uint32_t)hndl;
+    uint32_t gen = (uint32_t)(hndl >> 32);
+    struct session_slot *slot;
+    struct session_obj *obj;
+
+    if (idx == 0 || idx > SESSION_POOL_MAX_SLOTS || !(gen & 1))
+        return NULL;
+
+    slot = &sess_pool->slots[idx - 1];
+    if (atomic_load_explicit(&slot->gen, memory_order_acquire) != gen)
+        return NULL;
+
+    /*
+     * The slot may have been closed and handed to another session since,
+     * in which case the generation has moved on by the time obj is read.
+     */
+    obj = atomic_load_explicit(&slot->obj, memory_order_acquire);
+    if (atomic_load_explicit(&slot->gen, memory_order_relaxed) != gen)
+        return NULL;
+
+    return obj;
+}
+
 /* returns session_obj associated with session id */
 int session_obj_get(int session_id, struct session_obj **obj)
 {
@@ -381,6 +662,36 @@ int session_obj_get(int session_id, struct session_obj **obj)
     return ret;
 }
 
+/*
+ * sess_obj->graph is only opened and closed through these, so that
+ * read/write, which take data_lock alone, never see a graph going away.
+ * Must be called with sess_obj->lock held.
+ */
+static int session_graph_open(struct session_obj *sess_obj,
+                              struct agm_meta_data_gsl *metadata,
+                              struct device_obj *dev_obj)
+{
+    int ret;
+
+    pthread_mutex_lock(&sess_obj->data_lock);
+    ret = graph_open(metadata, sess_obj, dev_obj, &sess_obj->graph);
+    pthread_mutex_unlock(&sess_obj->data_lock);
+
+    return ret;
+}
+
+static int session_graph_close(struct session_obj *sess_obj)
+{
+    int ret;
+
+    pthread_mutex_lock(&sess_obj->data_lock);
+    ret = graph_close(sess_obj->graph);
+    sess_obj->graph = NULL;
+    pthread_mutex_unlock(&sess_obj->data_lock);
+
+    return ret;
+}
+
 static int session_set_loopback(struct session_obj *sess_obj,
                                 uint32_t pb_id, bool enable)
 {
@@ -414,7 +725,14 @@ static int session_set_loopback(struct session_obj *sess_obj,
         goto done;
     }
 
-    playback_metadata = session_get_merged_metadata(pb_obj);
+    /*
+     * The playback session is not locked here, so merge its metadata afresh
+     * instead of going through its cache.
+     */
+    if (pb_obj->stream_config.sess_mode == AGM_SESSION_NON_TUNNEL)
+        playback_metadata = metadata_merge(1, &pb_obj->sess_meta);
+    else
+        playback_metadata = session_build_merged_metadata(pb_obj, true, NULL);
     if (!playback_metadata) {
         ret = -ENOMEM;
         AGM_LOGE("Error:%d, merging metadata with session id=%d\n",
@@ -443,10 +761,6 @@ static int session_set_loopback(struct session_obj *sess_obj,
     }
 
 done:
-    if (capture_metadata) {
-        metadata_free(capture_metadata);
-        free(capture_metadata);
-    }
     if (playback_metadata) {
         metadata_free(playback_metadata);
         free(playback_metadata);
@@ -506,10 +820,6 @@ static int session_set_ec_ref(struct session_obj *sess_obj, uint32_t aif_id,
     }
 
 done:
-    if (capture_metadata) {
-        metadata_free(capture_metadata);
-        free(capture_metadata);
-    }
     if (merged_metadata) {
         metadata_free(merged_metadata);
         free(merged_metadata);
@@ -517,6 +827,81 @@ done:
     return ret;
 }
 
+/*
+ * Hardware endpoint sequencing (device refcounts, SLIMBUS/BTFM slave-first
+ * start, EC reference state) is serialized per device or device group
+ * instead of across all sessions, so sessions on disjoint backends can
+ * prepare, start and stop in parallel. A session takes the locks of the
+ * devices of its opened aifs, plus any extra device it depends on, in
+ * address order so that overlapping sets cannot deadlock.
+ */
+struct hwep_lock_set {
+    uint32_t num_locks;
+    pthread_mutex_t **locks;
+};
+
+static void hwep_lock_set_add(struct hwep_lock_set *set, pthread_mutex_t *lock)
+{
+    uint32_t i, j;
+
+    for (i = 0; i < set->num_locks; i++) {
+        if (set->locks[i] == lock)
+            return;
+        if ((uintptr_t)set->locks[i] > (uintptr_t)lock)
+            break;
+    }
+
+    for (j = set->num_locks; j > i; j--)
+        set->locks[j] = set->locks[j - 1];
+    set->locks[i] = lock;
+    set->num_locks++;
+}
+
+static int session_hwep_lock(struct session_obj *sess_obj,
+                             struct device_obj *extra_dev_obj,
+                             struct hwep_lock_set *set)
+{
+    struct aif *aif_obj;
+    struct listnode *node;
+    uint32_t i, count = 1;
+
+    list_for_each(node, &sess_obj->aif_pool)
+        count++;
+
+    set->num_locks = 0;
+    set->locks = calloc(count, sizeof(*set->locks));
+    if (!set->locks) {
+        AGM_LOGE("No memory for hwep lock set session_id:%d\n",
+                 sess_obj->sess_id);
+        return -ENOMEM;
+    }
+
+    list_for_each(node, &sess_obj->aif_pool) {
+        aif_obj = node_to_item(node, struct aif, node);
+        if (aif_obj->state >= AIF_OPENED && aif_obj->dev_obj)
+            hwep_lock_set_add(set, device_get_hwep_lock(aif_obj->dev_obj));
+    }
+    if (extra_dev_obj)
+        hwep_lock_set_add(set, device_get_hwep_lock(extra_dev_obj));
+
+    for (i = 0; i < set->num_locks; i++)
+        pthread_mutex_lock(set->locks[i]);
+
+    return 0;
+}
+
+static void session_hwep_unlock(struct hwep_lock_set *set)
+{
+    uint32_t i;
+
+    for (i = set->num_locks; i > 0; i--)
+        pthread_mutex_unlock(set->locks[i - 1]);
+
+    free(set->locks);
+    set->locks = NULL;
+    set->num_locks = 0;
+}
+
 static int session_disconnect_aif(struct session_obj *sess_obj,
                     struct aif *aif_obj, uint32_t opened_count)
 {
@@ -525,11 +910,9 @@ static int session_disconnect_aif(struct session_obj *sess_obj,
     struct agm_meta_data_gsl *merged_meta_sess_aif = NULL;
     struct agm_meta_data_gsl temp = {0};
     struct graph_obj *graph = sess_obj->graph;
+    pthread_mutex_t *hwep_lock = device_get_hwep_lock(aif_obj->dev_obj);
 
-    pthread_mutex_lock(&aif_obj->dev_obj->lock);
-    merged_metadata = metadata_merge(3, &sess_obj->sess_meta,
-                      &aif_obj->sess_aif_meta, &aif_obj->dev_obj->metadata);
-    pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+    merged_metadata = session_get_aif_merged_metadata(sess_obj, aif_obj);
     if (!merged_metadata) {
         AGM_LOGE("No memory to create merged_metadata session_id: %d, \
                       audio interface id:%d \n",
@@ -538,20 +921,17 @@ static int session_disconnect_aif(struct session_obj *sess_obj,
         goto done;
     }
 
-    pthread_mutex_lock(&hwep_lock);
+    pthread_mutex_lock(hwep_lock);
     if (opened_count == 1) {
         //this is SSSD condition, hence stop just the stream/stream-device,
         //merged only sess-aif, aif
-        pthread_mutex_lock(&aif_obj->dev_obj->lock);
-        merged_meta_sess_aif = metadata_merge(2, &aif_obj->sess_aif_meta,
-                                            &aif_obj->dev_obj->metadata);
-        pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+        merged_meta_sess_aif = session_get_aif_dev_merged_metadata(aif_obj);
         if (!merged_meta_sess_aif) {
             AGM_LOGE("No memory to create merged_metadata session_id: %d, \
                           audio interface id:%d \n",
                           sess_obj->sess_id, aif_obj->aif_id);
             ret = -ENOMEM;
-            pthread_mutex_unlock(&hwep_lock);
+            pthread_mutex_unlock(hwep_lock);
             goto done;
         }
 
@@ -581,27 +961,594 @@ static int session_disconnect_aif(struct session_obj *sess_obj,
         AGM_LOGE("Error:%d closing device object with id:%d \n",
             ret, aif_obj->aif_id);
     }
-    pthread_mutex_unlock(&hwep_lock);
+    pthread_mutex_unlock(hwep_lock);
 
 done:
-    if (merged_meta_sess_aif) {
-        metadata_free(merged_meta_sess_aif);
-        free(merged_meta_sess_aif);
+    return ret;
+}
+
+#ifndef SESSION_EVENT_DISPATCH_PRIO
+/* SCHED_FIFO priority of the event dispatch thread, 0 leaves it SCHED_OTHER */
+#define SESSION_EVENT_DISPATCH_PRIO 0
+#endif
+
+#ifndef SESSION_EVENT_DISPATCH_THREADS
+/* number of event dispatch threads, sessions are assigned by session id */
+#define SESSION_EVENT_DISPATCH_THREADS 4
+#endif
+
+struct session_event_dispatcher {
+    pthread_t thread;
+    bool started;
+    bool exit;
+    struct listnode dispatch_list;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    /* sessions holding back a batch of completions, dispatch thread only */
+    struct listnode batch_list;
+};
+
+static struct session_event_dispatcher
+                        event_dispatchers[SESSION_EVENT_DISPATCH_THREADS];
+
+static inline struct session_event_dispatcher *session_event_dispatcher_get(
+                                               struct session_obj *sess_obj)
+{
+    return &event_dispatchers[sess_obj->sess_id %
+                              SESSION_EVENT_DISPATCH_THREADS];
+}
+
+static uint64_t session_event_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void session_cb_read_unlock(struct session_obj *sess_obj,
+                                   unsigned int idx)
+{
+    if (atomic_fetch_sub(&sess_obj->cb_readers[idx], 1) == 1 &&
+        atomic_load(&sess_obj->cb_sync_waiting)) {
+        pthread_mutex_lock(&sess_obj->cb_sync_lock);
+        pthread_cond_broadcast(&sess_obj->cb_sync_cond);
+        pthread_mutex_unlock(&sess_obj->cb_sync_lock);
     }
+}
 
-    if (merged_metadata) {
-        metadata_free(merged_metadata);
-        free(merged_metadata);
+static unsigned int session_cb_read_lock(struct session_obj *sess_obj)
+{
+    unsigned int epoch;
+
+    while (1) {
+        epoch = atomic_load(&sess_obj->cb_epoch);
+        atomic_fetch_add(&sess_obj->cb_readers[epoch & 1], 1);
+        /* a writer that flipped meanwhile may not have seen us, retry */
+        if (atomic_load(&sess_obj->cb_epoch) == epoch)
+            return epoch & 1;
+        session_cb_read_unlock(sess_obj, epoch & 1);
+    }
+}
+
+/* Waits out the readers that may still hold a replaced list, cb_pool_lock held */
+static void session_cb_synchronize(struct session_obj *sess_obj)
+{
+    unsigned int idx = atomic_fetch_add(&sess_obj->cb_epoch, 1) & 1;
+
+    atomic_store(&sess_obj->cb_sync_waiting, true);
+    pthread_mutex_lock(&sess_obj->cb_sync_lock);
+    while (atomic_load(&sess_obj->cb_readers[idx]))
+        pthread_cond_wait(&sess_obj->cb_sync_cond, &sess_obj->cb_sync_lock);
+    pthread_mutex_unlock(&sess_obj->cb_sync_lock);
+    atomic_store(&sess_obj->cb_sync_waiting, false);
+}
+
+static void session_cb_call(struct session_obj *sess_obj,
+                            enum event_type evt_type,
+                            struct agm_event_cb_params *event_params)
+{
+    struct session_cb_list *cb_list;
+    unsigned int idx;
+    uint32_t i;
+
+    idx = session_cb_read_lock(sess_obj);
+    cb_list = atomic_load_explicit(
+                       &sess_obj->cb_lists[SESSION_CB_INDEX(evt_type)],
+                       memory_order_acquire);
+    for (i = 0; cb_list && i < cb_list->num_cbs; i++)
+        cb_list->cbs[i].cb(sess_obj->sess_id, event_params,
+                           cb_list->cbs[i].client_data);
+    session_cb_read_unlock(sess_obj, idx);
+}
+
+static void session_event_queue_init(struct session_event_queue *queue)
+{
+    unsigned int i;
+
+    for (i = 0; i < SESSION_EVENT_QUEUE_DEPTH; i++)
+        atomic_init(&queue->slot[i].seq, i);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->pending, false);
+    atomic_init(&queue->spilled, 0);
+    atomic_init(&queue->overflows, 0);
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->large_events, 0);
+    list_init(&queue->spill_list);
+    pthread_mutex_init(&queue->spill_lock, (const pthread_mutexattr_t *) NULL);
+}
+
+static void session_event_queue_deinit(struct session_event_queue *queue)
+{
+    struct listnode *node, *next;
+
+    list_for_each_safe(node, next, &queue->spill_list) {
+        list_remove(node);
+        free(node_to_item(node, struct session_event_spill, node));
+    }
+    pthread_mutex_destroy(&queue->spill_lock);
+}
+
+static void session_deliver_event(struct session_obj *sess_obj,
+                                  struct agm_event_cb_params *event_params)
+{
+    enum event_type evt_type;
+
+    /* Filter callbacks based on event_id and event_type */
+    if (event_params->source_module_id == GSL_EVENT_SRC_MODULE_ID_GSL) {
+        if (event_params->event_id != AGM_EVENT_EOS_RENDERED &&
+            event_params->event_id != AGM_EVENT_READ_DONE &&
+            event_params->event_id != AGM_EVENT_WRITE_DONE)
+            return;
+        evt_type = AGM_EVENT_DATA_PATH;
+    } else {
+        evt_type = AGM_EVENT_MODULE;
+    }
+
+    session_cb_call(sess_obj, evt_type, event_params);
+}
+
+/* Claims the next slot and copies the event in, false if the queue is full */
+static bool session_event_enqueue(struct session_event_queue *queue,
+                                  struct agm_event_cb_params *event_params,
+                                  struct agm_event_cb_params *large_event)
+{
+    struct session_event_slot *slot;
+    unsigned int pos, seq;
+    int diff;
+
+    pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    while (1) {
+        slot = &queue->slot[pos & (SESSION_EVENT_QUEUE_DEPTH - 1)];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos,
+                                        pos + 1, memory_order_relaxed,
+                                        memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    slot->large_event = large_event;
+    if (!large_event)
+        memcpy(slot->event, event_params, sizeof(struct agm_event_cb_params) +
+                                          event_params->event_payload_size);
+    slot->queued_ns = session_event_now_ns();
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+static void session_event_batch_flush(struct session_obj *sess_obj)
+{
+    struct session_event_batch *batch = &sess_obj->event_batch;
+    struct agm_event_cb_params *event_params =
+                             (struct agm_event_cb_params *)batch->event;
+    struct agm_event_read_write_done_batch_payload *payload =
+        (struct agm_event_read_write_done_batch_payload *)
+                                            event_params->event_payload;
+
+    if (!payload->num_done)
+        return;
+
+    list_remove(&batch->node);
+    session_cb_call(sess_obj, AGM_EVENT_DATA_PATH, event_params);
+    payload->num_done = 0;
+}
+
+/* Adds a completion to the session batch, false if it has to go on its own */
+static bool session_event_batch_add(struct session_obj *sess_obj,
+                                    struct agm_event_cb_params *event_params)
+{
+    struct session_event_batch *batch = &sess_obj->event_batch;
+    struct agm_event_cb_params *batch_params =
+                             (struct agm_event_cb_params *)batch->event;
+    struct agm_event_read_write_done_batch_payload *payload =
+        (struct agm_event_read_write_done_batch_payload *)
+                                            batch_params->event_payload;
+    struct agm_event_read_write_done_payload *rw_payload;
+    uint64_t cfg = atomic_load_explicit(&batch->cfg, memory_order_relaxed);
+
+    if (!cfg ||
+        event_params->source_module_id != GSL_EVENT_SRC_MODULE_ID_GSL ||
+        (event_params->event_id != AGM_EVENT_READ_DONE &&
+         event_params->event_id != AGM_EVENT_WRITE_DONE))
+        return false;
+
+    if (event_params->event_payload_size) {
+        if (event_params->event_payload_size !=
+                         sizeof(struct agm_event_read_write_done_payload))
+            return false;
+        /* metadata blobs are handed over by the single event path only */
+        rw_payload = (struct agm_event_read_write_done_payload *)
+                                             event_params->event_payload;
+        if (rw_payload->buff.metadata_size)
+            return false;
+    }
+
+    if (payload->num_done &&
+        (payload->event_id != event_params->event_id ||
+         batch->entry_size != event_params->event_payload_size))
+        session_event_batch_flush(sess_obj);
+
+    if (!payload->num_done) {
+        batch->max_count = (uint32_t)(cfg >> 32);
+        batch->entry_size = event_params->event_payload_size;
+        batch->deadline_ns = session_event_now_ns() +
+                             (cfg & 0xffffffff) * 1000;
+        batch_params->source_module_id = GSL_EVENT_SRC_MODULE_ID_GSL;
+        batch_params->event_id = AGM_EVENT_READ_WRITE_DONE_BATCH;
+        payload->event_id = event_params->event_id;
+        list_add_tail(&session_event_dispatcher_get(sess_obj)->batch_list,
+                      &batch->node);
+    }
+
+    if (batch->entry_size)
+        memcpy(&payload->done[payload->num_done], event_params->event_payload,
+               batch->entry_size);
+    payload->num_done++;
+    batch_params->event_payload_size = sizeof(*payload) +
+                                       payload->num_done * batch->entry_size;
+
+    if (payload->num_done >= batch->max_count)
+        session_event_batch_flush(sess_obj);
+    return true;
+}
+
+/* Flushes the batches that are due, returns the next deadline or 0 */
+static uint64_t session_event_batch_expire(
+                                  struct session_event_dispatcher *dispatcher)
+{
+    struct session_event_batch *batch;
+    struct listnode *node, *next;
+    uint64_t now_ns = session_event_now_ns();
+    uint64_t next_ns = 0;
+
+    list_for_each_safe(node, next, &dispatcher->batch_list) {
+        batch = node_to_item(node, struct session_event_batch, node);
+        if (batch->deadline_ns <= now_ns)
+            session_event_batch_flush(node_to_item(batch, struct session_obj,
+                                                   event_batch));
+        else if (!next_ns || batch->deadline_ns < next_ns)
+            next_ns = batch->deadline_ns;
+    }
+    return next_ns;
+}
+
+static void session_event_handle(struct session_obj *sess_obj,
+                                 struct agm_event_cb_params *event_params,
+                                 uint64_t queued_ns, bool coalesce)
+{
+    struct session_event_queue *queue = &sess_obj->event_queue;
+    uint64_t latency_ns = session_event_now_ns() - queued_ns;
+
+    queue->dispatched++;
+    queue->latency_total_ns += latency_ns;
+    if (latency_ns > queue->latency_max_ns)
+        queue->latency_max_ns = latency_ns;
+
+    if (!coalesce || !session_event_batch_add(sess_obj, event_params)) {
+        /* whatever is held back goes first to keep events in order */
+        if (coalesce)
+            session_event_batch_flush(sess_obj);
+        session_deliver_event(sess_obj, event_params);
+    }
+}
+
+/* Delivers every queued event, only ever run by one thread at a time */
+static void session_event_drain(struct session_obj *sess_obj, bool coalesce)
+{
+    struct session_event_queue *queue = &sess_obj->event_queue;
+    struct session_event_slot *slot;
+    struct session_event_spill *spill;
+    struct agm_event_cb_params *event_params;
+    struct listnode *node, *next;
+    struct listnode spill_list;
+
+    while (1) {
+        slot = &queue->slot[queue->tail & (SESSION_EVENT_QUEUE_DEPTH - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) ==
+                                                            queue->tail + 1) {
+            event_params = slot->large_event ? slot->large_event :
+                                 (struct agm_event_cb_params *)slot->event;
+            session_event_handle(sess_obj, event_params, slot->queued_ns,
+                                 coalesce);
+            free(slot->large_event);
+            slot->large_event = NULL;
+
+            atomic_store_explicit(&slot->seq,
+                                  queue->tail + SESSION_EVENT_QUEUE_DEPTH,
+                                  memory_order_release);
+            queue->tail++;
+            continue;
+        }
+
+        /* the ring is empty, whatever spilled was posted after it */
+        if (!atomic_load(&queue->spilled))
+            break;
+
+        list_init(&spill_list);
+        pthread_mutex_lock(&queue->spill_lock);
+        list_for_each_safe(node, next, &queue->spill_list) {
+            list_remove(node);
+            list_add_tail(&spill_list, node);
+        }
+        atomic_store(&queue->spilled, 0);
+        pthread_mutex_unlock(&queue->spill_lock);
+
+        list_for_each_safe(node, next, &spill_list) {
+            spill = node_to_item(node, struct session_event_spill, node);
+            session_event_handle(sess_obj, spill->event, spill->queued_ns,
+                                 coalesce);
+            free(spill);
+        }
+    }
+}
+
+/* Hands the session to its dispatcher unless it is already waiting there */
+static void session_event_kick(struct session_obj *sess_obj)
+{
+    struct session_event_queue *queue = &sess_obj->event_queue;
+    struct session_event_dispatcher *dispatcher =
+                                      session_event_dispatcher_get(sess_obj);
+
+    if (atomic_exchange(&queue->pending, true))
+        return;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    if (!dispatcher->started) {
+        /* the dispatcher is gone, deliver from the calling thread */
+        atomic_store(&queue->pending, false);
+        session_event_drain(sess_obj, false);
+    } else {
+        list_add_tail(&dispatcher->dispatch_list, &queue->dispatch_node);
+        pthread_cond_signal(&dispatcher->cond);
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+static void session_event_drop(struct session_obj *sess_obj,
+                               struct agm_event_cb_params *event_params)
+{
+    struct session_event_queue *queue = &sess_obj->event_queue;
+
+    atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+    AGM_LOGE("Event %x of sess_id:%d dropped, %u events backed up\n",
+             event_params->event_id, sess_obj->sess_id,
+             atomic_load(&queue->spilled));
+}
+
+/* Queues the event on the spill list, the ring being full */
+static void session_event_spill(struct session_obj *sess_obj,
+                                struct agm_event_cb_params *event_params)
+{
+    struct session_event_queue *queue = &sess_obj->event_queue;
+    struct session_event_spill *spill = NULL;
+    size_t size = sizeof(struct agm_event_cb_params) +
+                                      event_params->event_payload_size;
+
+    if (atomic_load(&queue->spilled) < SESSION_EVENT_SPILL_MAX)
+        spill = malloc(sizeof(struct session_event_spill) + size);
+    if (!spill) {
+        session_event_drop(sess_obj, event_params);
+        return;
+    }
+
+    spill->event = (struct agm_event_cb_params *)(spill + 1);
+    memcpy(spill->event, event_params, size);
+    spill->queued_ns = session_event_now_ns();
+
+    pthread_mutex_lock(&queue->spill_lock);
+    list_add_tail(&queue->spill_list, &spill->node);
+    atomic_fetch_add(&queue->spilled, 1);
+    pthread_mutex_unlock(&queue->spill_lock);
+    atomic_fetch_add_explicit(&queue->overflows, 1, memory_order_relaxed);
+}
+
+/* Runs on the GSL callback thread, never waits for the dispatcher */
+static void session_event_post(struct session_obj *sess_obj,
+                               struct agm_event_cb_params *event_params)
+{
+    struct session_event_queue *queue = &sess_obj->event_queue;
+    struct agm_event_cb_params *large_event = NULL;
+    size_t size;
+
+    /* once spilling, stay there until drained or events get reordered */
+    if (!atomic_load(&queue->spilled)) {
+        if (event_params->event_payload_size > SESSION_EVENT_MAX_PAYLOAD) {
+            size = sizeof(struct agm_event_cb_params) +
+                                          event_params->event_payload_size;
+            large_event = malloc(size);
+            if (!large_event) {
+                session_event_drop(sess_obj, event_params);
+                return;
+            }
+            memcpy(large_event, event_params, size);
+        }
+
+        if (session_event_enqueue(queue, event_params, large_event)) {
+            if (large_event)
+                atomic_fetch_add_explicit(&queue->large_events, 1,
+                                          memory_order_relaxed);
+            session_event_kick(sess_obj);
+            return;
+        }
+        free(large_event);
+    }
+
+    session_event_spill(sess_obj, event_params);
+    session_event_kick(sess_obj);
+}
+
+static void *session_event_dispatch_loop(void *arg)
+{
+    struct session_event_dispatcher *dispatcher = arg;
+    struct session_event_queue *queue;
+    struct session_obj *sess_obj;
+    struct timespec ts;
+    uint64_t deadline_ns = 0;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while (1) {
+        while (list_empty(&dispatcher->dispatch_list) && !dispatcher->exit) {
+            if (!deadline_ns) {
+                pthread_cond_wait(&dispatcher->cond, &dispatcher->lock);
+                continue;
+            }
+            ts.tv_sec = deadline_ns / 1000000000ull;
+            ts.tv_nsec = deadline_ns % 1000000000ull;
+            if (pthread_cond_timedwait(&dispatcher->cond,
+                                       &dispatcher->lock, &ts) == ETIMEDOUT)
+                break;
+        }
+
+        if (list_empty(&dispatcher->dispatch_list)) {
+            if (dispatcher->exit && list_empty(&dispatcher->batch_list)) {
+                /* from here on events are delivered by their producers */
+                dispatcher->started = false;
+                break;
+            }
+            /* a batch is due, or everything held back goes out on exit */
+            pthread_mutex_unlock(&dispatcher->lock);
+            if (dispatcher->exit) {
+                while (!list_empty(&dispatcher->batch_list))
+                    session_event_batch_flush(node_to_item(
+                            node_to_item(list_head(&dispatcher->batch_list),
+                                         struct session_event_batch, node),
+                            struct session_obj, event_batch));
+                deadline_ns = 0;
+            } else {
+                deadline_ns = session_event_batch_expire(dispatcher);
+            }
+            pthread_mutex_lock(&dispatcher->lock);
+            continue;
+        }
+
+        queue = node_to_item(list_head(&dispatcher->dispatch_list),
+                             struct session_event_queue, dispatch_node);
+        list_remove(&queue->dispatch_node);
+        pthread_mutex_unlock(&dispatcher->lock);
+
+        sess_obj = node_to_item(queue, struct session_obj, event_queue);
+        atomic_store(&queue->pending, false);
+        session_event_drain(sess_obj, true);
+        deadline_ns = session_event_batch_expire(dispatcher);
+
+        pthread_mutex_lock(&dispatcher->lock);
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    return NULL;
+}
+
+static int session_event_dispatch_start()
+{
+    struct session_event_dispatcher *dispatcher;
+    pthread_attr_t attr;
+    pthread_condattr_t cond_attr;
+    struct sched_param param;
+    int i, ret = 0;
+
+    /* batch deadlines are on CLOCK_MONOTONIC */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    for (i = 0; i < SESSION_EVENT_DISPATCH_THREADS; i++) {
+        dispatcher = &event_dispatchers[i];
+        list_init(&dispatcher->dispatch_list);
+        list_init(&dispatcher->batch_list);
+        pthread_mutex_init(&dispatcher->lock,
+                           (const pthread_mutexattr_t *) NULL);
+        pthread_cond_init(&dispatcher->cond, &cond_attr);
+        dispatcher->started = false;
+        dispatcher->exit = false;
+    }
+    pthread_condattr_destroy(&cond_attr);
+
+    pthread_attr_init(&attr);
+    if (SESSION_EVENT_DISPATCH_PRIO > 0) {
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        param.sched_priority = SESSION_EVENT_DISPATCH_PRIO;
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    for (i = 0; i < SESSION_EVENT_DISPATCH_THREADS; i++) {
+        dispatcher = &event_dispatchers[i];
+        dispatcher->started = true;
+        ret = pthread_create(&dispatcher->thread, &attr,
+                             session_event_dispatch_loop, dispatcher);
+        if (ret && SESSION_EVENT_DISPATCH_PRIO > 0) {
+            AGM_LOGE("Error:%d creating event dispatcher at priority %d, "
+                     "falling back to default scheduling\n", ret,
+                     SESSION_EVENT_DISPATCH_PRIO);
+            ret = pthread_create(&dispatcher->thread,
+                                 (const pthread_attr_t *) NULL,
+                                 session_event_dispatch_loop, dispatcher);
+        }
+        if (ret) {
+            AGM_LOGE("Error:%d creating event dispatcher %d\n", ret, i);
+            dispatcher->started = false;
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    if (ret) {
+        session_event_dispatch_stop();
+        return -ret;
+    }
+    return 0;
+}
+
+static void session_event_dispatch_stop()
+{
+    struct session_event_dispatcher *dispatcher;
+    bool running[SESSION_EVENT_DISPATCH_THREADS];
+    int i;
+
+    for (i = 0; i < SESSION_EVENT_DISPATCH_THREADS; i++) {
+        dispatcher = &event_dispatchers[i];
+        pthread_mutex_lock(&dispatcher->lock);
+        running[i] = dispatcher->started;
+        dispatcher->exit = true;
+        pthread_cond_signal(&dispatcher->cond);
+        pthread_mutex_unlock(&dispatcher->lock);
+    }
+
+    for (i = 0; i < SESSION_EVENT_DISPATCH_THREADS; i++) {
+        if (running[i])
+            pthread_join(event_dispatchers[i].thread, (void **) NULL);
     }
-    return ret;
 }
 
 static void graph_event_cb(struct agm_event_cb_params *event_params,
                          void *client_data)
 {
     struct session_obj *sess_obj = NULL;
-    struct session_cb *sess_cb;
-    struct listnode *node, *next;
     uint32_t session_id = (uint32_t)((uintptr_t)client_data);
 
     if (!event_params) {
@@ -616,28 +1563,7 @@ static void graph_event_cb(struct agm_event_cb_params *event_params,
         return;
     }
 
-    pthread_mutex_lock(&sess_obj->cb_pool_lock);
-    list_for_each_safe(node, next, &sess_obj->cb_pool) {
-        sess_cb = node_to_item(node, struct session_cb, node);
-        if (sess_cb && sess_cb->cb) {
-            /* Filter callbacks based on event_id and event_type */
-            if (sess_cb->evt_type == AGM_EVENT_DATA_PATH &&
-                event_params->source_module_id == GSL_EVENT_SRC_MODULE_ID_GSL &&
-                (event_params->event_id == AGM_EVENT_EOS_RENDERED ||
-                event_params->event_id == AGM_EVENT_READ_DONE ||
-                event_params->event_id == AGM_EVENT_WRITE_DONE)) {
-                sess_cb->cb(sess_obj->sess_id,
-                                   (struct agm_event_cb_params *)event_params,
-                                    sess_cb->client_data);
-            } else if (sess_cb->evt_type == AGM_EVENT_MODULE &&
-                       event_params->source_module_id != GSL_EVENT_SRC_MODULE_ID_GSL) {
-                sess_cb->cb(sess_obj->sess_id,
-                                   (struct agm_event_cb_params *)event_params,
-                                    sess_cb->client_data);
-            }
-        }
-    }
-    pthread_mutex_unlock(&sess_obj->cb_pool_lock);
+    session_event_post(sess_obj, event_params);
 }
 
 static int session_apply_aif_tag_params(struct session_obj *sess_obj,
@@ -707,10 +1633,7 @@ static int session_connect_aif(struct session_obj *sess_obj,
     struct graph_obj *graph = sess_obj->graph;
 
     //step 2.a  merge metadata
-    pthread_mutex_lock(&aif_obj->dev_obj->lock);
-    merged_metadata = metadata_merge(3, &sess_obj->sess_meta,
-                         &aif_obj->sess_aif_meta, &aif_obj->dev_obj->metadata);
-    pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+    merged_metadata = session_get_aif_merged_metadata(sess_obj, aif_obj);
     if (!merged_metadata) {
         AGM_LOGE("Error merging metadata session_id:%d aif_id:%d\n",
             sess_obj->sess_id, aif_obj->aif_id);
@@ -728,8 +1651,8 @@ static int session_connect_aif(struct session_obj *sess_obj,
     //step 2.b
     if (opened_count == 0) {
         if (sess_obj->state == SESSION_CLOSED) {
-            ret = graph_open(merged_metadata, sess_obj, aif_obj->dev_obj,
-                                                       &sess_obj->graph);
+            ret = session_graph_open(sess_obj, merged_metadata,
+                                     aif_obj->dev_obj);
             graph = sess_obj->graph;
             if (ret) {
                 AGM_LOGE("Error:%d graph open failed session_id: %d, \
@@ -807,8 +1730,7 @@ static int session_connect_aif(struct session_obj *sess_obj,
 
 graph_cleanup:
     if (opened_count == 0) {
-        graph_close(sess_obj->graph);
-        sess_obj->graph = NULL;
+        session_graph_close(sess_obj);
     } else {
         graph_remove(sess_obj->graph, merged_metadata);
     }
@@ -822,11 +1744,6 @@ close_device:
     device_close(aif_obj->dev_obj);
 
 done:
-    if (merged_metadata) {
-        metadata_free(merged_metadata);
-        free(merged_metadata);
-    }
-
     return ret;
 }
 
@@ -907,11 +1824,10 @@ unwind:
             opened_count--;
         }
     }
-    ret = graph_close(sess_obj->graph);
+    ret = session_graph_close(sess_obj);
     if (ret) {
         AGM_LOGE("Error:%d initializing session_pool\n", ret);
     }
-    sess_obj->graph = NULL;
 
     return ret;
 }
@@ -922,7 +1838,7 @@ static int session_open_without_device(struct session_obj *sess_obj)
     struct graph_obj *graph = sess_obj->graph;
 
     if (sess_obj->state == SESSION_CLOSED) {
-        ret = graph_open(&sess_obj->sess_meta, sess_obj, NULL, &sess_obj->graph);
+        ret = session_graph_open(sess_obj, &sess_obj->sess_meta, NULL);
         graph = sess_obj->graph;
         if (ret) {
                 AGM_LOGE("Error:%d graph open failed session_id: %d\n",
@@ -954,8 +1870,7 @@ static int session_open_without_device(struct session_obj *sess_obj)
     goto done;
 
 graph_cleanup:
-        graph_close(sess_obj->graph);
-        sess_obj->graph = NULL;
+        session_graph_close(sess_obj);
 done:
     return ret;
 }
@@ -970,6 +1885,7 @@ static int session_prepare(struct session_obj *sess_obj)
     enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
     struct listnode *node = NULL;
     uint32_t count = 0;
+    struct hwep_lock_set hwep_locks = {0};
 
     if (sess_mode != AGM_SESSION_NON_TUNNEL  && sess_mode != AGM_SESSION_NO_CONFIG) {
         count = aif_obj_get_count_with_state(sess_obj, AIF_OPENED, false);
@@ -1021,9 +1937,11 @@ static int session_prepare(struct session_obj *sess_obj)
 #else
         if ((sess_obj->state != SESSION_STARTED)) {
 #endif
-            pthread_mutex_lock(&hwep_lock);
+            ret = session_hwep_lock(sess_obj, NULL, &hwep_locks);
+            if (ret)
+                goto done;
             ret = graph_prepare(sess_obj->graph);
-            pthread_mutex_unlock(&hwep_lock);
+            session_hwep_unlock(&hwep_locks);
             if (ret) {
                 AGM_LOGE("Error:%d preparing graph\n", ret);
                 goto done;
@@ -1055,6 +1973,7 @@ static int session_start(struct session_obj *sess_obj)
     uint32_t count = 0;
     struct session_obj *pb_obj = NULL;
     struct device_obj *ec_ref_dev_obj = NULL;
+    struct hwep_lock_set hwep_locks = {0};
 
     if (sess_mode != AGM_SESSION_NON_TUNNEL && sess_mode != AGM_SESSION_NO_CONFIG) {
         count = aif_obj_get_count_with_state(sess_obj, AIF_OPENED, false);
@@ -1066,6 +1985,20 @@ static int session_start(struct session_obj *sess_obj)
             goto done;
         }
 
+        /* hold the EC reference device too, so it cannot stop under the capture start */
+        if ((dir == TX) && (sess_obj->ec_ref_state == true)) {
+            ret = device_get_obj(sess_obj->ec_ref_aif_id, &ec_ref_dev_obj);
+            if (ret) {
+                AGM_LOGE("Error:%d getting device object with aif id:%d\n",
+                        ret, sess_obj->ec_ref_aif_id);
+                goto done;
+            }
+        }
+
+        ret = session_hwep_lock(sess_obj, ec_ref_dev_obj, &hwep_locks);
+        if (ret)
+            goto done;
+
         if (dir == TX) {
             // For loopback, check if the playback session is in STARTED state,
             //otherwise return failure
@@ -1075,7 +2008,7 @@ static int session_start(struct session_obj *sess_obj)
                     AGM_LOGE("Error:%d getting session object with \
                               session id:%d\n",
                               ret, sess_obj->loopback_sess_id);
-                    goto done;
+                    goto unlock;
                 }
 
                 if (pb_obj->state != SESSION_STARTED) {
@@ -1083,7 +2016,7 @@ static int session_start(struct session_obj *sess_obj)
                               "not in STARTED state, current state:%d\n",
                               ret, pb_obj->sess_id, pb_obj->state);
                     ret = -EINVAL;
-                    goto done;
+                    goto unlock;
                 }
             }
 
@@ -1094,22 +2027,14 @@ static int session_start(struct session_obj *sess_obj)
              * the RX EP is configured and hence capture session start() succeeds
              * if RX(EC) device EP is not started, graph_start of capture will fail.
              */
-            if (sess_obj->ec_ref_state == true) {
-                ret = device_get_obj(sess_obj->ec_ref_aif_id, &ec_ref_dev_obj);
-                if (ret) {
-                    AGM_LOGE("Error:%d getting device object with aif id:%d\n",
-                            ret, sess_obj->ec_ref_aif_id);
-                    goto done;
-                }
-
-                if (device_get_state(ec_ref_dev_obj) != DEV_STARTED) {
-                    AGM_LOGE("Error:%d Device object with aif id:%d\n"
-                              "not in STARTED state, current state:%d\n",
-                              ret, sess_obj->ec_ref_aif_id,
-                            ec_ref_dev_obj->state);
-                    ret = -EINVAL;
-                    goto done;
-                }
+            if (ec_ref_dev_obj &&
+                (device_get_state(ec_ref_dev_obj) != DEV_STARTED)) {
+                AGM_LOGE("Error:%d Device object with aif id:%d\n"
+                          "not in STARTED state, current state:%d\n",
+                          ret, sess_obj->ec_ref_aif_id,
+                        ec_ref_dev_obj->state);
+                ret = -EINVAL;
+                goto unlock;
             }
 #ifndef ENABLE_DEV_PREPARE_BEFORE_GRAPH_START_SEQ
         }
@@ -1117,14 +2042,12 @@ static int session_start(struct session_obj *sess_obj)
             ret = graph_start(sess_obj->graph);
             if (ret) {
                 AGM_LOGE("Error:%d starting graph\n", ret);
-                goto done;
+                goto unlock;
             }
 #ifdef ENABLE_DEV_PREPARE_BEFORE_GRAPH_START_SEQ
         }
 #endif
 
-        pthread_mutex_lock(&hwep_lock);
-
         //For Slimbus/CP EP - First configure the slave ports via device_prepare/start
         //and then start the master side via graph_start.
         list_for_each(node, &sess_obj->aif_pool) {
@@ -1169,7 +2092,6 @@ static int session_start(struct session_obj *sess_obj)
             aif_obj = node_to_item(node, struct aif, node);
             if (!aif_obj) {
                 AGM_LOGE("Error:%d could not find aif node\n", ret);
-                pthread_mutex_unlock(&hwep_lock);
                 goto unwind;
             }
 
@@ -1183,7 +2105,6 @@ static int session_start(struct session_obj *sess_obj)
                 ret = device_prepare(aif_obj->dev_obj);
                 if (ret) {
                     AGM_LOGE("Error:%d preparing device\n", ret);
-                    pthread_mutex_unlock(&hwep_lock);
                     goto unwind;
                 }
                 aif_obj->state = AIF_PREPARED;
@@ -1195,7 +2116,6 @@ static int session_start(struct session_obj *sess_obj)
                 if (ret) {
                     AGM_LOGE("Error:%d starting device id:%d\n",
                                    ret, aif_obj->aif_id);
-                    pthread_mutex_unlock(&hwep_lock);
                     goto unwind;
                 }
                 aif_obj->state = AIF_STARTED;
@@ -1210,7 +2130,7 @@ static int session_start(struct session_obj *sess_obj)
             }
         }
 #endif
-        pthread_mutex_unlock(&hwep_lock);
+        session_hwep_unlock(&hwep_locks);
     } else {
         ret = graph_start(sess_obj->graph);
         if (ret) {
@@ -1223,7 +2143,6 @@ static int session_start(struct session_obj *sess_obj)
     goto done;
 
 unwind:
-    pthread_mutex_lock(&hwep_lock);
 #ifdef ENABLE_DEV_PREPARE_BEFORE_GRAPH_START_SEQ
     if (dir == TX)
 #endif
@@ -1240,7 +2159,8 @@ device_stop:
             }
         }
     }
-    pthread_mutex_unlock(&hwep_lock);
+unlock:
+    session_hwep_unlock(&hwep_locks);
 done:
     return ret;
 }
@@ -1252,6 +2172,7 @@ static int session_stop(struct session_obj *sess_obj)
     enum direction dir = sess_obj->stream_config.dir;
     enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
     struct listnode *node = NULL;
+    struct hwep_lock_set hwep_locks = {0};
 
     if (sess_obj->state != SESSION_STARTED) {
         AGM_LOGE("session not in STARTED state, current state:%d\n",
@@ -1261,12 +2182,14 @@ static int session_stop(struct session_obj *sess_obj)
     }
 
     if (sess_mode != AGM_SESSION_NON_TUNNEL  && sess_mode != AGM_SESSION_NO_CONFIG) {
-        pthread_mutex_lock(&hwep_lock);
+        ret = session_hwep_lock(sess_obj, NULL, &hwep_locks);
+        if (ret)
+            goto done;
         if (dir == RX) {
             ret = graph_stop(sess_obj->graph, NULL);
             if (ret) {
                 AGM_LOGE("Error:%d stopping graph\n", ret);
-                pthread_mutex_unlock(&hwep_lock);
+                session_hwep_unlock(&hwep_locks);
                 goto done;
             }
         }
@@ -1294,7 +2217,7 @@ static int session_stop(struct session_obj *sess_obj)
                 AGM_LOGE("Error:%d stopping graph\n", ret);
             }
         }
-        pthread_mutex_unlock(&hwep_lock);
+        session_hwep_unlock(&hwep_locks);
     } else {
             ret = graph_stop(sess_obj->graph, NULL);
             if (ret) {
@@ -1314,6 +2237,7 @@ static int session_close(struct session_obj *sess_obj)
     enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
     struct listnode *node = NULL;
     struct listnode *next = NULL;
+    struct hwep_lock_set hwep_locks = {0};
 
     AGM_LOGD("enter");
     if (sess_obj->state == SESSION_CLOSED) {
@@ -1322,7 +2246,9 @@ static int session_close(struct session_obj *sess_obj)
         goto done;
     }
 
-    pthread_mutex_lock(&hwep_lock);
+    ret = session_hwep_lock(sess_obj, NULL, &hwep_locks);
+    if (ret)
+        goto done;
     if (sess_obj->state == SESSION_STARTED) {
         ret = graph_stop(sess_obj->graph, NULL);
         if (ret) {
@@ -1330,11 +2256,10 @@ static int session_close(struct session_obj *sess_obj)
         }
     }
 
-    ret = graph_close(sess_obj->graph);
+    ret = session_graph_close(sess_obj);
     if (ret) {
         AGM_LOGE("Error:%d closing graph\n", ret);
     }
-    sess_obj->graph = NULL;
     sess_obj->ec_ref_state = false;
     sess_obj->loopback_state = false;
 
@@ -1363,8 +2288,9 @@ static int session_close(struct session_obj *sess_obj)
             aif_free(aif_obj);
         }
     }
-    pthread_mutex_unlock(&hwep_lock);
+    session_hwep_unlock(&hwep_locks);
     sess_obj->state = SESSION_CLOSED;
+    session_obj_retire_handle(sess_obj);
 done:
     AGM_LOGD("exit, ret %d", ret);
     return ret;
@@ -1373,8 +2299,9 @@ done:
 int session_obj_deinit()
 {
     session_pool_free();
-    device_deinit();
+    /*pooled graphs still point at their devices*/
     graph_deinit();
+    device_deinit();
     return 0;
 }
 
@@ -1400,7 +2327,7 @@ int session_obj_init()
         AGM_LOGE("Error:%d initializing session_pool\n", ret);
         goto graph_deinit;
     }
-    pthread_mutex_init(&hwep_lock, (const pthread_mutexattr_t *) NULL);
+    graph_pool_warmup();
     goto done;
 
 graph_deinit:
@@ -1413,27 +2340,35 @@ done:
     return ret;
 }
 
-int session_obj_set_sess_metadata(struct session_obj *sess_obj,
+static int session_set_sess_metadata(struct session_obj *sess_obj,
                               uint32_t size, uint8_t *metadata)
 {
 
     int ret = 0;
 
-    pthread_mutex_lock(&sess_obj->lock);
     metadata_free(&(sess_obj->sess_meta));
     ret = metadata_copy(&(sess_obj->sess_meta), size, metadata);
+
+    return ret;
+}
+
+int session_obj_set_sess_metadata(struct session_obj *sess_obj,
+                              uint32_t size, uint8_t *metadata)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_set_sess_metadata(sess_obj, size, metadata);
     pthread_mutex_unlock(&sess_obj->lock);
 
     return ret;
 }
 
-int session_obj_set_sess_params(struct session_obj *sess_obj,
+static int session_set_sess_params(struct session_obj *sess_obj,
     void *payload, size_t size)
 {
    int ret = 0;
 
-   pthread_mutex_lock(&sess_obj->lock);
-
    if (sess_obj->params) {
        free(sess_obj->params);
        sess_obj->params = NULL;
@@ -1467,18 +2402,28 @@ int session_obj_set_sess_params(struct session_obj *sess_obj,
    }
 
 done:
-   pthread_mutex_unlock(&sess_obj->lock);
    return ret;
 }
 
-int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
+int session_obj_set_sess_params(struct session_obj *sess_obj,
+    void *payload, size_t size)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_set_sess_params(sess_obj, payload, size);
+    pthread_mutex_unlock(&sess_obj->lock);
+
+    return ret;
+}
+
+static int session_set_sess_aif_params(struct session_obj *sess_obj,
     uint32_t aif_id,
     void* payload, size_t size)
 {
     int ret = 0;
     struct aif *aif_obj = NULL;
 
-    pthread_mutex_lock(&sess_obj->lock);
     ret = aif_obj_get(sess_obj, aif_id, &aif_obj);
     if (ret) {
         AGM_LOGE("Error obtaining aif object with sess_id:%d,  aif id:%d\n",
@@ -1519,11 +2464,23 @@ int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
    }
 
 done:
-    pthread_mutex_unlock(&sess_obj->lock);
     return ret;
 
 }
 
+int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
+    uint32_t aif_id,
+    void* payload, size_t size)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_set_sess_aif_params(sess_obj, aif_id, payload, size);
+    pthread_mutex_unlock(&sess_obj->lock);
+
+    return ret;
+}
+
 int session_obj_set_sess_aif_params_with_tag(struct session_obj *sess_obj,
     uint32_t aif_id,
     struct agm_tag_config *tag_config)
@@ -1572,10 +2529,7 @@ int session_obj_set_sess_aif_params_with_tag(struct session_obj *sess_obj,
             goto done;
         }
 
-        pthread_mutex_lock(&aif_obj->dev_obj->lock);
-        merged_metadata = metadata_merge(3, &sess_obj->sess_meta,
-                          &aif_obj->sess_aif_meta, &aif_obj->dev_obj->metadata);
-        pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+        merged_metadata = session_get_aif_merged_metadata(sess_obj, aif_obj);
         if (!merged_metadata) {
             AGM_LOGE("Error merging metadata session_id:%d aif_id:%d\n",
                 sess_obj->sess_id, aif_obj->aif_id);
@@ -1614,11 +2568,6 @@ int session_obj_set_sess_aif_params_with_tag(struct session_obj *sess_obj,
     }
 
 done:
-    if (merged_metadata) {
-        metadata_free(merged_metadata);
-        free(merged_metadata);
-    }
-
     pthread_mutex_unlock(&sess_obj->lock);
 
     return ret;
@@ -1650,10 +2599,7 @@ int session_obj_rw_acdb_params_with_tag(
         goto error;
     }
 
-    pthread_mutex_lock(&aif_obj->dev_obj->lock);
-    merged_metadata = metadata_merge(3, &sess_obj->sess_meta,
-                        &aif_obj->sess_aif_meta, &aif_obj->dev_obj->metadata);
-    pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+    merged_metadata = session_get_aif_merged_metadata(sess_obj, aif_obj);
 
     if (!merged_metadata) {
         AGM_LOGE("Error merging metadata session_id:%d aif_id:%d\n",
@@ -1667,7 +2613,7 @@ int session_obj_rw_acdb_params_with_tag(
                     tckv.num_kvs * sizeof(struct agm_key_value));
     if (!tckv.kv) {
         ret = -ENOMEM;
-        goto free_metadata;
+        goto error;
     }
 
     memcpy((uint8_t *)tckv.kv, acdb_param->blob,
@@ -1691,11 +2637,6 @@ int session_obj_rw_acdb_params_with_tag(
     }
     free(tckv.kv);
 
-free_metadata:
-    if (merged_metadata) {
-        metadata_free(merged_metadata);
-        free(merged_metadata);
-    }
 error:
     pthread_mutex_unlock(&sess_obj->lock);
 
@@ -1753,10 +2694,9 @@ int session_obj_set_sess_aif_cal(struct session_obj *sess_obj,
         metadata_update_cal(&aif_obj->sess_aif_meta, &ckv);
         pthread_mutex_lock(&aif_obj->dev_obj->lock);
         metadata_update_cal(&aif_obj->dev_obj->metadata, &ckv);
-
-        merged_metadata = metadata_merge(3, &sess_obj->sess_meta,
-                          &aif_obj->sess_aif_meta, &aif_obj->dev_obj->metadata);
         pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+
+        merged_metadata = session_get_aif_merged_metadata(sess_obj, aif_obj);
         if (!merged_metadata) {
             AGM_LOGE("Error merging metadata session_id:%d aif_id:%d\n",
                 sess_obj->sess_id, aif_obj->aif_id);
@@ -1788,25 +2728,19 @@ int session_obj_set_sess_aif_cal(struct session_obj *sess_obj,
     }
 
 done:
-    if (merged_metadata) {
-        metadata_free(merged_metadata);
-        free(merged_metadata);
-    }
-
     pthread_mutex_unlock(&sess_obj->lock);
 
     return ret;
 }
 
 
-int session_obj_set_sess_aif_metadata(struct session_obj *sess_obj,
+static int session_set_sess_aif_metadata(struct session_obj *sess_obj,
     uint32_t aif_id,  uint32_t size, uint8_t *metadata)
 {
 
     int ret = 0;
     struct aif *aif_obj = NULL;
 
-    pthread_mutex_lock(&sess_obj->lock);
     ret = aif_obj_get(sess_obj, aif_id, &aif_obj);
     if (ret) {
         AGM_LOGE("Error obtaining aif object with sess_id:%d,  aif id:%d\n",
@@ -1826,8 +2760,19 @@ int session_obj_set_sess_aif_metadata(struct session_obj *sess_obj,
     metadata_print(&(aif_obj->sess_aif_meta));
 #endif
 done:
+    return ret;
+}
+
+int session_obj_set_sess_aif_metadata(struct session_obj *sess_obj,
+    uint32_t aif_id,  uint32_t size, uint8_t *metadata)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_set_sess_aif_metadata(sess_obj, aif_id, size, metadata);
     pthread_mutex_unlock(&sess_obj->lock);
     AGM_LOGI("Exit");
+
     return ret;
 }
 
@@ -1869,10 +2814,7 @@ int session_obj_get_tag_with_module_info(struct session_obj *sess_obj,
                 goto done;
             }
 
-            pthread_mutex_lock(&aif_obj->dev_obj->lock);
-            merged_metadata = metadata_merge(3, &sess_obj->sess_meta,
-                                &aif_obj->sess_aif_meta, &aif_obj->dev_obj->metadata);
-            pthread_mutex_unlock(&aif_obj->dev_obj->lock);
+            merged_metadata = session_get_aif_merged_metadata(sess_obj, aif_obj);
             if (!merged_metadata) {
                 AGM_LOGE("Error merging metadata session_id:%d aif_id:%d\n",
                     sess_obj->sess_id, aif_obj->aif_id);
@@ -1884,13 +2826,7 @@ int session_obj_get_tag_with_module_info(struct session_obj *sess_obj,
             goto done;
         }
     } else {
-        merged_metadata = metadata_merge(1, &sess_obj->sess_meta);
-        if (!merged_metadata) {
-            AGM_LOGE("Error merging metadata session_id:%d aif_id:%d\n",
-                     sess_obj->sess_id, aif_id);
-            ret = -ENOMEM;
-            goto done;
-        }
+        merged_metadata = &sess_obj->sess_meta;
     }
 
     ret = graph_get_tags_with_module_info(&merged_metadata->gkv, payload, size);
@@ -1902,11 +2838,6 @@ int session_obj_get_tag_with_module_info(struct session_obj *sess_obj,
     }
 
 done:
-    if (merged_metadata) {
-        metadata_free(merged_metadata);
-        free(merged_metadata);
-    }
-
     pthread_mutex_unlock(&sess_obj->lock);
     return ret;
 }
@@ -1928,49 +2859,104 @@ int session_obj_register_cb(struct session_obj *sess_obj, agm_event_cb cb,
                               enum event_type evt_type, void *client_data)
 {
     int ret = 0;
-    struct session_cb *sess_cb = NULL;
+    struct session_cb_list *old_list = NULL, *new_list = NULL;
+    uint32_t i, num_cbs;
+
+    if (evt_type < AGM_EVENT_DATA_PATH || evt_type > AGM_EVENT_SESSION_OP) {
+        AGM_LOGE("Invalid evt_type %d for sess_id:%d\n", evt_type,
+                                               sess_obj->sess_id);
+        return -EINVAL;
+    }
 
     pthread_mutex_lock(&sess_obj->cb_pool_lock);
-    if (cb != NULL) {
-        sess_cb = calloc(1, sizeof(struct session_cb));
-        if (!sess_cb) {
-            AGM_LOGE("Error creating session_cb object with sess_id:%d\n",
-                                             sess_obj->sess_id);
-            ret = -ENOMEM;
-            goto done;
+    old_list = atomic_load(&sess_obj->cb_lists[SESSION_CB_INDEX(evt_type)]);
+    num_cbs = old_list ? old_list->num_cbs : 0;
+
+    /* sized for one more entry, deregistration only shrinks it */
+    new_list = calloc(1, sizeof(struct session_cb_list) +
+                         (num_cbs + 1) * sizeof(struct session_cb));
+    if (!new_list) {
+        AGM_LOGE("Error creating session_cb object with sess_id:%d\n",
+                                         sess_obj->sess_id);
+        ret = -ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_cbs; i++) {
+        if (cb == NULL &&
+            old_list->cbs[i].client_data == client_data) {
+            AGM_LOGV("remove sess_cb client_data %p evt_type %d",
+                     client_data, evt_type);
+            continue;
         }
+        new_list->cbs[new_list->num_cbs++] = old_list->cbs[i];
+    }
+
+    if (cb != NULL) {
+        new_list->cbs[new_list->num_cbs].cb = cb;
+        new_list->cbs[new_list->num_cbs].client_data = client_data;
+        new_list->cbs[new_list->num_cbs].evt_type = evt_type;
+        new_list->num_cbs++;
+        AGM_LOGV("sess_cb client_data %p evt_type %d", client_data, evt_type);
+    }
 
-        sess_cb->cb = cb;
-        sess_cb->client_data = client_data;
-        sess_cb->evt_type = evt_type;
-        AGM_LOGV("sess_cb %p client_data %p evt_type %d", sess_cb,
-                                           client_data, evt_type);
-        list_add_tail(&sess_obj->cb_pool, &sess_cb->node);
-    } else {
-        struct listnode *node, *next;
-        list_for_each_safe(node, next, &sess_obj->cb_pool) {
-            sess_cb = node_to_item(node, struct session_cb, node);
-            if (sess_cb->evt_type == evt_type &&
-                sess_cb->client_data == client_data) {
-                AGM_LOGV("remove sess_cb %p client_data %p evt_type %d",
-                        sess_cb, sess_cb->client_data,
-                        sess_cb->evt_type);
-                list_remove(&sess_cb->node);
-                free(sess_cb);
-            }
-        }
+    if (new_list->num_cbs == 0) {
+        free(new_list);
+        new_list = NULL;
     }
+    atomic_store_explicit(&sess_obj->cb_lists[SESSION_CB_INDEX(evt_type)],
+                          new_list, memory_order_release);
+    if (old_list) {
+        session_cb_synchronize(sess_obj);
+        free(old_list);
+    }
+
 done:
     pthread_mutex_unlock(&sess_obj->cb_pool_lock);
     return ret;
 }
 
+static int session_set_event_coalesce(struct session_obj *sess_obj,
+                                      struct agm_event_reg_cfg *evt_reg_cfg)
+{
+    struct agm_event_coalesce_cfg *cfg;
+
+    if (evt_reg_cfg->event_id != AGM_EVENT_READ_WRITE_DONE_BATCH) {
+        AGM_LOGE("Invalid session event %x for sess_id:%d\n",
+                 evt_reg_cfg->event_id, sess_obj->sess_id);
+        return -EINVAL;
+    }
+
+    if (!evt_reg_cfg->is_register) {
+        atomic_store(&sess_obj->event_batch.cfg, 0);
+        return 0;
+    }
+
+    cfg = (struct agm_event_coalesce_cfg *)evt_reg_cfg->event_config_payload;
+    if (evt_reg_cfg->event_config_payload_size < sizeof(*cfg) ||
+        cfg->max_count < 2 || cfg->max_count > AGM_EVENT_COALESCE_MAX_COUNT ||
+        cfg->max_delay_us == 0) {
+        AGM_LOGE("Invalid coalescing config for sess_id:%d\n",
+                 sess_obj->sess_id);
+        return -EINVAL;
+    }
+
+    AGM_LOGD("sess_id:%d coalescing %u completions within %u us\n",
+             sess_obj->sess_id, cfg->max_count, cfg->max_delay_us);
+    atomic_store(&sess_obj->event_batch.cfg,
+                 ((uint64_t)cfg->max_count << 32) | cfg->max_delay_us);
+    return 0;
+}
+
 int session_obj_register_for_events(struct session_obj *sess_obj,
                            struct agm_event_reg_cfg *evt_reg_cfg)
 {
 
     int ret = 0;
 
+    if (evt_reg_cfg->module_instance_id == AGM_MODULE_INSTANCE_ID_SESSION)
+        return session_set_event_coalesce(sess_obj, evt_reg_cfg);
+
     pthread_mutex_lock(&sess_obj->lock);
 
     if (sess_obj->state == SESSION_CLOSED) {
@@ -1993,14 +2979,13 @@ done:
     return ret;
 }
 
-int session_obj_sess_aif_connect(struct session_obj *sess_obj,
+static int session_sess_aif_connect(struct session_obj *sess_obj,
     uint32_t aif_id, bool aif_state)
 {
     int ret = 0;
     struct aif *aif_obj = NULL;
     uint32_t opened_count = 0;
 
-    pthread_mutex_lock(&sess_obj->lock);
     ret = aif_obj_get(sess_obj, aif_id, &aif_obj);
     if (ret) {
         AGM_LOGE("Error obtaining aif object with sess_id:%d,  aif id:%d\n",
@@ -2110,28 +3095,30 @@ unwind:
     opened_count--;
 
 done:
-    pthread_mutex_unlock(&sess_obj->lock);
     return ret;
 }
 
-int session_obj_open(uint32_t session_id,
-                     enum agm_session_mode sess_mode,
-                     struct session_obj **session)
+int session_obj_sess_aif_connect(struct session_obj *sess_obj,
+    uint32_t aif_id, bool aif_state)
 {
+    int ret = 0;
 
-    struct session_obj *sess_obj = NULL;
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_sess_aif_connect(sess_obj, aif_id, aif_state);
+    pthread_mutex_unlock(&sess_obj->lock);
+
+    return ret;
+}
+
+static int session_open(struct session_obj *sess_obj,
+                        enum agm_session_mode sess_mode,
+                        uint64_t *hndl)
+{
     int ret = 0;
     int ret_unwind = 0;
     struct listnode *node;
     struct aif *aif_obj = NULL;
 
-    ret = session_obj_get(session_id, &sess_obj);
-    if (ret) {
-        AGM_LOGE("Error getting session object\n");
-        return ret;
-    }
-
-    pthread_mutex_lock(&sess_obj->lock);
     if (sess_obj->state != SESSION_CLOSED) {
         AGM_LOGE("Session already Opened, session_state:%d\n",
                                        sess_obj->state);
@@ -2198,8 +3185,11 @@ int session_obj_open(uint32_t session_id,
         }
     }
 
+    ret = session_obj_publish_handle(sess_obj, hndl);
+    if (ret)
+        goto unwind;
+
     sess_obj->state = SESSION_OPENED;
-    *session = sess_obj;
     goto done;
 
 unwind:
@@ -2215,24 +3205,41 @@ unwind:
             aif_obj->state = AIF_OPEN;
         }
     }
-    ret_unwind = graph_close(sess_obj->graph);
+    ret_unwind = session_graph_close(sess_obj);
     if (ret_unwind) {
         AGM_LOGE("Error:%d Failed to close graph\n", ret_unwind);
     }
-    sess_obj->graph = NULL;
 
 done:
+    return ret;
+}
+
+int session_obj_open(uint32_t session_id,
+                     enum agm_session_mode sess_mode,
+                     uint64_t *hndl)
+{
+    struct session_obj *sess_obj = NULL;
+    int ret = 0;
+
+    ret = session_obj_get(session_id, &sess_obj);
+    if (ret) {
+        AGM_LOGE("Error getting session object\n");
+        return ret;
+    }
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_open(sess_obj, sess_mode, hndl);
     pthread_mutex_unlock(&sess_obj->lock);
+
     return ret;
 }
 
-int session_obj_set_config(struct session_obj *sess_obj,
+static int session_set_config(struct session_obj *sess_obj,
                  struct agm_session_config *stream_config,
                  struct agm_media_config *media_config,
                  struct agm_buffer_config *buffer_config)
 {
     int ret = 0;
-    pthread_mutex_lock(&sess_obj->lock);
 
     sess_obj->stream_config = *stream_config;
 
@@ -2257,7 +3264,21 @@ int session_obj_set_config(struct session_obj *sess_obj,
         }
     }
 
+    return ret;
+}
+
+int session_obj_set_config(struct session_obj *sess_obj,
+                 struct agm_session_config *stream_config,
+                 struct agm_media_config *media_config,
+                 struct agm_buffer_config *buffer_config)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_set_config(sess_obj, stream_config, media_config,
+                             buffer_config);
     pthread_mutex_unlock(&sess_obj->lock);
+
     return ret;
 }
 
@@ -2306,6 +3327,145 @@ int session_obj_close(struct session_obj *sess_obj)
     return ret;
 }
 
+static void session_notify_op_done(struct session_obj *sess_obj,
+                                   enum agm_session_async_op op,
+                                   uint64_t token, int status)
+{
+    /*the payload follows the params unaligned, as in a single allocation*/
+    union {
+        struct agm_event_cb_params params;
+        uint8_t buf[sizeof(struct agm_event_cb_params) +
+                    sizeof(struct agm_event_session_op_done_payload)];
+    } event;
+    struct agm_event_session_op_done_payload payload;
+
+    memset(&event, 0, sizeof(event));
+    event.params.source_module_id = GSL_EVENT_SRC_MODULE_ID_GSL;
+    event.params.event_id = AGM_EVENT_SESSION_OP_DONE;
+    event.params.event_payload_size = sizeof(payload);
+    payload.op = op;
+    payload.status = status;
+    payload.token = token;
+    memcpy(event.params.event_payload, &payload, sizeof(payload));
+
+    session_cb_call(sess_obj, AGM_EVENT_SESSION_OP, &event.params);
+}
+
+static void *session_async_thread_loop(void *arg)
+{
+    struct session_obj *sess_obj = (struct session_obj *)arg;
+    struct session_async_op *async_op = NULL;
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->async_lock);
+    while (1) {
+        while (list_empty(&sess_obj->async_list) && !sess_obj->async_exit)
+            pthread_cond_wait(&sess_obj->async_cond, &sess_obj->async_lock);
+
+        /* on exit, whatever is still queued is run first */
+        if (list_empty(&sess_obj->async_list))
+            break;
+
+        async_op = node_to_item(list_head(&sess_obj->async_list),
+                                struct session_async_op, node);
+        list_remove(&async_op->node);
+        pthread_mutex_unlock(&sess_obj->async_lock);
+
+        pthread_mutex_lock(&sess_obj->lock);
+        switch (async_op->op) {
+        case AGM_SESSION_OP_PREPARE:
+            ret = session_prepare(sess_obj);
+            break;
+        case AGM_SESSION_OP_START:
+            ret = session_start(sess_obj);
+            break;
+        case AGM_SESSION_OP_STOP:
+            ret = session_stop(sess_obj);
+            break;
+        case AGM_SESSION_OP_CLOSE:
+            ret = session_close(sess_obj);
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        pthread_mutex_unlock(&sess_obj->lock);
+
+        if (ret)
+            AGM_LOGE("Error:%d async op %d on sess_id:%d\n", ret,
+                     async_op->op, sess_obj->sess_id);
+        session_notify_op_done(sess_obj, async_op->op, async_op->token, ret);
+        free(async_op);
+
+        pthread_mutex_lock(&sess_obj->async_lock);
+    }
+    pthread_mutex_unlock(&sess_obj->async_lock);
+
+    return NULL;
+}
+
+static void session_async_stop(struct session_obj *sess_obj)
+{
+    bool started = false;
+
+    pthread_mutex_lock(&sess_obj->async_lock);
+    sess_obj->async_exit = true;
+    started = sess_obj->async_thread_started;
+    pthread_cond_signal(&sess_obj->async_cond);
+    pthread_mutex_unlock(&sess_obj->async_lock);
+
+    if (started)
+        pthread_join(sess_obj->async_thread, (void **) NULL);
+}
+
+int session_obj_async_op(struct session_obj *sess_obj,
+                         enum agm_session_async_op op, uint64_t token)
+{
+    struct session_async_op *async_op = NULL;
+    int ret = 0;
+
+    if (op < AGM_SESSION_OP_PREPARE || op > AGM_SESSION_OP_CLOSE) {
+        AGM_LOGE("Invalid async op %d\n", op);
+        return -EINVAL;
+    }
+
+    async_op = calloc(1, sizeof(struct session_async_op));
+    if (!async_op) {
+        AGM_LOGE("Not enough memory for async op\n");
+        return -ENOMEM;
+    }
+    async_op->op = op;
+    async_op->token = token;
+
+    pthread_mutex_lock(&sess_obj->async_lock);
+    if (sess_obj->async_exit) {
+        ret = -ESHUTDOWN;
+        goto done;
+    }
+
+    /* the worker is started on first use, most sessions never need one */
+    if (!sess_obj->async_thread_started) {
+        ret = pthread_create(&sess_obj->async_thread, (const pthread_attr_t *) NULL,
+                             session_async_thread_loop, sess_obj);
+        if (ret) {
+            AGM_LOGE("Error:%d creating async thread for sess_id:%d\n",
+                     ret, sess_obj->sess_id);
+            ret = -ret;
+            goto done;
+        }
+        sess_obj->async_thread_started = true;
+    }
+
+    list_add_tail(&sess_obj->async_list, &async_op->node);
+    async_op = NULL;
+    pthread_cond_signal(&sess_obj->async_cond);
+
+done:
+    pthread_mutex_unlock(&sess_obj->async_lock);
+    free(async_op);
+    return ret;
+}
+
 int session_obj_pause(struct session_obj *sess_obj)
 {
     int ret = 0;
@@ -2333,8 +3493,6 @@ done:
 int session_obj_flush(struct session_obj *sess_obj)
 {
     int ret = 0;
-    struct session_cb *sess_cb;
-    struct listnode *node, *next;
     struct agm_event_cb_params *event_params = NULL;
 
     pthread_mutex_lock(&sess_obj->lock);
@@ -2353,17 +3511,9 @@ int session_obj_flush(struct session_obj *sess_obj)
         goto done;
     }
 
-    pthread_mutex_lock(&sess_obj->cb_pool_lock);
-    list_for_each_safe(node, next, &sess_obj->cb_pool) {
-        sess_cb = node_to_item(node, struct session_cb, node);
-        if (sess_cb && sess_cb->cb) {
-            event_params->event_id = AGM_EVENT_EARLY_EOS;
-            sess_cb->cb(sess_obj->sess_id,
-                        (struct agm_event_cb_params *)event_params,
-                        sess_cb->client_data);
-        }
-    }
-    pthread_mutex_unlock(&sess_obj->cb_pool_lock);
+    event_params->event_id = AGM_EVENT_EARLY_EOS;
+    session_cb_call(sess_obj, AGM_EVENT_DATA_PATH, event_params);
+    session_cb_call(sess_obj, AGM_EVENT_MODULE, event_params);
     if (event_params)
         free(event_params);
 
@@ -2410,8 +3560,9 @@ int session_obj_read(struct session_obj *sess_obj, void *buff, size_t *count)
     int ret = 0;
     struct agm_buff buffer = {0};
 
-    pthread_mutex_lock(&sess_obj->lock);
-    if (sess_obj->state == SESSION_CLOSED) {
+    pthread_mutex_lock(&sess_obj->data_lock);
+    /* a session without a graph is closed, or being switched over */
+    if (!sess_obj->graph) {
         AGM_LOGE("Cannot issue read in state:%d\n",
                            sess_obj->state);
         ret = -EINVAL;
@@ -2429,7 +3580,7 @@ int session_obj_read(struct session_obj *sess_obj, void *buff, size_t *count)
     }
 
 done:
-    pthread_mutex_unlock(&sess_obj->lock);
+    pthread_mutex_unlock(&sess_obj->data_lock);
     return ret;
 }
 
@@ -2438,8 +3589,9 @@ int session_obj_write(struct session_obj *sess_obj, void *buff, size_t *count)
     int ret = 0;
     struct agm_buff buffer = {0};
 
-    pthread_mutex_lock(&sess_obj->lock);
-    if (sess_obj->state == SESSION_CLOSED) {
+    pthread_mutex_lock(&sess_obj->data_lock);
+    /* a session without a graph is closed, or being switched over */
+    if (!sess_obj->graph) {
         AGM_LOGE("Cannot issue write in state:%d\n",
                             sess_obj->state);
         ret = -EINVAL;
@@ -2457,10 +3609,55 @@ int session_obj_write(struct session_obj *sess_obj, void *buff, size_t *count)
     }
 
 done:
-    pthread_mutex_unlock(&sess_obj->lock);
+    pthread_mutex_unlock(&sess_obj->data_lock);
+    return ret;
+}
+
+static int session_obj_transfer_iov(struct session_obj *sess_obj,
+                                    const struct iovec *iov, int iovcnt,
+                                    size_t *count, bool is_write)
+{
+    int ret = 0;
+
+    *count = 0;
+    if (iovcnt < 0 || iovcnt > AGM_SESSION_IOV_MAX || (iovcnt && !iov)) {
+        AGM_LOGE("Invalid segment list, iovcnt %d\n", iovcnt);
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&sess_obj->data_lock);
+    if (!sess_obj->graph) {
+        AGM_LOGE("Cannot issue %s in state:%d\n",
+                 is_write ? "writev" : "readv", sess_obj->state);
+        ret = -EINVAL;
+        goto done;
+    }
+
+    if (is_write)
+        ret = graph_writev(sess_obj->graph, iov, iovcnt, count);
+    else
+        ret = graph_readv(sess_obj->graph, iov, iovcnt, count);
+    if (ret)
+        AGM_LOGE("Error:%d %s graph\n", ret,
+                 is_write ? "writing to" : "reading from");
+
+done:
+    pthread_mutex_unlock(&sess_obj->data_lock);
     return ret;
 }
 
+int session_obj_readv(struct session_obj *sess_obj, const struct iovec *iov,
+                      int iovcnt, size_t *count)
+{
+    return session_obj_transfer_iov(sess_obj, iov, iovcnt, count, false);
+}
+
+int session_obj_writev(struct session_obj *sess_obj, const struct iovec *iov,
+                       int iovcnt, size_t *count)
+{
+    return session_obj_transfer_iov(sess_obj, iov, iovcnt, count, true);
+}
+
 size_t session_obj_hw_processed_buff_cnt(struct session_obj *sess_obj,
                                                    enum direction dir)
 {
@@ -2698,8 +3895,9 @@ int session_obj_write_with_metadata(struct session_obj *sess_obj,
 {
     int ret = 0;
 
-    pthread_mutex_lock(&sess_obj->lock);
-    if (sess_obj->state == SESSION_CLOSED) {
+    pthread_mutex_lock(&sess_obj->data_lock);
+    /* a session without a graph is closed, or being switched over */
+    if (!sess_obj->graph) {
         AGM_LOGE("Cannot issue write in state:%d\n",
                             sess_obj->state);
         ret = -EINVAL;
@@ -2712,7 +3910,7 @@ int session_obj_write_with_metadata(struct session_obj *sess_obj,
     }
 
 done:
-    pthread_mutex_unlock(&sess_obj->lock);
+    pthread_mutex_unlock(&sess_obj->data_lock);
     return ret;
 }
 
@@ -2721,8 +3919,9 @@ int session_obj_read_with_metadata(struct session_obj *sess_obj,
                                    uint32_t *captured_size)
 {
     int ret = 0;
-    pthread_mutex_lock(&sess_obj->lock);
-    if (sess_obj->state == SESSION_CLOSED) {
+    pthread_mutex_lock(&sess_obj->data_lock);
+    /* a session without a graph is closed, or being switched over */
+    if (!sess_obj->graph) {
         AGM_LOGE("Cannot issue read in state:%d\n",
                            sess_obj->state);
         ret = -EINVAL;
@@ -2738,7 +3937,7 @@ int session_obj_read_with_metadata(struct session_obj *sess_obj,
     *captured_size = (uint32_t)read_size;
 
 done:
-    pthread_mutex_unlock(&sess_obj->lock);
+    pthread_mutex_unlock(&sess_obj->data_lock);
     return ret;
 }
 
@@ -2761,3 +3960,189 @@ int session_obj_set_non_tunnel_mode_config(struct session_obj *sess_obj,
     return ret;
 }
 
+
+static int session_batch_aif_op(const struct agm_batch_op *op)
+{
+    struct device_obj *dev_obj = NULL;
+    struct agm_media_config media_config;
+    int ret = 0;
+
+    ret = device_get_obj(op->aif_id, &dev_obj);
+    if (ret) {
+        AGM_LOGE("Error:%d retrieving device obj with audio_intf id=%d\n",
+                 ret, op->aif_id);
+        return ret;
+    }
+
+    switch (op->op_id) {
+    case AGM_BATCH_OP_AIF_SET_MEDIA_CONFIG:
+        if (op->payload_size != sizeof(media_config)) {
+            ret = -EINVAL;
+            break;
+        }
+        memcpy(&media_config, op->payload, sizeof(media_config));
+        ret = device_set_media_config(dev_obj, &media_config);
+        break;
+    case AGM_BATCH_OP_AIF_SET_METADATA:
+        ret = device_set_metadata(dev_obj, op->payload_size,
+                                  (uint8_t *)op->payload);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    return ret;
+}
+
+static int session_batch_sess_op(struct session_obj *sess_obj,
+                                 const struct agm_batch_op *op,
+                                 uint64_t *hndl)
+{
+    struct agm_batch_session_config config;
+    struct agm_buffer_config buffer_config;
+    int ret = 0;
+
+    switch (op->op_id) {
+    case AGM_BATCH_OP_SESSION_SET_METADATA:
+        ret = session_set_sess_metadata(sess_obj, op->payload_size,
+                                        (uint8_t *)op->payload);
+        break;
+    case AGM_BATCH_OP_SESSION_AIF_SET_METADATA:
+        ret = session_set_sess_aif_metadata(sess_obj, op->aif_id,
+                                  op->payload_size, (uint8_t *)op->payload);
+        break;
+    case AGM_BATCH_OP_SESSION_SET_PARAMS:
+        ret = session_set_sess_params(sess_obj, (void *)op->payload,
+                                      op->payload_size);
+        break;
+    case AGM_BATCH_OP_SESSION_AIF_SET_PARAMS:
+        ret = session_set_sess_aif_params(sess_obj, op->aif_id,
+                                  (void *)op->payload, op->payload_size);
+        break;
+    case AGM_BATCH_OP_SESSION_AIF_CONNECT:
+        ret = session_sess_aif_connect(sess_obj, op->aif_id, !!op->arg);
+        break;
+    case AGM_BATCH_OP_SESSION_OPEN:
+        ret = session_open(sess_obj, (enum agm_session_mode)op->arg, hndl);
+        break;
+    case AGM_BATCH_OP_SESSION_SET_CONFIG:
+        if (sess_obj->state == SESSION_CLOSED ||
+            op->payload_size != sizeof(config)) {
+            ret = -EINVAL;
+            break;
+        }
+        memcpy(&config, op->payload, sizeof(config));
+        buffer_config.count = config.buffer_count;
+        buffer_config.size = config.buffer_size;
+        buffer_config.max_metadata_size = config.max_metadata_size;
+        ret = session_set_config(sess_obj, &config.session_config,
+                                 &config.media_config, &buffer_config);
+        break;
+    case AGM_BATCH_OP_SESSION_PREPARE:
+        if (sess_obj->state == SESSION_CLOSED) {
+            ret = -EINVAL;
+            break;
+        }
+        ret = session_prepare(sess_obj);
+        break;
+    case AGM_BATCH_OP_SESSION_START:
+        if (sess_obj->state == SESSION_CLOSED) {
+            ret = -EINVAL;
+            break;
+        }
+        ret = session_start(sess_obj);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    return ret;
+}
+
+/**
+ * Runs the ops of a batch already validated by the caller. The lock of the
+ * session being worked on is kept across consecutive ops on that session
+ * and only handed over when the batch moves on to another session, so at
+ * most one session lock is held at any time.
+ */
+int session_obj_batch(const void *ops, uint32_t num_ops,
+                      struct agm_batch_status *status)
+{
+    const struct agm_batch_op *op = ops;
+    struct session_obj *sess_obj = NULL;
+    struct session_obj *locked_obj = NULL;
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; i < num_ops; i++, op = AGM_BATCH_OP_NEXT(op)) {
+        status[i].hndl = 0;
+        if (ret) {
+            status[i].ret = -ECANCELED;
+            continue;
+        }
+
+        if (op->op_id == AGM_BATCH_OP_AIF_SET_MEDIA_CONFIG ||
+            op->op_id == AGM_BATCH_OP_AIF_SET_METADATA) {
+            ret = session_batch_aif_op(op);
+            goto op_done;
+        }
+
+        ret = session_obj_get(op->session_id, &sess_obj);
+        if (ret) {
+            AGM_LOGE("Error:%d retrieving session obj with session id=%d\n",
+                     ret, op->session_id);
+            goto op_done;
+        }
+
+        if (sess_obj != locked_obj) {
+            if (locked_obj)
+                pthread_mutex_unlock(&locked_obj->lock);
+            pthread_mutex_lock(&sess_obj->lock);
+            locked_obj = sess_obj;
+        }
+
+        ret = session_batch_sess_op(sess_obj, op, &status[i].hndl);
+
+op_done:
+        if (ret)
+            AGM_LOGE("Error:%d batch op %d failed, sess_id:%d aif_id:%d\n",
+                     ret, op->op_id, op->session_id, op->aif_id);
+        status[i].ret = ret;
+    }
+
+    if (locked_obj)
+        pthread_mutex_unlock(&locked_obj->lock);
+
+    return ret;
+}
+
+void session_obj_dump()
+{
+    struct session_obj *sess_obj;
+    struct session_event_queue *queue;
+    struct listnode *node;
+
+    if (!sess_pool)
+        return;
+
+    pthread_rwlock_rdlock(&sess_pool->lock);
+    list_for_each(node, &sess_pool->session_list) {
+        sess_obj = node_to_item(node, struct session_obj, node);
+        queue = &sess_obj->event_queue;
+        if (!queue->dispatched)
+            continue;
+        AGM_LOGI("sess_id:%d events %llu, latency avg %llu us max %llu us, "
+                 "overflows %llu, dropped %llu, large %llu\n",
+                 sess_obj->sess_id,
+                 (unsigned long long)queue->dispatched,
+                 (unsigned long long)(queue->latency_total_ns /
+                                      queue->dispatched / 1000),
+                 (unsigned long long)(queue->latency_max_ns / 1000),
+                 (unsigned long long)atomic_load(&queue->overflows),
+                 (unsigned long long)atomic_load(&queue->dropped),
+                 (unsigned long long)atomic_load(&queue->large_events));
+    }
+    pthread_rwlock_unlock(&sess_pool->lock);
+}
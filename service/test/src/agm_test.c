@@ -29,7 +29,13 @@
 
 //#include "pch.h"
 #include <agm/agm_api.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
 
 typedef int(*testcase)(void);
 
@@ -1458,10 +1464,431 @@ int test_get_tagged_module_info()
 	return ret;
 }
 
-int main() {
+/*
+ * Benchmarks, run with "agmtest bench" for agm in process or with
+ * "agm_ipc_test bench" through the IPC client library; on Android
+ * agm_ipc_test is built by service/Android.mk against the binder
+ * libagmclient and runs against the audio HAL's agm service. They use the same
+ * devices and metadata as the test cases above and print their results
+ * instead of passing or failing on them.
+ */
+#define BENCH_SESSION_ID_BASE	100
+#define BENCH_MAX_THREADS	3
+#define BENCH_CYCLES		200
+
+struct bench_stats {
+	uint64_t *samples;	/* per operation latency in ns */
+	int count;
+	uint64_t elapsed_ns;
+	uint64_t bytes;
+	struct rusage ru_start;
+	struct rusage ru_end;
+};
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t bench_cpu_us(struct rusage *ru)
+{
+	return (uint64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000ull +
+		ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void bench_begin(struct bench_stats *stats)
+{
+	getrusage(RUSAGE_SELF, &stats->ru_start);
+	stats->elapsed_ns = bench_now_ns();
+}
+
+static void bench_end(struct bench_stats *stats)
+{
+	stats->elapsed_ns = bench_now_ns() - stats->elapsed_ns;
+	getrusage(RUSAGE_SELF, &stats->ru_end);
+}
+
+static void bench_report(const char *name, struct bench_stats *stats)
+{
+	uint64_t cpu_us;
+
+	if (!stats->count) {
+		printf("BENCH %s: no samples\n", name);
+		return;
+	}
+
+	qsort(stats->samples, stats->count, sizeof(uint64_t), bench_cmp_u64);
+	cpu_us = bench_cpu_us(&stats->ru_end) - bench_cpu_us(&stats->ru_start);
+	printf("BENCH %s: %d ops in %llu ms, p50 %llu us, p99 %llu us, max %llu us, cpu %llu ms",
+			name, stats->count,
+			(unsigned long long)(stats->elapsed_ns / 1000000),
+			(unsigned long long)(stats->samples[stats->count / 2] / 1000),
+			(unsigned long long)(stats->samples[(stats->count * 99) / 100] / 1000),
+			(unsigned long long)(stats->samples[stats->count - 1] / 1000),
+			(unsigned long long)(cpu_us / 1000));
+	if (stats->bytes && stats->elapsed_ns)
+		printf(", %.2f MB/s, %llu cpu us/MB",
+				stats->bytes * 1000.0 / stats->elapsed_ns,
+				(unsigned long long)(cpu_us * 1000000ull / stats->bytes));
+	printf("\n");
+}
+
+static int bench_setup_device(uint32_t aif_id, struct agm_media_config *config)
+{
+	int ret = 0;
+
+	ret = agm_aif_set_media_config(aif_id, config);
+	if (ret)
+		goto done;
+
+	ret = agm_aif_set_metadata(aif_id, sizeof(dev_rx_metadata),
+			(uint8_t *)dev_rx_metadata);
+
+done:
+	return ret;
+}
+
+static int bench_connect_session(uint32_t session_id, uint32_t aif_id)
+{
+	int ret = 0;
+
+	ret = agm_session_set_metadata(session_id, sizeof(stream_metadata),
+			(uint8_t *)stream_metadata);
+	if (ret)
+		goto done;
+
+	ret = agm_session_aif_set_metadata(session_id, aif_id,
+			sizeof(dev_rx_metadata), (uint8_t *)dev_rx_metadata);
+	if (ret)
+		goto done;
+
+	ret = agm_session_aif_connect(session_id, aif_id, true);
+
+done:
+	return ret;
+}
+
+static int bench_start_session(uint32_t session_id,
+		struct agm_media_config *config, struct agm_buffer_config *buf_config,
+		uint64_t *handle)
+{
+	struct agm_session_config sess_config = {0};
+	int ret = 0;
+
+	sess_config.dir = RX;
+	sess_config.sess_mode = AGM_SESSION_DEFAULT;
+
+	ret = agm_session_open(session_id, AGM_SESSION_DEFAULT, handle);
+	if (ret)
+		goto done;
+
+	ret = agm_session_set_config(*handle, &sess_config, config, buf_config);
+	if (ret)
+		goto close;
+
+	ret = agm_session_prepare(*handle);
+	if (ret)
+		goto close;
+
+	ret = agm_session_start(*handle);
+	if (ret)
+		goto close;
+
+	goto done;
+
+close:
+	agm_session_close(*handle);
+done:
+	return ret;
+}
+
+static int bench_stop_session(uint64_t handle)
+{
+	int ret = 0;
+
+	ret = agm_session_stop(handle);
+	if (ret)
+		agm_session_close(handle);
+	else
+		ret = agm_session_close(handle);
+	return ret;
+}
+
+struct bench_hwep_thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	uint32_t session_id;
+	uint64_t samples[BENCH_CYCLES];
+	int count;
+	int ret;
+};
+
+static void *bench_hwep_thread_loop(void *arg)
+{
+	struct bench_hwep_thread *t = arg;
+	uint64_t handle = 0, start_ns;
+	int i;
+
+	pthread_barrier_wait(t->barrier);
+	for (i = 0; i < BENCH_CYCLES; i++) {
+		start_ns = bench_now_ns();
+		t->ret = bench_start_session(t->session_id, &media_config,
+				&buffer_config, &handle);
+		if (t->ret)
+			break;
+		t->ret = bench_stop_session(handle);
+		if (t->ret)
+			break;
+		t->samples[t->count++] = bench_now_ns() - start_ns;
+	}
+	return NULL;
+}
+
+/*
+ * Sessions cycling through open, prepare, start, stop and close in
+ * parallel, once all on one backend and once each on its own. The start
+ * path holds the lock of the session's devices, so the second run shows
+ * how much unrelated backends still serialize on each other.
+ */
+static int bench_hwep_lock_run(const char *name, bool shared_device)
+{
+	uint32_t aifs[BENCH_MAX_THREADS] = { aif_id_rx1, aif_id_rx2, aif_id_rx3 };
+	struct bench_hwep_thread threads[BENCH_MAX_THREADS];
+	struct bench_stats stats = {0};
+	uint64_t samples[BENCH_MAX_THREADS * BENCH_CYCLES];
+	pthread_barrier_t barrier;
+	uint32_t aif_id;
+	int i, ret = 0;
+
+	memset(threads, 0, sizeof(threads));
+	for (i = 0; i < BENCH_MAX_THREADS; i++) {
+		aif_id = shared_device ? aifs[0] : aifs[i];
+		threads[i].session_id = BENCH_SESSION_ID_BASE + i;
+		ret = bench_setup_device(aif_id, &media_config);
+		if (!ret)
+			ret = bench_connect_session(threads[i].session_id, aif_id);
+		if (ret) {
+			printf("%s: Error:%d, setting up session %d\n", __func__, ret,
+					threads[i].session_id);
+			goto disconnect;
+		}
+	}
+
+	pthread_barrier_init(&barrier, NULL, BENCH_MAX_THREADS + 1);
+	for (i = 0; i < BENCH_MAX_THREADS; i++) {
+		threads[i].barrier = &barrier;
+		pthread_create(&threads[i].thread, NULL, bench_hwep_thread_loop,
+				&threads[i]);
+	}
+	bench_begin(&stats);
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < BENCH_MAX_THREADS; i++)
+		pthread_join(threads[i].thread, NULL);
+	bench_end(&stats);
+	pthread_barrier_destroy(&barrier);
+
+	stats.samples = samples;
+	for (i = 0; i < BENCH_MAX_THREADS; i++) {
+		memcpy(&samples[stats.count], threads[i].samples,
+				threads[i].count * sizeof(uint64_t));
+		stats.count += threads[i].count;
+		if (threads[i].ret && !ret)
+			ret = threads[i].ret;
+	}
+	bench_report(name, &stats);
+
+disconnect:
+	for (i = 0; i < BENCH_MAX_THREADS; i++) {
+		aif_id = shared_device ? aifs[0] : aifs[i];
+		agm_session_aif_connect(BENCH_SESSION_ID_BASE + i, aif_id, false);
+	}
+	return ret;
+}
+
+int bench_hwep_lock_contention(void)
+{
+	int ret = 0;
+
+	ret = testcase_common_init(__func__);
+	if (ret)
+		goto done;
+
+	ret = bench_hwep_lock_run("hwep_lock_shared_device", true);
+	if (ret)
+		goto done;
+
+	ret = bench_hwep_lock_run("hwep_lock_separate_devices", false);
+
+done:
+	testcase_common_deinit(__func__);
+	return ret;
+}
+
+#define BENCH_WRITES		500
+
+/*
+ * Writes BENCH_WRITES buffers of buf_config->size bytes to one playback
+ * session and reports the latency of every agm_session_write. Writes are
+ * paced by the DSP once all buffers are queued, so the IPC cost shows in
+ * the CPU time per MB rather than in the throughput.
+ */
+static int bench_session_write(const char *name, uint32_t session_id,
+		uint32_t aif_id, struct agm_media_config *config,
+		struct agm_buffer_config *buf_config)
+{
+	struct bench_stats stats = {0};
+	uint64_t samples[BENCH_WRITES];
+	uint64_t handle = 0, start_ns;
+	uint8_t *buff = NULL;
+	size_t size;
+	int i, ret = 0;
+
+	buff = calloc(1, buf_config->size);
+	if (!buff)
+		return -ENOMEM;
+
+	ret = bench_setup_device(aif_id, config);
+	if (!ret)
+		ret = bench_connect_session(session_id, aif_id);
+	if (ret) {
+		printf("%s: Error:%d, setting up session %d\n", __func__, ret,
+				session_id);
+		goto free_buff;
+	}
+
+	ret = bench_start_session(session_id, config, buf_config, &handle);
+	if (ret)
+		goto disconnect;
+
+	stats.samples = samples;
+	bench_begin(&stats);
+	for (i = 0; i < BENCH_WRITES; i++) {
+		size = buf_config->size;
+		start_ns = bench_now_ns();
+		ret = agm_session_write(handle, buff, &size);
+		if (ret) {
+			printf("%s: Error:%d, write %d failed\n", __func__, ret, i);
+			break;
+		}
+		samples[stats.count++] = bench_now_ns() - start_ns;
+		stats.bytes += size;
+	}
+	bench_end(&stats);
+	bench_report(name, &stats);
+
+	bench_stop_session(handle);
+disconnect:
+	agm_session_aif_connect(session_id, aif_id, false);
+free_buff:
+	free(buff);
+	return ret;
+}
+
+/*
+ * Session data through the IPC client library, once on the payload path
+ * (hidl_vec on HwBinder) and once through the shared memory the library
+ * sets up per session. AGM_IPC_DATA_SHM=0 is read when a session's first
+ * buffer is transferred, so it is switched between sessions. Both runs
+ * take the same path in agmtest, which calls agm directly.
+ */
+int bench_session_data_path(void)
+{
+	struct agm_buffer_config buf_configs[] = {
+		{ 4, 3840 },		/* 20 ms of 48 kHz stereo 16 bit */
+		{ 4, 32 * 1024 },
+	};
+	char name[64];
+	int i, ret = 0;
+
+	ret = testcase_common_init(__func__);
+	if (ret)
+		goto done;
+
+	for (i = 0; i < (int)(sizeof(buf_configs)/sizeof(buf_configs[0])); i++) {
+		setenv("AGM_IPC_DATA_SHM", "0", 1);
+		snprintf(name, sizeof(name), "session_write_%zu_payload",
+				buf_configs[i].size);
+		ret = bench_session_write(name, BENCH_SESSION_ID_BASE, aif_id_rx1,
+				&media_config, &buf_configs[i]);
+		unsetenv("AGM_IPC_DATA_SHM");
+		if (ret)
+			break;
+
+		snprintf(name, sizeof(name), "session_write_%zu_shm",
+				buf_configs[i].size);
+		ret = bench_session_write(name, BENCH_SESSION_ID_BASE, aif_id_rx1,
+				&media_config, &buf_configs[i]);
+		if (ret)
+			break;
+	}
+
+done:
+	testcase_common_deinit(__func__);
+	return ret;
+}
+
+/*
+ * 48 kHz 8 channel 16 bit playback in 10 ms periods, once over D-Bus method
+ * calls and once through the session's shared memory ring. As above,
+ * AGM_IPC_DATA_SHM=0 keeps sessions opened while it is set off the ring.
+ */
+int bench_session_data_8ch(void)
+{
+	struct agm_media_config config = media_config;
+	struct agm_buffer_config buf_config = { 4, 48 * 8 * 2 * 10 };
+	int ret = 0;
+
+	config.rate = 48000;
+	config.channels = 8;
+
+	ret = testcase_common_init(__func__);
+	if (ret)
+		goto done;
+
+	setenv("AGM_IPC_DATA_SHM", "0", 1);
+	ret = bench_session_write("session_write_48k_8ch_message",
+			BENCH_SESSION_ID_BASE, aif_id_rx1, &config, &buf_config);
+	unsetenv("AGM_IPC_DATA_SHM");
+	if (ret)
+		goto done;
+
+	ret = bench_session_write("session_write_48k_8ch_ring",
+			BENCH_SESSION_ID_BASE, aif_id_rx1, &config, &buf_config);
+
+done:
+	testcase_common_deinit(__func__);
+	return ret;
+}
+
+int main(int argc, char **argv) {
 	int ret = 0;
 	int i = 0;
 
+	testcase benchmarks[] = {
+				bench_hwep_lock_contention,
+				bench_session_data_path,
+				bench_session_data_8ch,
+	};
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		for (i = 0; i < (int)(sizeof(benchmarks)/sizeof(testcase)); i++) {
+			ret = benchmarks[i]();
+			if (ret)
+				printf("Failed @ benchmark no :%d, error %d\n", i+1, ret);
+		}
+		return 0;
+	}
+
 	testcase testcases[] = {
 			    test_device_get_aif_list,
 				test_stream_sssd_with_buf_writes,